@@ -0,0 +1,66 @@
+;;
+;; compare-bench.scm - compare two benchmark results
+;;
+;; Usage: gosh compare-bench.scm [options] <baseline.json> <result.json>
+;;
+;; Reads two results written by run-bench.scm, and shows the ratio of
+;; the median time of each benchmark (result / baseline).  A benchmark
+;; is flagged as a regression if both its median and minimum times grew
+;; more than the threshold; checking the minimum as well keeps a few
+;; noisy repetitions from being reported.  Likewise for improvements.
+;;
+;; Options:
+;;   --threshold=PCT  percentage to flag a change (default: 5)
+;;   --no-fail        exit with 0 even if there are regressions
+;;
+;; Exits with 1 if any regression is found, so that it can be used
+;; in scripts.
+
+(use gauche.parseopt)
+(use rfc.json)
+
+(define (read-result file)
+  (let1 json (call-with-input-file file parse-json)
+    (unless (equal? (assoc-ref json "format") "gauche-bench-1")
+      (exit 1 "~a: not a benchmark result" file))
+    (map (^b (cons (assoc-ref b "name") b))
+         (vector->list (assoc-ref json "benchmarks")))))
+
+(define (ratio new old key)
+  (/ (assoc-ref new key) (assoc-ref old key)))
+
+(define (main args)
+  (let-args (cdr args) ([threshold "threshold=f" 5]
+                        [no-fail? "no-fail"]
+                        . files)
+    (unless (= (length files) 2)
+      (exit 1 "Usage: gosh compare-bench.scm [--threshold=PCT] [--no-fail] \
+               <baseline.json> <result.json>"))
+    (let* ([base (read-result (car files))]
+           [new  (read-result (cadr files))]
+           [limit (+ 1 (/ threshold 100))]
+           [regressions 0])
+      (format #t "~30a ~12@a ~12@a ~8@a\n" "benchmark" "baseline(us)"
+              "result(us)" "ratio")
+      (dolist [n new]
+        (if-let1 b (assoc-ref base (car n))
+          (let* ([r (ratio (cdr n) b "median")]
+                 [rmin (ratio (cdr n) b "min")]
+                 [mark (cond [(and (> r limit) (> rmin limit))
+                              (inc! regressions)
+                              "  REGRESSION"]
+                             [(and (< r (/ limit)) (< rmin (/ limit)))
+                              "  improved"]
+                             [else ""])])
+            (format #t "~30a ~12,3f ~12,3f ~8,3f~a\n" (car n)
+                    (* (assoc-ref b "median") 1e6)
+                    (* (assoc-ref (cdr n) "median") 1e6)
+                    r mark))
+          (format #t "~30a ~12@a ~12,3f ~8@a\n" (car n) "-"
+                  (* (assoc-ref (cdr n) "median") 1e6) "new")))
+      (dolist [b base]
+        (unless (assoc-ref new (car b))
+          (format #t "~30a ~12,3f ~12@a ~8@a\n" (car b)
+                  (* (assoc-ref (cdr b) "median") 1e6) "-" "missing")))
+      (format #t "~d regression(s) beyond ~a%\n" regressions threshold)
+      (if (and (> regressions 0) (not no-fail?)) 1 0))))
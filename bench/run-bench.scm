@@ -0,0 +1,180 @@
+;;
+;; run-bench.scm - run the benchmark suite
+;;
+;; Usage: gosh run-bench.scm [options] [pattern ...]
+;;
+;; Runs the benchmarks in the suite/ directory next to this script, and
+;; writes the result in JSON.  If patterns are given, only the benchmarks
+;; whose name (category/name, e.g. "hash/eq-insert") contains one of them
+;; are run.
+;;
+;; Options:
+;;   -o, --output=FILE  write the result to FILE instead of stdout
+;;   --reps=N           number of measured repetitions (default: 5)
+;;   --warmup=N         number of unmeasured runs after calibration
+;;                      (default: 1)
+;;   --min-time=SECS    each repetition runs the benchmark body as many
+;;                      times as needed to take at least SECS seconds
+;;                      (default: 0.1)
+;;   --list             list the benchmark names and exit
+;;
+;; The result can be compared with another one by compare-bench.scm.
+;; 'make bench' in the build tree runs this script with the built gosh.
+;;
+;; Each file in suite/ defines benchmarks of a category, named after the
+;; file, with define-benchmark:
+;;
+;;   (define-benchmark NAME BODY ...)
+;;
+;; BODY is evaluated repeatedly, so it should take between microseconds
+;; and milliseconds.  Setup should be done outside of define-benchmark.
+
+(define-module bench.runner
+  (use gauche.parseopt)
+  (use file.util)
+  (use rfc.json)
+  (use srfi.13)
+  (export define-benchmark register-benchmark!))
+(select-module bench.runner)
+
+(define-constant *format-version* "gauche-bench-1")
+
+(define *suite-dir*
+  (build-path (sys-normalize-pathname (sys-dirname (current-load-path))
+                                      :absolute #t)
+              "suite"))
+
+;; (category name thunk), in the order of definition
+(define *benchmarks* '())
+(define *current-category* #f)
+
+(define (register-benchmark! name thunk)
+  (push! *benchmarks* (list *current-category* name thunk)))
+
+(define-syntax define-benchmark
+  (syntax-rules ()
+    [(_ name body ...)
+     (register-benchmark! 'name (^[] body ...))]))
+
+(define (load-suite dir)
+  (dolist [file (sort (glob #"~|dir|/*.scm"))]
+    (set! *current-category* (path-sans-extension (sys-basename file)))
+    (let1 env (make-module #f)
+      (eval '(import bench.runner) env)
+      (load file :environment env)))
+  (reverse *benchmarks*))
+
+(define (bench-name b) #"~(car b)/~(cadr b)")
+
+;;
+;; Measurement
+;;
+
+(define (now)
+  (receive (sec nsec) (sys-clock-gettime-monotonic)
+    (if sec
+      (+ sec (/. nsec 1e9))
+      (receive (sec usec) (sys-gettimeofday)
+        (+ sec (/. usec 1e6))))))
+
+(define (cpu-time)
+  (let1 ts (sys-times)
+    (/. (+ (list-ref ts 0) (list-ref ts 1)) (list-ref ts 4))))
+
+;; Runs THUNK COUNT times, returns elapsed real and cpu time.
+(define (run thunk count)
+  (let ([r0 (now)] [c0 (cpu-time)])
+    (dotimes [count] (thunk))
+    (values (- (now) r0) (- (cpu-time) c0))))
+
+;; Finds the iteration count that takes at least MIN-TIME.  This also
+;; warms up the code and the heap.
+(define (calibrate thunk min-time)
+  (let loop ([count 1])
+    (receive (real _) (run thunk count)
+      (cond [(>= real min-time) count]
+            [(< real (/ min-time 100)) (loop (* count 10))]
+            [else (loop (ceiling->exact (* count (/ (* min-time 1.2) real))))]))))
+
+(define (median xs)
+  (let* ([v (list->vector (sort xs))]
+         [n (vector-length v)])
+    (if (odd? n)
+      (vector-ref v (quotient n 2))
+      (/ (+ (vector-ref v (- (quotient n 2) 1)) (vector-ref v (quotient n 2)))
+         2))))
+
+(define (mean xs) (/ (apply + xs) (length xs)))
+
+(define (stddev xs)
+  (let1 m (mean xs)
+    (sqrt (/ (apply + (map (^x (square (- x m))) xs)) (length xs)))))
+
+;; Returns an alist to be written as a JSON object.  Times are seconds
+;; per iteration.
+(define (measure b reps warmup min-time)
+  (let* ([thunk (caddr b)]
+         [count (calibrate thunk min-time)])
+    (dotimes [warmup] (run thunk count))
+    (let loop ([i 0] [reals '()] [cpus '()])
+      (if (< i reps)
+        (begin
+          (gc)
+          (receive (real cpu) (run thunk count)
+            (loop (+ i 1) (cons (/ real count) reals) (cons (/ cpu count) cpus))))
+        (let1 reals (reverse reals)
+          `(("name" . ,(bench-name b))
+            ("iterations" . ,count)
+            ("times" . ,(list->vector reals))
+            ("min" . ,(apply min reals))
+            ("median" . ,(median reals))
+            ("mean" . ,(mean reals))
+            ("stddev" . ,(stddev reals))
+            ("cpu-median" . ,(median cpus))))))))
+
+(define (usage)
+  (exit 1 "Usage: gosh run-bench.scm [-o FILE] [--reps=N] [--warmup=N] \
+           [--min-time=SECS] [--list] [pattern ...]"))
+
+(define (main args)
+  (let-args (cdr args) ([output "o|output=s" #f]
+                        [reps "reps=i" 5]
+                        [warmup "warmup=i" 1]
+                        [min-time "min-time=f" 0.1]
+                        [list? "list"]
+                        [help "h|help" => usage]
+                        . patterns)
+    (let* ([suite (load-suite *suite-dir*)]
+           [benchmarks (if (null? patterns)
+                         suite
+                         (filter (^b (any (cut string-contains (bench-name b) <>)
+                                          patterns))
+                                 suite))])
+      (when (< reps 1) (exit 1 "--reps must be positive"))
+      (if list?
+        (for-each (^b (print (bench-name b))) benchmarks)
+        (let1 results
+            (map (^b
+                   (format (current-error-port) "~30a" (bench-name b))
+                   (flush (current-error-port))
+                   (rlet1 r (measure b reps warmup min-time)
+                     (format (current-error-port) "~12,3f us\n"
+                             (* (assoc-ref r "median") 1e6))))
+                 benchmarks)
+          (let1 json
+              `(("format" . ,*format-version*)
+                ("gauche-version" . ,(gauche-version))
+                ("architecture" . ,(gauche-architecture))
+                ("date" . ,(sys-strftime "%Y-%m-%dT%H:%M:%S%z"
+                                         (sys-localtime (sys-time))))
+                ("config" . (("reps" . ,reps)
+                             ("warmup" . ,warmup)
+                             ("min-time" . ,min-time)))
+                ("benchmarks" . ,(list->vector results)))
+            (if output
+              (with-output-to-file output (^[] (construct-json json) (newline)))
+              (begin (construct-json json) (newline))))))))
+  0)
+
+(select-module user)
+(define main (with-module bench.runner main))
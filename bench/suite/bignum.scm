@@ -0,0 +1,15 @@
+;; Bignums and exact rationals
+
+(define (fact n) (if (= n 0) 1 (* n (fact (- n 1)))))
+
+(define *big* (fact 500))
+(define *big2* (+ (fact 300) 12345))
+
+(define-benchmark factorial (fact 500))
+(define-benchmark multiply (* *big* *big2*))
+(define-benchmark divide (quotient *big* *big2*))
+(define-benchmark ->string (number->string *big*))
+(define-benchmark expt (expt 3 5000))
+(define-benchmark rational
+  (let loop ([i 1] [s 0])
+    (if (> i 200) s (loop (+ i 1) (+ s (/ 1 i))))))
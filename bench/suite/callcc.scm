@@ -0,0 +1,36 @@
+;; Continuations and dynamic-wind
+
+(define *list* (iota 1000))
+
+(define (find-escape x lis)
+  (call/cc (^k (for-each (^y (when (= x y) (k y))) lis) #f)))
+
+;; A generator made of call/cc, which re-enters continuations.
+(define (make-gen lis)
+  (define return #f)
+  (define resume #f)
+  (^[]
+    (call/cc
+     (^r (set! return r)
+         (if resume
+           (resume #f)
+           (begin
+             (for-each (^x (call/cc (^k (set! resume k) (return x)))) lis)
+             (set! resume (^_ (return (eof-object))))
+             (return (eof-object))))))))
+
+(define (sum-gen gen)
+  (let loop ([s 0])
+    (let1 x (gen)
+      (if (eof-object? x) s (loop (+ s x))))))
+
+(define (wind n)
+  (let1 c 0
+    (dotimes [n]
+      (dynamic-wind (^[] (inc! c)) (^[] c) (^[] (dec! c))))
+    c))
+
+(define-benchmark escape (find-escape 500 *list*))
+(define-benchmark generator (sum-gen (make-gen *list*)))
+(define-benchmark dynamic-wind (wind 1000))
+(define-benchmark let/cc (dotimes [i 1000] (let/cc k (k i))))
@@ -0,0 +1,24 @@
+;; Closure creation and higher-order procedures
+
+(define *list* (iota 1000))
+
+(define (make-adders n)
+  (map (^i (^x (+ x i))) (iota n)))
+
+(define (call-all procs x)
+  (fold (^[p s] (+ s (p x))) 0 procs))
+
+(define (sum-with-for-each lis k)
+  (let1 s 0
+    (for-each (^x (set! s (+ s (* x k)))) lis)
+    s))
+
+(define (compose-n f n)
+  (if (= n 0) identity (let1 g (compose-n f (- n 1)) (^x (f (g x))))))
+
+(define Map map)                        ; prevent inline expansion
+
+(define-benchmark make-and-call (call-all (make-adders 1000) 1))
+(define-benchmark for-each-lambda (sum-with-for-each *list* 3))
+(define-benchmark map-procedure (Map (^x (* x x)) *list*))
+(define-benchmark compose ((compose-n (^x (+ x 1)) 1000) 0))
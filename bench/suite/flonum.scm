@@ -0,0 +1,33 @@
+;; Flonum arithmetic
+
+(use gauche.uvector)
+
+(define (mandelbrot size)
+  (let loop ([y 0] [n 0])
+    (if (= y size)
+      n
+      (loop (+ y 1)
+            (let xloop ([x 0] [n n])
+              (if (= x size)
+                n
+                (let ([cr (- (/. (* 2 x) size) 1.5)]
+                      [ci (- (/. (* 2 y) size) 1.0)])
+                  (let iter ([zr 0.0] [zi 0.0] [i 0])
+                    (cond [(> (+ (* zr zr) (* zi zi)) 4.0) (xloop (+ x 1) n)]
+                          [(= i 50) (xloop (+ x 1) (+ n 1))]
+                          [else (iter (+ (- (* zr zr) (* zi zi)) cr)
+                                      (+ (* 2.0 zr zi) ci)
+                                      (+ i 1))])))))))))
+
+(define (flsum n)
+  (let loop ([i 0] [s 0.0])
+    (if (< i n) (loop (+ i 1) (+ s (sqrt (exact->inexact i)))) s)))
+
+(define *v1* (make-f64vector 10000 1.5))
+(define *v2* (make-f64vector 10000 2.5))
+
+(define-benchmark mandelbrot (mandelbrot 32))
+(define-benchmark sum-sqrt (flsum 10000))
+(define-benchmark f64vector-dot (f64vector-dot *v1* *v2*))
+(define-benchmark ->string
+  (dotimes [i 1000] (number->string (/ i 7.0))))
@@ -0,0 +1,14 @@
+;; Allocation and garbage collection
+
+(define (make-tree depth)
+  (if (= depth 0)
+    '()
+    (cons (make-tree (- depth 1)) (make-tree (- depth 1)))))
+
+(define *long-lived* (make-tree 16))
+
+(define-benchmark cons (length (make-list 10000 'a)))
+(define-benchmark tree (make-tree 12))
+(define-benchmark vectors (dotimes [i 100] (make-vector 1000 i)))
+(define-benchmark strings (dotimes [i 1000] (make-string 100 #\a)))
+(define-benchmark full-gc (gc))
@@ -0,0 +1,34 @@
+;; Object system: generic function dispatch and slot access
+
+(define-class <shape> () ())
+(define-class <rect> (<shape>)
+  ((w :init-keyword :w) (h :init-keyword :h)))
+(define-class <square> (<rect>) ())
+(define-class <circle> (<shape>)
+  ((r :init-keyword :r)))
+
+(define-generic area)
+(define-method area ((s <rect>)) (* (~ s'w) (~ s'h)))
+(define-method area ((s <circle>)) (* 3 (~ s'r) (~ s'r)))
+(define-method area ((s <square>)) (next-method))
+
+(define *shapes*
+  (map (^i (case (modulo i 3)
+              [(0) (make <rect> :w i :h 2)]
+              [(1) (make <square> :w i :h i)]
+              [else (make <circle> :r i)]))
+       (iota 1000)))
+
+(define (total-area shapes)
+  (let loop ([ss shapes] [s 0])
+    (if (null? ss) s (loop (cdr ss) (+ s (area (car ss)))))))
+
+(define (slot-update! shapes)
+  (dolist [s shapes]
+    (when (is-a? s <rect>)
+      (slot-set! s 'w (+ (slot-ref s 'w) 1)))))
+
+(define-benchmark dispatch (total-area *shapes*))
+(define-benchmark slot-access (slot-update! *shapes*))
+(define-benchmark make-instance
+  (dotimes [i 1000] (make <rect> :w i :h i)))
@@ -0,0 +1,20 @@
+;; Hash tables
+
+(define *symbols*
+  (map (^i (string->symbol (format "sym~d" i))) (iota 1000)))
+(define *strings* (map (^i (format "key~d" i)) (iota 1000)))
+(define *lists* (map (^i (list i (* i 2) 'x)) (iota 1000)))
+
+(define (insert-and-lookup type keys)
+  (let1 ht (make-hash-table type)
+    (dolist [k keys] (hash-table-put! ht k #t))
+    (count (cut hash-table-get ht <> #f) keys)))
+
+(define-benchmark eq-insert (insert-and-lookup 'eq? *symbols*))
+(define-benchmark eqv-fixnum (insert-and-lookup 'eqv? (iota 1000)))
+(define-benchmark string-insert (insert-and-lookup 'string=? *strings*))
+(define-benchmark equal-insert (insert-and-lookup 'equal? *lists*))
+(define-benchmark update
+  (let1 ht (make-hash-table 'eqv?)
+    (dotimes [i 10000] (hash-table-update! ht (modulo i 100) (cut + <> 1) 0))
+    (hash-table-get ht 0)))
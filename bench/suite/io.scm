@@ -0,0 +1,26 @@
+;; Port I/O on string ports and a file
+
+(use file.util)
+
+(define *data* (map (^i (list i (format "str~d" i) (* i 1.5))) (iota 1000)))
+(define *written* (write-to-string *data*))
+(define *lines* (string-join (map (^i (format "line ~d" i)) (iota 1000)) "\n"))
+
+(define (file-roundtrip)
+  (receive (port name) (sys-mkstemp (build-path (temporary-directory) "bench"))
+    (unwind-protect
+        (begin
+          (display *lines* port)
+          (close-port port)
+          (call-with-input-file name (^[in] (length (port->string-list in)))))
+      (sys-unlink name))))
+
+(define-benchmark write (write-to-string *data*))
+(define-benchmark read (read-from-string *written*))
+(define-benchmark read-line
+  (with-input-from-string *lines*
+    (^[] (generator-fold (^[l n] (+ n 1)) 0 read-line))))
+(define-benchmark read-char
+  (with-input-from-string *lines*
+    (^[] (generator-fold (^[c n] (+ n 1)) 0 read-char))))
+(define-benchmark file-roundtrip (file-roundtrip))
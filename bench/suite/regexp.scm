@@ -0,0 +1,19 @@
+;; Regular expressions
+
+(define *lines*
+  (map (^i (format "~d: user~d@example.com sent ~d bytes at 12:~2,'0d" i i
+                   (* i 37) (modulo i 60)))
+       (iota 1000)))
+(define *text* (string-join *lines* "\n"))
+
+(define-benchmark match
+  (count (^l (#/user(\d+)@example\.com/ l)) *lines*))
+(define-benchmark no-match
+  (count (^l (#/foo[0-9]+bar/ l)) *lines*))
+(define-benchmark replace-all
+  (regexp-replace-all #/\d+/ *text* "N"))
+(define-benchmark submatch
+  (fold (^[l s] (if-let1 m (#/sent (\d+) bytes/ l)
+                  (+ s (string->number (m 1)))
+                  s))
+        0 *lines*))
@@ -0,0 +1,22 @@
+;; Strings and symbols
+
+(define *words* (map (^i (format "word~d" i)) (iota 1000)))
+(define *text* (string-join *words* " "))
+
+(define-benchmark append (apply string-append *words*))
+(define-benchmark output-port
+  (call-with-output-string
+    (^[out] (dolist [w *words*] (write-string w out) (write-char #\space out)))))
+(define-benchmark split (length (string-split *text* #\space)))
+(define-benchmark scan (string-scan *text* "word999"))
+(define-benchmark cursor
+  (let ([end (string-cursor-end *text*)])
+    (let loop ([c (string-cursor-start *text*)] [n 0])
+      (if (string-cursor=? c end)
+        n
+        (loop (string-cursor-next *text* c)
+              (if (char=? (string-ref *text* c) #\w) (+ n 1) n))))))
+(define-benchmark number->string
+  (dotimes [i 1000] (number->string (* i 12345))))
+(define-benchmark string->symbol
+  (dolist [w *words*] (string->symbol w)))
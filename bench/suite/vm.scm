@@ -0,0 +1,30 @@
+;; VM dispatch: calls, local loops, arithmetic on fixnums
+
+(define (fib n)
+  (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+
+(define (tak x y z)
+  (if (not (< y x))
+    z
+    (tak (tak (- x 1) y z) (tak (- y 1) z x) (tak (- z 1) x y))))
+
+(define (count-up n)
+  (let loop ([i 0] [s 0])
+    (if (< i n) (loop (+ i 1) (+ s i)) s)))
+
+(define (vector-sum v)
+  (let loop ([i 0] [s 0])
+    (if (< i (vector-length v))
+      (loop (+ i 1) (+ s (vector-ref v i)))
+      s)))
+
+(define *vec* (list->vector (iota 10000)))
+
+(define Apply apply)                    ; prevent apply inlining
+(define (add5 a b c d e) (+ a b c d e))
+
+(define-benchmark fib (fib 20))
+(define-benchmark tak (tak 18 12 6))
+(define-benchmark loop (count-up 100000))
+(define-benchmark vector-sum (vector-sum *vec*))
+(define-benchmark apply (dotimes [i 1000] (Apply add5 1 2 '(3 4 5))))
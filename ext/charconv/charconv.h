@@ -59,6 +59,11 @@ typedef struct ScmConvInfoRec {
     const char *toCode;         /* conver to ... */
     int istate;                 /* current input state */
     int ostate;                 /* current output state */
+    int asciiPath;              /* how runs of ASCII chars can bypass
+                                   the conversion (see jconv.c) */
+    int ucsPath;                /* nonzero if chars can be transcoded
+                                   directly between Unicode encodings
+                                   (see jconv.c) */
     ScmPort *remote;            /* source or drain port */
     int ownerp;                 /* do I own remote port? */
     int remoteClosed;           /* true if remore port is closed */
@@ -43,6 +43,9 @@
 
 #include <ctype.h>
 #include "charconv.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "jconv_tab.h"
 #include "latin_tab.h"
 
@@ -1879,6 +1882,489 @@ static ScmSize jconv_ident(ScmConvInfo *cinfo SCM_UNUSED, const char **iptr,
     }
 }
 
+/*------------------------------------------------------------------
+ * ASCII fast path
+ *
+ * Most text in "legacy" encodings is largely ASCII.  When ASCII chars
+ * in the input map to ASCII chars in the output, we can process a run
+ * of them in bulk, instead of calling the conversion routine for
+ * each byte.  cinfo->asciiPath tells what to do with such runs.
+ */
+
+enum {
+    ASCII_PATH_NONE,            /* no fast path */
+    ASCII_PATH_COPY,            /* ASCII-compatible -> ASCII-compatible */
+    ASCII_PATH_TO_UTF16,        /* ASCII-compatible -> UTF-16 */
+    ASCII_PATH_TO_UTF32,        /* ASCII-compatible -> UTF-32 */
+    ASCII_PATH_FROM_UTF16,      /* UTF-16 -> ASCII-compatible */
+    ASCII_PATH_FROM_UTF32       /* UTF-32 -> ASCII-compatible */
+};
+
+/* Stateless encodings in which a byte 0x00-0x7f always stands for
+   the ASCII character. */
+static int ascii_compatible_code(int code)
+{
+    return (code == JCODE_ASCII || code == JCODE_EUCJ || code == JCODE_SJIS
+            || code == JCODE_UTF8
+            || (code >= JCODE_ISO8859_1 && code <= JCODE_ISO8859_16));
+}
+
+static int utf16_code(int code)
+{
+    return (code == JCODE_UTF16 || code == JCODE_UTF16BE
+            || code == JCODE_UTF16LE);
+}
+
+static int utf32_code(int code)
+{
+    return (code == JCODE_UTF32 || code == JCODE_UTF32BE
+            || code == JCODE_UTF32LE);
+}
+
+static int ascii_path(int incode, int outcode)
+{
+    if (ascii_compatible_code(incode)) {
+        if (ascii_compatible_code(outcode)) return ASCII_PATH_COPY;
+        if (utf16_code(outcode)) return ASCII_PATH_TO_UTF16;
+        if (utf32_code(outcode)) return ASCII_PATH_TO_UTF32;
+    } else if (ascii_compatible_code(outcode)) {
+        if (utf16_code(incode)) return ASCII_PATH_FROM_UTF16;
+        if (utf32_code(incode)) return ASCII_PATH_FROM_UTF32;
+    }
+    return ASCII_PATH_NONE;
+}
+
+/* Each of the following routines converts a run of ASCII chars at the
+   beginning of IN, up to N chars, and returns the number of chars
+   converted.  They stop at the first non-ASCII char.  With SSE2, we
+   examine 16 bytes at a time. */
+
+static ScmSize ascii_copy(const u_char *in, ScmSize n, u_char *out)
+{
+    ScmSize i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        if (_mm_movemask_epi8(v)) break;
+        _mm_storeu_si128((__m128i*)(out + i), v);
+    }
+#else  /*!__SSE2__*/
+    for (; i + 8 <= n; i += 8) {
+        uint64_t v;
+        memcpy(&v, in + i, 8);
+        if (v & 0x8080808080808080ULL) break;
+        memcpy(out + i, &v, 8);
+    }
+#endif /*!__SSE2__*/
+    for (; i < n && in[i] < 0x80; i++) out[i] = in[i];
+    return i;
+}
+
+static ScmSize ascii_to_utf16(const u_char *in, ScmSize n, u_char *out,
+                              int be)
+{
+    ScmSize i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        if (_mm_movemask_epi8(v)) break;
+        __m128i lo = be ? _mm_unpacklo_epi8(zero, v) : _mm_unpacklo_epi8(v, zero);
+        __m128i hi = be ? _mm_unpackhi_epi8(zero, v) : _mm_unpackhi_epi8(v, zero);
+        _mm_storeu_si128((__m128i*)(out + i*2), lo);
+        _mm_storeu_si128((__m128i*)(out + i*2 + 16), hi);
+    }
+#endif /*__SSE2__*/
+    for (; i < n && in[i] < 0x80; i++) {
+        out[i*2+be] = in[i];
+        out[i*2+1-be] = 0;
+    }
+    return i;
+}
+
+static ScmSize ascii_to_utf32(const u_char *in, ScmSize n, u_char *out,
+                              int be)
+{
+    ScmSize i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        if (_mm_movemask_epi8(v)) break;
+        __m128i w[2], d[4];
+        if (be) {
+            w[0] = _mm_unpacklo_epi8(zero, v);
+            w[1] = _mm_unpackhi_epi8(zero, v);
+            d[0] = _mm_unpacklo_epi16(zero, w[0]);
+            d[1] = _mm_unpackhi_epi16(zero, w[0]);
+            d[2] = _mm_unpacklo_epi16(zero, w[1]);
+            d[3] = _mm_unpackhi_epi16(zero, w[1]);
+        } else {
+            w[0] = _mm_unpacklo_epi8(v, zero);
+            w[1] = _mm_unpackhi_epi8(v, zero);
+            d[0] = _mm_unpacklo_epi16(w[0], zero);
+            d[1] = _mm_unpackhi_epi16(w[0], zero);
+            d[2] = _mm_unpacklo_epi16(w[1], zero);
+            d[3] = _mm_unpackhi_epi16(w[1], zero);
+        }
+        for (int k = 0; k < 4; k++) {
+            _mm_storeu_si128((__m128i*)(out + i*4 + k*16), d[k]);
+        }
+    }
+#endif /*__SSE2__*/
+    for (; i < n && in[i] < 0x80; i++) {
+        u_char *o = out + i*4;
+        o[0] = o[1] = o[2] = o[3] = 0;
+        o[be ? 3 : 0] = in[i];
+    }
+    return i;
+}
+
+/* N is the number of code units here. */
+static ScmSize utf16_to_ascii(const u_char *in, ScmSize n, u_char *out,
+                              int be)
+{
+    ScmSize i = 0;
+#if defined(__SSE2__)
+    /* A code unit is ASCII iff it has no bits other than the lower 7. */
+    const __m128i mask = be ? _mm_set1_epi16((short)0x80ff)
+                            : _mm_set1_epi16((short)0xff80);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(in + i*2));
+        __m128i b = _mm_loadu_si128((const __m128i*)(in + i*2 + 16));
+        __m128i t = _mm_or_si128(_mm_and_si128(a, mask),
+                                 _mm_and_si128(b, mask));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(t, zero)) != 0xffff) break;
+        if (be) {
+            a = _mm_srli_epi16(a, 8);
+            b = _mm_srli_epi16(b, 8);
+        }
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(a, b));
+    }
+#endif /*__SSE2__*/
+    for (; i < n; i++) {
+        const u_char *u = in + i*2;
+        if (u[1-be] != 0 || u[be] >= 0x80) break;
+        out[i] = u[be];
+    }
+    return i;
+}
+
+/* N is the number of code units here. */
+static ScmSize utf32_to_ascii(const u_char *in, ScmSize n, u_char *out,
+                              int be)
+{
+    ScmSize i = 0;
+#if defined(__SSE2__)
+    const __m128i mask = be ? _mm_set1_epi32((int)0x80ffffff)
+                            : _mm_set1_epi32((int)0xffffff80);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(in + i*4));
+        __m128i b = _mm_loadu_si128((const __m128i*)(in + i*4 + 16));
+        __m128i t = _mm_or_si128(_mm_and_si128(a, mask),
+                                 _mm_and_si128(b, mask));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(t, zero)) != 0xffff) break;
+        if (be) {
+            a = _mm_srli_epi32(a, 24);
+            b = _mm_srli_epi32(b, 24);
+        }
+        /* All values are < 0x80, so saturation doesn't matter. */
+        __m128i w = _mm_packs_epi32(a, b);
+        _mm_storel_epi64((__m128i*)(out + i), _mm_packus_epi16(w, w));
+    }
+#endif /*__SSE2__*/
+    for (; i < n; i++) {
+        const u_char *u = in + i*4;
+        u_char c = u[be ? 3 : 0];
+        if (u[be ? 0 : 3] != 0 || u[1] != 0 || u[2] != 0 || c >= 0x80) break;
+        out[i] = c;
+    }
+    return i;
+}
+
+/* Process a run of ASCII chars at *IPTR according to cinfo->asciiPath,
+   updating the pointers and rooms.  Returns the number of input bytes
+   consumed. */
+static ScmSize ascii_fast_forward(ScmConvInfo *cinfo,
+                                  const char **iptr, ScmSize *iroom,
+                                  char **optr, ScmSize *oroom)
+{
+    const u_char *in = (const u_char*)*iptr;
+    u_char *out = (u_char*)*optr;
+    ScmSize inr = *iroom, outr = *oroom;
+    ScmSize nin = 0, nout = 0, n;
+    int be;
+
+    switch (cinfo->asciiPath) {
+    case ASCII_PATH_COPY:
+        n = ascii_copy(in, (inr < outr ? inr : outr), out);
+        nin = nout = n;
+        break;
+    case ASCII_PATH_TO_UTF16:
+        /* We need to know the byte order; if the output is UTF-16 without
+           specified byte order, the conversion routine decides it
+           with the first character. */
+        if (cinfo->ostate != UTF_BE && cinfo->ostate != UTF_LE) return 0;
+        be = (cinfo->ostate == UTF_BE);
+        n = ascii_to_utf16(in, (inr < outr/2 ? inr : outr/2), out, be);
+        nin = n;
+        nout = n*2;
+        break;
+    case ASCII_PATH_TO_UTF32:
+        if (cinfo->ostate != UTF_BE && cinfo->ostate != UTF_LE) return 0;
+        be = (cinfo->ostate == UTF_BE);
+        n = ascii_to_utf32(in, (inr < outr/4 ? inr : outr/4), out, be);
+        nin = n;
+        nout = n*4;
+        break;
+    case ASCII_PATH_FROM_UTF16:
+        /* Likewise, the input byte order is decided by the BOM. */
+        if (cinfo->istate != UTF_BE && cinfo->istate != UTF_LE) return 0;
+        be = (cinfo->istate == UTF_BE);
+        n = utf16_to_ascii(in, (inr/2 < outr ? inr/2 : outr), out, be);
+        nin = n*2;
+        nout = n;
+        break;
+    case ASCII_PATH_FROM_UTF32:
+        if (cinfo->istate != UTF_BE && cinfo->istate != UTF_LE) return 0;
+        be = (cinfo->istate == UTF_BE);
+        n = utf32_to_ascii(in, (inr/4 < outr ? inr/4 : outr), out, be);
+        nin = n*4;
+        nout = n;
+        break;
+    default:
+        return 0;
+    }
+    *iptr += nin;
+    *iroom -= nin;
+    *optr += nout;
+    *oroom -= nout;
+    return nin;
+}
+
+/*------------------------------------------------------------------
+ * Unicode transcoding fast path
+ *
+ * Between UTF-8, UTF-16, UTF-32 and ISO-8859-1, a character converts
+ * to the same code point, so we can decode and encode directly in
+ * a loop, instead of going through a per-character routine (which is
+ * a fused one for e.g. UTF-16 -> UTF-32).  cinfo->ucsPath holds the
+ * input and output kinds.
+ *
+ * The loop only handles well-formed input that is representable in the
+ * output.  It stops at anything else---an invalid or incomplete
+ * sequence, a surrogate, a char out of range of the output---and lets
+ * the per-character routine deal with it, so the results, including
+ * substitution and errors, are the same as before.
+ */
+
+enum {
+    UCS_NONE,
+    UCS_UTF8,
+    UCS_UTF16,
+    UCS_UTF32,
+    UCS_LATIN1
+};
+
+#define UCS_PATH(in, out)  (((in)<<4)|(out))
+#define UCS_PATH_IN(p)     ((p)>>4)
+#define UCS_PATH_OUT(p)    ((p)&0x0f)
+
+static int ucs_kind(int code)
+{
+    if (code == JCODE_UTF8) return UCS_UTF8;
+    if (utf16_code(code)) return UCS_UTF16;
+    if (utf32_code(code)) return UCS_UTF32;
+    if (code == JCODE_ISO8859_1) return UCS_LATIN1;
+    return UCS_NONE;
+}
+
+static int ucs_path(int incode, int outcode)
+{
+    int in = ucs_kind(incode), out = ucs_kind(outcode);
+    /* Conversions within the same kind are not transcoding; UTF-16 to
+       UTF-16 only swaps bytes, and the others are identity. */
+    if (in == UCS_NONE || out == UCS_NONE || in == out) return 0;
+    return UCS_PATH(in, out);
+}
+
+#define SURROGATE_P(ch)  ((ch) >= 0xd800 && (ch) < 0xe000)
+
+/* Decodes a char at IN.  Returns the number of bytes, or 0 if it isn't
+   well-formed. */
+static inline ScmSize ucs_decode(int kind, int be,
+                                 const u_char *in, ScmSize room, ScmChar *ch)
+{
+    switch (kind) {
+    case UCS_UTF8: {
+        u_char u0 = in[0];
+        if (u0 < 0x80) { *ch = u0; return 1; }
+        if (u0 < 0xc2) return 0;     /* trailing byte or overlong */
+        if (u0 < 0xe0) {
+            if (room < 2 || (in[1] & 0xc0) != 0x80) return 0;
+            *ch = ((u0 & 0x1f) << 6) | (in[1] & 0x3f);
+            return 2;
+        }
+        if (u0 < 0xf0) {
+            if (room < 3 || (in[1] & 0xc0) != 0x80
+                || (in[2] & 0xc0) != 0x80) return 0;
+            ScmChar c = ((u0 & 0x0f) << 12) | ((in[1] & 0x3f) << 6)
+                | (in[2] & 0x3f);
+            if (c < 0x800 || SURROGATE_P(c)) return 0;
+            *ch = c;
+            return 3;
+        }
+        if (u0 < 0xf5) {
+            if (room < 4 || (in[1] & 0xc0) != 0x80
+                || (in[2] & 0xc0) != 0x80 || (in[3] & 0xc0) != 0x80) return 0;
+            ScmChar c = ((u0 & 0x07) << 18) | ((in[1] & 0x3f) << 12)
+                | ((in[2] & 0x3f) << 6) | (in[3] & 0x3f);
+            if (c < 0x10000 || c > 0x10ffff) return 0;
+            *ch = c;
+            return 4;
+        }
+        return 0;
+    }
+    case UCS_UTF16: {
+        if (room < 2) return 0;
+        ScmChar u = be ? (in[0] << 8) | in[1] : (in[1] << 8) | in[0];
+        if (!SURROGATE_P(u)) { *ch = u; return 2; }
+        if (u >= 0xdc00 || room < 4) return 0;
+        ScmChar v = be ? (in[2] << 8) | in[3] : (in[3] << 8) | in[2];
+        if (v < 0xdc00 || v >= 0xe000) return 0;
+        *ch = (((u & 0x3ff) << 10) | (v & 0x3ff)) + 0x10000;
+        return 4;
+    }
+    case UCS_UTF32: {
+        if (room < 4) return 0;
+        uint32_t u = be
+            ? ((uint32_t)in[0] << 24) | (in[1] << 16) | (in[2] << 8) | in[3]
+            : ((uint32_t)in[3] << 24) | (in[2] << 16) | (in[1] << 8) | in[0];
+        if (u > 0x10ffff || SURROGATE_P(u)) return 0;
+        *ch = (ScmChar)u;
+        return 4;
+    }
+    case UCS_LATIN1:
+        *ch = in[0];
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* Encodes CH to OUT.  Returns the number of bytes, or 0 if CH can't be
+   represented or there isn't enough room. */
+static inline ScmSize ucs_encode(int kind, int be,
+                                 ScmChar ch, u_char *out, ScmSize room)
+{
+    switch (kind) {
+    case UCS_UTF8: {
+        ScmSize n = UCS2UTF_NBYTES(ch);
+        if (room < n) return 0;
+        jconv_ucs4_to_utf8(ch, (char*)out);
+        return n;
+    }
+    case UCS_UTF16:
+        if (ch < 0x10000) {
+            if (room < 2) return 0;
+            out[be ? 0 : 1] = (u_char)(ch >> 8);
+            out[be ? 1 : 0] = (u_char)ch;
+            return 2;
+        } else {
+            if (room < 4) return 0;
+            ScmChar c = ch - 0x10000;
+            ScmChar hi = 0xd800 | (c >> 10), lo = 0xdc00 | (c & 0x3ff);
+            out[be ? 0 : 1] = (u_char)(hi >> 8);
+            out[be ? 1 : 0] = (u_char)hi;
+            out[be ? 2 : 3] = (u_char)(lo >> 8);
+            out[be ? 3 : 2] = (u_char)lo;
+            return 4;
+        }
+    case UCS_UTF32:
+        if (room < 4) return 0;
+        out[be ? 0 : 3] = 0;
+        out[be ? 1 : 2] = (u_char)(ch >> 16);
+        out[be ? 2 : 1] = (u_char)(ch >> 8);
+        out[be ? 3 : 0] = (u_char)ch;
+        return 4;
+    case UCS_LATIN1:
+        if (ch >= 0x100 || room < 1) return 0;
+        out[0] = (u_char)ch;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* Byte order of a UTF-16/32 side; -1 if it isn't decided yet. */
+static int ucs_byte_order(int kind, int state)
+{
+    if (kind != UCS_UTF16 && kind != UCS_UTF32) return 0;
+    if (state == UTF_BE) return 1;
+    if (state == UTF_LE) return 0;
+    return -1;
+}
+
+/* Converts chars at *IPTR while they're well-formed and representable,
+   updating the pointers and rooms.  If we have the ASCII fast path,
+   we leave a run of ASCII chars to it.  Returns the number of input
+   bytes consumed. */
+static ScmSize ucs_fast_forward(ScmConvInfo *cinfo,
+                                const char **iptr, ScmSize *iroom,
+                                char **optr, ScmSize *oroom)
+{
+    int inkind = UCS_PATH_IN(cinfo->ucsPath);
+    int outkind = UCS_PATH_OUT(cinfo->ucsPath);
+    int ibe = ucs_byte_order(inkind, cinfo->istate);
+    int obe = ucs_byte_order(outkind, cinfo->ostate);
+    if (ibe < 0 || obe < 0) return 0;
+
+    const u_char *in = (const u_char*)*iptr;
+    u_char *out = (u_char*)*optr;
+    ScmSize inr = *iroom, outr = *oroom;
+    int stop_at_ascii = (cinfo->asciiPath != ASCII_PATH_NONE);
+
+    while (inr > 0) {
+        ScmChar ch;
+        ScmSize ni = ucs_decode(inkind, ibe, in, inr, &ch);
+        if (ni == 0 || (stop_at_ascii && ch < 0x80)) break;
+        ScmSize no = ucs_encode(outkind, obe, ch, out, outr);
+        if (no == 0) break;
+        in += ni; inr -= ni;
+        out += no; outr -= no;
+    }
+    ScmSize nin = *iroom - inr;
+    *iptr = (const char*)in;
+    *iroom = inr;
+    *optr = (char*)out;
+    *oroom = outr;
+    return nin;
+}
+
+/* Runs the fast paths alternately while they make progress. */
+static ScmSize fast_forward(ScmConvInfo *cinfo,
+                            const char **iptr, ScmSize *iroom,
+                            char **optr, ScmSize *oroom)
+{
+    ScmSize total = 0;
+    for (;;) {
+        ScmSize n = 0;
+        if (cinfo->asciiPath != ASCII_PATH_NONE) {
+            n += ascii_fast_forward(cinfo, iptr, iroom, optr, oroom);
+        }
+        if (cinfo->ucsPath && *iroom > 0 && *oroom > 0) {
+            n += ucs_fast_forward(cinfo, iptr, iroom, optr, oroom);
+        }
+        total += n;
+        if (n == 0 || *iroom == 0 || *oroom == 0) break;
+        /* Without the ASCII path, ucs_fast_forward has done all it can. */
+        if (cinfo->asciiPath == ASCII_PATH_NONE) break;
+    }
+    return total;
+}
+
 /* calling conversion routine for each char */
 static ScmSize jconv_1tier(ScmConvInfo *cinfo, const char **iptr,
                            ScmSize *iroom, char **optr, ScmSize *oroom)
@@ -1894,6 +2380,13 @@ static ScmSize jconv_1tier(ScmConvInfo *cinfo, const char **iptr,
 #endif
     SCM_ASSERT(cvt != NULL);
     while (inr > 0 && outr > 0) {
+        if (cinfo->asciiPath != ASCII_PATH_NONE || cinfo->ucsPath) {
+            ScmSize ir = inr, or = outr;
+            converted += fast_forward(cinfo, &inp, &ir, &outp, &or);
+            inr = (int)ir;
+            outr = (int)or;
+            if (inr == 0 || outr == 0) break;
+        }
         ScmSize outchars;
         ScmSize inchars = cvt(cinfo, inp, inr, outp, outr, &outchars);
         if (ERRP(inchars)) {
@@ -1922,12 +2415,19 @@ static ScmSize jconv_1tier(ScmConvInfo *cinfo, const char **iptr,
  * reset sequence; the first call should emit the sequence, but the second
  * call shouldn't.
  */
+static ScmSize jconv_iconv_ascii(ScmConvInfo *cinfo,
+                                 const char **iptr, ScmSize *iroom,
+                                 char **optr, ScmSize *oroom);
+
 static ScmSize jconv_iconv(ScmConvInfo *cinfo, const char **iptr, ScmSize *iroom,
                            char **optr, ScmSize *oroom)
 {
 #ifdef JCONV_DEBUG
     fprintf(stderr, "jconv_iconv %s->%s\n", cinfo->fromCode, cinfo->toCode);
 #endif
+    if (cinfo->asciiPath == ASCII_PATH_COPY) {
+        return jconv_iconv_ascii(cinfo, iptr, iroom, optr, oroom);
+    }
     size_t ir = *iroom, or = *oroom;
     size_t r = iconv(cinfo->handle, (char **)iptr, &ir, optr, &or);
     *iroom = ir;
@@ -1942,6 +2442,81 @@ static ScmSize jconv_iconv(ScmConvInfo *cinfo, const char **iptr, ScmSize *iroom
     }
 }
 
+/* If both encodings are stateless and ASCII-compatible, we copy ASCII
+   runs by ourselves and pass only the rest to iconv.  A trailing byte of
+   a multibyte char can be in ASCII range in some encodings (e.g. Big5),
+   so when iconv stops at an incomplete char at the end of a non-ASCII
+   segment, we extend the segment until the char is complete. */
+static ScmSize jconv_iconv_ascii(ScmConvInfo *cinfo,
+                                 const char **iptr, ScmSize *iroom,
+                                 char **optr, ScmSize *oroom)
+{
+    ScmSize converted = 0;
+    cinfo->ostate = JIS_UNKNOWN;
+    while (*iroom > 0) {
+        converted += ascii_fast_forward(cinfo, iptr, iroom, optr, oroom);
+        if (*iroom == 0) break;
+        if (*oroom == 0) return OUTPUT_NOT_ENOUGH;
+
+        const u_char *p = (const u_char*)*iptr;
+        ScmSize seg = 1;
+        while (seg < *iroom && p[seg] >= 0x80) seg++;
+        for (;;) {
+            size_t ir = seg, or = *oroom;
+            size_t r = iconv(cinfo->handle, (char **)iptr, &ir, optr, &or);
+            converted += seg - (ScmSize)ir;
+            *iroom -= seg - (ScmSize)ir;
+            *oroom = or;
+            if (r != (size_t)-1) break;
+            if (errno == E2BIG) return OUTPUT_NOT_ENOUGH;
+            if (errno != EINVAL) return ILLEGAL_SEQUENCE;
+            if ((ScmSize)ir == *iroom) return INPUT_NOT_ENOUGH;
+            seg = (ScmSize)ir + 1;
+        }
+    }
+    return converted;
+}
+
+/* Returns true if the encoding NAME may be stateful.  We can't tell it
+   from iconv, so we check the names of known stateful encodings. */
+static int iconv_stateful_name(const char *name)
+{
+    static const char *stateful[] = { "2022", "cp5022", "utf7", "hz", NULL };
+    char buf[64];
+    size_t k = 0;
+    for (const char *p = name; *p && k < sizeof(buf)-1; p++) {
+        if (*p == '-' || *p == '_') continue;
+        buf[k++] = tolower(*p);
+    }
+    buf[k] = '\0';
+    for (const char **s = stateful; *s; s++) {
+        if (strstr(buf, *s)) return TRUE;
+    }
+    return FALSE;
+}
+
+/* Determine if we can use ASCII_PATH_COPY with iconv conversion.  Besides
+   the name check, we actually convert all ASCII chars to see they
+   are preserved. */
+static int iconv_ascii_path(iconv_t handle,
+                            const char *fromCode, const char *toCode)
+{
+    if (iconv_stateful_name(fromCode) || iconv_stateful_name(toCode)) {
+        return ASCII_PATH_NONE;
+    }
+    char in[128], out[256];
+    for (int i = 0; i < 128; i++) in[i] = (char)i;
+    char *ip = in, *op = out;
+    size_t ir = sizeof(in), or = sizeof(out);
+    size_t r = iconv(handle, &ip, &ir, &op, &or);
+    iconv(handle, NULL, NULL, NULL, NULL); /* reset the state */
+    if (r == (size_t)-1 || ir != 0 || sizeof(out) - or != sizeof(in)
+        || memcmp(in, out, sizeof(in)) != 0) {
+        return ASCII_PATH_NONE;
+    }
+    return ASCII_PATH_COPY;
+}
+
 /* reset routine for iconv */
 static ScmSize jconv_iconv_reset(ScmConvInfo *cinfo, char *optr, ScmSize oroom)
 {
@@ -1969,7 +2544,7 @@ ScmConvInfo *jconv_open(const char *toCode, const char *fromCode,
     ScmConvHandler *handler = NULL;
     ScmConvProc *convert = NULL;
     ScmConvReset *reset = NULL;
-    int istate = 0, ostate = 0;
+    int istate = 0, ostate = 0, apath = ASCII_PATH_NONE, upath = 0;
     iconv_t handle = (iconv_t)-1;
 
     int incode  = conv_name_find(fromCode);
@@ -1992,6 +2567,7 @@ ScmConvInfo *jconv_open(const char *toCode, const char *fromCode,
             if (handle == (iconv_t)-1) return NULL;
             handler = jconv_iconv;
             reset = jconv_iconv_reset;
+            apath = iconv_ascii_path(handle, fromCode, toCode);
 #else /*!HAVE_ICONV_H*/
             return NULL;
 #endif
@@ -2002,6 +2578,8 @@ ScmConvInfo *jconv_open(const char *toCode, const char *fromCode,
         handler = jconv_ident;
     } else  {
         handler = jconv_1tier;
+        apath = ascii_path(incode, outcode);
+        upath = ucs_path(incode, outcode);
     }
 
     ScmConvInfo *cinfo;
@@ -2013,6 +2591,8 @@ ScmConvInfo *jconv_open(const char *toCode, const char *fromCode,
     cinfo->toCode = toCode;
     cinfo->istate = istate;
     cinfo->ostate = ostate;
+    cinfo->asciiPath = apath;
+    cinfo->ucsPath = upath;
     cinfo->fromCode = fromCode;
     /* The replacement settings can be modified by jconv_set_replacement */
     cinfo->replacep = FALSE;
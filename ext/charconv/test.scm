@@ -366,6 +366,96 @@
        (ces-convert-to <u8vector> src 'utf-8 'sjis :illegal-output 'replace))
   )
 
+;;--------------------------------------------------------------------
+(test-section "ASCII runs")
+
+;; Long ASCII runs are converted in bulk; make sure they're correctly
+;; connected to non-ASCII chars, including at buffer boundaries.
+(let* ([src (with-output-to-string
+              (^[] (dotimes [i 200]
+                     (display (make-string (modulo (* i 7) 53) #\a))
+                     (display (if (even? i) "\u00e9" "\u3042"))
+                     (display i))))]
+       [utf16be (with-output-to-string
+                  (^[] (string-for-each
+                        (^c (let1 n (char->integer c)
+                              (write-byte (ash n -8))
+                              (write-byte (logand n #xff))))
+                        src)))])
+  (test* "utf-8 -> utf-16be" (string-complete->incomplete utf16be)
+         (string-complete->incomplete (ces-convert src 'utf-8 'utf-16be)))
+  (dolist [code '(utf-16 utf-16le utf-16be utf-32 utf-32le utf-32be eucjp
+                  sjis)]
+    (dolist [bufsiz '(0 7 64)]
+      (test* #"round trip utf-8 -> ~|code| (buffer ~|bufsiz|)" src
+             (let1 s (ces-convert src 'utf-8 code)
+               (port->string
+                (open-input-conversion-port (open-input-string s) code
+                                            :to-code 'utf-8
+                                            :buffer-size bufsiz))))))
+  (let1 latin (string-map (^c (if (char=? c #\u3042) #\? c)) src)
+    (test* "round trip utf-8 -> latin-1" latin
+           (ces-convert (ces-convert latin 'utf-8 'latin1) 'latin1 'utf-8))))
+
+;;--------------------------------------------------------------------
+(test-section "Unicode transcoding")
+
+;; Non-ASCII chars between Unicode encodings and Latin-1 are transcoded
+;; directly.  Mix BMP, non-BMP and ASCII chars to exercise surrogate
+;; pairs, the hand-off to the ASCII path, and buffer boundaries.
+(let* ([src (with-output-to-string
+              (^[] (dotimes [i 100]
+                     (display "\u0436\u00e9\u3042\U0001f600")
+                     (display (make-string (modulo i 5) #\z))
+                     (display "\u00ff\U0010fffd"))))]
+       [u16be (^n (write-byte (ash n -8)) (write-byte (logand n #xff)))]
+       [utf16be (with-output-to-string
+                  (^[] (string-for-each
+                        (^c (let1 n (char->integer c)
+                              (if (< n #x10000)
+                                (u16be n)
+                                (let1 m (- n #x10000)
+                                  (u16be (logior #xd800 (ash m -10)))
+                                  (u16be (logior #xdc00 (logand m #x3ff)))))))
+                        src)))]
+       [utf32le (with-output-to-string
+                  (^[] (string-for-each
+                        (^c (let1 n (char->integer c)
+                              (dotimes [i 4]
+                                (write-byte (logand (ash n (* i -8)) #xff)))))
+                        src)))])
+  (test* "utf-8 -> utf-16be" (string-complete->incomplete utf16be)
+         (string-complete->incomplete (ces-convert src 'utf-8 'utf-16be)))
+  (test* "utf-8 -> utf-32le" (string-complete->incomplete utf32le)
+         (string-complete->incomplete (ces-convert src 'utf-8 'utf-32le)))
+  (test* "utf-16be -> utf-32le" (string-complete->incomplete utf32le)
+         (string-complete->incomplete
+          (ces-convert utf16be 'utf-16be 'utf-32le)))
+  (test* "utf-32le -> utf-16be" (string-complete->incomplete utf16be)
+         (string-complete->incomplete
+          (ces-convert utf32le 'utf-32le 'utf-16be)))
+  (dolist [code '(utf-16 utf-16le utf-32 utf-32be)]
+    (dolist [bufsiz '(0 7 64)]
+      (test* #"round trip utf-8 -> ~|code| (buffer ~|bufsiz|)" src
+             (let1 s (ces-convert src 'utf-8 code)
+               (port->string
+                (open-input-conversion-port (open-input-string s) code
+                                            :to-code 'utf-8
+                                            :buffer-size bufsiz))))))
+  (let1 latin (list->string (filter (^c (< (char->integer c) #x100))
+                                     (string->list src)))
+    (dolist [code '(utf-8 utf-16le utf-32be)]
+      (test* #"round trip latin-1 -> ~|code|" latin
+             (ces-convert (ces-convert (ces-convert latin 'utf-8 'latin1)
+                                       'latin1 code)
+                          code 'utf-8)))
+    ;; chars not in Latin-1 are still substituted
+    (test* "utf-16le -> latin-1 substitution"
+           (string-map (^c (if (< (char->integer c) #x100) c #\?)) src)
+           (ces-convert (ces-convert (ces-convert src 'utf-8 'utf-16le)
+                                     'utf-16le 'latin1)
+                        'latin1 'utf-8))))
+
 ;;--------------------------------------------------------------------
 (test-section "wrapping conversion")
 
@@ -0,0 +1,541 @@
+;;;
+;;; control.fiber - lightweight threads
+;;;
+;;;   Copyright (c) 2024  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; Fibers are lightweight threads scheduled cooperatively on a small
+;; number of carrier threads.  A fiber costs a closure and a record,
+;; so we can have tens of thousands of them, e.g. one per connection.
+;;
+;; - A fiber is a thunk run under a reset.  When it needs to wait, it
+;;   captures its partial continuation with shift and returns to the
+;;   carrier's scheduling loop.  The continuation is resumed by the
+;;   carrier later.
+;;
+;; - A continuation can only be resumed in the VM that captured it, so
+;;   a fiber stays on the carrier it's assigned to at spawn time.
+;;   Fibers are assigned to carriers in round-robin.
+;;
+;; - Each carrier has a run queue, a poller (epoll, or poll where epoll
+;;   isn't available) and a timer heap.  When the run queue is empty,
+;;   the carrier blocks in the poller until an fd gets ready or the
+;;   earliest timer expires.  Other threads wake the carrier by writing
+;;   to a pipe the poller watches.
+;;
+;; - Every time a fiber suspends, its epoch is incremented.  A wakeup
+;;   carries the epoch it's for, and stale wakeups (e.g. a timeout
+;;   after the I/O is ready) are ignored.  So a fiber can wait for
+;;   multiple events and the first one wins.
+;;
+;; - Only the waits provided here yield.  Other blocking operations,
+;;   e.g. reading from a port, block the whole carrier; use
+;;   fiber-wait-readable before reading, or fiber-socket-* procedures.
+
+(define-module control.fiber
+  (use gauche.threads)
+  (use gauche.partcont)
+  (use gauche.record)
+  (use gauche.net)
+  (use gauche.fcntl)
+  (use gauche.uvector)
+  (use data.heap)
+  (use data.queue)
+  (export <fiber-scheduler> make-fiber-scheduler fiber-scheduler?
+          default-fiber-scheduler fiber-scheduler-num-carriers
+          fiber-scheduler-shutdown!
+          spawn-fiber fiber? fiber-name fiber-done? fiber-join
+          current-fiber fiber-yield fiber-sleep
+          fiber-wait-readable fiber-wait-writable
+          fiber-socket-accept fiber-socket-recv fiber-socket-send))
+(select-module control.fiber)
+
+(inline-stub
+ (declcode
+  (.include "poller.h"))
+
+ (define-ctype ScmFiberPoller::(.struct
+                                (SCM_HEADER :: ""
+                                 p::Poller*)))
+
+ (define-cclass <fiber-poller> :private
+   ScmFiberPoller* "Scm_FiberPollerClass" ()
+   ()
+   [printer
+    (Scm_Printf port "#<fiber-poller%s>"
+                (?: (PollerClosedP (-> (SCM_FIBER_POLLER obj) p))
+                    " (closed)" ""))])
+
+ (define-cfn poller_finalize (obj _::void*) ::void :static
+   (PollerClose (-> (SCM_FIBER_POLLER obj) p)))
+
+ (define-enum POLLER_READ)
+ (define-enum POLLER_WRITE)
+
+ (define-cproc make-poller ()
+   (let* ([z::ScmFiberPoller* (SCM_NEW ScmFiberPoller)])
+     (SCM_SET_CLASS z (& Scm_FiberPollerClass))
+     (set! (-> z p) (PollerNew))
+     (Scm_RegisterFinalizer (SCM_OBJ z) poller_finalize NULL)
+     (return (SCM_OBJ z))))
+
+ (define-cproc poller-close (p::<fiber-poller>) ::<void>
+   (PollerClose (-> p p)))
+
+ ;; Returns #f if FD can't be polled.
+ (define-cproc poller-set! (p::<fiber-poller> fd::<int> events::<int>)
+   ::<boolean>
+   (return (PollerSet (-> p p) fd events)))
+
+ ;; TIMEOUT is in milliseconds; negative to wait indefinitely.
+ (define-cproc poller-wait (p::<fiber-poller> timeout::<long>)
+   (return (PollerWait (-> p p) timeout)))
+
+ (define-cproc %recv-nonblock (fd::<int> bytes::<fixnum> flags::<fixnum>)
+   (return (NonblockRecv fd bytes flags)))
+
+ (define-cproc %send-nonblock (fd::<int> msg start::<fixnum> flags::<fixnum>)
+   (return (NonblockSend fd msg start flags)))
+ )
+
+;;
+;; Fiber
+;;
+
+;; STATE is one of suspended, runnable, running, done or error.  The
+;; transitions between the first three are made under the carrier lock.
+;; A new fiber starts as suspended with epoch 0 and CONT #f.
+;; RESULT is a list of values if done, a raised object if error.
+(define-record-type fiber %make-fiber fiber?
+  (name    fiber-name)
+  (thunk   fiber-thunk   fiber-thunk-set!)
+  (carrier fiber-carrier)
+  (cont    fiber-cont    fiber-cont-set!)   ; partial continuation to resume
+  (value   fiber-value   fiber-value-set!)  ; value to pass to cont
+  (state   fiber-state   fiber-state-set!)
+  (epoch   fiber-epoch   fiber-epoch-set!)
+  (result  fiber-result  fiber-result-set!)
+  (waiters fiber-waiters fiber-waiters-set!); ((fiber . epoch) ...) to join
+  (lock    fiber-lock)                      ; protects result and waiters
+  (cv      fiber-cv))
+
+(define-method write-object ((f fiber) port)
+  (format port "#<fiber ~s ~a>" (fiber-name f) (fiber-state f)))
+
+(define (fiber-finished? f) (memq (fiber-state f) '(done error)))
+
+(define (fiber-done? f)
+  (assume-type f fiber)
+  (boolean (fiber-finished? f)))
+
+;;
+;; Carrier
+;;
+
+;; The run queue, the notified flag and the fiber count are protected
+;; by the lock.  The rest are only touched by the carrier thread.
+(define-record-type carrier %make-carrier #f
+  (scheduler  carrier-scheduler)
+  (lock       carrier-lock)
+  (runq       carrier-runq)
+  (notified   carrier-notified carrier-notified-set!) ; wake byte is in pipe
+  (nfibers    carrier-nfibers  carrier-nfibers-set!)  ; # of live fibers
+  (poller     carrier-poller)
+  (wake-in    carrier-wake-in)
+  (wake-out   carrier-wake-out)
+  (io-waiters carrier-io-waiters)   ; fd -> #((fiber . epoch) (fiber . epoch))
+  (timers     carrier-timers)       ; heap of (deadline fiber epoch value)
+  (thread     carrier-thread carrier-thread-set!))
+
+(define-syntax with-carrier
+  (syntax-rules ()
+    [(_ c expr ...)
+     (begin
+       (mutex-lock! (carrier-lock c))
+       (begin0 (begin expr ...) (mutex-unlock! (carrier-lock c))))]))
+
+(define (make-carrier sched)
+  (receive (in out) (sys-pipe :buffering :none)
+    (rlet1 c (%make-carrier sched (make-mutex) (make-queue) #f 0
+                            (make-poller) in out
+                            (make-hash-table eqv-comparator)
+                            (make-binary-heap :key car) #f)
+      (poller-set! (carrier-poller c) (port-file-number in) POLLER_READ))))
+
+(define current-carrier (make-thread-local #f))
+(define %current-fiber (make-thread-local #f))
+
+;; Wake up the carrier thread of C if it may be blocking in the poller.
+;; One byte in the pipe is enough no matter how many wakeups are pending.
+(define (carrier-notify! c)
+  (when (and (not (eq? (tlref current-carrier) c))
+             (with-carrier c (and (not (carrier-notified c))
+                                  (begin (carrier-notified-set! c #t) #t))))
+    (write-byte 0 (carrier-wake-out c))))
+
+;; Make fiber F runnable with VAL, if it's still waiting for EPOCH.
+;; Can be called from any thread.
+(define (wake! f epoch val)
+  (let1 c (fiber-carrier f)
+    (when (with-carrier c
+            (and (eq? (fiber-state f) 'suspended)
+                 (eqv? (fiber-epoch f) epoch)
+                 (begin
+                   (fiber-state-set! f 'runnable)
+                   (fiber-value-set! f val)
+                   (enqueue! (carrier-runq c) f)
+                   #t)))
+      (carrier-notify! c))))
+
+;; Suspend the current fiber.  REGISTER is called with the fiber and the
+;; new epoch, after the continuation is saved, on the carrier thread
+;; outside of the fiber.  It should arrange to call wake! later.
+;; Returns the value passed to wake!.
+(define (%suspend register)
+  (let* ([f (tlref %current-fiber)]
+         [c (fiber-carrier f)])
+    (shift k
+      (let1 epoch (with-carrier c
+                    (fiber-cont-set! f k)
+                    (fiber-state-set! f 'suspended)
+                    (rlet1 e (+ (fiber-epoch f) 1)
+                      (fiber-epoch-set! f e)))
+        (register f epoch)))))
+
+(define (finish! c f state result)
+  (mutex-lock! (fiber-lock f))
+  (fiber-thunk-set! f #f)
+  (fiber-result-set! f result)
+  (fiber-state-set! f state)
+  (let1 ws (fiber-waiters f)
+    (fiber-waiters-set! f '())
+    (condition-variable-broadcast! (fiber-cv f))
+    (mutex-unlock! (fiber-lock f))
+    (dolist [w ws] (wake! (car w) (cdr w) #t)))
+  (with-carrier c
+    (carrier-nfibers-set! c (- (carrier-nfibers c) 1))))
+
+;; Run F until it finishes or suspends.  Errors are caught outside
+;; of reset, so the handler is in effect whichever continuation
+;; is running.
+(define (run-fiber! c f)
+  (tlset! %current-fiber f)
+  (guard (e [else (finish! c f 'error e)])
+    (reset
+     (if-let1 k (fiber-cont f)
+       (begin (fiber-cont-set! f #f)
+              (k (fiber-value f)))
+       (finish! c f 'done (values->list ((fiber-thunk f)))))))
+  (tlset! %current-fiber #f))
+
+;; Run the fibers that are in the run queue at this moment.  Fibers
+;; made runnable meanwhile wait for the next round, so I/O is polled
+;; even if some fibers keep yielding.
+(define (run-queued! c)
+  (let loop ([n (with-carrier c (queue-length (carrier-runq c)))])
+    (when (> n 0)
+      (let1 f (with-carrier c
+                (rlet1 f (dequeue! (carrier-runq c))
+                  (fiber-state-set! f 'running)))
+        (run-fiber! c f)
+        (loop (- n 1))))))
+
+(define (now) (time->seconds (current-time)))
+
+(define (add-timer! c deadline f epoch val)
+  (binary-heap-push! (carrier-timers c) (list deadline f epoch val)))
+
+(define (fire-timers! c)
+  (let ([h (carrier-timers c)]
+        [t (now)])
+    (let loop ()
+      (unless (binary-heap-empty? h)
+        (let1 e (binary-heap-find-min h)
+          (when (<= (car e) t)
+            (binary-heap-pop-min! h)
+            (apply wake! (cdr e))
+            (loop)))))))
+
+(define (io-mask w)
+  (logior (if (vector-ref w 0) POLLER_READ 0)
+          (if (vector-ref w 1) POLLER_WRITE 0)))
+
+(define (io-ready! c fd events)
+  (and-let1 w (hash-table-get (carrier-io-waiters c) fd #f)
+    (dolist [i '(0 1)]
+      (when (logtest events (if (= i 0) POLLER_READ POLLER_WRITE))
+        (and-let1 r (vector-ref w i)
+          (vector-set! w i #f)
+          (wake! (car r) (cdr r) #t))))
+    (if (zero? (io-mask w))
+      (hash-table-delete! (carrier-io-waiters c) fd)
+      (poller-set! (carrier-poller c) fd (io-mask w)))))
+
+(define (poll-io! c)
+  (define timers (carrier-timers c))
+  (define wake-fd (port-file-number (carrier-wake-in c)))
+  (define timeout
+    (cond [(with-carrier c (not (queue-empty? (carrier-runq c)))) 0]
+          [(binary-heap-empty? timers) -1]
+          [else (max 0 (exact (ceiling
+                               (* 1000 (- (car (binary-heap-find-min timers))
+                                          (now))))))]))
+  (dolist [e (poller-wait (carrier-poller c) timeout)]
+    (if (eqv? (car e) wake-fd)
+      (begin
+        (read-byte (carrier-wake-in c))
+        (with-carrier c (carrier-notified-set! c #f))
+        (poller-set! (carrier-poller c) wake-fd POLLER_READ))
+      (io-ready! c (car e) (cdr e)))))
+
+(define (carrier-exit? c)
+  (and (~ (carrier-scheduler c)'shut-down)
+       (with-carrier c (zero? (carrier-nfibers c)))))
+
+(define (carrier-loop c)
+  (tlset! current-carrier c)
+  (let loop ()
+    (run-queued! c)
+    (unless (carrier-exit? c)
+      (poll-io! c)
+      (fire-timers! c)
+      (loop)))
+  (poller-close (carrier-poller c)))
+
+;;
+;; Scheduler
+;;
+
+(define-class <fiber-scheduler> ()
+  ((num-carriers :init-keyword :num-carriers)
+   ;; the rest of slots are private
+   (carriers     :init-value #f)        ; vector of carrier
+   (lock         :init-form (make-mutex))
+   (next         :init-value 0)         ; round-robin index; under lock
+   (shut-down    :init-value #f)))
+
+(define (make-fiber-scheduler :optional (num-carriers
+                                         (sys-available-processors)))
+  (assume (and (exact-integer? num-carriers) (positive? num-carriers))
+          "num-carriers must be a positive exact integer, but got:"
+          num-carriers)
+  (make <fiber-scheduler> :num-carriers num-carriers))
+
+(define-method initialize ((s <fiber-scheduler>) initargs)
+  (next-method)
+  (set! (~ s'carriers)
+        (list->vector
+         (list-tabulate
+          (~ s'num-carriers)
+          (^i (rlet1 c (make-carrier s)
+                (carrier-thread-set!
+                 c (thread-start!
+                    (make-thread (cut carrier-loop c)
+                                 (string->symbol #"fiber-carrier-~i"))))))))))
+
+(define (fiber-scheduler? obj) (is-a? obj <fiber-scheduler>))
+
+(define (fiber-scheduler-num-carriers s) (~ s'num-carriers))
+
+(define *default-scheduler* #f)
+(define *default-scheduler-lock* (make-mutex))
+
+;; The shared scheduler, created on demand.
+(define (default-fiber-scheduler)
+  (or *default-scheduler*
+      (with-locking-mutex *default-scheduler-lock*
+        (^[] (or *default-scheduler*
+                 (rlet1 s (make-fiber-scheduler)
+                   (set! *default-scheduler* s)))))))
+
+;; API
+;; Carriers exit after all the fibers finish.
+(define (fiber-scheduler-shutdown! s)
+  (assume-type s <fiber-scheduler>)
+  (set! (~ s'shut-down) #t)
+  (vector-for-each carrier-notify! (~ s'carriers))
+  (unless (and-let1 c (tlref current-carrier)
+            (eq? (carrier-scheduler c) s))
+    (vector-for-each (^c (thread-join! (carrier-thread c))) (~ s'carriers)))
+  (undefined))
+
+;; API
+(define (spawn-fiber thunk :key (name #f)
+                                (scheduler (default-fiber-scheduler)))
+  (assume-type scheduler <fiber-scheduler>)
+  (when (~ scheduler'shut-down)
+    (error "fiber scheduler has been shut down:" scheduler))
+  (let* ([cs (~ scheduler'carriers)]
+         [c (with-locking-mutex (~ scheduler'lock)
+              (^[] (rlet1 c (vector-ref cs (~ scheduler'next))
+                     (set! (~ scheduler'next)
+                           (modulo (+ (~ scheduler'next) 1)
+                                   (vector-length cs))))))]
+         [f (%make-fiber name thunk c #f #f 'suspended 0 #f '()
+                         (make-mutex) (make-condition-variable))])
+    (with-carrier c (carrier-nfibers-set! c (+ (carrier-nfibers c) 1)))
+    (wake! f 0 #f)
+    f))
+
+;; API
+(define (current-fiber) (tlref %current-fiber))
+
+;; API
+(define (fiber-yield)
+  (if (current-fiber)
+    (%suspend (^[f epoch] (wake! f epoch #t)))
+    (thread-yield!))
+  (undefined))
+
+;; API
+(define (fiber-sleep secs)
+  (if (current-fiber)
+    (let1 deadline (+ (now) secs)
+      (%suspend (^[f epoch]
+                  (add-timer! (fiber-carrier f) deadline f epoch #t))))
+    (thread-sleep! secs))
+  (undefined))
+
+;; API
+;; If called from a fiber, only the calling fiber waits.  Otherwise
+;; the calling thread blocks.
+(define (fiber-join f :optional (timeout #f) (timeout-val #f))
+  (assume-type f fiber)
+  (let1 abstime (absolute-time timeout)
+    (define (result)
+      (if (eq? (fiber-state f) 'done)
+        (apply values (fiber-result f))
+        (raise (fiber-result f))))
+    (define (join-in-fiber)
+      (%suspend
+       (^[self epoch]
+         (mutex-lock! (fiber-lock f))
+         (if (fiber-finished? f)
+           (begin (mutex-unlock! (fiber-lock f))
+                  (wake! self epoch #t))
+           (begin (push! (fiber-waiters f) (cons self epoch))
+                  (mutex-unlock! (fiber-lock f))
+                  (when abstime
+                    (add-timer! (fiber-carrier self) (time->seconds abstime)
+                                self epoch #f)))))))
+    (define (join-in-thread)
+      (mutex-lock! (fiber-lock f))
+      (if (fiber-finished? f)
+        (begin (mutex-unlock! (fiber-lock f)) #t)
+        (and (mutex-unlock! (fiber-lock f) (fiber-cv f) abstime)
+             (join-in-thread))))
+    (cond [(fiber-finished? f) (result)]
+          [(eq? f (current-fiber)) (error "fiber can't join itself:" f)]
+          [(if (current-fiber) (join-in-fiber) (join-in-thread)) (result)]
+          [else timeout-val])))
+
+;;
+;; I/O
+;;
+
+(define (->fd obj)
+  (cond [(exact-integer? obj) obj]
+        [(is-a? obj <socket>) (socket-fd obj)]
+        [(and (port? obj) (port-file-number obj))]
+        [else (error "port, socket or file descriptor required, but got:"
+                     obj)]))
+
+;; Returns #t if FD gets ready, #f on timeout.
+(define (wait-io obj dir timeout)
+  (define fd (->fd obj))
+  (define index (if (= dir POLLER_READ) 0 1))
+  (define (wait-in-fiber c)
+    (let* ([tab (carrier-io-waiters c)]
+           [w (or (hash-table-get tab fd #f)
+                  (rlet1 w (make-vector 2 #f) (hash-table-put! tab fd w)))]
+           [deadline (and timeout (+ (now) timeout))])
+      (and-let1 r (vector-ref w index)
+        (when (and (eq? (fiber-state (car r)) 'suspended)
+                   (eqv? (fiber-epoch (car r)) (cdr r)))
+          (error "another fiber is waiting on the same fd:" fd)))
+      (%suspend
+       (^[f epoch]
+         (vector-set! w index (cons f epoch))
+         (cond [(poller-set! (carrier-poller c) fd (io-mask w))
+                (when deadline (add-timer! c deadline f epoch #f))]
+               [else
+                ;; FD isn't pollable (e.g. a regular file).  It's always
+                ;; ready.
+                (vector-set! w index #f)
+                (when (zero? (io-mask w)) (hash-table-delete! tab fd))
+                (wake! f epoch #t)])))))
+  (define (wait-in-thread)
+    (let ([fds (sys-fdset fd)]
+          [us (and timeout (exact (round (* timeout 1e6))))])
+      (receive (n . _) (if (= dir POLLER_READ)
+                         (sys-select fds #f #f us)
+                         (sys-select #f fds #f us))
+        (> n 0))))
+  (if (current-fiber)
+    (wait-in-fiber (fiber-carrier (current-fiber)))
+    (wait-in-thread)))
+
+;; API
+(define (fiber-wait-readable obj :optional (timeout #f))
+  (wait-io obj POLLER_READ timeout))
+
+;; API
+(define (fiber-wait-writable obj :optional (timeout #f))
+  (wait-io obj POLLER_WRITE timeout))
+
+;; API
+;; The listening socket is made nonblocking, so that we won't block
+;; if other process takes the connection before us.
+(define (fiber-socket-accept sock)
+  (let1 fd (socket-fd sock)
+    (sys-fcntl fd F_SETFL (logior O_NONBLOCK (sys-fcntl fd F_GETFL)))
+    (let loop ()
+      (or (socket-accept sock)
+          (begin (fiber-wait-readable fd) (loop))))))
+
+;; API
+(define (fiber-socket-recv sock bytes :optional (flags 0))
+  (let1 fd (socket-fd sock)
+    (let loop ()
+      (or (%recv-nonblock fd bytes flags)
+          (begin (fiber-wait-readable fd) (loop))))))
+
+;; API
+;; Unlike socket-send, this sends the entire MSG.  Returns the number
+;; of bytes sent.
+(define (fiber-socket-send sock msg :optional (flags 0))
+  (let ([fd (socket-fd sock)]
+        [size (if (string? msg) (string-size msg) (uvector-size msg))])
+    (let loop ([start 0])
+      (if (>= start size)
+        size
+        (if-let1 n (%send-nonblock fd msg start flags)
+          (loop (+ start n))
+          (begin (fiber-wait-writable fd) (loop start)))))))
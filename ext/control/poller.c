@@ -0,0 +1,343 @@
+/*
+ * poller.c - I/O readiness notification for control.fiber
+ *
+ *   Copyright (c) 2024  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "poller.h"
+#include <errno.h>
+#include <unistd.h>
+
+#if defined(HAVE_SYS_EPOLL_H)
+#include <sys/epoll.h>
+#define USE_EPOLL 1
+#elif defined(HAVE_POLL_H)
+#include <poll.h>
+#define USE_POLL 1
+#endif
+
+#if defined(USE_EPOLL) || defined(USE_POLL)
+#include <sys/types.h>
+#include <sys/socket.h>
+#endif
+
+/* Without MSG_DONTWAIT, we rely on the caller that waits for readiness
+   before calling NonblockRecv/NonblockSend.  It may block on a spurious
+   wakeup, but won't fail. */
+#if !defined(MSG_DONTWAIT)
+#define MSG_DONTWAIT 0
+#endif
+
+#define MAX_EVENTS 256
+
+#if defined(USE_EPOLL)
+
+/*=================================================================
+ * epoll
+ */
+
+struct PollerRec {
+    int epfd;                   /* -1 if closed */
+};
+
+Poller *PollerNew(void)
+{
+    int fd = epoll_create1(EPOLL_CLOEXEC);
+    if (fd < 0) Scm_SysError("epoll_create1 failed");
+    Poller *p = SCM_NEW_ATOMIC(Poller);
+    p->epfd = fd;
+    return p;
+}
+
+void PollerClose(Poller *p)
+{
+    if (p->epfd >= 0) {
+        close(p->epfd);
+        p->epfd = -1;
+    }
+}
+
+int PollerClosedP(Poller *p)
+{
+    return p->epfd < 0;
+}
+
+int PollerSet(Poller *p, int fd, int events)
+{
+    if (p->epfd < 0) Scm_Error("poller already closed");
+    if (events == 0) {
+        /* The fd may already be closed, in which case the kernel has
+           removed it for us. */
+        if (epoll_ctl(p->epfd, EPOLL_CTL_DEL, fd, NULL) < 0
+            && errno != ENOENT && errno != EBADF) {
+            Scm_SysError("epoll_ctl(DEL) failed on fd %d", fd);
+        }
+        return TRUE;
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLONESHOT;
+    if (events & POLLER_READ)  ev.events |= EPOLLIN;
+    if (events & POLLER_WRITE) ev.events |= EPOLLOUT;
+    ev.data.fd = fd;
+
+    /* Once registered, a disarmed one-shot fd stays in the interest list,
+       so MOD is the common case. */
+    if (epoll_ctl(p->epfd, EPOLL_CTL_MOD, fd, &ev) == 0) return TRUE;
+    if (errno == ENOENT) {
+        if (epoll_ctl(p->epfd, EPOLL_CTL_ADD, fd, &ev) == 0) return TRUE;
+    }
+    if (errno == EPERM) return FALSE; /* fd doesn't support polling */
+    Scm_SysError("epoll_ctl failed on fd %d", fd);
+    return FALSE;               /* dummy */
+}
+
+ScmObj PollerWait(Poller *p, long timeout)
+{
+    struct epoll_event evs[MAX_EVENTS];
+    if (p->epfd < 0) Scm_Error("poller already closed");
+    int n = epoll_wait(p->epfd, evs, MAX_EVENTS,
+                       timeout < 0 ? -1 : (int)timeout);
+    if (n < 0) {
+        if (errno == EINTR) {
+            Scm_SigCheck(Scm_VM());
+            return SCM_NIL;
+        }
+        Scm_SysError("epoll_wait failed");
+    }
+
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    for (int i = 0; i < n; i++) {
+        int e = 0;
+        if (evs[i].events & EPOLLIN)  e |= POLLER_READ;
+        if (evs[i].events & EPOLLOUT) e |= POLLER_WRITE;
+        if (evs[i].events & (EPOLLERR|EPOLLHUP)) e |= POLLER_READ|POLLER_WRITE;
+        SCM_APPEND1(h, t, Scm_Cons(SCM_MAKE_INT(evs[i].data.fd),
+                                   SCM_MAKE_INT(e)));
+    }
+    return h;
+}
+
+#endif /* USE_EPOLL */
+
+#if defined(USE_POLL)
+
+/*=================================================================
+ * poll
+ */
+
+struct PollerRec {
+    int closed;
+    int nfds;
+    int size;
+    struct pollfd *fds;
+};
+
+Poller *PollerNew(void)
+{
+    Poller *p = SCM_NEW(Poller);
+    p->closed = FALSE;
+    p->nfds = 0;
+    p->size = 16;
+    p->fds = SCM_NEW_ATOMIC_ARRAY(struct pollfd, p->size);
+    return p;
+}
+
+void PollerClose(Poller *p)
+{
+    p->closed = TRUE;
+    p->nfds = 0;
+}
+
+int PollerClosedP(Poller *p)
+{
+    return p->closed;
+}
+
+static int find_fd(Poller *p, int fd)
+{
+    for (int i = 0; i < p->nfds; i++) {
+        if (p->fds[i].fd == fd) return i;
+    }
+    return -1;
+}
+
+static void remove_at(Poller *p, int i)
+{
+    p->fds[i] = p->fds[--p->nfds];
+}
+
+int PollerSet(Poller *p, int fd, int events)
+{
+    if (p->closed) Scm_Error("poller already closed");
+    int i = find_fd(p, fd);
+    if (events == 0) {
+        if (i >= 0) remove_at(p, i);
+        return TRUE;
+    }
+    if (i < 0) {
+        if (p->nfds == p->size) {
+            int newsize = p->size * 2;
+            struct pollfd *newfds =
+                SCM_NEW_ATOMIC_ARRAY(struct pollfd, newsize);
+            memcpy(newfds, p->fds, sizeof(struct pollfd) * p->nfds);
+            p->fds = newfds;
+            p->size = newsize;
+        }
+        i = p->nfds++;
+        p->fds[i].fd = fd;
+    }
+    p->fds[i].events = 0;
+    p->fds[i].revents = 0;
+    if (events & POLLER_READ)  p->fds[i].events |= POLLIN;
+    if (events & POLLER_WRITE) p->fds[i].events |= POLLOUT;
+    return TRUE;
+}
+
+ScmObj PollerWait(Poller *p, long timeout)
+{
+    if (p->closed) Scm_Error("poller already closed");
+    int n = poll(p->fds, p->nfds, timeout < 0 ? -1 : (int)timeout);
+    if (n < 0) {
+        if (errno == EINTR) {
+            Scm_SigCheck(Scm_VM());
+            return SCM_NIL;
+        }
+        Scm_SysError("poll failed");
+    }
+
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    for (int i = 0; i < p->nfds && n > 0; ) {
+        short r = p->fds[i].revents;
+        if (r == 0) { i++; continue; }
+        int e = 0;
+        if (r & POLLIN)  e |= POLLER_READ;
+        if (r & POLLOUT) e |= POLLER_WRITE;
+        if (r & (POLLERR|POLLHUP|POLLNVAL)) e |= POLLER_READ|POLLER_WRITE;
+        SCM_APPEND1(h, t, Scm_Cons(SCM_MAKE_INT(p->fds[i].fd),
+                                   SCM_MAKE_INT(e)));
+        remove_at(p, i);        /* one-shot */
+        n--;
+    }
+    return h;
+}
+
+#endif /* USE_POLL */
+
+#if defined(USE_EPOLL) || defined(USE_POLL)
+
+/*=================================================================
+ * Nonblocking socket I/O
+ */
+
+ScmObj NonblockRecv(int fd, ScmSmallInt bytes, int flags)
+{
+    ssize_t r;
+    if (bytes < 0) Scm_Error("bytes must be nonnegative, but got %ld", bytes);
+    char *buf = SCM_NEW_ATOMIC2(char*, bytes);
+    SCM_SYSCALL(r, recv(fd, buf, bytes, flags|MSG_DONTWAIT));
+    if (r < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return SCM_FALSE;
+        Scm_SysError("recv(2) failed");
+    }
+    return Scm_MakeString(buf, r, r, SCM_STRING_INCOMPLETE);
+}
+
+ScmObj NonblockSend(int fd, ScmObj msg, ScmSmallInt start, int flags)
+{
+    ssize_t r;
+    ScmSmallInt size;
+    const char *p;
+    if (SCM_UVECTORP(msg)) {
+        size = Scm_UVectorSizeInBytes(SCM_UVECTOR(msg));
+        p = (const char*)SCM_UVECTOR_ELEMENTS(msg);
+    } else if (SCM_STRINGP(msg)) {
+        p = Scm_GetStringContent(SCM_STRING(msg), &size, NULL, NULL);
+    } else {
+        Scm_TypeError("msg", "uniform vector or string", msg);
+        return SCM_UNDEFINED;   /* dummy */
+    }
+    if (start < 0 || start > size) {
+        Scm_Error("start offset out of range: %ld", start);
+    }
+    SCM_SYSCALL(r, send(fd, p + start, size - start, flags|MSG_DONTWAIT));
+    if (r < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return SCM_FALSE;
+        Scm_SysError("send(2) failed");
+    }
+    return Scm_MakeInteger(r);
+}
+
+#else  /* !USE_EPOLL && !USE_POLL */
+
+struct PollerRec {
+    int dummy;
+};
+
+Poller *PollerNew(void)
+{
+    Scm_Error("fiber poller isn't supported on this platform");
+    return NULL;                /* dummy */
+}
+
+void PollerClose(Poller *p SCM_UNUSED)
+{
+}
+
+int PollerClosedP(Poller *p SCM_UNUSED)
+{
+    return TRUE;
+}
+
+int PollerSet(Poller *p SCM_UNUSED, int fd SCM_UNUSED, int events SCM_UNUSED)
+{
+    return FALSE;
+}
+
+ScmObj PollerWait(Poller *p SCM_UNUSED, long timeout SCM_UNUSED)
+{
+    return SCM_NIL;
+}
+
+ScmObj NonblockRecv(int fd SCM_UNUSED, ScmSmallInt bytes SCM_UNUSED,
+                    int flags SCM_UNUSED)
+{
+    Scm_Error("nonblocking recv isn't supported on this platform");
+    return SCM_UNDEFINED;       /* dummy */
+}
+
+ScmObj NonblockSend(int fd SCM_UNUSED, ScmObj msg SCM_UNUSED,
+                    ScmSmallInt start SCM_UNUSED, int flags SCM_UNUSED)
+{
+    Scm_Error("nonblocking send isn't supported on this platform");
+    return SCM_UNDEFINED;       /* dummy */
+}
+
+#endif /* !USE_EPOLL && !USE_POLL */
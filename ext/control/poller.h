@@ -0,0 +1,77 @@
+/*
+ * poller.h - I/O readiness notification for control.fiber
+ *
+ *   Copyright (c) 2024  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_POLLER_H
+#define GAUCHE_POLLER_H
+
+#include <gauche.h>
+#include <gauche/extend.h>
+
+/* Poller watches a set of file descriptors and tells which ones are
+ * ready.  We use epoll if available, poll otherwise.  It is used by
+ * the fiber scheduler; each carrier thread owns one, so it is not
+ * thread safe.
+ *
+ * Registration is one-shot: once an fd is reported, it is not watched
+ * until it is registered again by PollerSet.
+ */
+
+enum {
+    POLLER_READ  = 1,
+    POLLER_WRITE = 2
+};
+
+typedef struct PollerRec Poller;
+
+extern Poller *PollerNew(void);
+extern void    PollerClose(Poller *p);
+extern int     PollerClosedP(Poller *p);
+
+/* Watch FD for EVENTS (logior of POLLER_READ and POLLER_WRITE).  If EVENTS
+   is 0, stop watching FD.  Returns FALSE if FD can't be watched (e.g. it's
+   a regular file, which is always ready). */
+extern int     PollerSet(Poller *p, int fd, int events);
+
+/* Wait until some of the fds get ready, or TIMEOUT (in milliseconds,
+   negative for no timeout) elapses.  Returns a list of (fd . events).
+   An error or hangup on an fd is reported as both READ and WRITE. */
+extern ScmObj  PollerWait(Poller *p, long timeout);
+
+/* Nonblocking socket I/O.  These return #f instead of blocking when
+   the operation can't proceed.  NonblockRecv returns an incomplete
+   string, NonblockSend returns the number of bytes sent from the
+   START-th byte of MSG. */
+extern ScmObj  NonblockRecv(int fd, ScmSmallInt bytes, int flags);
+extern ScmObj  NonblockSend(int fd, ScmObj msg, ScmSmallInt start, int flags);
+
+#endif /*GAUCHE_POLLER_H*/
@@ -0,0 +1,176 @@
+;;
+;; testing control.fiber
+;;
+
+(use gauche.test)
+(use gauche.threads)
+(use gauche.net)
+(test-start "control.fiber")
+
+(use control.fiber)
+(test-module 'control.fiber)
+
+(define sched (make-fiber-scheduler 2))
+
+(test-section "basics")
+
+(test* "spawn and join" '(1 2)
+       (values->list
+        (fiber-join (spawn-fiber (^[] (values 1 2)) :scheduler sched))))
+
+(test* "name" 'foo
+       (fiber-name (spawn-fiber (^[] #t) :name 'foo :scheduler sched)))
+
+(test* "current-fiber" '(#f #t)
+       (list (current-fiber)
+             (let1 f (spawn-fiber (^[] (current-fiber)) :scheduler sched)
+               (eq? (fiber-join f) f))))
+
+(test* "error" (test-error <error> "oops")
+       (fiber-join (spawn-fiber (^[] (error "oops")) :scheduler sched)))
+
+(test* "fiber-done?" #t
+       (let1 f (spawn-fiber (^[] 'ok) :scheduler sched)
+         (fiber-join f)
+         (fiber-done? f)))
+
+(test* "join timeout" 'timeout
+       (fiber-join (spawn-fiber (^[] (fiber-sleep 1)) :scheduler sched)
+                   0.05 'timeout))
+
+(test-section "scheduling")
+
+;; Fibers on the same carrier interleave at yield points.  The fibers
+;; are spawned from a fiber so that they don't start until it finishes.
+(test* "yield" '(a b a b a b)
+       (let* ([s (make-fiber-scheduler 1)]
+              [log '()]
+              [fs (fiber-join
+                   (spawn-fiber
+                    (^[] (map (^[tag]
+                                (spawn-fiber
+                                 (^[] (dotimes [i 3]
+                                        (push! log tag)
+                                        (fiber-yield)))
+                                 :scheduler s))
+                              '(a b)))
+                    :scheduler s))])
+         (for-each fiber-join fs)
+         (fiber-scheduler-shutdown! s)
+         (reverse log)))
+
+(test* "sleep order" '(1 2 3)
+       (let* ([q (atom '())]
+              [fs (map (^n (spawn-fiber
+                            (^[] (fiber-sleep (* n 0.02))
+                                 (atomic-update! q (cut cons n <>)))
+                            :scheduler sched))
+                       '(3 1 2))])
+         (for-each fiber-join fs)
+         (reverse (atom-ref q))))
+
+(test* "many fibers" 50005000
+       (let1 fs (map (^i (spawn-fiber (^[] (fiber-yield) i) :scheduler sched))
+                     (iota 10000 1))
+         (fold (^[f s] (+ (fiber-join f) s)) 0 fs)))
+
+(test* "join from fiber" 'inner
+       (fiber-join
+        (spawn-fiber
+         (^[] (fiber-join (spawn-fiber (^[] (fiber-sleep 0.01) 'inner)
+                                       :scheduler sched)))
+         :scheduler sched)))
+
+(test* "join from fiber, timeout" 'timeout
+       (fiber-join
+        (spawn-fiber
+         (^[] (fiber-join (spawn-fiber (^[] (fiber-sleep 1))
+                                       :scheduler sched)
+                          0.02 'timeout))
+         :scheduler sched)))
+
+(test-section "I/O")
+
+(test* "wait-readable" "hello"
+       (receive (in out) (sys-pipe)
+         (let1 reader (spawn-fiber
+                       (^[] (fiber-wait-readable in) (read-line in))
+                       :scheduler sched)
+           (spawn-fiber (^[] (fiber-sleep 0.02)
+                             (display "hello\n" out) (flush out))
+                        :scheduler sched)
+           (begin0 (fiber-join reader)
+             (close-port in)
+             (close-port out)))))
+
+(test* "wait-readable timeout" #f
+       (receive (in out) (sys-pipe)
+         (begin0 (fiber-join
+                  (spawn-fiber (^[] (fiber-wait-readable in 0.02))
+                               :scheduler sched))
+           (close-port in)
+           (close-port out))))
+
+(test* "wait-writable" #t
+       (receive (in out) (sys-pipe)
+         (begin0 (fiber-join
+                  (spawn-fiber (^[] (fiber-wait-writable out 1))
+                               :scheduler sched))
+           (close-port in)
+           (close-port out))))
+
+(sys-unlink "fiber-sock.o")
+
+(test* "echo server" (map (^i (format "~a:~a" i (make-string 1000 #\x)))
+                          (iota 20))
+       (let* ([server (make-server-socket 'unix "fiber-sock.o")]
+              [handle (^[sock]
+                        (let loop ()
+                          (let1 s (fiber-socket-recv sock 4096)
+                            (unless (zero? (string-size s))
+                              (fiber-socket-send sock s)
+                              (loop))))
+                        (socket-close sock))]
+              [acceptor (spawn-fiber
+                         (^[] (dotimes [i 20]
+                                (let1 sock (fiber-socket-accept server)
+                                  (spawn-fiber (cut handle sock)
+                                               :scheduler sched))))
+                         :scheduler sched)]
+              [clients
+               (map (^i (spawn-fiber
+                         (^[] (let* ([sock (make-client-socket 'unix
+                                                               "fiber-sock.o")]
+                                     [msg (format "~a:~a" i
+                                                  (make-string 1000 #\x))])
+                                (fiber-socket-send sock msg)
+                                (socket-shutdown sock SHUT_WR)
+                                (let loop ([r '()])
+                                  (let1 s (fiber-socket-recv sock 4096)
+                                    (if (zero? (string-size s))
+                                      (begin
+                                        (socket-close sock)
+                                        (string-incomplete->complete
+                                         (apply string-append (reverse r))))
+                                      (loop (cons s r)))))))
+                         :scheduler sched))
+                    (iota 20))])
+         (begin0 (map fiber-join clients)
+           (fiber-join acceptor)
+           (socket-close server))))
+
+(sys-unlink "fiber-sock.o")
+
+(test-section "shutdown")
+
+(test* "shutdown waits for fibers" 'done
+       (let* ([s (make-fiber-scheduler 2)]
+              [f (spawn-fiber (^[] (fiber-sleep 0.05) 'done) :scheduler s)])
+         (fiber-scheduler-shutdown! s)
+         (fiber-join f)))
+
+(test* "spawn after shutdown" (test-error)
+       (begin (fiber-scheduler-shutdown! sched)
+              (spawn-fiber (^[] #t) :scheduler sched)))
+
+(test-end)
@@ -0,0 +1,250 @@
+/*
+ * mpmcq.c - bounded lock-free multi-producer multi-consumer queue
+ *
+ *   Copyright (c) 2024  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "mpmcq.h"
+
+/* NB: Positions increase monotonically and may wrap around.  We always
+   compare them by the signed difference. */
+#define POS_DIFF(a, b)  ((intptr_t)((ScmAtomicWord)(a) - (ScmAtomicWord)(b)))
+#define CELL(q, pos)    (&(q)->cells[(pos) & ((q)->capacity - 1)])
+
+void MpmcQueueInit(ScmMpmcQueue *q, ScmSize capacity)
+{
+    if (capacity < 1) Scm_Error("capacity must be positive, but got %ld",
+                                capacity);
+    /* The algorithm needs at least two cells; with one cell, 'filled for
+       pos' and 'free for pos+1' would be indistinguishable. */
+    ScmSize size = 2;
+    while (size < capacity) size <<= 1;
+
+    q->capacity = size;
+    q->cells = SCM_NEW_ARRAY(MpmcCell, size);
+    for (ScmSize i = 0; i < size; i++) {
+        AO_store(&q->cells[i].seq, (ScmAtomicWord)i);
+        q->cells[i].value = SCM_FALSE;
+    }
+    AO_store(&q->enqPos, 0);
+    AO_store(&q->deqPos, 0);
+    AO_store(&q->closed, 0);
+    AO_store(&q->readersWaiting, 0);
+    AO_store(&q->writersWaiting, 0);
+    SCM_INTERNAL_MUTEX_INIT(q->mutex);
+    SCM_INTERNAL_COND_INIT(q->readerWait);
+    SCM_INTERNAL_COND_INIT(q->writerWait);
+}
+
+ScmSize MpmcQueueLength(ScmMpmcQueue *q)
+{
+    ScmAtomicWord d = AO_load(&q->deqPos);
+    ScmAtomicWord e = AO_load(&q->enqPos);
+    intptr_t len = POS_DIFF(e, d);
+    if (len < 0) return 0;
+    if (len > q->capacity) return q->capacity;
+    return (ScmSize)len;
+}
+
+/*
+ * Lock-free part
+ */
+
+static ScmSize try_enqueue(ScmMpmcQueue *q, ScmObj *objs, ScmSize n, int all)
+{
+    if (n <= 0) return 0;
+    if (all && n > q->capacity) {
+        Scm_Error("too many items (%ld) for the queue capacity (%ld)",
+                  n, q->capacity);
+    }
+    ScmAtomicWord pos = AO_load(&q->enqPos);
+    for (;;) {
+        /* Count free cells from pos. */
+        ScmSize k = 0;
+        intptr_t dif = 0;
+        while (k < n) {
+            dif = POS_DIFF(AO_load(&CELL(q, pos+k)->seq), pos+k);
+            if (dif != 0) break;
+            k++;
+        }
+        if (k == 0 || (all && k < n)) {
+            /* If dif < 0, the cell is still occupied by the previous lap;
+               the queue is full (at least for N items).  Otherwise, other
+               producer has taken pos; retry. */
+            if (dif < 0) return 0;
+            pos = AO_load(&q->enqPos);
+            continue;
+        }
+        ScmAtomicWord expected = pos;
+        if (AO_compare_and_swap_full(&q->enqPos, expected, pos+k)) {
+            for (ScmSize i = 0; i < k; i++) {
+                MpmcCell *c = CELL(q, pos+i);
+                c->value = objs[i];
+                AO_store(&c->seq, pos+i+1);
+            }
+            return k;
+        }
+        pos = AO_load(&q->enqPos);
+    }
+}
+
+static ScmSize try_dequeue(ScmMpmcQueue *q, ScmObj *buf, ScmSize max)
+{
+    if (max <= 0) return 0;
+    ScmAtomicWord pos = AO_load(&q->deqPos);
+    for (;;) {
+        /* Count filled cells from pos. */
+        ScmSize k = 0;
+        intptr_t dif = 0;
+        while (k < max) {
+            dif = POS_DIFF(AO_load(&CELL(q, pos+k)->seq), pos+k+1);
+            if (dif != 0) break;
+            k++;
+        }
+        if (k == 0) {
+            if (dif < 0) return 0; /* empty */
+            pos = AO_load(&q->deqPos);
+            continue;
+        }
+        ScmAtomicWord expected = pos;
+        if (AO_compare_and_swap_full(&q->deqPos, expected, pos+k)) {
+            for (ScmSize i = 0; i < k; i++) {
+                MpmcCell *c = CELL(q, pos+i);
+                buf[i] = c->value;
+                c->value = SCM_FALSE; /* to be friendly to GC */
+                AO_store(&c->seq, pos+i+q->capacity);
+            }
+            return k;
+        }
+        pos = AO_load(&q->deqPos);
+    }
+}
+
+/* NB: The waiter increments the counter and retries the operation while
+   holding the mutex; the other side updates the queue and then checks
+   the counter.  Since all of them are sequentially consistent, either
+   the waiter sees the update, or the other side sees the counter and
+   broadcasts after the waiter starts waiting. */
+static void notify(ScmMpmcQueue *q, ScmAtomicVar *counter,
+                   ScmInternalCond *cv)
+{
+    if (AO_load(counter) > 0) {
+        SCM_INTERNAL_MUTEX_LOCK(q->mutex);
+        SCM_INTERNAL_COND_BROADCAST(*cv);
+        SCM_INTERNAL_MUTEX_UNLOCK(q->mutex);
+    }
+}
+
+#define notify_readers(q) notify(q, &(q)->readersWaiting, &(q)->readerWait)
+#define notify_writers(q) notify(q, &(q)->writersWaiting, &(q)->writerWait)
+
+static void check_closed(ScmMpmcQueue *q)
+{
+    if (AO_load(&q->closed)) Scm_Error("queue is closed: %S", q);
+}
+
+ScmSize MpmcQueueEnqueue(ScmMpmcQueue *q, ScmObj *objs, ScmSize n, int all)
+{
+    check_closed(q);
+    ScmSize k = try_enqueue(q, objs, n, all);
+    if (k > 0) notify_readers(q);
+    return k;
+}
+
+ScmSize MpmcQueueDequeue(ScmMpmcQueue *q, ScmObj *buf, ScmSize max)
+{
+    ScmSize k = try_dequeue(q, buf, max);
+    if (k > 0) notify_writers(q);
+    return k;
+}
+
+/*
+ * Blocking part
+ */
+
+/* Wait on CV while holding mutex.  Returns the status of timedwait. */
+static int wait_cv(ScmMpmcQueue *q, ScmInternalCond *cv, ScmTimeSpec *pts)
+{
+    if (pts) {
+        return SCM_INTERNAL_COND_TIMEDWAIT(*cv, q->mutex, pts);
+    } else {
+        SCM_INTERNAL_COND_WAIT(*cv, q->mutex);
+        return 0;
+    }
+}
+
+ScmSize MpmcQueueEnqueueWait(ScmMpmcQueue *q, ScmObj *objs, ScmSize n,
+                             ScmTimeSpec *pts)
+{
+    if (n <= 0) return 0;
+    for (;;) {
+        check_closed(q);
+        ScmSize k = try_enqueue(q, objs, n, FALSE);
+        int r = 0;
+        if (k == 0) {
+            SCM_INTERNAL_MUTEX_SAFE_LOCK_BEGIN(q->mutex);
+            AO_store(&q->writersWaiting, AO_load(&q->writersWaiting) + 1);
+            k = try_enqueue(q, objs, n, FALSE);
+            if (k == 0) r = wait_cv(q, &q->writerWait, pts);
+            AO_store(&q->writersWaiting, AO_load(&q->writersWaiting) - 1);
+            SCM_INTERNAL_MUTEX_SAFE_LOCK_END();
+        }
+        if (k > 0) {
+            notify_readers(q);
+            return k;
+        }
+        if (r == SCM_INTERNAL_COND_TIMEDOUT) return 0;
+        if (r == SCM_INTERNAL_COND_INTR) Scm_SigCheck(Scm_VM());
+    }
+}
+
+ScmSize MpmcQueueDequeueWait(ScmMpmcQueue *q, ScmObj *buf, ScmSize max,
+                             ScmTimeSpec *pts)
+{
+    if (max <= 0) return 0;
+    for (;;) {
+        ScmSize k = try_dequeue(q, buf, max);
+        int r = 0;
+        if (k == 0) {
+            SCM_INTERNAL_MUTEX_SAFE_LOCK_BEGIN(q->mutex);
+            AO_store(&q->readersWaiting, AO_load(&q->readersWaiting) + 1);
+            k = try_dequeue(q, buf, max);
+            if (k == 0) r = wait_cv(q, &q->readerWait, pts);
+            AO_store(&q->readersWaiting, AO_load(&q->readersWaiting) - 1);
+            SCM_INTERNAL_MUTEX_SAFE_LOCK_END();
+        }
+        if (k > 0) {
+            notify_writers(q);
+            return k;
+        }
+        if (r == SCM_INTERNAL_COND_TIMEDOUT) return 0;
+        if (r == SCM_INTERNAL_COND_INTR) Scm_SigCheck(Scm_VM());
+    }
+}
@@ -0,0 +1,103 @@
+/*
+ * mpmcq.h - bounded lock-free multi-producer multi-consumer queue
+ *
+ *   Copyright (c) 2024  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_MPMCQ_H
+#define GAUCHE_MPMCQ_H
+
+#include <gauche.h>
+#include <gauche/extend.h>
+#include <gauche/priv/atomicP.h>
+
+/* A bounded queue based on Dmitry Vyukov's ring buffer algorithm.
+ *
+ * Each cell has a sequence number.  A cell at position POS is free
+ * for the producer of POS if its seq is POS, and filled for the
+ * consumer of POS if its seq is POS+1.  Producers and consumers claim
+ * positions by CAS on enqPos and deqPos respectively, so they don't
+ * block each other as long as the queue is neither full nor empty.
+ * Batch operations claim a range of consecutive positions with a single
+ * CAS.
+ *
+ * Blocking operations use the mutex and condition variables only when
+ * the queue is empty (for readers) or full (for writers).  The number of
+ * waiting threads is counted, so that the other side only needs to take
+ * the mutex when somebody is waiting.
+ */
+
+#define MPMCQ_CACHE_LINE 64
+
+typedef struct MpmcCellRec {
+    ScmAtomicVar seq;
+    ScmObj value;
+} MpmcCell;
+
+typedef struct ScmMpmcQueueRec {
+    SCM_INSTANCE_HEADER;
+    ScmSize capacity;           /* power of 2 */
+    MpmcCell *cells;
+    char pad0[MPMCQ_CACHE_LINE];
+    ScmAtomicVar enqPos;
+    char pad1[MPMCQ_CACHE_LINE];
+    ScmAtomicVar deqPos;
+    char pad2[MPMCQ_CACHE_LINE];
+    ScmAtomicVar closed;
+    ScmAtomicVar readersWaiting; /* modified only while holding mutex */
+    ScmAtomicVar writersWaiting; /* ditto */
+    ScmInternalMutex mutex;
+    ScmInternalCond readerWait;
+    ScmInternalCond writerWait;
+} ScmMpmcQueue;
+
+/* CAPACITY is rounded up to a power of 2, at least 2. */
+extern void    MpmcQueueInit(ScmMpmcQueue *q, ScmSize capacity);
+
+/* The number of items.  It's just a snapshot under concurrent access. */
+extern ScmSize MpmcQueueLength(ScmMpmcQueue *q);
+
+/* Nonblocking operations.  MpmcQueueEnqueue enqueues OBJS[0..N).  If ALL
+   is true, it enqueues all of them or nothing; otherwise it enqueues as
+   many as there's room for.  MpmcQueueDequeue dequeues up to MAX items
+   into BUF.  Both return the number of items transferred. */
+extern ScmSize MpmcQueueEnqueue(ScmMpmcQueue *q, ScmObj *objs, ScmSize n,
+                                int all);
+extern ScmSize MpmcQueueDequeue(ScmMpmcQueue *q, ScmObj *buf, ScmSize max);
+
+/* Blocking operations.  Wait until at least one item can be transferred,
+   then transfer as many as possible.  PTS is the absolute time of timeout,
+   or NULL to wait indefinitely.  Returns 0 on timeout. */
+extern ScmSize MpmcQueueEnqueueWait(ScmMpmcQueue *q, ScmObj *objs, ScmSize n,
+                                    ScmTimeSpec *pts);
+extern ScmSize MpmcQueueDequeueWait(ScmMpmcQueue *q, ScmObj *buf, ScmSize max,
+                                    ScmTimeSpec *pts);
+
+#endif /*GAUCHE_MPMCQ_H*/
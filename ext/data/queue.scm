@@ -45,10 +45,15 @@
 ;; to do so with holding C-level mutex, since Scheme procedure may
 ;; take indefinitely long.  So we use Scheme-level slot to keep the
 ;; thread that is working on the queue.
+;;
+;; <mpmc-queue> is a bounded thread-safe queue that doesn't lock as long
+;; as it is neither empty nor full.  It is implemented in mpmcq.c.  It
+;; isn't a subclass of <queue>, and only supports the operations that
+;; don't need to look into the middle of the queue.
 
 (define-module data.queue
-  (export <queue> <mtqueue>
-          make-queue make-mtqueue queue? mtqueue?
+  (export <queue> <mtqueue> <mpmc-queue>
+          make-queue make-mtqueue make-mpmc-queue queue? mtqueue? mpmc-queue?
           queue-length mtqueue-max-length mtqueue-room
           mtqueue-num-waiting-readers
           queue-empty? copy-queue
@@ -59,7 +64,10 @@
           find-in-queue remove-from-queue!
           any-in-queue every-in-queue
 
-          enqueue/wait! queue-push/wait! dequeue/wait! queue-pop/wait!)
+          enqueue/wait! queue-push/wait! dequeue/wait! queue-pop/wait!
+
+          enqueue-batch! enqueue-batch/wait!
+          dequeue-batch! dequeue-batch/wait!)
   )
 (select-module data.queue)
 
@@ -266,6 +274,49 @@
              [(CW_INTR)     (Scm_SigCheck (Scm_VM)) (continue)]) ;restart op
            (break))))])
 
+ ;;
+ ;; <mpmc-queue>
+ ;;
+ (.include "mpmcq.h")
+
+ "SCM_CLASS_DECL(MpmcQueueClass);"
+
+ (.define MPMCQP (obj) (SCM_ISA obj (& MpmcQueueClass)))
+ (.define MPMCQ (obj) (cast ScmMpmcQueue* obj))
+
+ (define-cfn makempmcq (klass::ScmClass* capacity::ScmSmallInt)
+   (let* ([z::ScmMpmcQueue* (SCM_NEW_INSTANCE ScmMpmcQueue klass)])
+     (MpmcQueueInit z capacity)
+     (return (SCM_OBJ z))))
+
+ (define-cclass <mpmc-queue>
+   "ScmMpmcQueue*" "MpmcQueueClass" ()
+   ((capacity :getter "return SCM_MAKE_INT(MPMCQ(obj)->capacity);"
+              :setter #f)
+    (closed   :getter "return SCM_MAKE_BOOL(AO_load(&MPMCQ(obj)->closed));"
+              :setter #f))
+   (allocator
+    (let* ([c (Scm_GetKeyword ':capacity initargs (SCM_MAKE_INT 64))])
+      (unless (SCM_INTP c) (SCM_TYPE_ERROR c "fixnum"))
+      (return (makempmcq klass (SCM_INT_VALUE c)))))
+   (printer
+    (Scm_Printf port "#<mpmc-queue %ld/%ld %s@%p>"
+                (MpmcQueueLength (MPMCQ obj))
+                (-> (MPMCQ obj) capacity)
+                (?: (AO_load (& (-> (MPMCQ obj) closed))) "(closed)" "")
+                obj))
+   (c-predicate "MPMCQP")
+   (unboxer "MPMCQ"))
+
+ ;; The generic queue APIs take <queue> or <mpmc-queue>.  After handling
+ ;; <mpmc-queue>, these check and cast the argument.
+ (define-cfn queue-arg (q) ::Queue*
+   (unless (QP q) (SCM_TYPE_ERROR q "<queue> or <mpmc-queue>"))
+   (return (Q q)))
+ (define-cfn mtqueue-arg (q) ::MtQueue*
+   (unless (MTQP q) (SCM_TYPE_ERROR q "<mtqueue> or <mpmc-queue>"))
+   (return (MTQ q)))
+
  (define-cproc %lock-mtq (q::<mtqueue>) ::<void>   (grab-mtq-big-lock q))
  (define-cproc %unlock-mtq (q::<mtqueue>) ::<void> (release-mtq-big-lock q))
  (define-cproc %notify-writers (q::<mtqueue>) ::<void> (notify-writers q))
@@ -279,6 +330,8 @@
      (cond
       [(mtqueue? q) (%lock-mtq q) (unwind-protect (proc #t) (%unlock-mtq q))]
       [(queue? q)   (proc #f)]
+      [(mpmc-queue? q)
+       (error "operation not supported on <mpmc-queue>:" q)]
       [else (error "queue required, but got" q)])]))
 
 ;;;
@@ -292,6 +345,8 @@
                     (?: (SCM_UINTP max-length)
                         (SCM_INT_VALUE max-length)
                         -1))))
+ (define-cproc make-mpmc-queue (capacity::<fixnum>)
+   (return (makempmcq (& MpmcQueueClass) capacity)))
 
  ;; caller must hold lock
  (define-cproc %queue-set-content! (q::<queue> list last-pair) ::<void>
@@ -320,16 +375,18 @@
 ;;; Predicates
 ;;;
 (inline-stub
- (define-cproc queue-empty? (q::<queue>) ::<boolean>
-   (if (MTQP q)
-     (let* ([r::int FALSE])
-       (with-mtq-light-lock q (set! r (Q_EMPTY_P q)))
-       (return r))
-     (return (Q_EMPTY_P q))))
+ (define-cproc queue-empty? (q) ::<boolean>
+   (cond [(MPMCQP q) (return (== (MpmcQueueLength (MPMCQ q)) 0))]
+         [(MTQP q)
+          (let* ([r::int FALSE])
+            (with-mtq-light-lock q (set! r (Q_EMPTY_P q)))
+            (return r))]
+         [else (return (Q_EMPTY_P (queue-arg q)))]))
  )
 
 (define-inline (queue? q)   (is-a? q <queue>))
 (define-inline (mtqueue? q) (is-a? q <mtqueue>))
+(define-inline (mpmc-queue? q) (is-a? q <mpmc-queue>))
 
 ;;;
 ;;; Queries
@@ -341,17 +398,27 @@
           (> (+ ,cnt (%qlength (Q ,q))) (MTQ_MAXLEN ,q)))])
 
  ;; API
- (define-cproc queue-length (q::<queue>) ::<int> %qlength)
- (define-cproc mtqueue-max-length (q::<mtqueue>)
-   (return (?: (>= (MTQ_MAXLEN q) 0) (SCM_MAKE_INT (MTQ_MAXLEN q)) '#f)))
+ (define-cproc queue-length (q) ::<int>
+   (if (MPMCQP q)
+     (return (MpmcQueueLength (MPMCQ q)))
+     (return (%qlength (queue-arg q)))))
+ (define-cproc mtqueue-max-length (q)
+   (when (MPMCQP q)
+     (return (SCM_MAKE_INT (-> (MPMCQ q) capacity))))
+   (let* ([mq::MtQueue* (mtqueue-arg q)])
+     (return (?: (>= (MTQ_MAXLEN mq) 0) (SCM_MAKE_INT (MTQ_MAXLEN mq)) '#f))))
 
  ;; caller must hold lock
  (define-cproc %mtqueue-overflow? (q::<mtqueue> cnt::<int>) ::<boolean>
    (return (mtq-overflows q cnt)))
 
  ;; API
- (define-cproc mtqueue-room (q::<mtqueue>) ::<number>
+ (define-cproc mtqueue-room (q) ::<number>
+   (when (MPMCQP q)
+     (return (SCM_MAKE_INT (- (-> (MPMCQ q) capacity)
+                              (MpmcQueueLength (MPMCQ q))))))
    (let* ([room::ScmSmallInt -1])
+     (mtqueue-arg q)
      (with-mtq-light-lock q
        (when (>= (MTQ_MAXLEN q) 0)
          (set! room (- (MTQ_MAXLEN q) (%qlength (Q q))))))
@@ -440,10 +507,24 @@
          (when ovf (Scm_Error "queue is full: %S" ,q)))
        (,op ,q ,cnt ,head ,tail))])
 
+ ;; enqueue OBJ and MORE-OBJS to mpmc-queue, all or nothing.
+ (define-cfn mpmcq-enqueue-all (q::ScmMpmcQueue* obj more-objs) ::void
+   (let* ([k::ScmSize 0])
+     (if (SCM_NULLP more-objs)
+       (set! k (MpmcQueueEnqueue q (& obj) 1 TRUE))
+       (let* ([n::ScmSize 0]
+              [objs::ScmObj* (Scm_ListToArray (Scm_Cons obj more-objs)
+                                              (& n) NULL TRUE)])
+         (set! k (MpmcQueueEnqueue q objs n TRUE))))
+     (when (== k 0) (Scm_Error "queue is full: %S" q))))
+
  ;; API
- (define-cproc enqueue! (q::<queue> obj :rest more-objs)
+ (define-cproc enqueue! (q obj :rest more-objs)
+   (when (MPMCQP q)
+     (mpmcq-enqueue-all (MPMCQ q) obj more-objs)
+     (return q))
    (let* ([head (Scm_Cons obj more-objs)] [tail] [cnt::ScmSmallInt]
-          [qq::(Queue* volatile) q])
+          [qq::(Queue* volatile) (queue-arg q)])
      (if (SCM_NULLP more-objs)
        (set! tail head cnt 1)
        (set! tail (Scm_LastPair more-objs) cnt (Scm_Length head)))
@@ -451,22 +532,29 @@
      (return (SCM_OBJ qq))))
 
  ;; API
- (define-cproc enqueue/wait! (q::<mtqueue> obj
-                                           :optional (timeout #f)
-                                                     (timeout-val #f)
-                                                     (close::<boolean> #f))
-   (let* ([cell (SCM_LIST1 obj)] [retval (SCM_OBJ q)])
-     (do-with-timeout q retval timeout timeout-val writerWait
-                      (when (MTQ_CLOSED q)
+ (define-cproc enqueue/wait! (q obj :optional (timeout #f)
+                                            (timeout-val #f)
+                                            (close::<boolean> #f))
+   (when (MPMCQP q)
+     (let* ([ts::ScmTimeSpec]
+            [pts::ScmTimeSpec* (Scm_GetTimeSpec timeout (& ts))])
+       (when (== (MpmcQueueEnqueueWait (MPMCQ q) (& obj) 1 pts) 0)
+         (return timeout-val))
+       (when close
+         (AO_store (& (-> (MPMCQ q) closed)) 1))
+       (return '#t)))
+   (let* ([mq::MtQueue* (mtqueue-arg q)] [cell (SCM_LIST1 obj)] [retval q])
+     (do-with-timeout mq retval timeout timeout-val writerWait
+                      (when (MTQ_CLOSED mq)
                         (set! err "queue is closed"))
-                      (?: (!= (MTQ_MAXLEN q) 0)
-                          (mtq-overflows q 1)
-                          (== (MTQ_READER_SEM q) 0))
-                      (begin (enqueue_int (Q q) 1 cell cell)
+                      (?: (!= (MTQ_MAXLEN mq) 0)
+                          (mtq-overflows mq 1)
+                          (== (MTQ_READER_SEM mq) 0))
+                      (begin (enqueue_int (Q mq) 1 cell cell)
                              (set! retval '#t)
                              (when close
-                               (set! (MTQ_CLOSED q) TRUE))
-                             (notify-readers (Q q))))
+                               (set! (MTQ_CLOSED mq) TRUE))
+                             (notify-readers (Q mq))))
      (return retval)))
  )
 
@@ -552,11 +640,14 @@
             (when (>= (Q_LENGTH q) 0) (dec! (Q_LENGTH q)))
             (return FALSE))]))
 
- (define-cproc dequeue! (q::<queue> :optional fallback)
+ (define-cproc dequeue! (q :optional fallback)
    (let* ([empty::int FALSE] [fb::(volatile ScmObj) fallback] [r SCM_UNDEFINED])
-     (if (not (MTQP q))
-       (set! empty (dequeue-int q (& r)))
-       (with-mtq-light-lock q (set! empty (dequeue-int q (& r)))))
+     (cond [(MPMCQP q)
+            (set! empty (== (MpmcQueueDequeue (MPMCQ q) (& r) 1) 0))]
+           [(not (MTQP q))
+            (set! empty (dequeue-int (queue-arg q) (& r)))]
+           [else
+            (with-mtq-light-lock q (set! empty (dequeue-int (Q q) (& r))))])
      (if empty
        (if (SCM_UNBOUNDP fb)
          (Scm_Error "queue is empty: %S" q)
@@ -564,18 +655,27 @@
        (when (MTQP q) (notify-writers q)))
      (return r)))
 
- (define-cproc dequeue/wait! (q::<mtqueue> :optional (timeout #f)
-                                                     (timeout-val #f)
-                                                     (close::<boolean> #f))
-   (let* ([retval SCM_UNDEFINED])
-     (do-with-timeout q retval timeout timeout-val readerWait
-                      (begin (post++ (MTQ_READER_SEM q))
-                             (when close (set! (MTQ_CLOSED q) TRUE))
-                             (notify-writers (Q q)))
-                      (Q_EMPTY_P q)
-                      (begin (pre-- (MTQ_READER_SEM q))
-                             (dequeue_int (Q q) (& retval))
-                             (notify-writers (Q q))))
+ (define-cproc dequeue/wait! (q :optional (timeout #f)
+                                          (timeout-val #f)
+                                          (close::<boolean> #f))
+   (when (MPMCQP q)
+     (let* ([ts::ScmTimeSpec]
+            [pts::ScmTimeSpec* (Scm_GetTimeSpec timeout (& ts))]
+            [r SCM_UNDEFINED])
+       (when close
+         (AO_store (& (-> (MPMCQ q) closed)) 1))
+       (if (== (MpmcQueueDequeueWait (MPMCQ q) (& r) 1 pts) 0)
+         (return timeout-val)
+         (return r))))
+   (let* ([mq::MtQueue* (mtqueue-arg q)] [retval SCM_UNDEFINED])
+     (do-with-timeout mq retval timeout timeout-val readerWait
+                      (begin (post++ (MTQ_READER_SEM mq))
+                             (when close (set! (MTQ_CLOSED mq) TRUE))
+                             (notify-writers (Q mq)))
+                      (Q_EMPTY_P mq)
+                      (begin (pre-- (MTQ_READER_SEM mq))
+                             (dequeue_int (Q mq) (& retval))
+                             (notify-writers (Q mq))))
      (return retval)))
 
  (define-cfn dequeue-all-int (q::Queue*)
@@ -583,24 +683,147 @@
      (set! (Q_LENGTH q) 0 (Q_HEAD q) SCM_NIL (Q_TAIL q) SCM_NIL)
      (return lis)))
 
- (define-cproc dequeue-all! (q::<queue>)
-   (if (not (MTQP q))
-     (return (dequeue-all-int q))
-     (let* ([r])
-       (with-mtq-light-lock q (set! r (dequeue-all-int q)))
-       (notify-writers q)
-       (return r))))
+ (define-cfn mpmcq-dequeue-all (q::ScmMpmcQueue*)
+   (let* ([buf::(.array ScmObj (32))] [h SCM_NIL] [t SCM_NIL])
+     (loop
+      (let* ([k::ScmSize (MpmcQueueDequeue q buf 32)])
+        (when (== k 0) (break))
+        (dotimes [i k] (SCM_APPEND1 h t (aref buf i)))))
+     (return h)))
+
+ (define-cproc dequeue-all! (q)
+   (cond [(MPMCQP q) (return (mpmcq-dequeue-all (MPMCQ q)))]
+         [(not (MTQP q)) (return (dequeue-all-int (queue-arg q)))]
+         [else
+          (let* ([r])
+            (with-mtq-light-lock q (set! r (dequeue-all-int (Q q))))
+            (notify-writers q)
+            (return r))]))
+
+ ;; Batch operations on mpmc-queue.  If WAIT is true, wait until
+ ;; TIMEOUT for the first item to be transferred.
+ ;; %mpmcq-enqueue-list returns the items that couldn't be enqueued.
+ ;; %mpmcq-dequeue-list returns a list of dequeued items, or #f on timeout.
+ (define-cproc %mpmcq-enqueue-list (q::<mpmc-queue> lis wait::<boolean>
+                                                    timeout)
+   (let* ([buf::(.array ScmObj (32))] [ts::ScmTimeSpec]
+          [pts::ScmTimeSpec* (?: wait (Scm_GetTimeSpec timeout (& ts)) NULL)])
+     (while (SCM_PAIRP lis)
+       (let* ([n::ScmSize 0] [p lis] [k::ScmSize 0])
+         (while (and (SCM_PAIRP p) (< n 32))
+           (set! (aref buf (post++ n)) (SCM_CAR p)
+                 p (SCM_CDR p)))
+         (if wait
+           (set! k (MpmcQueueEnqueueWait q buf n pts))
+           (set! k (MpmcQueueEnqueue q buf n FALSE)))
+         (when (== k 0) (break))
+         (dotimes [i k] (set! lis (SCM_CDR lis)))))
+     (return lis)))
+
+ (define-cproc %mpmcq-dequeue-list (q::<mpmc-queue> max::<fixnum>
+                                                    wait::<boolean>
+                                                    timeout)
+   (let* ([buf::(.array ScmObj (32))] [h SCM_NIL] [t SCM_NIL]
+          [ts::ScmTimeSpec]
+          [pts::ScmTimeSpec* (?: wait (Scm_GetTimeSpec timeout (& ts)) NULL)])
+     (while (> max 0)
+       (let* ([m::ScmSize (?: (< max 32) max 32)] [k::ScmSize 0])
+         (if (and wait (SCM_NULLP h))
+           (set! k (MpmcQueueDequeueWait q buf m pts))
+           (set! k (MpmcQueueDequeue q buf m)))
+         (when (== k 0) (break))
+         (dotimes [i k] (SCM_APPEND1 h t (aref buf i)))
+         (set! max (- max k))))
+     (if (and wait (SCM_NULLP h))
+       (return SCM_FALSE)
+       (return h))))
  )
 
 (define queue-pop! dequeue!)
 (define queue-pop/wait! dequeue/wait!)
 
+;;;
+;;; Batch operations
+;;;
+
+;; These are mainly for <mpmc-queue>, with which a batch is transferred
+;; with a single atomic operation.  For other queues, they're built on
+;; top of the basic operations.
+
+;; Returns the list of items that couldn't be enqueued because the queue
+;; is full.
+(define (enqueue-batch! q lis)
+  (if (mpmc-queue? q)
+    (%mpmcq-enqueue-list q lis #f #f)
+    (queue-op q (^[mt?]
+                  (when (and mt? (~ q'closed))
+                    (error "queue is closed:" q))
+                  (let* ([len (length lis)]
+                         [maxlen (and mt? (mtqueue-max-length q))]
+                         [n (if maxlen
+                              (max 0 (min len (- maxlen (queue-length q))))
+                              len)])
+                    (receive (xs rest) (split-at lis n)
+                      (unless (null? xs)
+                        (%enqueue! q n xs (last-pair xs))
+                        (when mt? (%notify-readers q)))
+                      rest))))))
+
+;; Returns () if all items are enqueued, or the rest of items if timed out.
+;; TIMEOUT is for the entire operation.
+(define (enqueue-batch/wait! q lis :optional (timeout #f))
+  (if (mpmc-queue? q)
+    (%mpmcq-enqueue-list q lis #t timeout)
+    (let1 limit (%absolute-timeout timeout)
+      (let loop ([lis lis])
+        (cond [(null? lis) '()]
+              [(enqueue/wait! q (car lis) limit #f) (loop (cdr lis))]
+              [else lis])))))
+
+(define (check-batch-max max min)
+  (unless (and (exact-integer? max) (>= max min))
+    (errorf "max must be an exact integer greater than or equal to ~a, \
+             but got ~s" min max)))
+
+;; Returns a list of at most MAX items.  It may be empty.
+(define (dequeue-batch! q max)
+  (check-batch-max max 0)
+  (if (mpmc-queue? q)
+    (%mpmcq-dequeue-list q max #f #f)
+    (queue-op q (^[mt?]
+                  (receive (xs rest)
+                      (split-at (%qhead q) (min max (queue-length q)))
+                    (unless (null? xs)
+                      (%queue-set-content! q rest (%qtail q))
+                      (when mt? (%notify-writers q)))
+                    xs)))))
+
+;; Waits until at least one item is available, and returns a list of
+;; one to MAX items.  Returns TIMEOUT-VAL on timeout.
+(define (dequeue-batch/wait! q max :optional (timeout #f) (timeout-val #f))
+  (check-batch-max max 1)
+  (if (mpmc-queue? q)
+    (or (%mpmcq-dequeue-list q max #t timeout) timeout-val)
+    (let* ([none (list #f)]
+           [x (dequeue/wait! q timeout none)])
+      (if (eq? x none)
+        timeout-val
+        (cons x (dequeue-batch! q (- max 1)))))))
+
+(define (%absolute-timeout timeout)
+  (if (real? timeout)
+    (seconds->time (+ (time->seconds (current-time)) timeout))
+    timeout))
+
 ;; Returns # of readers waiting on mtq.  Note that the value might
 ;; change at any moment after returning this procedure, so for meaningful
 ;; operation the caller need another mutex to prevent new items
 ;; from being inserted into the mtq.
-(define-cproc mtqueue-num-waiting-readers (q::<mtqueue>) ::<int>
+(define-cproc mtqueue-num-waiting-readers (q) ::<int>
+  (when (MPMCQP q)
+    (return (AO_load (& (-> (MPMCQ q) readersWaiting)))))
   (let* ([n::int 0])
+    (mtqueue-arg q)
     (with-mtq-light-lock q (set! n (MTQ_READER_SEM q)))
     (return n)))
 
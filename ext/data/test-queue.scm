@@ -200,6 +200,73 @@
 
 (test* "mtqueue room" +inf.0 (mtqueue-room (make-mtqueue)))
 
+(test-section "mpmc-queue")
+
+(let1 q (make-mpmc-queue 3)
+  (test* "mpmc-queue capacity" 4 (~ q'capacity))
+  (test* "mpmc-queue?" '(#t #f #f) (list (mpmc-queue? q) (queue? q) (mtqueue? q)))
+  (test* "mpmc-queue empty" '(#t 0 4)
+         (list (queue-empty? q) (queue-length q) (mtqueue-room q)))
+  (test* "mpmc-queue enqueue!" '(#f 3 1)
+         (begin (enqueue! q 'a)
+                (enqueue! q 'b 'c)
+                (list (queue-empty? q) (queue-length q) (mtqueue-room q))))
+  (test* "mpmc-queue enqueue! overflow" (test-error <error> #/queue is full/)
+         (enqueue! q 'd 'e))
+  (test* "mpmc-queue dequeue!" '(a b)
+         (let* ([x (dequeue! q)] [y (dequeue! q)]) (list x y)))
+  (test* "mpmc-queue wraparound" '(c d e f)
+         (begin (enqueue! q 'd 'e 'f)
+                (dequeue-all! q)))
+  (test* "mpmc-queue dequeue! empty" (test-error <error> #/queue is empty/)
+         (dequeue! q))
+  (test* "mpmc-queue dequeue! fallback" 'none (dequeue! q 'none))
+  (test* "mpmc-queue queue->list" (test-error <error> #/not supported/)
+         (queue->list q))
+  )
+
+(let1 q (make-mpmc-queue 4)
+  (test* "enqueue-batch! (mpmc)" '(e f) (enqueue-batch! q '(a b c d e f)))
+  (test* "dequeue-batch! (mpmc)" '((a b c) (d) ())
+         (let* ([x (dequeue-batch! q 3)]
+                [y (dequeue-batch! q 3)]
+                [z (dequeue-batch! q 3)])
+           (list x y z)))
+  (test* "dequeue-batch/wait! (mpmc)" '(e f)
+         (begin (enqueue-batch! q '(e f))
+                (dequeue-batch/wait! q 10)))
+  (test* "dequeue-batch/wait! timeout (mpmc)" 'timeout
+         (dequeue-batch/wait! q 10 0.01 'timeout))
+  (test* "enqueue-batch/wait! timeout (mpmc)" '(z)
+         (enqueue-batch/wait! q '(v w x y z) 0.01))
+  )
+
+(let1 q (make-mtqueue :max-length 4)
+  (test* "enqueue-batch! (mtqueue)" '(e f) (enqueue-batch! q '(a b c d e f)))
+  (test* "dequeue-batch! (mtqueue)" '((a b c) (d) ())
+         (let* ([x (dequeue-batch! q 3)]
+                [y (dequeue-batch! q 3)]
+                [z (dequeue-batch! q 3)])
+           (list x y z)))
+  (test* "enqueue-batch/wait! timeout (mtqueue)" '(z)
+         (enqueue-batch/wait! q '(v w x y z) 0.01))
+  (test* "dequeue-batch/wait! (mtqueue)" '(v w x y)
+         (dequeue-batch/wait! q 10))
+  )
+
+(dolist [q (list (make-queue) (make-mtqueue) (make-mpmc-queue 4))]
+  (let1 name (class-name (class-of q))
+    (test* #"dequeue-batch! zero max ~name" '() (dequeue-batch! q 0))
+    (test* #"dequeue-batch! negative max ~name" (test-error)
+           (dequeue-batch! q -1))
+    (test* #"dequeue-batch/wait! zero max ~name" (test-error)
+           (dequeue-batch/wait! q 0 0.01))))
+
+(test* "enqueue-batch! (queue)" '(() (a b c))
+       (let* ([q (make-queue)]
+              [r (enqueue-batch! q '(a b c))])
+         (list r (queue->list q))))
+
 ;; Note: */wait! APIs are tested in ext/threads/test.scm instead of here,
 ;; since we need threads working.
 
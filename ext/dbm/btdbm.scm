@@ -0,0 +1,328 @@
+;;;
+;;; btdbm - B+tree dbm
+;;;
+;;;   Copyright (c) 2024  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; A dbm implementation on top of the built-in B+tree (btree.c).
+;; It doesn't depend on external libraries.  Unlike other dbm
+;; implementations, keys are kept in order, so we can scan a range of
+;; keys efficiently.
+
+(define-module dbm.btdbm
+  (extend dbm)
+  (export <btdbm>
+          btdbm-fold-range btdbm-count btdbm-first-key btdbm-last-key
+          btdbm-begin btdbm-commit btdbm-abort btdbm-in-transaction?
+          btdbm-call-with-transaction btdbm-bulk-load!
+          btdbm-file-of)
+  )
+(select-module dbm.btdbm)
+
+;;;
+;;; High-level dbm interface
+;;;
+
+(define-class <btdbm-meta> (<dbm-meta>)
+  ())
+
+(define-class <btdbm> (<dbm>)
+  ((btdbm-file :accessor btdbm-file-of :initform #f)
+   (sync       :init-keyword :sync   :initform #t)
+   (nolock     :init-keyword :nolock :initform #f)
+   )
+  :metaclass <btdbm-meta>)
+
+(define-method dbm-open ((self <btdbm>))
+  (next-method)
+  (unless (slot-bound? self 'path)
+    (error "path must be set to open btdbm database"))
+  (when (btdbm-file-of self)
+    (errorf "btdbm ~S already opened" self))
+  (let* ([rwopt (+ (case (slot-ref self 'rw-mode)
+                     [(:read)   BTREE_READER]
+                     [(:write)  BTREE_WRITER]
+                     [(:create) BTREE_NEWDB])
+                   (if (slot-ref self 'sync) BTREE_SYNC 0)
+                   (if (slot-ref self 'nolock) BTREE_NOLOCK 0))]
+         [fp    (btree-open (slot-ref self 'path) rwopt
+                            (slot-ref self 'file-mode))])
+    (slot-set! self 'btdbm-file fp)
+    self))
+
+;;
+;; close operation
+;;
+
+(define-method dbm-close ((self <btdbm>))
+  (let1 f (btdbm-file-of self)
+    (and f (btree-close f))))
+
+(define-method dbm-closed? ((self <btdbm>))
+  (let1 f (btdbm-file-of self)
+    (or (not f) (btree-closed? f))))
+
+;;
+;; accessors
+;;
+
+(define-method dbm-put! ((self <btdbm>) key value)
+  (next-method)
+  (btree-put! (btdbm-file-of self) (%dbm-k2s self key) (%dbm-v2s self value)))
+
+(define-method dbm-get ((self <btdbm>) key . args)
+  (next-method)
+  (cond [(btree-get (btdbm-file-of self) (%dbm-k2s self key))
+         => (cut %dbm-s2v self <>)]
+        [(pair? args) (car args)]     ;fall-back value
+        [else  (errorf "btdbm: no data for key ~s in database ~s"
+                       key (btdbm-file-of self))]))
+
+(define-method dbm-exists? ((self <btdbm>) key)
+  (next-method)
+  (boolean (btree-get (btdbm-file-of self) (%dbm-k2s self key))))
+
+(define-method dbm-delete! ((self <btdbm>) key)
+  (next-method)
+  (btree-delete! (btdbm-file-of self) (%dbm-k2s self key)))
+
+;;
+;; Iterations
+;;
+
+;; Entries are visited in the increasing order of serialized keys.
+;; We look up the next entry from the key every time, so it is safe
+;; to modify the database during the iteration.
+(define-method dbm-fold ((self <btdbm>) proc knil)
+  (btdbm-fold-range self proc knil))
+
+;; API
+;; Fold over entries whose serialized keys are in [START, END).
+;; #f for START or END means unbounded.  If REVERSE is true, entries
+;; are visited in decreasing order.
+(define (btdbm-fold-range self proc knil :key (start #f) (end #f) (reverse #f))
+  (define f (btdbm-file-of self))
+  (define skey (and start (%dbm-k2s self start)))
+  (define ekey (and end (%dbm-k2s self end)))
+  (define (in-range? k)
+    (if reverse
+      (or (not skey) (string>=? k skey))
+      (or (not ekey) (string<? k ekey))))
+  (define (step op key r)
+    (receive (k v) (btree-seek f op key)
+      (if (and k (in-range? k))
+        (step (if reverse BTREE_LT BTREE_GT) k
+              (proc (%dbm-s2k self k) (%dbm-s2v self v) r))
+        r)))
+  (cond [(not reverse) (step (if skey BTREE_GE BTREE_FIRST) skey knil)]
+        [ekey (step BTREE_LT ekey knil)]
+        [else (step BTREE_LAST #f knil)]))
+
+;; API
+(define (btdbm-count self) (btree-count (btdbm-file-of self)))
+
+;; API
+(define (btdbm-first-key self :optional (default #f))
+  (receive (k v) (btree-seek (btdbm-file-of self) BTREE_FIRST #f)
+    (if k (%dbm-s2k self k) default)))
+
+(define (btdbm-last-key self :optional (default #f))
+  (receive (k v) (btree-seek (btdbm-file-of self) BTREE_LAST #f)
+    (if k (%dbm-s2k self k) default)))
+
+;;
+;; Transactions
+;;
+
+;; Without explicit transaction, each dbm-put! and dbm-delete! is
+;; committed to the file individually.
+
+;; API
+(define (btdbm-begin self) (btree-begin (btdbm-file-of self)))
+(define (btdbm-commit self) (btree-commit (btdbm-file-of self)))
+(define (btdbm-abort self) (btree-abort (btdbm-file-of self)))
+(define (btdbm-in-transaction? self)
+  (btree-in-transaction? (btdbm-file-of self)))
+
+;; API
+;; Run THUNK in a transaction.  If THUNK returns normally, the changes
+;; are committed; if it raises a condition, they're discarded.
+(define (btdbm-call-with-transaction self thunk)
+  (define f (btdbm-file-of self))
+  (btree-begin f)
+  (receive r (guard (e [else (when (btree-in-transaction? f) (btree-abort f))
+                             (raise e)])
+               (thunk))
+    (btree-commit f)
+    (apply values r)))
+
+;; API
+;; Load entries from SOURCE, which is a list of (key . value) or
+;; a generator that yields them, in one transaction.  Keys must be
+;; given in increasing order, and must be greater than the existing
+;; keys in the database.  Pages are filled fully, so it is faster and
+;; the resulting file is smaller than putting entries one by one.
+(define (btdbm-bulk-load! self source)
+  (define f (btdbm-file-of self))
+  (define (put! kv)
+    (btree-put! f (%dbm-k2s self (car kv)) (%dbm-v2s self (cdr kv)) #t))
+  (btdbm-call-with-transaction self
+    (^[] (if (procedure? source)
+           (let loop ([kv (source)])
+             (unless (eof-object? kv) (put! kv) (loop (source))))
+           (for-each put! source)))))
+
+;;
+;; Metaoperations
+;;
+
+(autoload file.util copy-file move-file)
+
+(define (%with-btdbm-locking path thunk)
+  (let1 f (btree-open path BTREE_READER #o664) ;; put read-lock
+    (unwind-protect (thunk) (btree-close f))))
+
+(define-method dbm-db-exists? ((class <btdbm-meta>) name)
+  (file-exists? name))
+
+(define-method dbm-db-remove ((class <btdbm-meta>) name)
+  (sys-unlink name))
+
+(define-method dbm-db-copy ((class <btdbm-meta>) from to . keys)
+  (%with-btdbm-locking from
+   (^[] (apply copy-file from to :safe #t keys))))
+
+(define-method dbm-db-move ((class <btdbm-meta>) from to . keys)
+  (%with-btdbm-locking from
+   (^[] (apply move-file from to :safe #t keys))))
+
+;;;
+;;; Low-level bindings
+;;;
+
+(inline-stub
+ (declcode
+  (.include "btree.h"))
+
+ (define-ctype ScmBtdbmFile::(.struct
+                              (SCM_HEADER :: ""
+                               name
+                               bt::Btree*)))
+
+ (define-cclass <btdbm-file> :private ScmBtdbmFile* "Scm_BtdbmFileClass" ()
+   ()
+   [printer
+    (Scm_Printf port "#<btdbm-file %S%s>" (-> (SCM_BTDBM_FILE obj) name)
+                (?: (BtreeClosedP (-> (SCM_BTDBM_FILE obj) bt))
+                    " (closed)" ""))])
+
+ (define-cfn btdbm_finalize (obj _::void*) ::void :static
+   (BtreeClose (-> (SCM_BTDBM_FILE obj) bt)))
+
+ (define-cise-stmt STRING_BYTES
+   [(_ scm ptr len)
+    (let ((tmp (gensym)))
+      `(let* ((,tmp :: (const ScmStringBody*) (SCM_STRING_BODY ,scm)))
+         (set! ,ptr (SCM_STRING_BODY_START ,tmp))
+         (set! ,len (SCM_STRING_BODY_SIZE ,tmp))))])
+
+ (define-cise-expr BYTES_STRING
+   [(_ ptr len)
+    `(Scm_MakeString (cast (const char*) ,ptr) ,len -1 SCM_STRING_COPYING)])
+
+ (define-cproc btree-open (name::<string> flags::<fixnum> mode::<fixnum>)
+   (let* ([z::ScmBtdbmFile* (SCM_NEW ScmBtdbmFile)])
+     (SCM_SET_CLASS z (& Scm_BtdbmFileClass))
+     (set! (-> z name) (SCM_OBJ name))
+     (set! (-> z bt) (BtreeOpen (Scm_GetStringConst name) flags mode))
+     (Scm_RegisterFinalizer (SCM_OBJ z) btdbm_finalize NULL)
+     (return (SCM_OBJ z))))
+
+ (define-cproc btree-close (f::<btdbm-file>) ::<void>
+   (BtreeClose (-> f bt)))
+
+ (define-cproc btree-closed? (f::<btdbm-file>) ::<boolean>
+   (return (BtreeClosedP (-> f bt))))
+
+ (define-cproc btree-get (f::<btdbm-file> key::<string>)
+   (let* ([k::(const char*)] [klen::ScmSmallInt]
+          [v::(const void*)] [vlen::size_t])
+     (STRING_BYTES key k klen)
+     (if (BtreeGet (-> f bt) k klen (& v) (& vlen))
+       (return (BYTES_STRING v vlen))
+       (return SCM_FALSE))))
+
+ ;; Returns key and value, or #f and #f if there's no such entry.
+ (define-cproc btree-seek (f::<btdbm-file> op::<fixnum> key) ::(<top> <top>)
+   (let* ([k::(const char*) NULL] [klen::ScmSmallInt 0]
+          [rk::(const void*)] [rklen::size_t]
+          [rv::(const void*)] [rvlen::size_t])
+     (cond [(SCM_STRINGP key) (STRING_BYTES key k klen)]
+           [(not (SCM_FALSEP key))
+            (SCM_TYPE_ERROR key "string or #f")])
+     (if (BtreeSeek (-> f bt) op k klen (& rk) (& rklen) (& rv) (& rvlen))
+       (return (BYTES_STRING rk rklen) (BYTES_STRING rv rvlen))
+       (return SCM_FALSE SCM_FALSE))))
+
+ (define-cproc btree-put! (f::<btdbm-file> key::<string> val::<string>
+                           :optional (appendp::<boolean> #f))
+   ::<void>
+   (let* ([k::(const char*)] [klen::ScmSmallInt]
+          [v::(const char*)] [vlen::ScmSmallInt])
+     (STRING_BYTES key k klen)
+     (STRING_BYTES val v vlen)
+     (BtreePut (-> f bt) k klen v vlen appendp)))
+
+ (define-cproc btree-delete! (f::<btdbm-file> key::<string>) ::<boolean>
+   (let* ([k::(const char*)] [klen::ScmSmallInt])
+     (STRING_BYTES key k klen)
+     (return (BtreeDelete (-> f bt) k klen))))
+
+ (define-cproc btree-count (f::<btdbm-file>) ::<ulong>
+   (return (BtreeCount (-> f bt))))
+
+ (define-cproc btree-begin (f::<btdbm-file>) ::<void> (BtreeBegin (-> f bt)))
+ (define-cproc btree-commit (f::<btdbm-file>) ::<void> (BtreeCommit (-> f bt)))
+ (define-cproc btree-abort (f::<btdbm-file>) ::<void> (BtreeAbort (-> f bt)))
+ (define-cproc btree-in-transaction? (f::<btdbm-file>) ::<boolean>
+   (return (BtreeInTransactionP (-> f bt))))
+
+ (define-enum BTREE_READER)
+ (define-enum BTREE_WRITER)
+ (define-enum BTREE_NEWDB)
+ (define-enum BTREE_SYNC)
+ (define-enum BTREE_NOLOCK)
+ (define-enum BTREE_FIRST)
+ (define-enum BTREE_LAST)
+ (define-enum BTREE_GE)
+ (define-enum BTREE_GT)
+ (define-enum BTREE_LE)
+ (define-enum BTREE_LT)
+ )
@@ -0,0 +1,1401 @@
+/*
+ * btree.c - memory-mapped copy-on-write B+tree for dbm.btdbm
+ *
+ *   Copyright (c) 2024  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "btree.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+typedef uint32_t pgno_t;
+
+#define PAGE_SIZE_    BTREE_PAGE_SIZE
+#define PGNO_MAX      UINT32_MAX
+
+/*
+ * Page layout
+ *
+ *  Branch and leaf pages are slotted pages.  An array of 16bit offsets
+ *  of nodes follows the header, growing upwards, and the nodes are
+ *  allocated from the end of the page, growing downwards.  LOWER and
+ *  UPPER delimit the free space between them.
+ *
+ *  Each node consists of a header, key, and payload.  In a branch node,
+ *  DATA is the child page number, and the key of the first node is
+ *  always empty (it works as minus infinity).  In a leaf node, DATA is
+ *  the size of the value, and the value follows the key.  If the value
+ *  is too large, it is stored in consecutive overflow pages and the node
+ *  has the first page number instead of the value.
+ *
+ *  An overflow page has NEXT as the number of pages it occupies.
+ *  A free-list page has NEXT as the previous (older) free-list page,
+ *  and NKEYS page numbers after the header.
+ */
+typedef struct PageRec {
+    uint32_t pgno;
+    uint16_t flags;
+    uint16_t nkeys;
+    uint16_t lower;
+    uint16_t upper;
+    uint32_t next;
+} Page;
+
+#define PAGE_HDR      sizeof(Page)
+
+#define P_BRANCH      0x01
+#define P_LEAF        0x02
+#define P_OVERFLOW    0x04
+#define P_META        0x08
+#define P_FREE        0x10
+
+typedef struct NodeRec {
+    uint32_t data;
+    uint16_t ksize;
+    uint16_t flags;
+    char     key[];
+} Node;
+
+#define NODE_HDR      sizeof(Node)
+#define N_BIGDATA     0x01
+
+#define ALIGN4(n)     (((n)+3)&~(size_t)3)
+
+/* We guarantee that each page can hold at least 4 nodes, so that
+   split always works.  Leaf nodes larger than this have the value
+   in overflow pages. */
+#define MAX_NODE      ((PAGE_SIZE_ - PAGE_HDR)/4 - sizeof(uint16_t))
+#define MAX_NODES_PER_PAGE ((PAGE_SIZE_ - PAGE_HDR)/(NODE_HDR+sizeof(uint16_t)))
+
+/* Pages used less than this are merged with a sibling if possible. */
+#define FILL_THRESHOLD ((PAGE_SIZE_ - PAGE_HDR)/4)
+
+#define FREE_PER_PAGE ((PAGE_SIZE_ - PAGE_HDR)/sizeof(pgno_t))
+
+#define MAX_DEPTH     32
+
+/* Meta page.  Page 0 and 1. */
+typedef struct MetaRec {
+    Page     hdr;
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pageSize;
+    uint32_t root;              /* 0 if the tree is empty */
+    uint32_t depth;
+    uint32_t npages;            /* # of pages in the file */
+    uint32_t freelist;          /* top of the free-list chain, or 0 */
+    uint32_t nfree;
+    uint64_t txnid;
+    uint64_t nentries;
+    uint32_t checksum;
+} Meta;
+
+#define BTREE_MAGIC   0x4d544247 /* "GBTM" */
+#define BTREE_VERSION 1
+
+typedef struct PgnoListRec {
+    pgno_t *v;
+    size_t  n;
+    size_t  cap;
+} PgnoList;
+
+/* Pages modified in the current transaction, keyed by page number.
+   Open addressing.  An entry with nonzero pgno and NULL page is
+   a deleted entry.  (Page 0 is a meta page and never gets here.) */
+typedef struct DirtyEntryRec {
+    pgno_t pgno;
+    Page  *page;
+} DirtyEntry;
+
+typedef struct DirtyTableRec {
+    DirtyEntry *v;
+    size_t      cap;
+    size_t      n;
+} DirtyTable;
+
+struct BtreeRec {
+    int       fd;               /* -1 if closed */
+    int       flags;
+    char     *map;              /* read-only mapping of the file */
+    size_t    mapsize;
+    Meta      meta;             /* the last committed state */
+
+    /* current state.  same as meta unless we're in a transaction. */
+    pgno_t    root;
+    uint32_t  depth;
+    pgno_t    npages;
+    uint64_t  nentries;
+
+    int       writing;          /* a transaction is active */
+    int       explicitTxn;      /* the transaction is started by BtreeBegin */
+    int       modified;
+    DirtyTable dirty;
+
+    /* Free pages.  AVAIL is a stack of pages we can use now; its bottom
+       AVAILSTABLE entries are unchanged since the last commit.  FREED
+       are pages of the committed tree we no longer use; they can't be
+       overwritten until this transaction is committed.  CHAIN and
+       CHAINCOUNT are the committed free-list pages and the number of
+       entries in each, from the bottom of the stack. */
+    PgnoList  avail;
+    size_t    availStable;
+    PgnoList  freed;
+    PgnoList  chain;
+    PgnoList  chainCount;
+};
+
+#define BTREE_CLOSED_P(bt)  ((bt)->fd < 0)
+
+/*
+ * Utilities
+ */
+
+static void check_open(Btree *bt)
+{
+    if (BTREE_CLOSED_P(bt)) Scm_Error("btdbm file already closed");
+}
+
+static void check_writable(Btree *bt)
+{
+    check_open(bt);
+    if ((bt->flags & BTREE_RWMASK) == BTREE_READER) {
+        Scm_Error("btdbm file is opened read-only");
+    }
+}
+
+static void txn_abort(Btree *bt);
+
+static void corrupted(Btree *bt)
+{
+    if (bt->writing) txn_abort(bt);
+    Scm_Error("btdbm file is corrupted");
+}
+
+static int key_cmp(const void *a, size_t alen, const void *b, size_t blen)
+{
+    int r = memcmp(a, b, (alen < blen)? alen : blen);
+    if (r != 0) return r;
+    return (alen < blen)? -1 : (alen > blen)? 1 : 0;
+}
+
+static void plist_push(PgnoList *l, pgno_t pg)
+{
+    if (l->n == l->cap) {
+        size_t ncap = l->cap? l->cap*2 : 256;
+        pgno_t *nv = SCM_NEW_ATOMIC2(pgno_t*, ncap*sizeof(pgno_t));
+        if (l->n > 0) memcpy(nv, l->v, l->n*sizeof(pgno_t));
+        l->v = nv;
+        l->cap = ncap;
+    }
+    l->v[l->n++] = pg;
+}
+
+static int pread_full(int fd, void *buf, size_t size, off_t off)
+{
+    char *p = (char*)buf;
+    while (size > 0) {
+        ssize_t r;
+        SCM_SYSCALL(r, pread(fd, p, size, off));
+        if (r < 0) return -1;
+        if (r == 0) { errno = EIO; return -1; }
+        p += r; size -= r; off += r;
+    }
+    return 0;
+}
+
+static int pwrite_full(int fd, const void *buf, size_t size, off_t off)
+{
+    const char *p = (const char*)buf;
+    while (size > 0) {
+        ssize_t r;
+        SCM_SYSCALL(r, pwrite(fd, p, size, off));
+        if (r < 0) return -1;
+        p += r; size -= r; off += r;
+    }
+    return 0;
+}
+
+/* FNV-1a */
+static uint32_t meta_checksum(const Meta *m)
+{
+    const unsigned char *p = (const unsigned char*)m;
+    uint32_t h = 2166136261U;
+    for (size_t i=0; i<offsetof(Meta, checksum); i++) {
+        h = (h ^ p[i]) * 16777619U;
+    }
+    return h;
+}
+
+/*
+ * Memory mapping
+ */
+
+static void map_file(Btree *bt, size_t need)
+{
+    if (need <= bt->mapsize) return;
+    size_t size = bt->mapsize? bt->mapsize : 1024*1024;
+    while (size < need) size *= 2;
+    if (bt->map) {
+        munmap(bt->map, bt->mapsize);
+        bt->map = NULL;
+        bt->mapsize = 0;
+    }
+    void *m = mmap(NULL, size, PROT_READ, MAP_SHARED, bt->fd, 0);
+    if (m == MAP_FAILED) Scm_SysError("mmap failed");
+    bt->map = (char*)m;
+    bt->mapsize = size;
+}
+
+/*
+ * Dirty pages
+ */
+
+#define DIRTY_HASH(pg)  ((size_t)((pg) * 2654435761U))
+
+static Page *dirty_get(Btree *bt, pgno_t pg)
+{
+    if (bt->dirty.cap == 0) return NULL;
+    size_t mask = bt->dirty.cap - 1;
+    for (size_t i = DIRTY_HASH(pg) & mask; ; i = (i+1) & mask) {
+        DirtyEntry *e = &bt->dirty.v[i];
+        if (e->pgno == pg) return e->page;
+        if (e->pgno == 0) return NULL;
+    }
+}
+
+static void dirty_put(Btree *bt, pgno_t pg, Page *page);
+
+static void dirty_grow(Btree *bt)
+{
+    DirtyEntry *ov = bt->dirty.v;
+    size_t ocap = bt->dirty.cap;
+    bt->dirty.cap = ocap? ocap*2 : 64;
+    bt->dirty.v = SCM_NEW2(DirtyEntry*, bt->dirty.cap*sizeof(DirtyEntry));
+    memset(bt->dirty.v, 0, bt->dirty.cap*sizeof(DirtyEntry));
+    bt->dirty.n = 0;
+    for (size_t i=0; i<ocap; i++) {
+        if (ov[i].page) dirty_put(bt, ov[i].pgno, ov[i].page);
+    }
+}
+
+static void dirty_put(Btree *bt, pgno_t pg, Page *page)
+{
+    if ((bt->dirty.n + 1)*2 > bt->dirty.cap) dirty_grow(bt);
+    size_t mask = bt->dirty.cap - 1;
+    for (size_t i = DIRTY_HASH(pg) & mask; ; i = (i+1) & mask) {
+        DirtyEntry *e = &bt->dirty.v[i];
+        if (e->pgno == pg) { e->page = page; return; }
+        if (e->pgno == 0) {
+            e->pgno = pg;
+            e->page = page;
+            bt->dirty.n++;
+            return;
+        }
+    }
+}
+
+static void dirty_remove(Btree *bt, pgno_t pg)
+{
+    if (bt->dirty.cap == 0) return;
+    size_t mask = bt->dirty.cap - 1;
+    for (size_t i = DIRTY_HASH(pg) & mask; ; i = (i+1) & mask) {
+        DirtyEntry *e = &bt->dirty.v[i];
+        if (e->pgno == pg) { e->page = NULL; return; }
+        if (e->pgno == 0) return;
+    }
+}
+
+static void dirty_clear(Btree *bt)
+{
+    bt->dirty.v = NULL;
+    bt->dirty.cap = bt->dirty.n = 0;
+}
+
+/*
+ * Page access
+ */
+
+static Page *page_get(Btree *bt, pgno_t pg)
+{
+    if (bt->writing) {
+        Page *p = dirty_get(bt, pg);
+        if (p) return p;
+    }
+    if (pg < 2 || pg >= bt->meta.npages) corrupted(bt);
+    return (Page*)(bt->map + (size_t)pg*PAGE_SIZE_);
+}
+
+static int page_dirty_p(Btree *bt, Page *p)
+{
+    return bt->writing && dirty_get(bt, p->pgno) == p;
+}
+
+static int pgno_cmp(const void *a, const void *b)
+{
+    pgno_t x = *(const pgno_t*)a, y = *(const pgno_t*)b;
+    return (x < y)? -1 : (x > y)? 1 : 0;
+}
+
+/* Finds N consecutive pages in AVAIL and removes them.  Returns TRUE
+   and sets the first page number to *PG if found.  This is only used
+   for overflow pages, so we don't bother to keep AVAIL sorted. */
+static int avail_take_run(Btree *bt, size_t n, pgno_t *pg)
+{
+    size_t m = bt->avail.n;
+    if (m < n) return FALSE;
+
+    pgno_t *v = SCM_NEW_ATOMIC2(pgno_t*, m*sizeof(pgno_t));
+    memcpy(v, bt->avail.v, m*sizeof(pgno_t));
+    qsort(v, m, sizeof(pgno_t), pgno_cmp);
+    size_t run = 1, i;
+    for (i = 1; i < m && run < n; i++) {
+        run = (v[i] == v[i-1] + 1)? run + 1 : 1;
+    }
+    if (run < n) return FALSE;
+    pgno_t start = v[i-1] - (pgno_t)(n-1);
+
+    /* Remove them, keeping the order of the rest.  The entries below
+       the first removed one are unchanged. */
+    size_t j = 0, first = m;
+    for (size_t k = 0; k < m; k++) {
+        pgno_t p = bt->avail.v[k];
+        if (p >= start && p - start < n) {
+            if (first == m) first = k;
+        } else {
+            bt->avail.v[j++] = p;
+        }
+    }
+    bt->avail.n = j;
+    if (bt->availStable > first) bt->availStable = first;
+    *pg = start;
+    return TRUE;
+}
+
+/* Allocate N consecutive pages.  The returned page is zero-cleared. */
+static Page *page_alloc(Btree *bt, size_t n)
+{
+    pgno_t pg;
+    if (n == 1 && bt->avail.n > 0) {
+        pg = bt->avail.v[--bt->avail.n];
+        if (bt->availStable > bt->avail.n) bt->availStable = bt->avail.n;
+    } else if (n == 1 || !avail_take_run(bt, n, &pg)) {
+        if ((uint64_t)bt->npages + n > PGNO_MAX) {
+            Scm_Error("btdbm file is full");
+        }
+        pg = bt->npages;
+        bt->npages += (pgno_t)n;
+    }
+    Page *p = SCM_NEW_ATOMIC2(Page*, n*PAGE_SIZE_);
+    memset(p, 0, n*PAGE_SIZE_);
+    p->pgno = pg;
+    dirty_put(bt, pg, p);
+    bt->modified = TRUE;
+    return p;
+}
+
+static void page_free(Btree *bt, pgno_t pg, size_t n)
+{
+    if (dirty_get(bt, pg)) {
+        /* allocated in this transaction; we can reuse it right away. */
+        dirty_remove(bt, pg);
+        for (size_t i=0; i<n; i++) plist_push(&bt->avail, pg+(pgno_t)i);
+    } else {
+        for (size_t i=0; i<n; i++) plist_push(&bt->freed, pg+(pgno_t)i);
+    }
+    bt->modified = TRUE;
+}
+
+static void page_init(Page *p, int flags)
+{
+    p->flags = (uint16_t)flags;
+    p->nkeys = 0;
+    p->lower = PAGE_HDR;
+    p->upper = PAGE_SIZE_;
+    p->next = 0;
+}
+
+static inline uint16_t *page_slots(Page *p)
+{
+    return (uint16_t*)((char*)p + PAGE_HDR);
+}
+
+static inline Node *page_node(Page *p, int i)
+{
+    return (Node*)((char*)p + page_slots(p)[i]);
+}
+
+static inline size_t page_room(Page *p)
+{
+    return p->upper - p->lower;
+}
+
+/* bytes used by nodes and slots */
+static inline size_t page_used(Page *p)
+{
+    return (PAGE_SIZE_ - p->upper) + (p->lower - PAGE_HDR);
+}
+
+static inline size_t node_payload_size(Page *p, Node *n)
+{
+    if (!(p->flags & P_LEAF)) return 0;
+    if (n->flags & N_BIGDATA) return sizeof(pgno_t);
+    return n->data;
+}
+
+static inline size_t node_size(Page *p, Node *n)
+{
+    return ALIGN4(NODE_HDR + n->ksize + node_payload_size(p, n));
+}
+
+static void page_insert_node(Page *p, int idx, uint32_t data, int flags,
+                             const void *key, size_t klen,
+                             const void *payload, size_t plen)
+{
+    size_t sz = ALIGN4(NODE_HDR + klen + plen);
+    SCM_ASSERT(page_room(p) >= sz + sizeof(uint16_t));
+    p->upper -= (uint16_t)sz;
+    Node *n = (Node*)((char*)p + p->upper);
+    n->data = data;
+    n->ksize = (uint16_t)klen;
+    n->flags = (uint16_t)flags;
+    if (klen > 0) memcpy(n->key, key, klen);
+    if (plen > 0) memcpy(n->key + klen, payload, plen);
+    uint16_t *s = page_slots(p);
+    memmove(s+idx+1, s+idx, (p->nkeys-idx)*sizeof(uint16_t));
+    s[idx] = p->upper;
+    p->nkeys++;
+    p->lower += sizeof(uint16_t);
+}
+
+static void page_delete_node(Page *p, int idx)
+{
+    uint16_t *s = page_slots(p);
+    uint16_t off = s[idx];
+    size_t sz = node_size(p, page_node(p, idx));
+    char *base = (char*)p;
+
+    memmove(base + p->upper + sz, base + p->upper, off - p->upper);
+    for (int i=0; i<p->nkeys; i++) {
+        if (s[i] < off) s[i] += (uint16_t)sz;
+    }
+    memmove(s+idx, s+idx+1, (p->nkeys-idx-1)*sizeof(uint16_t));
+    p->nkeys--;
+    p->lower -= sizeof(uint16_t);
+    p->upper += (uint16_t)sz;
+}
+
+/* Returns the first index whose key is >= KEY. */
+static int leaf_search(Page *p, const void *key, size_t klen, int *exact)
+{
+    int lo = 0, hi = p->nkeys;
+    while (lo < hi) {
+        int mid = (lo + hi)/2;
+        Node *n = page_node(p, mid);
+        if (key_cmp(n->key, n->ksize, key, klen) < 0) lo = mid+1;
+        else hi = mid;
+    }
+    if (exact) {
+        *exact = FALSE;
+        if (lo < p->nkeys) {
+            Node *n = page_node(p, lo);
+            *exact = (key_cmp(n->key, n->ksize, key, klen) == 0);
+        }
+    }
+    return lo;
+}
+
+/* Returns the index of the child that may contain KEY. */
+static int branch_search(Page *p, const void *key, size_t klen)
+{
+    int lo = 1, hi = p->nkeys;
+    while (lo < hi) {
+        int mid = (lo + hi)/2;
+        Node *n = page_node(p, mid);
+        if (key_cmp(n->key, n->ksize, key, klen) <= 0) lo = mid+1;
+        else hi = mid;
+    }
+    return lo-1;
+}
+
+static void leaf_value(Btree *bt, Node *n, const void **val, size_t *vlen)
+{
+    *vlen = n->data;
+    if (n->flags & N_BIGDATA) {
+        pgno_t pg;
+        memcpy(&pg, n->key + n->ksize, sizeof(pgno_t));
+        Page *op = page_get(bt, pg);
+        if (!(op->flags & P_OVERFLOW)) corrupted(bt);
+        *val = (char*)op + PAGE_HDR;
+    } else {
+        *val = n->key + n->ksize;
+    }
+}
+
+static void free_overflow(Btree *bt, Node *n)
+{
+    pgno_t pg;
+    memcpy(&pg, n->key + n->ksize, sizeof(pgno_t));
+    Page *op = page_get(bt, pg);
+    if (!(op->flags & P_OVERFLOW)) corrupted(bt);
+    page_free(bt, pg, op->next);
+}
+
+/*
+ * Free list
+ */
+
+/* Reads the committed free list. */
+static void load_freelist(Btree *bt)
+{
+    PgnoList rev = { NULL, 0, 0 };
+    bt->avail.n = 0;
+    bt->freed.n = 0;
+    bt->chain.n = 0;
+    bt->chainCount.n = 0;
+
+    for (pgno_t pg = bt->meta.freelist; pg != 0; ) {
+        if (rev.n > bt->meta.npages) corrupted(bt); /* loop */
+        plist_push(&rev, pg);
+        Page *p = page_get(bt, pg);
+        if (!(p->flags & P_FREE) || p->nkeys > FREE_PER_PAGE) corrupted(bt);
+        pg = p->next;
+    }
+    for (size_t i = rev.n; i > 0; i--) {
+        Page *p = page_get(bt, rev.v[i-1]);
+        pgno_t *ents = (pgno_t*)((char*)p + PAGE_HDR);
+        plist_push(&bt->chain, rev.v[i-1]);
+        plist_push(&bt->chainCount, p->nkeys);
+        for (int j=0; j<p->nkeys; j++) plist_push(&bt->avail, ents[j]);
+    }
+    if (bt->avail.n != bt->meta.nfree) corrupted(bt);
+    bt->availStable = bt->avail.n;
+}
+
+/*
+ * Transaction
+ */
+
+static void txn_begin(Btree *bt)
+{
+    bt->writing = TRUE;
+    bt->modified = FALSE;
+    bt->freed.n = 0;
+    bt->availStable = bt->avail.n;
+    dirty_clear(bt);
+}
+
+/* Returns TRUE if we started an implicit transaction. */
+static int txn_ensure(Btree *bt)
+{
+    if (bt->writing) return FALSE;
+    txn_begin(bt);
+    return TRUE;
+}
+
+static void txn_abort(Btree *bt)
+{
+    bt->writing = FALSE;
+    bt->explicitTxn = FALSE;
+    dirty_clear(bt);
+    bt->root = bt->meta.root;
+    bt->depth = bt->meta.depth;
+    bt->npages = bt->meta.npages;
+    bt->nentries = bt->meta.nentries;
+    load_freelist(bt);
+}
+
+/* Called when an error is raised in the middle of an update.  The
+   modified pages may be inconsistent, so we discard the whole
+   transaction, even if it is an explicit one. */
+static void txn_abort_on_error(Btree *bt)
+{
+    if (bt->writing) txn_abort(bt);
+}
+
+static void txn_commit(Btree *bt)
+{
+    const char *what = NULL;
+    int syncp = (bt->flags & BTREE_SYNC);
+
+    if (!bt->writing) return;
+    if (!bt->modified) {
+        bt->writing = FALSE;
+        bt->explicitTxn = FALSE;
+        dirty_clear(bt);
+        return;
+    }
+
+    /* Allocate pages to save the new free list.  The bottom part of
+       the committed free list that is unchanged is reused as is. */
+    PgnoList newchain = { NULL, 0, 0 };
+    size_t keep, base, total, need;
+    for (;;) {
+        size_t stable = (bt->availStable < bt->avail.n)
+            ? bt->availStable : bt->avail.n;
+        keep = 0; base = 0;
+        while (keep < bt->chain.n && base + bt->chainCount.v[keep] <= stable) {
+            base += bt->chainCount.v[keep++];
+        }
+        total = bt->avail.n + bt->freed.n + (bt->chain.n - keep);
+        need = (total - base + FREE_PER_PAGE - 1)/FREE_PER_PAGE;
+        if (newchain.n >= need) break;
+        /* NB: We can't use pages in FREED here, for they're still
+           a part of the committed state. */
+        if (bt->avail.n > 0) {
+            plist_push(&newchain, bt->avail.v[--bt->avail.n]);
+            if (bt->availStable > bt->avail.n) {
+                bt->availStable = bt->avail.n;
+            }
+        } else {
+            if (bt->npages == PGNO_MAX) {
+                txn_abort(bt);
+                Scm_Error("btdbm file is full");
+            }
+            plist_push(&newchain, bt->npages++);
+        }
+    }
+    for (size_t i=0; i<bt->freed.n; i++) plist_push(&bt->avail, bt->freed.v[i]);
+    for (size_t i=keep; i<bt->chain.n; i++) plist_push(&bt->avail, bt->chain.v[i]);
+    /* We may have popped one more page than needed.  Return it. */
+    while (newchain.n > need
+           && newchain.n - 1 >= (total + 1 - base + FREE_PER_PAGE - 1)/FREE_PER_PAGE) {
+        plist_push(&bt->avail, newchain.v[--newchain.n]);
+        total++;
+        need = (total - base + FREE_PER_PAGE - 1)/FREE_PER_PAGE;
+    }
+    SCM_ASSERT(bt->avail.n == total);
+
+    /* Write out modified pages */
+    for (size_t i=0; i<bt->dirty.cap; i++) {
+        DirtyEntry *e = &bt->dirty.v[i];
+        if (e->page == NULL) continue;
+        size_t n = (e->page->flags & P_OVERFLOW)? e->page->next : 1;
+        if (pwrite_full(bt->fd, e->page, n*PAGE_SIZE_,
+                        (off_t)e->pgno*PAGE_SIZE_) < 0) {
+            what = "write"; goto err;
+        }
+    }
+
+    /* Write out the new free list */
+    pgno_t top = (keep > 0)? bt->chain.v[keep-1] : 0;
+    size_t pos = base;
+    union { Page p; char b[PAGE_SIZE_]; } buf;
+    bt->chain.n = keep;
+    bt->chainCount.n = keep;
+    for (size_t i=0; i<newchain.n; i++) {
+        size_t cnt = total - pos;
+        if (cnt > FREE_PER_PAGE) cnt = FREE_PER_PAGE;
+        memset(&buf, 0, sizeof(buf));
+        buf.p.pgno = newchain.v[i];
+        buf.p.flags = P_FREE;
+        buf.p.nkeys = (uint16_t)cnt;
+        buf.p.next = top;
+        memcpy(buf.b + PAGE_HDR, bt->avail.v + pos, cnt*sizeof(pgno_t));
+        if (pwrite_full(bt->fd, &buf, PAGE_SIZE_,
+                        (off_t)newchain.v[i]*PAGE_SIZE_) < 0) {
+            what = "write"; goto err;
+        }
+        plist_push(&bt->chain, newchain.v[i]);
+        plist_push(&bt->chainCount, (pgno_t)cnt);
+        top = newchain.v[i];
+        pos += cnt;
+    }
+
+    /* Pages at the end may have been allocated and freed, so never
+       written.  Make sure the file covers all the pages. */
+    struct stat st;
+    if (fstat(bt->fd, &st) < 0) { what = "fstat"; goto err; }
+    if (st.st_size < (off_t)bt->npages*PAGE_SIZE_) {
+        int r;
+        SCM_SYSCALL(r, ftruncate(bt->fd, (off_t)bt->npages*PAGE_SIZE_));
+        if (r < 0) { what = "ftruncate"; goto err; }
+    }
+
+    if (syncp && fsync(bt->fd) < 0) { what = "fsync"; goto err; }
+
+    Meta m = bt->meta;
+    m.txnid++;
+    m.root = bt->root;
+    m.depth = bt->depth;
+    m.npages = bt->npages;
+    m.freelist = top;
+    m.nfree = (uint32_t)total;
+    m.nentries = bt->nentries;
+    m.checksum = meta_checksum(&m);
+    memset(&buf, 0, sizeof(buf));
+    memcpy(&buf, &m, sizeof(Meta));
+    if (pwrite_full(bt->fd, &buf, PAGE_SIZE_,
+                    (off_t)(m.txnid & 1)*PAGE_SIZE_) < 0) {
+        what = "write"; goto err;
+    }
+    if (syncp && fsync(bt->fd) < 0) { what = "fsync"; goto err; }
+
+    bt->meta = m;
+    bt->writing = FALSE;
+    bt->explicitTxn = FALSE;
+    bt->freed.n = 0;
+    bt->availStable = bt->avail.n;
+    dirty_clear(bt);
+    map_file(bt, (size_t)bt->npages*PAGE_SIZE_);
+    return;
+
+  err:
+    {
+        int e = errno;
+        txn_abort(bt);
+        errno = e;
+        Scm_SysError("btdbm: %s failed during commit", what);
+    }
+}
+
+void BtreeBegin(Btree *bt)
+{
+    check_writable(bt);
+    if (bt->explicitTxn) Scm_Error("btdbm: transaction already active");
+    txn_begin(bt);
+    bt->explicitTxn = TRUE;
+}
+
+void BtreeCommit(Btree *bt)
+{
+    check_writable(bt);
+    txn_commit(bt);
+}
+
+void BtreeAbort(Btree *bt)
+{
+    check_writable(bt);
+    if (bt->writing) txn_abort(bt);
+}
+
+int BtreeInTransactionP(Btree *bt)
+{
+    return bt->explicitTxn;
+}
+
+/*
+ * Open and close
+ */
+
+static int read_meta(Btree *bt, int slot, Meta *m)
+{
+    if (pread_full(bt->fd, m, sizeof(Meta), (off_t)slot*PAGE_SIZE_) < 0) {
+        return FALSE;
+    }
+    return (m->magic == BTREE_MAGIC
+            && m->version == BTREE_VERSION
+            && m->pageSize == PAGE_SIZE_
+            && m->checksum == meta_checksum(m));
+}
+
+static int init_file(Btree *bt)
+{
+    union { Meta m; char b[PAGE_SIZE_]; } buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.m.hdr.flags = P_META;
+    buf.m.magic = BTREE_MAGIC;
+    buf.m.version = BTREE_VERSION;
+    buf.m.pageSize = PAGE_SIZE_;
+    buf.m.npages = 2;
+    for (int slot = 0; slot < 2; slot++) {
+        buf.m.hdr.pgno = slot;
+        buf.m.checksum = meta_checksum(&buf.m);
+        if (pwrite_full(bt->fd, &buf, PAGE_SIZE_,
+                        (off_t)slot*PAGE_SIZE_) < 0) {
+            return -1;
+        }
+    }
+    if (bt->flags & BTREE_SYNC) return fsync(bt->fd);
+    return 0;
+}
+
+Btree *BtreeOpen(const char *path, int flags, int mode)
+{
+    int rw = flags & BTREE_RWMASK;
+    int oflags = (rw == BTREE_READER)? O_RDONLY : (O_RDWR|O_CREAT);
+    int fd;
+
+    SCM_SYSCALL(fd, open(path, oflags, mode));
+    if (fd < 0) Scm_SysError("couldn't open btdbm file %s", path);
+
+    Btree *bt = SCM_NEW(Btree);
+    bt->fd = fd;
+    bt->flags = flags;
+
+    const char *what = NULL;
+    if (!(flags & BTREE_NOLOCK)) {
+        struct flock fl;
+        fl.l_type = (rw == BTREE_READER)? F_RDLCK : F_WRLCK;
+        fl.l_whence = SEEK_SET;
+        fl.l_start = 0;
+        fl.l_len = 0;
+        if (fcntl(fd, F_SETLK, &fl) < 0) { what = "lock"; goto err; }
+    }
+
+    /* NB: We truncate the file after acquiring the lock. */
+    if (rw == BTREE_NEWDB && ftruncate(fd, 0) < 0) {
+        what = "truncate"; goto err;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) { what = "stat"; goto err; }
+    if (st.st_size == 0) {
+        if (rw == BTREE_READER) {
+            close(fd);
+            Scm_Error("btdbm file %s is empty", path);
+        }
+        if (init_file(bt) < 0) { what = "initialize"; goto err; }
+        st.st_size = 2*PAGE_SIZE_;
+    }
+
+    Meta m0, m1;
+    int v0 = read_meta(bt, 0, &m0);
+    int v1 = read_meta(bt, 1, &m1);
+    if (!v0 && !v1) {
+        close(fd);
+        Scm_Error("%s is not a btdbm file, or corrupted", path);
+    }
+    bt->meta = (v0 && (!v1 || m0.txnid >= m1.txnid))? m0 : m1;
+    if ((off_t)bt->meta.npages*PAGE_SIZE_ > st.st_size
+        || bt->meta.depth > MAX_DEPTH) {
+        close(fd);
+        Scm_Error("btdbm file %s is corrupted", path);
+    }
+    bt->root = bt->meta.root;
+    bt->depth = bt->meta.depth;
+    bt->npages = bt->meta.npages;
+    bt->nentries = bt->meta.nentries;
+
+    /* These may raise an error.  Don't leave the fd open. */
+    SCM_UNWIND_PROTECT {
+        map_file(bt, (size_t)bt->npages*PAGE_SIZE_);
+        load_freelist(bt);
+    } SCM_WHEN_ERROR {
+        BtreeClose(bt);
+        SCM_NEXT_HANDLER;
+    } SCM_END_PROTECT;
+    return bt;
+
+  err:
+    {
+        int e = errno;
+        close(fd);
+        errno = e;
+        Scm_SysError("couldn't %s btdbm file %s", what, path);
+    }
+    return NULL;                /* dummy */
+}
+
+/* An uncommitted explicit transaction is discarded. */
+void BtreeClose(Btree *bt)
+{
+    if (BTREE_CLOSED_P(bt)) return;
+    if (bt->writing) {
+        bt->writing = FALSE;
+        bt->explicitTxn = FALSE;
+        dirty_clear(bt);
+    }
+    if (bt->map) munmap(bt->map, bt->mapsize);
+    bt->map = NULL;
+    bt->mapsize = 0;
+    close(bt->fd);              /* this releases the lock as well */
+    bt->fd = -1;
+}
+
+int BtreeClosedP(Btree *bt)
+{
+    return BTREE_CLOSED_P(bt);
+}
+
+/*
+ * Search
+ */
+
+typedef struct PathRec {
+    Page *page[MAX_DEPTH];
+    int   idx[MAX_DEPTH];
+    int   depth;
+} Path;
+
+/* Fills PATH to the leaf where KEY is, or would be inserted.
+   Returns FALSE if the tree is empty. */
+static int search(Btree *bt, const void *key, size_t klen,
+                  Path *path, int *exact)
+{
+    pgno_t pg = bt->root;
+    path->depth = 0;
+    *exact = FALSE;
+    if (pg == 0) return FALSE;
+    for (;;) {
+        if (path->depth >= MAX_DEPTH) corrupted(bt);
+        Page *p = page_get(bt, pg);
+        int i;
+        if (p->flags & P_BRANCH) {
+            if (p->nkeys == 0) corrupted(bt);
+            i = branch_search(p, key, klen);
+            pg = page_node(p, i)->data;
+        } else if (p->flags & P_LEAF) {
+            i = leaf_search(p, key, klen, exact);
+        } else {
+            corrupted(bt);
+            return FALSE;       /* dummy */
+        }
+        path->page[path->depth] = p;
+        path->idx[path->depth] = i;
+        path->depth++;
+        if (p->flags & P_LEAF) return TRUE;
+    }
+}
+
+/* Descend from page PG at LEVEL to the leftmost or rightmost leaf. */
+static void descend_edge(Btree *bt, Path *path, int level, pgno_t pg,
+                         int rightp)
+{
+    for (;;) {
+        if (level >= MAX_DEPTH) corrupted(bt);
+        Page *p = page_get(bt, pg);
+        if (p->nkeys == 0 && level > 0) corrupted(bt);
+        int i = rightp? p->nkeys-1 : 0;
+        path->page[level] = p;
+        path->idx[level] = i;
+        if (p->flags & P_LEAF) {
+            path->depth = level+1;
+            return;
+        }
+        pg = page_node(p, i)->data;
+        level++;
+    }
+}
+
+static int next_leaf(Btree *bt, Path *path)
+{
+    for (int l = path->depth-2; l >= 0; l--) {
+        if (path->idx[l] + 1 < path->page[l]->nkeys) {
+            path->idx[l]++;
+            descend_edge(bt, path, l+1,
+                         page_node(path->page[l], path->idx[l])->data, FALSE);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static int prev_leaf(Btree *bt, Path *path)
+{
+    for (int l = path->depth-2; l >= 0; l--) {
+        if (path->idx[l] > 0) {
+            path->idx[l]--;
+            descend_edge(bt, path, l+1,
+                         page_node(path->page[l], path->idx[l])->data, TRUE);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+int BtreeGet(Btree *bt, const void *key, size_t klen,
+             const void **val, size_t *vlen)
+{
+    Path path;
+    int exact;
+    check_open(bt);
+    if (!search(bt, key, klen, &path, &exact) || !exact) return FALSE;
+    Page *leaf = path.page[path.depth-1];
+    leaf_value(bt, page_node(leaf, path.idx[path.depth-1]), val, vlen);
+    return TRUE;
+}
+
+int BtreeSeek(Btree *bt, int op, const void *key, size_t klen,
+              const void **rkey, size_t *rklen,
+              const void **rval, size_t *rvlen)
+{
+    Path path;
+    int exact, idx;
+    check_open(bt);
+    if (bt->root == 0) return FALSE;
+
+    switch (op) {
+    case BTREE_FIRST:
+        descend_edge(bt, &path, 0, bt->root, FALSE);
+        break;
+    case BTREE_LAST:
+        descend_edge(bt, &path, 0, bt->root, TRUE);
+        break;
+    case BTREE_GE:
+    case BTREE_GT:
+        search(bt, key, klen, &path, &exact);
+        if (op == BTREE_GT && exact) path.idx[path.depth-1]++;
+        if (path.idx[path.depth-1] >= path.page[path.depth-1]->nkeys) {
+            if (!next_leaf(bt, &path)) return FALSE;
+        }
+        break;
+    case BTREE_LE:
+    case BTREE_LT:
+        search(bt, key, klen, &path, &exact);
+        if (!(op == BTREE_LE && exact)) path.idx[path.depth-1]--;
+        if (path.idx[path.depth-1] < 0) {
+            if (!prev_leaf(bt, &path)) return FALSE;
+        }
+        break;
+    default:
+        Scm_Error("bad seek operation: %d", op);
+    }
+
+    Page *leaf = path.page[path.depth-1];
+    idx = path.idx[path.depth-1];
+    if (idx < 0 || idx >= leaf->nkeys) return FALSE; /* empty root leaf */
+    Node *n = page_node(leaf, idx);
+    *rkey = n->key;
+    *rklen = n->ksize;
+    leaf_value(bt, n, rval, rvlen);
+    return TRUE;
+}
+
+u_long BtreeCount(Btree *bt)
+{
+    check_open(bt);
+    return (u_long)bt->nentries;
+}
+
+/*
+ * Modification
+ */
+
+/* Make the page at LEVEL of PATH writable.  Pages above LEVEL must
+   already be writable. */
+static Page *path_touch(Btree *bt, Path *path, int level)
+{
+    Page *p = path->page[level];
+    if (page_dirty_p(bt, p)) return p;
+    Page *np = page_alloc(bt, 1);
+    pgno_t pg = np->pgno;
+    memcpy(np, p, PAGE_SIZE_);
+    np->pgno = pg;
+    page_free(bt, p->pgno, 1);
+    if (level == 0) bt->root = pg;
+    else page_node(path->page[level-1], path->idx[level-1])->data = pg;
+    path->page[level] = np;
+    return np;
+}
+
+/* Make IDX-th child of a writable PARENT writable. */
+static Page *child_touch(Btree *bt, Page *parent, int idx)
+{
+    Node *n = page_node(parent, idx);
+    Page *c = page_get(bt, n->data);
+    if (page_dirty_p(bt, c)) return c;
+    Page *nc = page_alloc(bt, 1);
+    pgno_t pg = nc->pgno;
+    memcpy(nc, c, PAGE_SIZE_);
+    nc->pgno = pg;
+    page_free(bt, c->pgno, 1);
+    n->data = pg;
+    return nc;
+}
+
+typedef struct NodeSpecRec {
+    uint32_t    data;
+    int         flags;
+    const char *key;
+    size_t      klen;
+    const void *payload;
+    size_t      plen;
+} NodeSpec;
+
+static size_t spec_size(const NodeSpec *s)
+{
+    return ALIGN4(NODE_HDR + s->klen + s->plen) + sizeof(uint16_t);
+}
+
+/* Split the page at LEVEL of PATH, while inserting a node NEW at IDX.
+   The separator key is copied to SEP, and the new right page number
+   is returned. */
+static pgno_t page_split(Btree *bt, Path *path, int level, int idx,
+                         const NodeSpec *new, int appendp,
+                         char *sep, size_t *seplen)
+{
+    Page *p = path->page[level];
+    union { Page p; char b[PAGE_SIZE_]; } copy;
+    NodeSpec specs[MAX_NODES_PER_PAGE+1];
+    int branchp = (p->flags & P_BRANCH);
+
+    memcpy(&copy, p, PAGE_SIZE_);
+    int n = copy.p.nkeys + 1;
+    size_t total = 0;
+    for (int i=0, j=0; i<n; i++) {
+        if (i == idx) {
+            specs[i] = *new;
+        } else {
+            Node *nd = page_node(&copy.p, j++);
+            specs[i].data = nd->data;
+            specs[i].flags = nd->flags;
+            specs[i].key = nd->key;
+            specs[i].klen = nd->ksize;
+            specs[i].payload = nd->key + nd->ksize;
+            specs[i].plen = node_payload_size(&copy.p, nd);
+        }
+        total += spec_size(&specs[i]);
+    }
+
+    /* S is the number of nodes that go to the left page. */
+    int s;
+    if (appendp && idx == n-1) {
+        s = n-1;
+    } else {
+        size_t acc = 0;
+        for (s = 0; s < n; s++) {
+            acc += spec_size(&specs[s]);
+            if (acc >= total/2) break;
+        }
+        if (s < 1) s = 1;
+        if (s > n-1) s = n-1;
+    }
+
+    /* The separator.  For branch, the first node of the right page
+       loses its key. */
+    *seplen = specs[s].klen;
+    memcpy(sep, specs[s].key, specs[s].klen);
+    if (branchp) specs[s].klen = 0;
+
+    Page *r = page_alloc(bt, 1);
+    page_init(r, p->flags);
+    page_init(p, p->flags);
+    for (int i=0; i<n; i++) {
+        Page *d = (i < s)? p : r;
+        page_insert_node(d, d->nkeys, specs[i].data, specs[i].flags,
+                         specs[i].key, specs[i].klen,
+                         specs[i].payload, specs[i].plen);
+    }
+    return r->pgno;
+}
+
+static void insert_node(Btree *bt, Path *path, int level, int idx,
+                        const NodeSpec *new, int appendp)
+{
+    Page *p = path->page[level];
+    if (page_room(p) >= spec_size(new)) {
+        page_insert_node(p, idx, new->data, new->flags, new->key, new->klen,
+                         new->payload, new->plen);
+        return;
+    }
+
+    char sep[BTREE_MAX_KEY];
+    size_t seplen;
+    pgno_t right = page_split(bt, path, level, idx, new, appendp,
+                              sep, &seplen);
+    if (level == 0) {
+        if (bt->depth >= MAX_DEPTH) corrupted(bt);
+        Page *root = page_alloc(bt, 1);
+        page_init(root, P_BRANCH);
+        page_insert_node(root, 0, p->pgno, 0, NULL, 0, NULL, 0);
+        page_insert_node(root, 1, right, 0, sep, seplen, NULL, 0);
+        bt->root = root->pgno;
+        bt->depth++;
+    } else {
+        NodeSpec s = { right, 0, sep, seplen, NULL, 0 };
+        insert_node(bt, path, level-1, path->idx[level-1]+1, &s, appendp);
+    }
+}
+
+static void put_in_txn(Btree *bt, Path *path, int nonempty, int exact,
+                       const void *key, size_t klen,
+                       const void *val, size_t vlen, int appendp)
+{
+    if (!nonempty) {
+        Page *p = page_alloc(bt, 1);
+        page_init(p, P_LEAF);
+        bt->root = p->pgno;
+        bt->depth = 1;
+        path->page[0] = p;
+        path->idx[0] = 0;
+        path->depth = 1;
+    } else {
+        for (int l=0; l<path->depth; l++) path_touch(bt, path, l);
+        if (exact) {
+            Page *leaf = path->page[path->depth-1];
+            int idx = path->idx[path->depth-1];
+            Node *n = page_node(leaf, idx);
+            if (n->flags & N_BIGDATA) free_overflow(bt, n);
+            page_delete_node(leaf, idx);
+            bt->nentries--;
+        }
+    }
+
+    NodeSpec s = { (uint32_t)vlen, 0, key, klen, val, vlen };
+    pgno_t opg;
+    if (ALIGN4(NODE_HDR + klen + vlen) > MAX_NODE) {
+        size_t n = (PAGE_HDR + vlen + PAGE_SIZE_ - 1)/PAGE_SIZE_;
+        Page *op = page_alloc(bt, n);
+        op->flags = P_OVERFLOW;
+        op->next = (uint32_t)n;
+        memcpy((char*)op + PAGE_HDR, val, vlen);
+        opg = op->pgno;
+        s.flags = N_BIGDATA;
+        s.payload = &opg;
+        s.plen = sizeof(pgno_t);
+    }
+    insert_node(bt, path, path->depth-1, path->idx[path->depth-1], &s, appendp);
+    bt->nentries++;
+    bt->modified = TRUE;
+}
+
+void BtreePut(Btree *bt, const void *key, size_t klen,
+              const void *val, size_t vlen, int appendp)
+{
+    Path path;
+    int exact;
+
+    check_writable(bt);
+    if (klen > BTREE_MAX_KEY) {
+        Scm_Error("btdbm: key too long (%lu bytes, while max %d bytes)",
+                  (u_long)klen, BTREE_MAX_KEY);
+    }
+    if (vlen > UINT32_MAX) {
+        Scm_Error("btdbm: value too long (%lu bytes)", (u_long)vlen);
+    }
+
+    int nonempty = search(bt, key, klen, &path, &exact);
+    if (appendp && nonempty) {
+        int rightmost = !exact;
+        for (int l=0; l<path.depth && rightmost; l++) {
+            int last = path.page[l]->nkeys - ((l == path.depth-1)? 0 : 1);
+            if (path.idx[l] != last) rightmost = FALSE;
+        }
+        if (!rightmost) Scm_Error("btdbm: keys must be added in order");
+    }
+
+    int implicit = txn_ensure(bt);
+    SCM_UNWIND_PROTECT {
+        put_in_txn(bt, &path, nonempty, exact, key, klen, val, vlen, appendp);
+        if (implicit) txn_commit(bt);
+    } SCM_WHEN_ERROR {
+        txn_abort_on_error(bt);
+        SCM_NEXT_HANDLER;
+    } SCM_END_PROTECT;
+}
+
+/* Called after a node is removed from the page at LEVEL. */
+static void rebalance(Btree *bt, Path *path, int level)
+{
+    Page *p = path->page[level];
+
+    if (level == 0) {
+        if (p->nkeys == 0) {
+            page_free(bt, p->pgno, 1);
+            bt->root = 0;
+            bt->depth = 0;
+        } else if ((p->flags & P_BRANCH) && p->nkeys == 1) {
+            bt->root = page_node(p, 0)->data;
+            bt->depth--;
+            page_free(bt, p->pgno, 1);
+        }
+        return;
+    }
+
+    int minkeys = (p->flags & P_BRANCH)? 2 : 1;
+    if (page_used(p) >= FILL_THRESHOLD && p->nkeys >= minkeys) return;
+
+    Page *parent = path->page[level-1];
+    int pidx = path->idx[level-1];
+    if (p->nkeys == 0) {
+        page_delete_node(parent, pidx);
+        page_free(bt, p->pgno, 1);
+        rebalance(bt, path, level-1);
+        return;
+    }
+    if (parent->nkeys < 2) return;
+
+    /* Try to merge with a sibling */
+    int lidx, ridx;
+    if (pidx + 1 < parent->nkeys) { lidx = pidx; ridx = pidx+1; }
+    else                          { lidx = pidx-1; ridx = pidx; }
+    Page *l = (lidx == pidx)? p : child_touch(bt, parent, lidx);
+    Page *r = (ridx == pidx)? p : child_touch(bt, parent, ridx);
+    Node *sepn = page_node(parent, ridx);
+    size_t extra = 0;
+    if (p->flags & P_BRANCH) {
+        extra = ALIGN4(NODE_HDR + sepn->ksize) - ALIGN4(NODE_HDR);
+    }
+    if (page_used(l) + page_used(r) + extra > PAGE_SIZE_ - PAGE_HDR) return;
+
+    for (int i=0; i<r->nkeys; i++) {
+        Node *n = page_node(r, i);
+        if ((r->flags & P_BRANCH) && i == 0) {
+            page_insert_node(l, l->nkeys, n->data, n->flags,
+                             sepn->key, sepn->ksize, NULL, 0);
+        } else {
+            page_insert_node(l, l->nkeys, n->data, n->flags,
+                             n->key, n->ksize,
+                             n->key + n->ksize, node_payload_size(r, n));
+        }
+    }
+    page_delete_node(parent, ridx);
+    page_free(bt, r->pgno, 1);
+    rebalance(bt, path, level-1);
+}
+
+static void delete_in_txn(Btree *bt, Path *path)
+{
+    for (int l=0; l<path->depth; l++) path_touch(bt, path, l);
+    Page *leaf = path->page[path->depth-1];
+    int idx = path->idx[path->depth-1];
+    Node *n = page_node(leaf, idx);
+    if (n->flags & N_BIGDATA) free_overflow(bt, n);
+    page_delete_node(leaf, idx);
+    bt->nentries--;
+    rebalance(bt, path, path->depth-1);
+    bt->modified = TRUE;
+}
+
+int BtreeDelete(Btree *bt, const void *key, size_t klen)
+{
+    Path path;
+    int exact;
+
+    check_writable(bt);
+    if (!search(bt, key, klen, &path, &exact) || !exact) return FALSE;
+
+    int implicit = txn_ensure(bt);
+    SCM_UNWIND_PROTECT {
+        delete_in_txn(bt, &path);
+        if (implicit) txn_commit(bt);
+    } SCM_WHEN_ERROR {
+        txn_abort_on_error(bt);
+        SCM_NEXT_HANDLER;
+    } SCM_END_PROTECT;
+    return TRUE;
+}
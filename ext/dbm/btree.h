@@ -0,0 +1,114 @@
+/*
+ * btree.h - memory-mapped copy-on-write B+tree for dbm.btdbm
+ *
+ *   Copyright (c) 2024  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_BTREE_H
+#define GAUCHE_BTREE_H
+
+#include <gauche.h>
+#include <gauche/extend.h>
+
+/* Btree is a disk-based B+tree that maps byte strings to byte strings,
+ * used as the backend of dbm.btdbm.  Like CompactTrie in ext/sparse,
+ * it is not intended to be used outside of this directory, so we don't
+ * use 'Scm' prefix.
+ *
+ * The file consists of fixed-size pages.  The first two pages are meta
+ * pages; the rest are tree pages, overflow pages (for large values) and
+ * free-list pages.  Pages are never modified in place once committed.
+ * An update writes modified pages to the free space, then writes the
+ * meta page that points to the new root.  We alternate the two meta
+ * pages, and each one has a checksum, so if we crash before the meta
+ * page is written, the database is opened with the previous state.
+ * Against a system crash, this holds only with BTREE_SYNC, which
+ * fsyncs the data pages before writing the meta page.
+ *
+ * Committed pages are read through a read-only memory mapping of the
+ * file.  Pages modified in the current transaction are kept in memory
+ * until commit.
+ *
+ * Keys are ordered by byte-wise comparison (a shorter key comes first
+ * if it is a prefix of the other).
+ */
+
+#define BTREE_PAGE_SIZE   4096
+#define BTREE_MAX_KEY     511
+
+/* Open flags */
+enum {
+    BTREE_READER = 0,           /* read only */
+    BTREE_WRITER = 1,           /* read-write; create if not exist */
+    BTREE_NEWDB  = 2,           /* read-write; always create a new one */
+    BTREE_RWMASK = 3,
+
+    BTREE_SYNC   = (1L<<4),     /* fsync on every commit */
+    BTREE_NOLOCK = (1L<<5)      /* do not lock the file */
+};
+
+/* Seek operations */
+enum {
+    BTREE_FIRST,                /* the first entry */
+    BTREE_LAST,                 /* the last entry */
+    BTREE_GE,                   /* the first entry with key >= given */
+    BTREE_GT,                   /* the first entry with key > given */
+    BTREE_LE,                   /* the last entry with key <= given */
+    BTREE_LT                    /* the last entry with key < given */
+};
+
+typedef struct BtreeRec Btree;
+
+extern Btree *BtreeOpen(const char *path, int flags, int mode);
+extern void   BtreeClose(Btree *bt);
+extern int    BtreeClosedP(Btree *bt);
+
+/* Returned pointers are valid until the next operation on BT. */
+extern int    BtreeGet(Btree *bt, const void *key, size_t klen,
+                       const void **val, size_t *vlen);
+extern int    BtreeSeek(Btree *bt, int op, const void *key, size_t klen,
+                        const void **rkey, size_t *rklen,
+                        const void **rval, size_t *rvlen);
+
+/* If APPENDP is true, KEY must be greater than any existing key; it
+   makes pages filled fully, which is good for bulk loading. */
+extern void   BtreePut(Btree *bt, const void *key, size_t klen,
+                       const void *val, size_t vlen, int appendp);
+extern int    BtreeDelete(Btree *bt, const void *key, size_t klen);
+extern u_long BtreeCount(Btree *bt);
+
+/* Transaction.  Without explicit transaction, each BtreePut and
+   BtreeDelete is committed individually. */
+extern void   BtreeBegin(Btree *bt);
+extern void   BtreeCommit(Btree *bt);
+extern void   BtreeAbort(Btree *bt);
+extern int    BtreeInTransactionP(Btree *bt);
+
+#endif /*GAUCHE_BTREE_H*/
@@ -257,6 +257,107 @@
 (test-module 'dbm.fsdbm)
 (full-test <fsdbm>)
 
+;;
+;; BTDBM test
+;;
+
+(test-if-exists "dbm--btdbm" dbm.btdbm <btdbm>)
+
+(define (btdbm-specific-test)
+  (define class <btdbm>)
+  (define keys (map (cut format "k~4,'0d" <>) (iota 2000)))
+  ;; We don't need durability here; fsync-ing on every commit makes
+  ;; the tests slow.
+  (define (open-db mode)
+    (dbm-open class :path *test-dbm* :rw-mode mode :sync #f))
+
+  (test-section "btdbm specific features")
+  (dynamic-wind
+   clean-up
+   (^[]
+     (let1 db (open-db :create)
+       ;; put in random order
+       (for-each (^k (dbm-put! db k (string-append "v" k)))
+                 (sort keys (^[a b] (< (default-hash a) (default-hash b)))))
+       (test* "ordered fold" keys
+              (reverse (dbm-fold db (^[k v r] (cons k r)) '())))
+       (test* "count" 2000 (btdbm-count db))
+       (test* "first/last key" '("k0000" "k1999")
+              (list (btdbm-first-key db) (btdbm-last-key db)))
+       (test* "fold-range" '("k0100" "k0101" "k0102")
+              (reverse (btdbm-fold-range db (^[k v r] (cons k r)) '()
+                        :start "k0100" :end "k0103")))
+       (test* "fold-range (open end)" '("k1998" "k1999")
+              (reverse (btdbm-fold-range db (^[k v r] (cons k r)) '()
+                        :start "k1998")))
+       (test* "fold-range (reverse)" '("k0102" "k0101" "k0100")
+              (reverse (btdbm-fold-range db (^[k v r] (cons k r)) '()
+                        :start "k0100" :end "k0103" :reverse #t)))
+       (test* "fold-range (no match)" '()
+              (btdbm-fold-range db (^[k v r] (cons k r)) '()
+               :start "x"))
+
+       ;; large value goes to overflow pages
+       (let1 big (make-string 100000 #\z)
+         (dbm-put! db "big" big)
+         (test* "large value" big (dbm-get db "big"))
+         (dbm-delete! db "big")
+         (test* "large value deleted" #f (dbm-exists? db "big")))
+
+       ;; rewriting large values reuses the freed overflow pages
+       (let* ([big (make-string 10000 #\z)]
+              [size (^[] (sys-stat->size (sys-stat *test-dbm*)))]
+              [_ (dbm-put! db "big" big)]
+              [s0 (size)])
+         (dotimes [i 200] (dbm-put! db "big" big))
+         (test* "overflow pages reused" #t
+                (< (- (size) s0) (* 100 4096)))
+         (dbm-delete! db "big"))
+
+       ;; delete during iteration
+       (dbm-for-each db (^[k v] (when (odd? (string->number (substring k 1 5)))
+                                  (dbm-delete! db k))))
+       (test* "delete during iteration" 1000 (btdbm-count db))
+
+       ;; transaction
+       (btdbm-begin db)
+       (dbm-put! db "k0001" "new")
+       (dbm-delete! db "k0000")
+       (test* "in transaction" '("new" #f)
+              (list (dbm-get db "k0001") (dbm-exists? db "k0000")))
+       (btdbm-abort db)
+       (test* "abort" '(#f #t)
+              (list (dbm-exists? db "k0001") (dbm-exists? db "k0000")))
+       (test* "call-with-transaction (error)" '(error #f)
+              (list (guard (e [else 'error])
+                      (btdbm-call-with-transaction db
+                       (^[] (dbm-put! db "k0001" "new") (error "oops"))))
+                    (dbm-exists? db "k0001")))
+       (test* "call-with-transaction" '(ok "new")
+              (list (btdbm-call-with-transaction db
+                     (^[] (dbm-put! db "k0001" "new") 'ok))
+                    (dbm-get db "k0001")))
+       (dbm-close db))
+
+     (let1 db (open-db :read)
+       (test* "persistence" '(1001 "new" "vk0002")
+              (list (btdbm-count db) (dbm-get db "k0001")
+                    (dbm-get db "k0002")))
+       (dbm-close db))
+
+     ;; bulk load
+     (let1 db (open-db :create)
+       (btdbm-bulk-load! db (map (^k (cons k k)) keys))
+       (test* "bulk load" keys (dbm-map db (^[k v] v)))
+       (test* "bulk load (out of order)" (test-error)
+              (btdbm-bulk-load! db '(("k5000" . "a") ("k4000" . "b"))))
+       (test* "bulk load (out of order) rollback" '(2000 #f)
+              (list (btdbm-count db) (dbm-exists? db "k5000")))
+       (dbm-close db)))
+   clean-up))
+
+(when (find-module 'dbm.btdbm) (btdbm-specific-test))
+
 ;;
 ;; GDBM test
 ;;
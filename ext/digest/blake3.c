@@ -0,0 +1,361 @@
+/*
+ * blake3.c - BLAKE3 hash function
+ *
+ *   Copyright (c) 2024  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include "blake3.h"
+
+enum {
+    CHUNK_START = 1<<0,
+    CHUNK_END   = 1<<1,
+    PARENT      = 1<<2,
+    ROOT        = 1<<3
+};
+
+static const uint32_t IV[8] = {
+    0x6a09e667UL, 0xbb67ae85UL, 0x3c6ef372UL, 0xa54ff53aUL,
+    0x510e527fUL, 0x9b05688cUL, 0x1f83d9abUL, 0x5be0cd19UL
+};
+
+static const uint8_t MSG_SCHEDULE[7][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+    {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+    {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+    {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+    {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+    {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+static inline uint32_t rotr32(uint32_t w, int c)
+{
+    return (w >> c) | (w << (32 - c));
+}
+
+static inline uint32_t load32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1]<<8)
+        | ((uint32_t)p[2]<<16) | ((uint32_t)p[3]<<24);
+}
+
+static inline void store32(uint8_t *p, uint32_t w)
+{
+    p[0] = (uint8_t)w;
+    p[1] = (uint8_t)(w >> 8);
+    p[2] = (uint8_t)(w >> 16);
+    p[3] = (uint8_t)(w >> 24);
+}
+
+static inline void store_cv(uint8_t *out, const uint32_t cv[8])
+{
+    for (int i = 0; i < 8; i++) store32(out + 4*i, cv[i]);
+}
+
+static inline void load_cv(uint32_t cv[8], const uint8_t *in)
+{
+    for (int i = 0; i < 8; i++) cv[i] = load32(in + 4*i);
+}
+
+#define G(a, b, c, d, x, y)                     \
+    do {                                        \
+        s[a] = s[a] + s[b] + (x);               \
+        s[d] = rotr32(s[d] ^ s[a], 16);         \
+        s[c] = s[c] + s[d];                     \
+        s[b] = rotr32(s[b] ^ s[c], 12);         \
+        s[a] = s[a] + s[b] + (y);               \
+        s[d] = rotr32(s[d] ^ s[a], 8);          \
+        s[c] = s[c] + s[d];                     \
+        s[b] = rotr32(s[b] ^ s[c], 7);          \
+    } while (0)
+
+/* Full compression.  Leaves 16 words of output in S. */
+static void compress(const uint32_t cv[8], const uint8_t block[BLAKE3_BLOCK_LEN],
+                     uint8_t block_len, uint64_t counter, uint8_t flags,
+                     uint32_t s[16])
+{
+    uint32_t m[16];
+    for (int i = 0; i < 16; i++) m[i] = load32(block + 4*i);
+
+    for (int i = 0; i < 8; i++) s[i] = cv[i];
+    s[8]  = IV[0]; s[9]  = IV[1]; s[10] = IV[2]; s[11] = IV[3];
+    s[12] = (uint32_t)counter;
+    s[13] = (uint32_t)(counter >> 32);
+    s[14] = block_len;
+    s[15] = flags;
+
+    for (int r = 0; r < 7; r++) {
+        const uint8_t *k = MSG_SCHEDULE[r];
+        G(0, 4,  8, 12, m[k[0]],  m[k[1]]);
+        G(1, 5,  9, 13, m[k[2]],  m[k[3]]);
+        G(2, 6, 10, 14, m[k[4]],  m[k[5]]);
+        G(3, 7, 11, 15, m[k[6]],  m[k[7]]);
+        G(0, 5, 10, 15, m[k[8]],  m[k[9]]);
+        G(1, 6, 11, 12, m[k[10]], m[k[11]]);
+        G(2, 7,  8, 13, m[k[12]], m[k[13]]);
+        G(3, 4,  9, 14, m[k[14]], m[k[15]]);
+    }
+    for (int i = 0; i < 8; i++) {
+        s[i] ^= s[i+8];
+        s[i+8] ^= cv[i];
+    }
+}
+
+static void compress_cv(uint32_t cv[8], const uint8_t block[BLAKE3_BLOCK_LEN],
+                        uint8_t block_len, uint64_t counter, uint8_t flags)
+{
+    uint32_t s[16];
+    compress(cv, block, block_len, counter, flags, s);
+    memcpy(cv, s, sizeof(uint32_t)*8);
+}
+
+/*
+ * Output of a node, from which either a chaining value or the root
+ * output can be taken.
+ */
+typedef struct {
+    uint32_t input_cv[8];
+    uint64_t counter;
+    uint8_t  block[BLAKE3_BLOCK_LEN];
+    uint8_t  block_len;
+    uint8_t  flags;
+} Output;
+
+static void output_cv(const Output *o, uint32_t cv[8])
+{
+    memcpy(cv, o->input_cv, sizeof(uint32_t)*8);
+    compress_cv(cv, o->block, o->block_len, o->counter, o->flags);
+}
+
+static void output_root(const Output *o, uint8_t *out, size_t outlen)
+{
+    uint64_t counter = 0;
+    while (outlen > 0) {
+        uint32_t s[16];
+        uint8_t  bytes[64];
+        compress(o->input_cv, o->block, o->block_len, counter,
+                 o->flags | ROOT, s);
+        for (int i = 0; i < 16; i++) store32(bytes + 4*i, s[i]);
+        size_t n = outlen < 64 ? outlen : 64;
+        memcpy(out, bytes, n);
+        out += n;
+        outlen -= n;
+        counter++;
+    }
+}
+
+static void parent_output(const uint32_t left[8], const uint32_t right[8],
+                          Output *o)
+{
+    memcpy(o->input_cv, IV, sizeof(IV));
+    for (int i = 0; i < 8; i++) {
+        store32(o->block + 4*i, left[i]);
+        store32(o->block + 32 + 4*i, right[i]);
+    }
+    o->counter = 0;
+    o->block_len = BLAKE3_BLOCK_LEN;
+    o->flags = PARENT;
+}
+
+/*
+ * Chunk state
+ */
+
+static void chunk_init(Blake3ChunkState *c, uint64_t chunk_counter)
+{
+    memcpy(c->cv, IV, sizeof(IV));
+    c->chunk_counter = chunk_counter;
+    memset(c->buf, 0, BLAKE3_BLOCK_LEN);
+    c->buf_len = 0;
+    c->blocks_compressed = 0;
+}
+
+static size_t chunk_len(const Blake3ChunkState *c)
+{
+    return BLAKE3_BLOCK_LEN * (size_t)c->blocks_compressed + c->buf_len;
+}
+
+static uint8_t chunk_start_flag(const Blake3ChunkState *c)
+{
+    return c->blocks_compressed == 0 ? CHUNK_START : 0;
+}
+
+static void chunk_update(Blake3ChunkState *c, const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        /* Keep the last block buffered; it may be the final one. */
+        if (c->buf_len == BLAKE3_BLOCK_LEN) {
+            compress_cv(c->cv, c->buf, BLAKE3_BLOCK_LEN, c->chunk_counter,
+                        chunk_start_flag(c));
+            c->blocks_compressed++;
+            c->buf_len = 0;
+            memset(c->buf, 0, BLAKE3_BLOCK_LEN);
+        }
+        size_t take = BLAKE3_BLOCK_LEN - c->buf_len;
+        if (take > len) take = len;
+        memcpy(c->buf + c->buf_len, data, take);
+        c->buf_len += (uint8_t)take;
+        data += take;
+        len -= take;
+    }
+}
+
+static void chunk_output(const Blake3ChunkState *c, Output *o)
+{
+    memcpy(o->input_cv, c->cv, sizeof(c->cv));
+    memcpy(o->block, c->buf, BLAKE3_BLOCK_LEN);
+    o->block_len = c->buf_len;
+    o->counter = c->chunk_counter;
+    o->flags = chunk_start_flag(c) | CHUNK_END;
+}
+
+/*
+ * Incremental hasher
+ */
+
+void Blake3Init(Blake3Hasher *h)
+{
+    chunk_init(&h->chunk, 0);
+    h->cv_stack_len = 0;
+}
+
+/* Push the CV of a completed chunk, merging completed subtrees.  The
+   number of trailing zero bits of TOTAL_CHUNKS tells how many. */
+static void add_chunk_cv(Blake3Hasher *h, uint32_t cv[8], uint64_t total_chunks)
+{
+    while ((total_chunks & 1) == 0) {
+        Output o;
+        parent_output(h->cv_stack[--h->cv_stack_len], cv, &o);
+        output_cv(&o, cv);
+        total_chunks >>= 1;
+    }
+    memcpy(h->cv_stack[h->cv_stack_len++], cv, sizeof(uint32_t)*8);
+}
+
+void Blake3Update(Blake3Hasher *h, const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        if (chunk_len(&h->chunk) == BLAKE3_CHUNK_LEN) {
+            Output o;
+            uint32_t cv[8];
+            uint64_t total = h->chunk.chunk_counter + 1;
+            chunk_output(&h->chunk, &o);
+            output_cv(&o, cv);
+            add_chunk_cv(h, cv, total);
+            chunk_init(&h->chunk, total);
+        }
+        size_t take = BLAKE3_CHUNK_LEN - chunk_len(&h->chunk);
+        if (take > len) take = len;
+        chunk_update(&h->chunk, data, take);
+        data += take;
+        len -= take;
+    }
+}
+
+void Blake3Final(const Blake3Hasher *h, uint8_t *out, size_t outlen)
+{
+    Output o;
+    chunk_output(&h->chunk, &o);
+    for (int i = h->cv_stack_len; i > 0; i--) {
+        uint32_t cv[8];
+        output_cv(&o, cv);
+        parent_output(h->cv_stack[i-1], cv, &o);
+    }
+    output_root(&o, out, outlen);
+}
+
+void Blake3Digest(const uint8_t *data, size_t len, uint8_t *out)
+{
+    Blake3Hasher h;
+    Blake3Init(&h);
+    Blake3Update(&h, data, len);
+    Blake3Final(&h, out, BLAKE3_OUT_LEN);
+}
+
+/*
+ * Tree interface
+ */
+
+size_t Blake3LeftLen(size_t len)
+{
+    /* Largest power of 2 chunks that is less than the total chunks. */
+    size_t full_chunks = (len - 1) / BLAKE3_CHUNK_LEN;
+    size_t p = 1;
+    while (p * 2 <= full_chunks) p *= 2;
+    return p * BLAKE3_CHUNK_LEN;
+}
+
+static void subtree_cv(const uint8_t *data, size_t len,
+                       uint64_t chunk_counter, uint32_t cv[8])
+{
+    if (len <= BLAKE3_CHUNK_LEN) {
+        Blake3ChunkState c;
+        Output o;
+        chunk_init(&c, chunk_counter);
+        chunk_update(&c, data, len);
+        chunk_output(&c, &o);
+        output_cv(&o, cv);
+    } else {
+        size_t llen = Blake3LeftLen(len);
+        uint32_t l[8], r[8];
+        Output o;
+        subtree_cv(data, llen, chunk_counter, l);
+        subtree_cv(data + llen, len - llen,
+                   chunk_counter + llen / BLAKE3_CHUNK_LEN, r);
+        parent_output(l, r, &o);
+        output_cv(&o, cv);
+    }
+}
+
+void Blake3SubtreeCV(const uint8_t *data, size_t len,
+                     uint64_t chunk_counter, uint8_t *out)
+{
+    uint32_t cv[8];
+    subtree_cv(data, len, chunk_counter, cv);
+    store_cv(out, cv);
+}
+
+void Blake3ParentCV(const uint8_t *left, const uint8_t *right,
+                    int root, uint8_t *out)
+{
+    uint32_t l[8], r[8];
+    Output o;
+    load_cv(l, left);
+    load_cv(r, right);
+    parent_output(l, r, &o);
+    if (root) {
+        output_root(&o, out, BLAKE3_OUT_LEN);
+    } else {
+        uint32_t cv[8];
+        output_cv(&o, cv);
+        store_cv(out, cv);
+    }
+}
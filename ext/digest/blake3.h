@@ -0,0 +1,97 @@
+/*
+ * blake3.h - BLAKE3 hash function
+ *
+ *   Copyright (c) 2024  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_BLAKE3_H
+#define GAUCHE_BLAKE3_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A portable implementation of BLAKE3 hash mode (no keyed hash or
+ * key derivation).  See https://github.com/BLAKE3-team/BLAKE3-specs
+ *
+ * Besides the usual incremental interface, we expose the tree structure
+ * so that the caller can hash the subtrees of a large input in parallel
+ * and combine the results.
+ */
+
+#define BLAKE3_OUT_LEN    32
+#define BLAKE3_BLOCK_LEN  64
+#define BLAKE3_CHUNK_LEN  1024
+#define BLAKE3_MAX_DEPTH  54
+
+typedef struct {
+    uint32_t cv[8];
+    uint64_t chunk_counter;
+    uint8_t  buf[BLAKE3_BLOCK_LEN];
+    uint8_t  buf_len;
+    uint8_t  blocks_compressed;
+} Blake3ChunkState;
+
+typedef struct {
+    Blake3ChunkState chunk;
+    uint8_t  cv_stack_len;
+    uint32_t cv_stack[BLAKE3_MAX_DEPTH][8];
+} Blake3Hasher;
+
+extern void Blake3Init(Blake3Hasher *h);
+extern void Blake3Update(Blake3Hasher *h, const uint8_t *data, size_t len);
+/* Writes OUTLEN bytes of the extendable output.  It doesn't modify H,
+   so the caller may keep feeding it. */
+extern void Blake3Final(const Blake3Hasher *h, uint8_t *out, size_t outlen);
+
+/* One-shot hash of DATA, LEN bytes, to BLAKE3_OUT_LEN bytes of OUT. */
+extern void Blake3Digest(const uint8_t *data, size_t len, uint8_t *out);
+
+/* Tree interface.
+ *
+ * The input is divided into 1024-byte chunks, and the chunks form a
+ * left-balanced binary tree: for a subtree of N bytes that spans more
+ * than one chunk, the left child covers the largest power-of-two
+ * number of chunks that leaves at least one byte to the right.
+ * Blake3LeftLen returns the byte length of the left child.
+ *
+ * Blake3SubtreeCV computes the chaining value of a non-root subtree
+ * covering LEN bytes of DATA, whose first chunk is CHUNK_COUNTER-th in
+ * the entire input.  Blake3ParentCV combines chaining values of two
+ * children; if ROOT is true, the result is the 32-byte digest of the
+ * whole input instead of a chaining value.  Chaining values and the
+ * digest are exchanged as 32-byte little-endian arrays.
+ */
+extern size_t Blake3LeftLen(size_t len);
+extern void Blake3SubtreeCV(const uint8_t *data, size_t len,
+                            uint64_t chunk_counter, uint8_t *out);
+extern void Blake3ParentCV(const uint8_t *left, const uint8_t *right,
+                           int root, uint8_t *out);
+
+#endif /*GAUCHE_BLAKE3_H*/
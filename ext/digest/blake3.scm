@@ -0,0 +1,232 @@
+;;;
+;;; blake3 - BLAKE3 message-digest
+;;;
+;;;   Copyright (c) 2024  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;;; Cf. https://github.com/BLAKE3-team/BLAKE3-specs
+
+;; BLAKE3 hashes the input as a binary tree of 1KB chunks, so disjoint
+;; parts of a large input can be hashed independently.  When the whole
+;; input is in memory (a string, a uniform vector, or an mmapped file),
+;; we split the tree among threads and combine the results.
+
+(define-module rfc.blake3
+  (use gauche.uvector)
+  (use gauche.threads)
+  (extend util.digest)
+  (export <blake3> blake3-digest blake3-digest-string blake3-digest-file))
+(select-module rfc.blake3)
+
+;;;
+;;;  High-level API
+;;;
+
+(define-constant *blake3-unit-len* 65536)
+
+;; Inputs smaller than this are hashed by a single thread.
+(define-constant *parallel-threshold* (* 1024 1024))
+
+;; We don't split a subtree further if it is smaller than this.
+(define-constant *min-subtree-len* (* 256 1024))
+
+(define (blake3-digest)
+  (let ([ctx (make <blake3-context>)]
+        [buf (make-u8vector *blake3-unit-len*)])
+    (%blake3-init ctx)
+    (generator-for-each
+     (^x (%blake3-update ctx x))
+     (^[] (let1 count (read-block! buf)
+            (cond [(eof-object? count) count]
+                  [(< count *blake3-unit-len*)
+                   (uvector-alias <u8vector> buf 0 count)]
+                  [else buf]))))
+    (%blake3-final ctx)))
+
+;; DATA may be a string, a uniform vector or a memory region.
+(define (blake3-digest-string data)
+  (let1 size (%blake3-data-size data)
+    (if (< size *parallel-threshold*)
+      (%blake3-digest-bytes data)
+      (parallel-digest data size))))
+
+(define (blake3-digest-file path)
+  (call-with-input-file path
+    (^[in]
+      (let1 size (~ (sys-fstat in)'size)
+        (if (< size *parallel-threshold*)
+          (with-input-from-port in blake3-digest)
+          (parallel-digest (sys-mmap in PROT_READ MAP_PRIVATE size) size))))
+    :element-type :binary))
+
+;; Hash subtrees in separate threads, up to the depth to keep all
+;; processors busy.
+(define (parallel-digest data size)
+  (define depth
+    (if (eq? (gauche-thread-type) 'none)
+      0
+      (integer-length (- (max (sys-available-processors) 1) 1))))
+  (define (subtree start len depth root?)
+    (if (or (zero? depth) (< len (* 2 *min-subtree-len*)))
+      (if root?
+        (%blake3-digest-bytes data)
+        (%blake3-subtree-cv data start len))
+      (let* ([llen (%blake3-left-len len)]
+             [t (thread-start!
+                 (make-thread (^[] (subtree start llen (- depth 1) #f))))]
+             [r (subtree (+ start llen) (- len llen) (- depth 1) #f)])
+        (%blake3-parent-cv (thread-join! t) r root?))))
+  (subtree 0 size depth #t))
+
+;;;
+;;; Digest framework
+;;;
+
+(define-class <blake3-meta> (<message-digest-algorithm-meta>) ())
+(define-class <blake3> (<message-digest-algorithm>)
+  (context)
+  :metaclass <blake3-meta>
+  :hmac-block-size 64)
+(define-method initialize ((self <blake3>) initargs)
+  (next-method)
+  (let1 ctx (make <blake3-context>)
+    (%blake3-init ctx)
+    (slot-set! self 'context ctx)))
+(define-method digest-update! ((self <blake3>) data)
+  (%blake3-update (slot-ref self'context) data))
+(define-method digest-final! ((self <blake3>))
+  (%blake3-final (slot-ref self'context)))
+(define-method digest ((class <blake3-meta>))
+  (blake3-digest))
+(define-method digest-message ((class <blake3-meta>) message)
+  (blake3-digest-string message))
+
+;;;
+;;; Low-level bindings
+;;;
+
+(inline-stub
+ (declcode
+  (.include <gauche/priv/configP.h>)
+  (.include <gauche/priv/mmapP.h>)
+  (.include "blake3.h")
+
+  (.define LIBGAUCHE_EXT_BODY)
+  (.include <gauche/extern.h>)      ; fix SCM_EXTERN in SCM_CLASS_DECL
+  )
+
+ (define-ctype ScmBlake3Context::(.struct
+                                  (SCM_HEADER :: ""
+                                   hasher::Blake3Hasher)))
+
+ (define-cclass <blake3-context> :private
+   ScmBlake3Context* "Scm_Blake3ContextClass" ()
+   ()
+   [allocator
+    (let* ([ctx :: ScmBlake3Context* (SCM_NEW_INSTANCE ScmBlake3Context klass)])
+      (cast void initargs)              ; suppress unused var warning
+      (return (SCM_OBJ ctx)))])
+
+ ;; Returns the content of DATA and sets its size to *SIZE.
+ (define-cfn data-bytes (data size::ScmSize*) ::(const uint8_t*) :static
+   (cond
+    [(SCM_UVECTORP data)
+     (set! (* size) (Scm_UVectorSizeInBytes (SCM_UVECTOR data)))
+     (return (cast (const uint8_t*) (SCM_UVECTOR_ELEMENTS data)))]
+    [(SCM_STRINGP data)
+     (let* ([b::(const ScmStringBody*) (SCM_STRING_BODY data)])
+       (set! (* size) (SCM_STRING_BODY_SIZE b))
+       (return (cast (const uint8_t*) (SCM_STRING_BODY_START b))))]
+    [(SCM_MEMORY_REGION_P data)
+     (set! (* size) (-> (SCM_MEMORY_REGION data) size))
+     (return (cast (const uint8_t*) (-> (SCM_MEMORY_REGION data) ptr)))]
+    [else
+     (SCM_TYPE_ERROR data "string, uniform vector or memory region")
+     (return NULL)]))
+
+ (define-cfn make-digest (digest::(const uint8_t*)) :static
+   (return (Scm_MakeString (cast (const char*) digest)
+                           BLAKE3_OUT_LEN BLAKE3_OUT_LEN
+                           (logior SCM_STRING_INCOMPLETE
+                                   SCM_STRING_COPYING))))
+
+ (define-cproc %blake3-init (ctx::<blake3-context>) ::<void>
+   (Blake3Init (& (-> ctx hasher))))
+
+ (define-cproc %blake3-update (ctx::<blake3-context> data) ::<void>
+   (let* ([size::ScmSize 0]
+          [p::(const uint8_t*) (data-bytes data (& size))])
+     (Blake3Update (& (-> ctx hasher)) p size)))
+
+ (define-cproc %blake3-final (ctx::<blake3-context>)
+   (let* ([digest::(.array uint8_t (BLAKE3_OUT_LEN))])
+     (Blake3Final (& (-> ctx hasher)) digest BLAKE3_OUT_LEN)
+     (return (make-digest digest))))
+
+ (define-cproc %blake3-data-size (data) ::<size_t>
+   (let* ([size::ScmSize 0])
+     (data-bytes data (& size))
+     (return size)))
+
+ (define-cproc %blake3-digest-bytes (data)
+   (let* ([size::ScmSize 0]
+          [p::(const uint8_t*) (data-bytes data (& size))]
+          [digest::(.array uint8_t (BLAKE3_OUT_LEN))])
+     (Blake3Digest p size digest)
+     (return (make-digest digest))))
+
+ (define-cproc %blake3-left-len (len::<size_t>) ::<size_t>
+   (return (Blake3LeftLen len)))
+
+ ;; START must be on a chunk boundary.
+ (define-cproc %blake3-subtree-cv (data start::<size_t> len::<size_t>)
+   (let* ([size::ScmSize 0]
+          [p::(const uint8_t*) (data-bytes data (& size))]
+          [cv::(.array uint8_t (BLAKE3_OUT_LEN))])
+     (when (or (!= (% start BLAKE3_CHUNK_LEN) 0)
+               (== len 0)
+               (> (+ start len) (cast size_t size)))
+       (Scm_Error "invalid subtree range: start=%lu, len=%lu"
+                  (cast u_long start) (cast u_long len)))
+     (Blake3SubtreeCV (+ p start) len (/ start BLAKE3_CHUNK_LEN) cv)
+     (return (make-digest cv))))
+
+ (define-cproc %blake3-parent-cv (left::<string> right::<string> root::<boolean>)
+   (let* ([lb::(const ScmStringBody*) (SCM_STRING_BODY left)]
+          [rb::(const ScmStringBody*) (SCM_STRING_BODY right)]
+          [cv::(.array uint8_t (BLAKE3_OUT_LEN))])
+     (unless (and (== (SCM_STRING_BODY_SIZE lb) BLAKE3_OUT_LEN)
+                  (== (SCM_STRING_BODY_SIZE rb) BLAKE3_OUT_LEN))
+       (Scm_Error "chaining values must be %d bytes long" BLAKE3_OUT_LEN))
+     (Blake3ParentCV (cast (const uint8_t*) (SCM_STRING_BODY_START lb))
+                     (cast (const uint8_t*) (SCM_STRING_BODY_START rb))
+                     root cv)
+     (return (make-digest cv))))
+ )
@@ -38,11 +38,12 @@
 (define-module rfc.sha
   (use gauche.uvector)
   (extend util.digest)
-  (export <sha1> sha1-digest sha1-digest-string
-          <sha224> sha224-digest sha224-digest-string
-          <sha256> sha256-digest sha256-digest-string
-          <sha384> sha384-digest sha384-digest-string
-          <sha512> sha512-digest sha512-digest-string))
+  (export <sha1> sha1-digest sha1-digest-string sha1-digest-batch
+          <sha224> sha224-digest sha224-digest-string sha224-digest-batch
+          <sha256> sha256-digest sha256-digest-string sha256-digest-batch
+          <sha384> sha384-digest sha384-digest-string sha384-digest-batch
+          <sha512> sha512-digest sha512-digest-string sha512-digest-batch
+          sha-hardware-features))
 (select-module rfc.sha)
 
 ;;;
@@ -70,11 +71,20 @@
 (define sha384-digest (gen-digest %sha384-init %sha384-update %sha384-final))
 (define sha512-digest (gen-digest %sha512-init %sha512-update %sha512-final))
 
-(define (sha1-digest-string s)   (with-input-from-string s sha1-digest))
-(define (sha224-digest-string s) (with-input-from-string s sha224-digest))
-(define (sha256-digest-string s) (with-input-from-string s sha256-digest))
-(define (sha384-digest-string s) (with-input-from-string s sha384-digest))
-(define (sha512-digest-string s) (with-input-from-string s sha512-digest))
+;; These digest the bytes of the given string, uniform vector or memory
+;; region in place, without going through a port.
+(define (sha1-digest-string s)   (%sha1-digest-bytes s))
+(define (sha224-digest-string s) (%sha224-digest-bytes s))
+(define (sha256-digest-string s) (%sha256-digest-bytes s))
+(define (sha384-digest-string s) (%sha384-digest-bytes s))
+(define (sha512-digest-string s) (%sha512-digest-bytes s))
+
+;; Digest each message in a list, returning a list of digests.
+(define (sha1-digest-batch msgs)   (%sha1-digest-batch msgs))
+(define (sha224-digest-batch msgs) (%sha224-digest-batch msgs))
+(define (sha256-digest-batch msgs) (%sha256-digest-batch msgs))
+(define (sha384-digest-batch msgs) (%sha384-digest-batch msgs))
+(define (sha512-digest-batch msgs) (%sha512-digest-batch msgs))
 
 ;;;
 ;;; Digest framework
@@ -86,6 +96,7 @@
         [init   (string->symbol #"%sha~|n|-init")]
         [update (string->symbol #"%sha~|n|-update")]
         [final  (string->symbol #"%sha~|n|-final")]
+        [bytes  (string->symbol #"%sha~|n|-digest-bytes")]
         [digest (string->symbol #"sha~|n|-digest")])
     `(begin
        (define-class ,meta (<message-digest-algorithm-meta>) ())
@@ -103,7 +114,9 @@
        (define-method digest-final! ((self ,cls))
          (,final (slot-ref self'context)))
        (define-method digest ((class ,meta))
-         (,digest)))))
+         (,digest))
+       (define-method digest-message ((class ,meta) message)
+         (,bytes message)))))
 
 (define-framework 1    64)
 (define-framework 224  64)
@@ -118,10 +131,12 @@
 (inline-stub
  (declcode
   (.include <gauche/priv/configP.h>)
+  (.include <gauche/priv/mmapP.h>)
 
   ;; customization for sha2.h
   (.define SHA2_USE_INTTYPES_H)         ; use uintXX_t
   (.include "sha2.h")
+  (.include "shahw.h")
 
   (.define LIBGAUCHE_EXT_BODY)
   (.include <gauche/extern.h>)      ; fix SCM_EXTERN in SCM_CLASS_DECL
@@ -150,20 +165,30 @@
  (define-cproc %sha512-init (ctx::<sha-context>) ::<void>
    (SHA512_Init (& (-> ctx ctx))))
 
+ ;; Returns the content of DATA and sets its size to *SIZE.  We digest
+ ;; the bytes in place, so a large uniform vector or an mmapped region
+ ;; can be digested without copying.
+ (define-cfn data-bytes (data size::ScmSize*) ::(const uint8_t*) :static
+   (cond
+    [(SCM_UVECTORP data)
+     (set! (* size) (Scm_UVectorSizeInBytes (SCM_UVECTOR data)))
+     (return (cast (const uint8_t*) (SCM_UVECTOR_ELEMENTS data)))]
+    [(SCM_STRINGP data)
+     (let* ([b::(const ScmStringBody*) (SCM_STRING_BODY data)])
+       (set! (* size) (SCM_STRING_BODY_SIZE b))
+       (return (cast (const uint8_t*) (SCM_STRING_BODY_START b))))]
+    [(SCM_MEMORY_REGION_P data)
+     (set! (* size) (-> (SCM_MEMORY_REGION data) size))
+     (return (cast (const uint8_t*) (-> (SCM_MEMORY_REGION data) ptr)))]
+    [else
+     (SCM_TYPE_ERROR data "string, uniform vector or memory region")
+     (return NULL)]))
+
  (define-cise-stmt common-update
    [(_ update ctx data)
-    `(cond
-      [(SCM_U8VECTORP ,data)
-       (,update (& (-> ,ctx ctx))
-                (cast (const unsigned char*)
-                      (SCM_UVECTOR_ELEMENTS (SCM_U8VECTOR ,data)))
-                (SCM_U8VECTOR_SIZE (SCM_U8VECTOR ,data)))]
-      [(SCM_STRINGP ,data)
-       (let* ([b::(const ScmStringBody*) (SCM_STRING_BODY ,data)])
-         (,update (& (-> ,ctx ctx))
-                  (cast (const unsigned char*) (SCM_STRING_BODY_START b))
-                  (SCM_STRING_BODY_SIZE b)))]
-      [else (SCM_TYPE_ERROR ,data "u8vector or string")])])
+    `(let* ([size::ScmSize 0]
+            [p::(const uint8_t*) (data-bytes ,data (& size))])
+       (,update (& (-> ,ctx ctx)) p size))])
 
  (define-cproc %sha1-update (ctx::<sha-context> data) ::<void>
    (common-update SHA1_Update ctx data))
@@ -195,4 +220,89 @@
    (common-final SHA384_Final ctx SHA384_DIGEST_LENGTH))
  (define-cproc %sha512-final (ctx::<sha-context>)
    (common-final SHA512_Final ctx SHA512_DIGEST_LENGTH))
+
+ (define-cfn make-digest (digest::(const uint8_t*) size::int) :static
+   (return (Scm_MakeString (cast (const char*) digest) size size
+                           (logior SCM_STRING_INCOMPLETE
+                                   SCM_STRING_COPYING))))
+
+ ;; One-shot digest, without allocating <sha-context>.
+ (define-cise-stmt common-digest-bytes
+   [(_ algo data)
+    (let ([init   (string->symbol #"~|algo|_Init")]
+          [update (string->symbol #"~|algo|_Update")]
+          [final  (string->symbol #"~|algo|_Final")]
+          [len    (string->symbol #"~|algo|_DIGEST_LENGTH")])
+      `(let* ([ctx::SHA_CTX]
+              [size::ScmSize 0]
+              [p::(const uint8_t*) (data-bytes ,data (& size))]
+              [digest::(.array uint8_t (,len))])
+         (,init (& ctx))
+         (,update (& ctx) p size)
+         (,final digest (& ctx))
+         (return (make-digest digest ,len))))])
+
+ (define-cproc %sha1-digest-bytes (data)   (common-digest-bytes SHA1 data))
+ (define-cproc %sha224-digest-bytes (data) (common-digest-bytes SHA224 data))
+ (define-cproc %sha256-digest-bytes (data) (common-digest-bytes SHA256 data))
+ (define-cproc %sha384-digest-bytes (data) (common-digest-bytes SHA384 data))
+ (define-cproc %sha512-digest-bytes (data) (common-digest-bytes SHA512 data))
+
+ (define-cise-stmt common-digest-batch
+   [(_ algo msgs)
+    (let ([init   (string->symbol #"~|algo|_Init")]
+          [update (string->symbol #"~|algo|_Update")]
+          [final  (string->symbol #"~|algo|_Final")]
+          [len    (string->symbol #"~|algo|_DIGEST_LENGTH")])
+      `(let* ([h SCM_NIL] [t SCM_NIL])
+         (dolist [m ,msgs]
+           (let* ([ctx::SHA_CTX]
+                  [size::ScmSize 0]
+                  [p::(const uint8_t*) (data-bytes m (& size))]
+                  [digest::(.array uint8_t (,len))])
+             (,init (& ctx))
+             (,update (& ctx) p size)
+             (,final digest (& ctx))
+             (SCM_APPEND1 h t (make-digest digest ,len))))
+         (return h)))])
+
+ (define-cproc %sha1-digest-batch (msgs::<list>)
+   (common-digest-batch SHA1 msgs))
+ (define-cproc %sha224-digest-batch (msgs::<list>)
+   (common-digest-batch SHA224 msgs))
+ (define-cproc %sha384-digest-batch (msgs::<list>)
+   (common-digest-batch SHA384 msgs))
+ (define-cproc %sha512-digest-batch (msgs::<list>)
+   (common-digest-batch SHA512 msgs))
+
+ ;; SHA-256 may hash multiple messages in parallel SIMD lanes.
+ (define-cproc %sha256-digest-batch (msgs::<list>)
+   (let* ([n::ScmSize (Scm_Length msgs)]
+          [ps::(const uint8_t**) (SCM_NEW_ATOMIC_ARRAY (.type const uint8_t*) n)]
+          [lens::size_t* (SCM_NEW_ATOMIC_ARRAY (.type size_t) n)]
+          [out::uint8_t* (SCM_NEW_ATOMIC_ARRAY (.type uint8_t)
+                                               (* n SHA256_DIGEST_LENGTH))]
+          [i::ScmSize 0])
+     (dolist [m msgs]
+       (let* ([size::ScmSize 0])
+         (set! (aref ps i) (data-bytes m (& size))
+               (aref lens i) size)
+         (post++ i)))
+     (Scm_SHA256DigestMany ps lens n out)
+     (let* ([h SCM_NIL] [t SCM_NIL])
+       (dotimes [k n]
+         (SCM_APPEND1 h t (make-digest (+ out (* k SHA256_DIGEST_LENGTH))
+                                       SHA256_DIGEST_LENGTH)))
+       (return h))))
+
+ (define-cproc sha-hardware-features ()
+   (let* ([f::int (Scm_ShaHwFeatures)]
+          [r SCM_NIL])
+     (when (logand f SCM_SHA_HW_AVX2)
+       (set! r (Scm_Cons 'avx2 r)))
+     (when (logand f SCM_SHA_HW_SHANI)
+       (set! r (Scm_Cons 'sha-ni r)))
+     (return r)))
+
+ (initcode (Scm_ShaHwInit))
  )
@@ -36,6 +36,7 @@
 #include <string.h>	/* memcpy()/memset() or bcopy()/bzero() */
 #include <assert.h>	/* assert() */
 #include "sha2.h"
+#include "shahw.h"
 
 /*
  * ASSERT NOTE:
@@ -639,6 +640,19 @@ void SHA1_Internal_Transform(SHA_CTX* context, const sha_word32* data) {
 
 #endif /* SHA2_UNROLL_TRANSFORM */
 
+/* [SK] Process NBLOCKS 64-byte blocks, using the hardware-accelerated
+   routine if the CPU supports it (see shahw.c). */
+static void SHA1_Blocks(SHA_CTX* context, const sha_byte *data, size_t nblocks) {
+        if (Scm_SHA1HwBlocks != NULL) {
+                Scm_SHA1HwBlocks(context->s1.state, data, nblocks);
+                return;
+        }
+        while (nblocks-- > 0) {
+                SHA1_Internal_Transform(context, (const sha_word32*)data);
+                data += 64;
+        }
+}
+
 void SHA1_Update(SHA_CTX* context, const sha_byte *data, size_t len) {
         unsigned int	freespace, usedspace;
         if (len == 0) {
@@ -660,7 +674,7 @@ void SHA1_Update(SHA_CTX* context, const sha_byte *data, size_t len) {
                         context->s1.bitcount += freespace << 3;
                         len -= freespace;
                         data += freespace;
-                        SHA1_Internal_Transform(context, (sha_word32*)context->s1.buffer);
+                        SHA1_Blocks(context, context->s1.buffer, 1);
                 } else {
                         /* The buffer is not yet full */
                         MEMCPY_BCOPY(&context->s1.buffer[usedspace], data, len);
@@ -670,12 +684,13 @@ void SHA1_Update(SHA_CTX* context, const sha_byte *data, size_t len) {
                         return;
                 }
         }
-        while (len >= 64) {
+        if (len >= 64) {
                 /* Process as many complete blocks as we can */
-                SHA1_Internal_Transform(context, (sha_word32*)data);
-                context->s1.bitcount += 512;
-                len -= 64;
-                data += 64;
+                size_t nblocks = len / 64;
+                SHA1_Blocks(context, data, nblocks);
+                context->s1.bitcount += (sha_word64)nblocks << 9;
+                len -= nblocks * 64;
+                data += nblocks * 64;
         }
         if (len > 0) {
                 /* There's left-overs, so save 'em */
@@ -721,7 +736,7 @@ void SHA1_Final(sha_byte digest[SHA1_DIGEST_LENGTH], SHA_CTX* context) {
                                 MEMSET_BZERO(&context->s1.buffer[usedspace], 64 - usedspace);
                         }
                         /* Do second-to-last transform: */
-                        SHA1_Internal_Transform(context, (sha_word32*)context->s1.buffer);
+                        SHA1_Blocks(context, context->s1.buffer, 1);
 
                         /* And set-up for the last transform: */
                         MEMSET_BZERO(context->s1.buffer, 56);
@@ -744,7 +759,7 @@ void SHA1_Final(sha_byte digest[SHA1_DIGEST_LENGTH], SHA_CTX* context) {
         buf56[0] = (context->s1.bitcount >> 56) & 0xff;
 
         /* Final transform: */
-        SHA1_Internal_Transform(context, (sha_word32*)context->s1.buffer);
+        SHA1_Blocks(context, context->s1.buffer, 1);
 
         /* Save the hash data for output: */
 #if BYTE_ORDER == LITTLE_ENDIAN
@@ -985,6 +1000,19 @@ void SHA256_Internal_Transform(SHA_CTX* context, const sha_word32* data) {
 
 #endif /* SHA2_UNROLL_TRANSFORM */
 
+/* [SK] Process NBLOCKS 64-byte blocks, using the hardware-accelerated
+   routine if the CPU supports it (see shahw.c). */
+static void SHA256_Blocks(SHA_CTX* context, const sha_byte *data, size_t nblocks) {
+        if (Scm_SHA256HwBlocks != NULL) {
+                Scm_SHA256HwBlocks(context->s256.state, data, nblocks);
+                return;
+        }
+        while (nblocks-- > 0) {
+                SHA256_Internal_Transform(context, (const sha_word32*)data);
+                data += 64;
+        }
+}
+
 void SHA256_Update(SHA_CTX* context, const sha_byte *data, size_t len) {
         unsigned int	freespace, usedspace;
 
@@ -1007,7 +1035,7 @@ void SHA256_Update(SHA_CTX* context, const sha_byte *data, size_t len) {
                         context->s256.bitcount += freespace << 3;
                         len -= freespace;
                         data += freespace;
-                        SHA256_Internal_Transform(context, (sha_word32*)context->s256.buffer);
+                        SHA256_Blocks(context, context->s256.buffer, 1);
                 } else {
                         /* The buffer is not yet full */
                         MEMCPY_BCOPY(&context->s256.buffer[usedspace], data, len);
@@ -1017,12 +1045,13 @@ void SHA256_Update(SHA_CTX* context, const sha_byte *data, size_t len) {
                         return;
                 }
         }
-        while (len >= 64) {
+        if (len >= 64) {
                 /* Process as many complete blocks as we can */
-                SHA256_Internal_Transform(context, (sha_word32*)data);
-                context->s256.bitcount += 512;
-                len -= 64;
-                data += 64;
+                size_t nblocks = len / 64;
+                SHA256_Blocks(context, data, nblocks);
+                context->s256.bitcount += (sha_word64)nblocks << 9;
+                len -= nblocks * 64;
+                data += nblocks * 64;
         }
         if (len > 0) {
                 /* There's left-overs, so save 'em */
@@ -1049,7 +1078,7 @@ void SHA256_Internal_Last(SHA_CTX* context) {
                                 MEMSET_BZERO(&context->s256.buffer[usedspace], 64 - usedspace);
                         }
                         /* Do second-to-last transform: */
-                        SHA256_Internal_Transform(context, (sha_word32*)context->s256.buffer);
+                        SHA256_Blocks(context, context->s256.buffer, 1);
 
                         /* And set-up for the last transform: */
                         MEMSET_BZERO(context->s256.buffer, 56);
@@ -1076,7 +1105,7 @@ void SHA256_Internal_Last(SHA_CTX* context) {
         buf56[0] = (context->s256.bitcount >> 56) & 0xff;
 
         /* Final transform: */
-        SHA256_Internal_Transform(context, (sha_word32*)context->s256.buffer);
+        SHA256_Blocks(context, context->s256.buffer, 1);
 }
 
 void SHA256_Final(sha_byte digest[SHA256_DIGEST_LENGTH], SHA_CTX* context) {
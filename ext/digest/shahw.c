@@ -0,0 +1,430 @@
+/*
+ * shahw.c - Hardware-accelerated SHA-1/SHA-256 block functions
+ *
+ *   Copyright (c) 2024  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include "sha2.h"
+#include "shahw.h"
+
+/* We compile the accelerated routines with per-function target
+ * attributes, so that the rest of the module doesn't require those
+ * instruction sets, and pick them at runtime by cpuid.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) \
+    && (defined(__clang__) || __GNUC__ >= 5)
+#define SHAHW_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+ScmShaBlocksProc Scm_SHA1HwBlocks = NULL;
+ScmShaBlocksProc Scm_SHA256HwBlocks = NULL;
+
+static int hw_features = 0;
+
+#if defined(SHAHW_X86)
+
+static const uint32_t K256[64] = {
+    0x428a2f98UL, 0x71374491UL, 0xb5c0fbcfUL, 0xe9b5dba5UL,
+    0x3956c25bUL, 0x59f111f1UL, 0x923f82a4UL, 0xab1c5ed5UL,
+    0xd807aa98UL, 0x12835b01UL, 0x243185beUL, 0x550c7dc3UL,
+    0x72be5d74UL, 0x80deb1feUL, 0x9bdc06a7UL, 0xc19bf174UL,
+    0xe49b69c1UL, 0xefbe4786UL, 0x0fc19dc6UL, 0x240ca1ccUL,
+    0x2de92c6fUL, 0x4a7484aaUL, 0x5cb0a9dcUL, 0x76f988daUL,
+    0x983e5152UL, 0xa831c66dUL, 0xb00327c8UL, 0xbf597fc7UL,
+    0xc6e00bf3UL, 0xd5a79147UL, 0x06ca6351UL, 0x14292967UL,
+    0x27b70a85UL, 0x2e1b2138UL, 0x4d2c6dfcUL, 0x53380d13UL,
+    0x650a7354UL, 0x766a0abbUL, 0x81c2c92eUL, 0x92722c85UL,
+    0xa2bfe8a1UL, 0xa81a664bUL, 0xc24b8b70UL, 0xc76c51a3UL,
+    0xd192e819UL, 0xd6990624UL, 0xf40e3585UL, 0x106aa070UL,
+    0x19a4c116UL, 0x1e376c08UL, 0x2748774cUL, 0x34b0bcb5UL,
+    0x391c0cb3UL, 0x4ed8aa4aUL, 0x5b9cca4fUL, 0x682e6ff3UL,
+    0x748f82eeUL, 0x78a5636fUL, 0x84c87814UL, 0x8cc70208UL,
+    0x90befffaUL, 0xa4506cebUL, 0xbef9a3f7UL, 0xc67178f2UL
+};
+
+static const uint32_t sha256_iv[8] = {
+    0x6a09e667UL, 0xbb67ae85UL, 0x3c6ef372UL, 0xa54ff53aUL,
+    0x510e527fUL, 0x9b05688cUL, 0x1f83d9abUL, 0x5be0cd19UL
+};
+
+/*=================================================================
+ * SHA extensions
+ */
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha1_blocks_shani(uint32_t *state, const uint8_t *data,
+                              size_t nblocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL,
+                                        0x08090a0b0c0d0e0fULL);
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state),
+                                     0x1b);
+    __m128i e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+    while (nblocks-- > 0) {
+        __m128i abcd_save = abcd, e0_save = e0, prev = abcd, e;
+        __m128i w[4];
+
+        /* 20 groups of 4 rounds.  W[g&3] holds the message words of
+           group g; it is computed from the preceding four groups. */
+        for (int g = 0; g < 20; g++) {
+            if (g < 4) {
+                w[g] = _mm_shuffle_epi8(
+                    _mm_loadu_si128((const __m128i*)(data + 16*g)), mask);
+            } else {
+                __m128i m = _mm_sha1msg1_epu32(w[g&3], w[(g+1)&3]);
+                m = _mm_xor_si128(m, w[(g+2)&3]);
+                w[g&3] = _mm_sha1msg2_epu32(m, w[(g+3)&3]);
+            }
+            if (g == 0) e = _mm_add_epi32(e0, w[0]);
+            else        e = _mm_sha1nexte_epu32(prev, w[g&3]);
+            prev = abcd;
+            /* The function selector must be an immediate. */
+            switch (g/5) {
+            case 0: abcd = _mm_sha1rnds4_epu32(abcd, e, 0); break;
+            case 1: abcd = _mm_sha1rnds4_epu32(abcd, e, 1); break;
+            case 2: abcd = _mm_sha1rnds4_epu32(abcd, e, 2); break;
+            default:abcd = _mm_sha1rnds4_epu32(abcd, e, 3); break;
+            }
+        }
+        e0 = _mm_sha1nexte_epu32(prev, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+        data += 64;
+    }
+
+    _mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(abcd, 0x1b));
+    state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha256_blocks_shani(uint32_t *state, const uint8_t *data,
+                                size_t nblocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                        0x0405060700010203ULL);
+    /* The instructions want the state as (ABEF, CDGH). */
+    __m128i t  = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]),
+                                   0xb1);
+    __m128i s1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]),
+                                   0x1b);
+    __m128i s0 = _mm_alignr_epi8(t, s1, 8);
+    s1 = _mm_blend_epi16(s1, t, 0xf0);
+
+    while (nblocks-- > 0) {
+        __m128i s0_save = s0, s1_save = s1;
+        __m128i w[4];
+
+        for (int g = 0; g < 16; g++) {
+            if (g < 4) {
+                w[g] = _mm_shuffle_epi8(
+                    _mm_loadu_si128((const __m128i*)(data + 16*g)), mask);
+            } else {
+                __m128i m = _mm_sha256msg1_epu32(w[g&3], w[(g+1)&3]);
+                m = _mm_add_epi32(m, _mm_alignr_epi8(w[(g+3)&3],
+                                                     w[(g+2)&3], 4));
+                w[g&3] = _mm_sha256msg2_epu32(m, w[(g+3)&3]);
+            }
+            __m128i k = _mm_add_epi32(w[g&3],
+                                      _mm_loadu_si128((const __m128i*)&K256[4*g]));
+            s1 = _mm_sha256rnds2_epu32(s1, s0, k);
+            s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(k, 0x0e));
+        }
+        s0 = _mm_add_epi32(s0, s0_save);
+        s1 = _mm_add_epi32(s1, s1_save);
+        data += 64;
+    }
+
+    t  = _mm_shuffle_epi32(s0, 0x1b);
+    s1 = _mm_shuffle_epi32(s1, 0xb1);
+    _mm_storeu_si128((__m128i*)&state[0], _mm_blend_epi16(t, s1, 0xf0));
+    _mm_storeu_si128((__m128i*)&state[4], _mm_alignr_epi8(s1, t, 8));
+}
+
+/*=================================================================
+ * AVX2 multi-buffer SHA-256
+ *
+ * Each 32-bit lane of a 256-bit register carries an independent
+ * message, so eight compressions run at once.  It doesn't help a single
+ * long message, but it wins for a bunch of short ones on CPUs without
+ * SHA extensions.
+ */
+
+#define LANES 8
+
+#define ROTR8(x, n) \
+    _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32-(n)))
+
+static inline uint32_t load_be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0]<<24)|((uint32_t)p[1]<<16)
+        |((uint32_t)p[2]<<8)|(uint32_t)p[3];
+}
+
+/* ST[word] holds that state word of all lanes.  BLOCKS[lane] points to
+   the 64-byte block to feed to the lane. */
+__attribute__((target("avx2")))
+static void sha256_x8_block(__m256i st[8], const uint8_t *blocks[LANES])
+{
+    __m256i w[64];
+    for (int t = 0; t < 16; t++) {
+        w[t] = _mm256_setr_epi32((int)load_be32(blocks[0] + 4*t),
+                                 (int)load_be32(blocks[1] + 4*t),
+                                 (int)load_be32(blocks[2] + 4*t),
+                                 (int)load_be32(blocks[3] + 4*t),
+                                 (int)load_be32(blocks[4] + 4*t),
+                                 (int)load_be32(blocks[5] + 4*t),
+                                 (int)load_be32(blocks[6] + 4*t),
+                                 (int)load_be32(blocks[7] + 4*t));
+    }
+    for (int t = 16; t < 64; t++) {
+        __m256i x = w[t-15], y = w[t-2];
+        __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(x, 7),
+                                                       ROTR8(x, 18)),
+                                      _mm256_srli_epi32(x, 3));
+        __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(y, 17),
+                                                       ROTR8(y, 19)),
+                                      _mm256_srli_epi32(y, 10));
+        w[t] = _mm256_add_epi32(_mm256_add_epi32(w[t-16], s0),
+                                _mm256_add_epi32(w[t-7], s1));
+    }
+
+    __m256i a = st[0], b = st[1], c = st[2], d = st[3];
+    __m256i e = st[4], f = st[5], g = st[6], h = st[7];
+    for (int t = 0; t < 64; t++) {
+        __m256i S1 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(e, 6),
+                                                       ROTR8(e, 11)),
+                                      ROTR8(e, 25));
+        __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f),
+                                      _mm256_andnot_si256(e, g));
+        __m256i t1 = _mm256_add_epi32(
+            _mm256_add_epi32(_mm256_add_epi32(h, S1), ch),
+            _mm256_add_epi32(_mm256_set1_epi32((int)K256[t]), w[t]));
+        __m256i S0 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(a, 2),
+                                                       ROTR8(a, 13)),
+                                      ROTR8(a, 22));
+        __m256i maj = _mm256_xor_si256(
+            _mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)),
+            _mm256_and_si256(b, c));
+        __m256i t2 = _mm256_add_epi32(S0, maj);
+        h = g; g = f; f = e;
+        e = _mm256_add_epi32(d, t1);
+        d = c; c = b; b = a;
+        a = _mm256_add_epi32(t1, t2);
+    }
+    st[0] = _mm256_add_epi32(st[0], a);
+    st[1] = _mm256_add_epi32(st[1], b);
+    st[2] = _mm256_add_epi32(st[2], c);
+    st[3] = _mm256_add_epi32(st[3], d);
+    st[4] = _mm256_add_epi32(st[4], e);
+    st[5] = _mm256_add_epi32(st[5], f);
+    st[6] = _mm256_add_epi32(st[6], g);
+    st[7] = _mm256_add_epi32(st[7], h);
+}
+
+/* A lane walks the full blocks of its message in place, then one or
+   two padded blocks made from the tail. */
+typedef struct {
+    const uint8_t *p;           /* next full block */
+    size_t nfull;               /* # of remaining full blocks */
+    uint8_t tail[128];
+    int ntail;                  /* # of padded tail blocks */
+    int tailpos;                /* # of tail blocks consumed */
+    long idx;                   /* message index, or -1 if idle */
+} Lane;
+
+static void lane_start(Lane *l, const uint8_t *msg, size_t len, long idx)
+{
+    size_t rem = len % 64;
+    uint64_t bits = (uint64_t)len * 8;
+
+    l->p = msg;
+    l->nfull = len / 64;
+    memset(l->tail, 0, sizeof(l->tail));
+    if (rem > 0) memcpy(l->tail, msg + len - rem, rem);
+    l->tail[rem] = 0x80;
+    l->ntail = (rem < 56) ? 1 : 2;
+    for (int i = 0; i < 8; i++) {
+        l->tail[l->ntail*64 - 1 - i] = (uint8_t)(bits >> (i*8));
+    }
+    l->tailpos = 0;
+    l->idx = idx;
+}
+
+static const uint8_t *lane_next(Lane *l)
+{
+    if (l->nfull > 0) {
+        const uint8_t *b = l->p;
+        l->p += 64;
+        l->nfull--;
+        return b;
+    }
+    return l->tail + 64 * (l->tailpos++);
+}
+
+static int lane_done(Lane *l)
+{
+    return l->nfull == 0 && l->tailpos == l->ntail;
+}
+
+__attribute__((target("avx2")))
+static void sha256_many_avx2(const uint8_t **msgs, const size_t *lens,
+                             size_t n, uint8_t *out)
+{
+    static const uint8_t zero_block[64] = {0};
+    Lane lanes[LANES];
+    __m256i st[8];
+    uint32_t words[8][LANES];
+    size_t next = 0;
+
+    for (int w = 0; w < 8; w++) {
+        for (int k = 0; k < LANES; k++) words[w][k] = sha256_iv[w];
+    }
+    for (int k = 0; k < LANES; k++) {
+        if (next < n) {
+            lane_start(&lanes[k], msgs[next], lens[next], (long)next);
+            next++;
+        } else {
+            lanes[k].idx = -1;
+        }
+    }
+    for (int w = 0; w < 8; w++) {
+        st[w] = _mm256_loadu_si256((const __m256i*)words[w]);
+    }
+
+    for (;;) {
+        const uint8_t *blocks[LANES];
+        int active = 0;
+        for (int k = 0; k < LANES; k++) {
+            if (lanes[k].idx >= 0) {
+                blocks[k] = lane_next(&lanes[k]);
+                active++;
+            } else {
+                blocks[k] = zero_block;
+            }
+        }
+        if (active == 0) break;
+        sha256_x8_block(st, blocks);
+
+        /* Retire finished lanes and refill them with pending messages. */
+        int dirty = 0;
+        for (int k = 0; k < LANES; k++) {
+            if (lanes[k].idx < 0 || !lane_done(&lanes[k])) continue;
+            if (!dirty) {
+                for (int w = 0; w < 8; w++) {
+                    _mm256_storeu_si256((__m256i*)words[w], st[w]);
+                }
+                dirty = 1;
+            }
+            uint8_t *o = out + 32 * lanes[k].idx;
+            for (int w = 0; w < 8; w++) {
+                o[w*4]   = (uint8_t)(words[w][k] >> 24);
+                o[w*4+1] = (uint8_t)(words[w][k] >> 16);
+                o[w*4+2] = (uint8_t)(words[w][k] >> 8);
+                o[w*4+3] = (uint8_t)(words[w][k]);
+                words[w][k] = sha256_iv[w];
+            }
+            if (next < n) {
+                lane_start(&lanes[k], msgs[next], lens[next], (long)next);
+                next++;
+            } else {
+                lanes[k].idx = -1;
+            }
+        }
+        if (dirty) {
+            for (int w = 0; w < 8; w++) {
+                st[w] = _mm256_loadu_si256((const __m256i*)words[w]);
+            }
+        }
+    }
+}
+
+static int detect_features(void)
+{
+    unsigned int a, b, c, d;
+    int r = 0;
+
+    if (!__get_cpuid(1, &a, &b, &c, &d)) return 0;
+    int sse41 = (c & bit_SSE4_1) != 0;
+    int ssse3 = (c & bit_SSSE3) != 0;
+    /* AVX requires the OS to save ymm registers (OSXSAVE + XCR0). */
+    int avx = 0;
+    if ((c & bit_OSXSAVE) && (c & bit_AVX)) {
+        unsigned int lo, hi;
+        __asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        avx = (lo & 0x6) == 0x6;
+    }
+
+    if (__get_cpuid_max(0, NULL) < 7) return 0;
+    __cpuid_count(7, 0, a, b, c, d);
+    if ((b & bit_SHA) && sse41 && ssse3) r |= SCM_SHA_HW_SHANI;
+    if ((b & bit_AVX2) && avx)           r |= SCM_SHA_HW_AVX2;
+    return r;
+}
+
+#endif /* SHAHW_X86 */
+
+int Scm_ShaHwInit(void)
+{
+#if defined(SHAHW_X86)
+    hw_features = detect_features();
+    if (hw_features & SCM_SHA_HW_SHANI) {
+        Scm_SHA1HwBlocks = sha1_blocks_shani;
+        Scm_SHA256HwBlocks = sha256_blocks_shani;
+    }
+#endif /* SHAHW_X86 */
+    return hw_features;
+}
+
+int Scm_ShaHwFeatures(void)
+{
+    return hw_features;
+}
+
+void Scm_SHA256DigestMany(const uint8_t **msgs, const size_t *lens,
+                          size_t n, uint8_t *out)
+{
+#if defined(SHAHW_X86)
+    /* A single SHA-NI stream is faster than 8 AVX2 lanes. */
+    if (n > 1 && (hw_features & SCM_SHA_HW_AVX2)
+        && !(hw_features & SCM_SHA_HW_SHANI)) {
+        sha256_many_avx2(msgs, lens, n, out);
+        return;
+    }
+#endif /* SHAHW_X86 */
+    for (size_t i = 0; i < n; i++) {
+        SHA_CTX ctx;
+        SHA256_Init(&ctx);
+        SHA256_Update(&ctx, msgs[i], lens[i]);
+        SHA256_Final(out + 32*i, &ctx);
+    }
+}
@@ -0,0 +1,71 @@
+/*
+ * shahw.h - Hardware-accelerated SHA-1/SHA-256 block functions
+ *
+ *   Copyright (c) 2024  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_SHAHW_H
+#define GAUCHE_SHAHW_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Block functions process NBLOCKS consecutive 64-byte blocks of DATA,
+ * updating STATE (5 words for SHA-1, 8 words for SHA-256) in place.
+ * They don't touch the bit count nor the buffer of SHA_CTX; sha2.c
+ * takes care of them.
+ *
+ * The pointers are set up by Scm_ShaHwInit according to what the
+ * running CPU supports, and remain NULL if no acceleration is available.
+ */
+typedef void (*ScmShaBlocksProc)(uint32_t *state, const uint8_t *data,
+                                 size_t nblocks);
+
+extern ScmShaBlocksProc Scm_SHA1HwBlocks;
+extern ScmShaBlocksProc Scm_SHA256HwBlocks;
+
+/* Feature bits returned by Scm_ShaHwInit */
+enum {
+    SCM_SHA_HW_SHANI = (1<<0),  /* SHA extensions (SHA-1 and SHA-256) */
+    SCM_SHA_HW_AVX2  = (1<<1)   /* 8-way multi-buffer SHA-256 */
+};
+
+extern int  Scm_ShaHwInit(void);
+extern int  Scm_ShaHwFeatures(void);
+
+/* Multi-buffer SHA-256.  Computes digests of N messages, MSGS[i] with
+ * LENS[i] bytes, into OUT + 32*i.  When the CPU has AVX2 but not SHA
+ * extensions, eight messages are hashed in parallel lanes; otherwise
+ * it just loops over the messages.
+ */
+extern void Scm_SHA256DigestMany(const uint8_t **msgs, const size_t *lens,
+                                 size_t n, uint8_t *out);
+
+#endif /*GAUCHE_SHAHW_H*/
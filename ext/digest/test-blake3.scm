@@ -0,0 +1,60 @@
+;;
+;; test for blake3 module
+;;
+
+(use gauche.test)
+(test-start "blake3")
+(test-section "blake3")
+
+(use gauche.uvector)
+(use gauche.vport)
+(use file.util)
+
+(use rfc.blake3)
+(test-module 'rfc.blake3)
+
+;; Input of the official test vectors: repeating 0, 1, ..., 250
+(define (test-input len)
+  (let1 v (make-u8vector len)
+    (dotimes [i len] (u8vector-set! v i (modulo i 251)))
+    v))
+
+(for-each
+ (^[args]
+   (let ([expected (car args)]
+         [input (test-input (cadr args))])
+     (test* #"blake3-digest-string ~(cadr args)" expected
+            (digest-hexify (blake3-digest-string input)))
+     (test* #"blake3-digest ~(cadr args)" expected
+            (digest-hexify (with-input-from-port (open-input-uvector input)
+                             blake3-digest)))))
+ '(("af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262" 0)
+   ("2d3adedff11b61f14c886e35afa036736dcd87a74d27b5c1510225d0f592e213" 1)
+   ("42214739f095a406f3fc83deb889744ac00df831c10daa55189b5d121c855af7" 1024)
+   ("d00278ae47eb27b34faecf67b4fe263f82d5412916c1ffd97c8cb7fb814b8444" 1025)
+   ("bc3e3d41a1146b069abffad3c0d44860cf664390afce4d9661f7902e7943e085" 102400)))
+
+(test* "digest-message-to" "6437b3ac38465133ffb63b75273a8db548c558465d79db03fd359c6cd5bd9d85"
+       (digest-message-to 'hex <blake3> "abc"))
+
+(test* "incremental" (blake3-digest-string "abcdefghijklmnopqrstuvwxyz")
+       (let1 d (make <blake3>)
+         (digest-update! d "abcdefghij")
+         (digest-update! d '#u8(107 108 109))
+         (digest-update! d "nopqrstuvwxyz")
+         (digest-final! d)))
+
+;; Large inputs are hashed by multiple threads (if available); the
+;; result must agree with the sequential one.
+(let* ([len (+ (* 5 1024 1024) 12345)]
+       [input (test-input len)]
+       [expected (with-input-from-port (open-input-uvector input)
+                   blake3-digest)])
+  (test* "parallel" expected (blake3-digest-string input))
+
+  (remove-files "blake3-test.o")
+  (call-with-output-file "blake3-test.o" (cut write-uvector input <>))
+  (test* "blake3-digest-file" expected (blake3-digest-file "blake3-test.o"))
+  (remove-files "blake3-test.o"))
+
+(test-end)
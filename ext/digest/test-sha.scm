@@ -101,4 +101,34 @@
 
 (for-each test-from-file (glob "data/*.info"))
 
+;; Digesting bytes directly, instead of reading from a port
+(test-section "zero-copy and batch")
+
+(use gauche.uvector)
+
+(let1 msgs (map (^n (string-ec (: i n) (integer->char (+ 32 (modulo i 95)))))
+                (iota 40 0 37))
+  (define (via-port digest) (^m (with-input-from-string m digest)))
+  (test* "sha1-digest-batch" (map (via-port sha1-digest) msgs)
+         (sha1-digest-batch msgs))
+  (test* "sha224-digest-batch" (map (via-port sha224-digest) msgs)
+         (sha224-digest-batch msgs))
+  (test* "sha256-digest-batch" (map (via-port sha256-digest) msgs)
+         (sha256-digest-batch msgs))
+  (test* "sha512-digest-batch" (map (via-port sha512-digest) msgs)
+         (sha512-digest-batch msgs))
+  (test* "sha256-digest-batch (empty)" '() (sha256-digest-batch '())))
+
+(test* "u8vector" (digest-message-to 'hex <sha256> "abc")
+       (digest-message-to 'hex <sha256> '#u8(97 98 99)))
+(test* "other uvector" (sha1-digest-string "\x00;\x01;\x02;\x03;\x04;\x05;\x06;\x07;")
+       (sha1-digest-string (uvector-alias <u32vector> (u8vector 0 1 2 3 4 5 6 7))))
+(test* "memory region" (sha256-digest-string (make-u8vector 4096 0))
+       (sha256-digest-string (sys-mmap #f (logior PROT_READ PROT_WRITE)
+                                       (logior MAP_PRIVATE MAP_ANONYMOUS)
+                                       4096)))
+(test* "bad type" (test-error <error>) (sha256-digest-string 'abc))
+(test* "sha-hardware-features" #t
+       (every (cut memq <> '(sha-ni avx2)) (sha-hardware-features)))
+
 (test-end)
@@ -11,6 +11,7 @@
 
 (include "test-md5")
 (include "test-sha")
+(include "test-blake3")
 (include "test-hmac")
 
 (test-end)
@@ -3,6 +3,7 @@
 (use data.sparse)
 (use util.match)
 (use gauche.time)
+(use gauche.threads)
 (use srfi.27)
 
 (define *problem-size* 200000)
@@ -78,6 +79,69 @@
     (dotimes [i *num-repeat*] (thunk))
     (- (active-memory-size) pre)))
 
+;; Copying is O(1), and the copied tree is shared until either one
+;; is modified.  We modify the original after each copy so that every
+;; copy starts from an unshared tree.
+(define (bench-copy name %make %set %copy %set1)
+  (let ([timer (make <user-time-counter>)]
+        [obj (%make)])
+    (%set obj)
+    (dotimes [i *num-repeat*]
+      (with-time-counter timer (%copy obj))
+      (%set1 obj (car *problem-set*) i))
+    (print name " copy:      "
+           (* (/. (time-counter-value timer) *num-repeat*) 1e9))))
+
+;; One writer keeps updating the table, while reader threads scan it.
+;; In 'locked' mode, all access is serialized with a mutex.  In 'snapshot'
+;; mode, the writer publishes a copy every 1000 updates and readers scan
+;; the latest copy without holding the lock.
+(define *num-readers* 4)
+(define *duration* 5)
+
+(define (bench-concurrent mode)
+  (define st (make-sparse-table 'eqv?))
+  (define lock (make-mutex))
+  (define stop? #f)
+  (define published #f)
+  (define (latest) (with-locking-mutex lock (^[] published)))
+  (define (scan t) (sparse-table-fold t (^[k v n] (+ n 1)) 0))
+  (define (reader)
+    (let loop ([scans 0])
+      (if stop?
+        scans
+        (begin
+          (if (eq? mode 'locked)
+            (with-locking-mutex lock (^[] (scan st)))
+            (scan (latest)))
+          (loop (+ scans 1))))))
+  (define (writer)
+    (let loop ([ks *problem-set*] [writes 0])
+      (cond [stop? writes]
+            [(null? ks) (loop *problem-set* writes)]
+            [(eq? mode 'locked)
+             (with-locking-mutex lock
+               (^[] (sparse-table-set! st (car ks) writes)))
+             (loop (cdr ks) (+ writes 1))]
+            [else
+             (sparse-table-set! st (car ks) writes)
+             (when (zero? (modulo writes 1000))
+               (let1 snap (sparse-table-copy st)
+                 (with-locking-mutex lock (^[] (set! published snap)))))
+             (loop (cdr ks) (+ writes 1))])))
+
+  (st-set st)
+  (set! published (sparse-table-copy st))
+  (let* ([rs (map (^_ (thread-start! (make-thread reader)))
+                  (iota *num-readers*))]
+         [w (thread-start! (make-thread writer))])
+    (thread-sleep! *duration*)
+    (set! stop? #t)
+    (let ([writes (thread-join! w)]
+          [scans (apply + (map thread-join! rs))])
+      (print "Sparse table " mode " writes/s: " (/. writes *duration*))
+      (print "Sparse table " mode " scans/s:  " (/. scans *duration*)))))
+
 (define (main args)
   (match (cdr args)
     [("ht" "speed") (bench-speed "Hash table" (cut make-hash-table 'eqv?)
@@ -97,6 +161,14 @@
                         (bench-mem (cut sv-set (make-sparse-vector 'u32))))]
     [("st" "mem") (print "Sparse table mem: "
                          (bench-mem (cut st-set (make-sparse-table 'eqv?))))]
-    [_ (exit 1 "Usage: bench ht|sv|st speed|mem")])
+
+    [("sv" "copy") (bench-copy "Sparse vector" (cut make-sparse-vector)
+                               sv-set sparse-vector-copy sparse-vector-set!)]
+    [("st" "copy") (bench-copy "Sparse table" (cut make-sparse-table 'eqv?)
+                               st-set sparse-table-copy sparse-table-set!)]
+    [("st" "locked") (bench-concurrent 'locked)]
+    [("st" "snapshot") (bench-concurrent 'snapshot)]
+    [_ (exit 1 "Usage: bench ht|sv|st speed|mem, bench sv|st copy, \
+                or bench st locked|snapshot")])
   (print "size: "  *problem-size*)
   0)
@@ -44,10 +44,20 @@ CompactTrie *MakeCompactTrie(void)
     return t;
 }
 
+/* Ownership token.  It only needs to be unique; nodes refer to it,
+   so it won't be reused while any of the nodes is alive. */
+static void *new_owner(void)
+{
+    return SCM_NEW_ATOMIC2(void*, sizeof(ScmWord));
+}
+
 void CompactTrieInit(CompactTrie *t)
 {
     t->numEntries = 0;
     t->root = NULL;
+    t->owner = new_owner();
+    t->leafCopy = NULL;
+    t->leafCopyData = NULL;
 }
 
 /*
@@ -69,6 +79,8 @@ void CompactTrieInit(CompactTrie *t)
 
 #define NODE_ENTRY(node, off)        ((node)->entries[(off)])
 
+#define NODE_OWNED_P(ct, node)       ((node)->owner == (ct)->owner)
+
 #define KEY_MASK(key) /* empty */
 
 /* When extending the node, we increase the number of entries by this
@@ -76,14 +88,84 @@ void CompactTrieInit(CompactTrie *t)
    reallocation.   Must be a power of two. */
 #define NODE_SIZE_INCR 2
 
-static Node *make_node(int nentry)
+#define NODE_SIZE_CLASSES (MAX_NODE_SIZE/NODE_SIZE_INCR)
+
+/* Nodes are allocated precisely typed, so that GC won't take the
+   bitmaps as pointers.  We have one descriptor for each node size. */
+static ScmGCDescriptor node_descr[NODE_SIZE_CLASSES];
+
+static inline size_t node_alloc_size(int nalloc)
+{
+    return sizeof(Node) + sizeof(void*)*(nalloc-2);
+}
+
+void Scm_Init_ctrie(void)
+{
+    for (int i=0; i<NODE_SIZE_CLASSES; i++) {
+        node_descr[i] =
+            Scm_MakeGCDescriptor(node_alloc_size((i+1)*NODE_SIZE_INCR),
+                                 offsetof(Node, emap),
+                                 offsetof(Node, owner));
+    }
+}
+
+static Node *make_node(CompactTrie *ct, int nentry)
 {
     int nalloc = (nentry+NODE_SIZE_INCR-1)&(~(NODE_SIZE_INCR-1));
-    /* SCM_NEW2 returns zero cleared chunk. */
-    return SCM_NEW2(Node*, sizeof(Node) + sizeof(void*)*(nalloc-2));
+    if (nalloc < NODE_SIZE_INCR) nalloc = NODE_SIZE_INCR;
+    /* SCM_NEW_TYPED2 returns zero cleared chunk. */
+    Node *n = SCM_NEW_TYPED2(Node*, node_alloc_size(nalloc),
+                             node_descr[nalloc/NODE_SIZE_INCR - 1]);
+    n->owner = ct->owner;
+    return n;
+}
+
+/* Returns N itself if CT owns it, or a copy of N owned by CT.
+   Child nodes are shared, but leaves are copied. */
+static Node *node_writable(CompactTrie *ct, Node *n)
+{
+    if (NODE_OWNED_P(ct, n)) return n;
+    SCM_ASSERT(ct->leafCopy != NULL);
+
+    int size = NODE_NCHILDREN(n);
+    Node *d = make_node(ct, size);
+    d->emap = n->emap;
+    d->lmap = n->lmap;
+    for (int i=0, off=0; i<MAX_NODE_SIZE && off < size; i++) {
+        if (!NODE_HAS_ARC(n, i)) continue;
+        if (NODE_ARC_IS_LEAF(n, i)) {
+            NODE_ENTRY(d, off) = ct->leafCopy((Leaf*)NODE_ENTRY(n, off),
+                                              ct->leafCopyData);
+        } else {
+            NODE_ENTRY(d, off) = NODE_ENTRY(n, off);
+        }
+        off++;
+    }
+    return d;
+}
+
+/* Make all the nodes on the path to KEY owned by CT.  After this,
+   the nodes and the leaf on the path can be modified in place. */
+static void path_writable(CompactTrie *ct, u_long key)
+{
+    if (ct->root == NULL) return;
+    Node *n = ct->root = node_writable(ct, ct->root);
+    for (int level=0; ; level++) {
+        u_long ind = KEY2INDEX(key, level);
+        if (!NODE_HAS_ARC(n, ind) || NODE_ARC_IS_LEAF(n, ind)) break;
+        u_long off = NODE_INDEX2OFF(n, ind);
+        Node *c = node_writable(ct, (Node*)NODE_ENTRY(n, off));
+        NODE_ENTRY(n, off) = c;
+        n = c;
+    }
 }
 
-static Node *node_insert(Node *orig, u_long ind, void *entry, int leafp)
+/* We only need to care ownership if the tree may be shared. */
+#define PREPARE_UPDATE(ct, key) \
+    do { if ((ct)->leafCopy) path_writable(ct, key); } while (0)
+
+static Node *node_insert(CompactTrie *ct, Node *orig, u_long ind,
+                         void *entry, int leafp)
 {
     int size = NODE_NCHILDREN(orig);
     int insertpoint = Scm__CountBitsBelow(orig->emap, ind);
@@ -101,7 +183,7 @@ static Node *node_insert(Node *orig, u_long ind, void *entry, int leafp)
         return orig;
     } else {
         /* we need to extend the node */
-        Node *newn = make_node(size+NODE_SIZE_INCR);
+        Node *newn = make_node(ct, size+NODE_SIZE_INCR);
         newn->emap = orig->emap;
         newn->lmap = orig->lmap;
         NODE_ARC_SET(newn, ind);
@@ -164,6 +246,16 @@ Leaf *CompactTrieGet(CompactTrie *ct, u_long key)
     else return get_rec(ct->root, key, 0);
 }
 
+Leaf *CompactTrieGetWritable(CompactTrie *ct, u_long key)
+{
+    Leaf *l = CompactTrieGet(ct, key);
+    if (l != NULL && ct->leafCopy) {
+        path_writable(ct, key);
+        l = get_rec(ct->root, key, 0);
+    }
+    return l;
+}
+
 /*
  * Search, and if not found, create
  */
@@ -177,7 +269,7 @@ static Node *add_rec(CompactTrie *ct, Node *n, u_long key, int level,
         Leaf *l = new_leaf(key, creator, data);
         *result = l;
         ct->numEntries++;
-        return node_insert(n, ind, (void*)l, TRUE);
+        return node_insert(ct, n, ind, (void*)l, TRUE);
     }
     else if (!NODE_ARC_IS_LEAF(n, ind)) {
         u_long off = NODE_INDEX2OFF(n, ind);
@@ -193,7 +285,7 @@ static Node *add_rec(CompactTrie *ct, Node *n, u_long key, int level,
 
         if (key == k0) { *result = l0; return n; }
         u_long i0 = KEY2INDEX(leaf_key(l0), level+1);
-        Node *m = make_node(NODE_SIZE_INCR);
+        Node *m = make_node(ct, NODE_SIZE_INCR);
         NODE_ARC_SET(m, i0);
         NODE_LEAF_SET(m, i0);
         NODE_ENTRY(m, 0) = l0;
@@ -209,7 +301,7 @@ Leaf *CompactTrieAdd(CompactTrie *ct, u_long key,
     KEY_MASK(key);
     if (ct->root == NULL) {
         Leaf *l = new_leaf(key, creator, data);
-        ct->root = make_node(NODE_SIZE_INCR);
+        ct->root = make_node(ct, NODE_SIZE_INCR);
         ct->numEntries = 1;
         NODE_ARC_SET(ct->root, key&TRIE_MASK);
         NODE_LEAF_SET(ct->root, key&TRIE_MASK);
@@ -217,6 +309,7 @@ Leaf *CompactTrieAdd(CompactTrie *ct, u_long key,
         return l;
     } else {
         Leaf *e = NULL;
+        PREPARE_UPDATE(ct, key);
         Node *p = add_rec(ct, ct->root, key, 0, &e, creator, data);
         if (p != ct->root) ct->root = p;
         return e;
@@ -275,12 +368,14 @@ Leaf *CompactTrieDelete(CompactTrie *ct, u_long key)
     Leaf *e = NULL;
     KEY_MASK(key);
     if (ct->root == NULL) return NULL;
+    PREPARE_UPDATE(ct, key);
     ct->root = (Node*)del_rec(ct, ct->root, key, 0, &e);
     return e;
 }
 
 /* 'init' can smash all the contents, but if you want to be more GC-friendly,
-   this one clears up all the freed chunks. */
+   this one clears up all the freed chunks.  Nodes shared with other tries
+   are left untouched. */
 static void clear_rec(CompactTrie *ct, Node *n,
                       void (*clearer)(Leaf*, void*),
                       void *data)
@@ -295,8 +390,12 @@ static void clear_rec(CompactTrie *ct, Node *n,
         }
     }
     for (int i=0; i<size; i++) {
-        if (is_leaf[i]) clearer((Leaf*)NODE_ENTRY(n, i), data);
-        else clear_rec(ct, (Node*)NODE_ENTRY(n, i), clearer, data);
+        if (is_leaf[i]) {
+            clearer((Leaf*)NODE_ENTRY(n, i), data);
+        } else {
+            Node *c = (Node*)NODE_ENTRY(n, i);
+            if (NODE_OWNED_P(ct, c)) clear_rec(ct, c, clearer, data);
+        }
         NODE_ENTRY(n, i) = NULL;
     }
     n->emap = n->lmap = 0;
@@ -309,7 +408,7 @@ void CompactTrieClear(CompactTrie *ct,
     Node *n = ct->root;
     ct->numEntries = 0;
     ct->root = NULL;
-    if (n) clear_rec(ct, n, clearer, data);
+    if (n && NODE_OWNED_P(ct, n)) clear_rec(ct, n, clearer, data);
 }
 
 /*
@@ -382,33 +481,22 @@ Leaf *CompactTrieLastLeaf(CompactTrie *ct)
 
 /*
  * Copy.
- * It is recommended that the caller first clear the dst.  The original
- * tree in dst is detached but otherwise remains intact, and may not be
- * friendly to GC.
+ * The tree is shared between DST and SRC, and copied lazily; see ctrie.h.
+ * The original tree in DST is detached but otherwise remains intact.
+ * It is recommended that the caller first clear the dst.
+ * COPY is used to copy a leaf when either trie needs to modify it.
  */
-static Node *copy_rec(const Node *s, Leaf *(*copy)(Leaf*, void*), void *data)
-{
-    int size = Scm__CountBitsInWord(s->emap);
-    Node *d = make_node(size);
-    d->emap = s->emap;
-    d->lmap = s->lmap;
-    for (int i=0, off=0; i<MAX_NODE_SIZE && off < size; i++) {
-        if (!NODE_HAS_ARC(s, i)) continue;
-        if (NODE_ARC_IS_LEAF(s, i)) {
-            NODE_ENTRY(d,off) = copy((Leaf*)NODE_ENTRY(s,off), data);
-        } else {
-            NODE_ENTRY(d,off) = copy_rec((Node*)NODE_ENTRY(s,off), copy, data);
-        }
-        off++;
-    }
-    return d;
-}
-
-void CompactTrieCopy(CompactTrie *dst, const CompactTrie *src,
+void CompactTrieCopy(CompactTrie *dst, CompactTrie *src,
                      Leaf *(*copy)(Leaf*, void*), void *data)
 {
-    if (src->root) dst->root = copy_rec(src->root, copy, data);
-    else           dst->root = NULL;
+    /* Existing nodes become read-only for both tries. */
+    src->owner = new_owner();
+    src->leafCopy = copy;
+    src->leafCopyData = data;
+    dst->owner = new_owner();
+    dst->leafCopy = copy;
+    dst->leafCopyData = data;
+    dst->root = src->root;
     dst->numEntries = src->numEntries;
 }
 
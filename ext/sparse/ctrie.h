@@ -50,8 +50,9 @@
  * structure whose header contains the key value that uniquely identifies
  * the leaf.
  * NODE is a variable length structure, whose first two words are bitmaps.
- * (NB: we may change the layout here, since full-word bitmap tends to become
- * false pointer and may have negative impact to our conservative GC.)
+ * (NB: Full-word bitmap tends to become false pointer and may have negative
+ * impact to our conservative GC.  So we allocate nodes with precise type
+ * descriptors that exclude the bitmaps from scanning.  See make_node().)
  *
  * NODE represents 32-way branch.  The first bitmap, EMAP or entry map,
  * shows which logical index of this node is active.  The second bitmap,
@@ -75,6 +76,8 @@
 typedef struct NodeRec {
     u_long   emap;              /* bitmap: 1 = has child */
     u_long   lmap;              /* bitmap: 1 = child is leaf */
+    void    *owner;             /* token of the trie that can modify this
+                                   node in place.  see below. */
     void    *entries[2];        /* variable length; 2 is the minimum entries */
 } Node;
 
@@ -138,10 +141,28 @@ static inline void leaf_data_bit_reset(Leaf *leaf, int bit)
 
 /*
  * Anchor to hold the trie
+ *
+ * Copying a trie is O(1); the copy shares the whole tree with the
+ * original, and the nodes are copied lazily when either one is modified
+ * (path copying).  Each trie has a unique OWNER token, and it modifies
+ * a node in place only if the node's owner is the same token.  A copy
+ * operation gives fresh tokens to both tries, so that all the existing
+ * nodes become read-only for both of them.  Leaves are copied together
+ * with the node that holds them, using LEAFCOPY procedure given to
+ * CompactTrieCopy; hence a leaf under an owned node is always owned.
+ *
+ * This also means a copy works as a consistent snapshot: once taken,
+ * other threads can read or iterate over the copy without locking,
+ * while the original is being updated.  (Updating the same trie from
+ * multiple threads still needs to be serialized by the caller.)
  */
 typedef struct CompactTrieRec {
     u_int    numEntries;
     Node     *root;
+    void     *owner;
+    Leaf     *(*leafCopy)(Leaf*, void*); /* non-NULL if the tree may be
+                                            shared with another trie */
+    void     *leafCopyData;
 } CompactTrie;
 
 typedef struct CompactTrieIterRec {
@@ -151,6 +172,9 @@ typedef struct CompactTrieIterRec {
     char         end;
 } CompactTrieIter;
 
+/* Initialization; must be called before creating any CompactTrie. */
+extern void Scm_Init_ctrie(void);
+
 /* Create empty CompactTrie */
 extern CompactTrie *MakeCompactTrie(void);
 extern void CompactTrieInit(CompactTrie *);
@@ -160,11 +184,13 @@ extern void CompactTrieClear(CompactTrie *,
 
 /* Search CompactTrie with KEY. */
 extern Leaf *CompactTrieGet(CompactTrie *ct, u_long key);
+/* Like CompactTrieGet, but the returned leaf can be modified in place. */
+extern Leaf *CompactTrieGetWritable(CompactTrie *ct, u_long key);
 extern Leaf *CompactTrieAdd(CompactTrie *ct, u_long key,
                             Leaf *(*creator)(void*), void *data);
 extern Leaf *CompactTrieDelete(CompactTrie *ct, u_long key);
 extern void  CompactTrieCopy(CompactTrie *dst,
-                             const CompactTrie *src,
+                             CompactTrie *src,
                              Leaf *(*copy)(Leaf*, void*), void *data);
 
 extern Leaf *CompactTrieFirstLeaf(CompactTrie *ct);
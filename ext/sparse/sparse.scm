@@ -80,7 +80,8 @@
   (.include "ctrie.h")
   (.include "spvec.h")
   (.include "sptab.h")
-  (.include <gauche/bits_inline.h>)))
+  (.include <gauche/bits_inline.h>))
+ (initcode "Scm_Init_ctrie();"))
 
 (define-macro (define-stuff type class iter ref set)
   (let ([x-fold     (string->symbol #"~|type|-fold")]
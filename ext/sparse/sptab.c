@@ -193,7 +193,7 @@ ScmObj SparseTableSet(SparseTable *st, ScmObj key, ScmObj value, int flags)
     TLeaf *z;
 
     if (!createp) {
-        z = (TLeaf*)CompactTrieGet(&st->trie, hv);
+        z = (TLeaf*)CompactTrieGetWritable(&st->trie, hv);
         if (z == NULL) return SCM_UNBOUND;
     } else {
         z = (TLeaf*)CompactTrieAdd(&st->trie, hv, leaf_allocate, NULL);
@@ -245,7 +245,7 @@ ScmObj SparseTableSet(SparseTable *st, ScmObj key, ScmObj value, int flags)
 ScmObj SparseTableDelete(SparseTable *st, ScmObj key)
 {
     u_long hv = sparse_table_hash(st, key);
-    TLeaf *z = (TLeaf*)CompactTrieGet(&st->trie, hv);
+    TLeaf *z = (TLeaf*)CompactTrieGetWritable(&st->trie, hv);
     ScmObj retval = SCM_UNBOUND;
 
     if (z != NULL) {
@@ -325,7 +325,7 @@ static Leaf *copy_leaf(Leaf *leaf, void *data SCM_UNUSED)
     return (Leaf*)d;
 }
 
-ScmObj SparseTableCopy(const SparseTable *s)
+ScmObj SparseTableCopy(SparseTable *s)
 {
     SparseTable *d = SCM_NEW(SparseTable);
     memcpy(d, s, sizeof(SparseTable));
@@ -65,7 +65,7 @@ extern ScmObj SparseTableSet(SparseTable *st, ScmObj key,
                              ScmObj value, int flags);
 extern ScmObj SparseTableDelete(SparseTable *st, ScmObj key);
 extern void   SparseTableClear(SparseTable *st);
-extern ScmObj SparseTableCopy(const SparseTable *st);
+extern ScmObj SparseTableCopy(SparseTable *st);
 
 extern void   SparseTableDump(SparseTable *sv);
 extern void   SparseTableCheck(SparseTable *sv);
@@ -88,7 +88,7 @@ void SparseVectorSet(SparseVector *sv, u_long index, ScmObj value)
 ScmObj SparseVectorDelete(SparseVector *sv, u_long index)
 {
     INDEX_CHECK(index);
-    Leaf *leaf = CompactTrieGet(&sv->trie, index >> sv->desc->shift);
+    Leaf *leaf = CompactTrieGetWritable(&sv->trie, index >> sv->desc->shift);
     if (leaf == NULL) return SCM_UNBOUND;
     ScmObj r = sv->desc->delete(leaf, index);
     if (!SCM_UNBOUNDP(r)) sv->numEntries--;
@@ -101,7 +101,7 @@ void SparseVectorClear(SparseVector *sv)
     CompactTrieClear(&sv->trie, sv->desc->clear, sv->desc);
 }
 
-ScmObj SparseVectorCopy(const SparseVector *src)
+ScmObj SparseVectorCopy(SparseVector *src)
 {
     SparseVector *dst =
         (SparseVector*)MakeSparseVector(Scm_ClassOf(SCM_OBJ(src)),
@@ -152,7 +152,7 @@ ScmObj SparseVectorInc(SparseVector *sv, u_long index,
         }
     }
     INDEX_CHECK(index);
-    Leaf *leaf = CompactTrieGet(&sv->trie, index >> sv->desc->shift);
+    Leaf *leaf = CompactTrieGetWritable(&sv->trie, index >> sv->desc->shift);
     if (leaf == NULL) {
         ScmObj v = Scm_Add(fallback, delta);
         SparseVectorSet(sv, index, v);
@@ -4,6 +4,7 @@
 
 (use gauche.test)
 (use gauche.generator)
+(use gauche.threads)
 (use data.random)
 (use util.match)
 (use scheme.list)
@@ -119,6 +120,29 @@
            (list (length keys)
                  (if %check (begin (%check new) #t) #t)
                  (every (^k (equal? (%ref new k) (%ref obj k))) keys))))
+  ;; copy shares the structure with the original; make sure modifying
+  ;; one doesn't affect the other.
+  (test* #"~name many copy isolation"
+         (list (quotient *data-set-size* 2) *data-set-size* #t #t)
+         (let* ([new (%copy obj)]
+                [keys (%keys obj)]
+                [half (take keys (quotient (length keys) 2))])
+           (for-each (cut %del new <>) half)
+           (let1 n (%cnt new)
+             (%clr new)
+             (when %check (%check obj) (%check new))
+             (list n
+                   (%cnt obj)
+                   (every (^k (%ref obj k #f)) half)
+                   (every (^k (not (%ref new k #f))) keys)))))
+  (test* #"~name many copy snapshot" *data-set-size*
+         (let* ([snap (%copy obj)]
+                [th (thread-start!
+                     (make-thread (^[] (length (%keys snap)))))])
+           (for-each (cut %del obj <>) (%keys obj))
+           (hash-table-for-each *data-set*
+                                (^[k v] (%set! obj (keygen k) (valgen v))))
+           (thread-join! th)))
 
   (test* #"~name many clear!" 0 (begin (%clr obj) (%cnt obj)))
   (test* #"~name many ref2" *data-set-size*
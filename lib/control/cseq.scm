@@ -55,7 +55,7 @@
                           (apply values r)))))
 
 (define (generator->cseq producer :key (queue-length #f))
-  (define q (make-mtqueue :max-length (or queue-length 64)))
+  (define q (make-mpmc-queue (max (or queue-length 64) 1)))
   (define (thunk)
     (guard [e (else (enqueue/wait! q (list (eof-object))) (raise e))]
       (let loop ()
@@ -66,7 +66,7 @@
   (%concurrent-generator->lseq q thunk))
 
 (define (coroutine->cseq proc :key (queue-length #f))
-  (define q (make-mtqueue :max-length (or queue-length 64)))
+  (define q (make-mpmc-queue (max (or queue-length 64) 1)))
   (define (yielder . vals) (enqueue/wait! q vals))
 
   (define (thunk)
@@ -0,0 +1,341 @@
+;;;
+;;; control.executor - work-stealing executor
+;;;
+;;;   Copyright (c) 2024  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; An executor runs many small tasks on a fixed number of worker threads.
+;;
+;; - Each worker has its own deque of tasks.  A task submitted from
+;;   a worker is pushed to the back of that worker's deque, and the worker
+;;   takes tasks from the back (LIFO), which keeps the working set small
+;;   in fork-join style computation.  An idle worker steals a task from
+;;   the front of other workers' deques.  Each deque has its own lock,
+;;   so there's no single lock all the workers contend for.
+;;
+;; - A task submitted from a non-worker thread is pushed to the deques
+;;   in round-robin.
+;;
+;; - task-result helps while waiting: If the task hasn't been started, the
+;;   waiting thread runs it by itself.  If the waiting thread is a worker,
+;;   it runs other tasks until the result is available.  So a task can
+;;   submit subtasks and wait for them without blocking the worker.
+;;
+;; - Idle workers sleep on the executor's condition variable, and are
+;;   woken up when a new task is submitted.
+
+(define-module control.executor
+  (use gauche.threads)
+  (use gauche.record)
+  (use data.ring-buffer)
+  (export <executor> make-executor executor? default-executor
+          executor-num-workers executor-shutdown!
+          executor-submit! task? task-done? task-result
+          parallel-for))
+(select-module control.executor)
+
+;;
+;; Task
+;;
+
+;; STATE is one of pending, running, done or error.  The transition
+;; from pending to running is done by task-claim!, so exactly one thread
+;; runs a task even if it's found in a deque and by task-result at the
+;; same time.  RESULT is a list of values if done, a raised object if error.
+(define-record-type task %make-task task?
+  (thunk  task-thunk  task-thunk-set!)
+  (state  task-state  task-state-set!)
+  (result task-result-ref task-result-set!)
+  (lock   task-lock)
+  (cv     task-cv))
+
+(define (make-task thunk)
+  (%make-task thunk 'pending #f (make-mutex) (make-condition-variable)))
+
+(define (task-finished? t) (memq (task-state t) '(done error)))
+
+(define (task-done? t)
+  (assume-type t task)
+  (boolean (task-finished? t)))
+
+(define (task-claim! t)
+  (mutex-lock! (task-lock t))
+  (begin0 (and (eq? (task-state t) 'pending)
+               (begin (task-state-set! t 'running) #t))
+    (mutex-unlock! (task-lock t))))
+
+(define (task-run! t)
+  (receive (state result)
+      (guard (e [else (values 'error e)])
+        (values 'done (values->list ((task-thunk t)))))
+    (mutex-lock! (task-lock t))
+    (task-thunk-set! t #f)               ;allow thunk to be GC-ed
+    (task-result-set! t result)
+    (task-state-set! t state)
+    (condition-variable-broadcast! (task-cv t))
+    (mutex-unlock! (task-lock t))))
+
+;; Wait on T's condition variable until it's finished or ABSTIME
+;; (#f for no timeout).  Returns #t if finished.  The condition variable
+;; may be woken up spuriously, so we loop.
+(define (task-wait t abstime)
+  (mutex-lock! (task-lock t))
+  (let loop ()
+    (cond [(task-finished? t) (mutex-unlock! (task-lock t)) #t]
+          [(and abstime (time>=? (current-time) abstime))
+           (mutex-unlock! (task-lock t)) #f]
+          [else (mutex-unlock! (task-lock t) (task-cv t) abstime)
+                (mutex-lock! (task-lock t))
+                (loop)])))
+
+;; Returns the state and the result of a finished task.
+(define (task-outcome t)
+  (mutex-lock! (task-lock t))
+  (let ([state (task-state t)]
+        [result (task-result-ref t)])
+    (mutex-unlock! (task-lock t))
+    (values state result)))
+
+;;
+;; Deque
+;;
+
+(define-record-type deque %make-deque #f
+  (lock  deque-lock)
+  (rb    deque-rb))
+
+(define (make-deque) (%make-deque (make-mutex) (make-ring-buffer)))
+
+(define-syntax with-deque
+  (syntax-rules ()
+    [(_ dq expr)
+     (begin
+       (mutex-lock! (deque-lock dq))
+       (begin0 expr (mutex-unlock! (deque-lock dq))))]))
+
+(define (deque-push! dq t)
+  (with-deque dq (ring-buffer-add-back! (deque-rb dq) t)))
+
+(define (deque-pop! dq)
+  (with-deque dq (and (not (ring-buffer-empty? (deque-rb dq)))
+                      (ring-buffer-remove-back! (deque-rb dq)))))
+
+(define (deque-steal! dq)
+  (with-deque dq (and (not (ring-buffer-empty? (deque-rb dq)))
+                      (ring-buffer-remove-front! (deque-rb dq)))))
+
+;;
+;; Executor
+;;
+
+(define-class <executor> ()
+  ((num-workers :init-keyword :num-workers)
+   ;; the rest of slots are private
+   (deques      :init-value #f)         ; Vector of deque
+   (threads     :init-value '())
+   (lock        :init-form (make-mutex))
+   (cv          :init-form (make-condition-variable))
+   (sleepers    :init-value 0)          ; # of sleeping workers; under lock
+   (wakeups     :init-value 0)          ; incremented by notify; under lock
+   (next        :init-value 0)          ; round-robin index for external submit
+   (shut-down   :init-value #f)))
+
+;; Holds (executor . index) in worker threads.
+(define current-worker (make-thread-local #f))
+
+(define (make-executor :optional (num-workers (sys-available-processors)))
+  (assume (and (exact-integer? num-workers) (positive? num-workers))
+          "num-workers must be a positive exact integer, but got:" num-workers)
+  (make <executor> :num-workers num-workers))
+
+(define-method initialize ((ex <executor>) initargs)
+  (next-method)
+  (let1 n (~ ex'num-workers)
+    (set! (~ ex'deques) (list->vector (list-tabulate n (^_ (make-deque)))))
+    (set! (~ ex'threads)
+          (list-tabulate n
+                         (^i (thread-start!
+                              (make-thread (cut worker ex i)
+                                           (string->symbol
+                                            #"executor-worker-~i"))))))))
+
+(define (executor? obj) (is-a? obj <executor>))
+
+(define (executor-num-workers ex) (~ ex'num-workers))
+
+(define *default-executor* #f)
+(define *default-executor-lock* (make-mutex))
+
+;; The shared executor, created on demand.
+(define (default-executor)
+  (or *default-executor*
+      (with-locking-mutex *default-executor-lock*
+        (^[] (or *default-executor*
+                 (rlet1 ex (make-executor)
+                   (set! *default-executor* ex)))))))
+
+;; Returns the index of the current thread if it is a worker of EX.
+(define (worker-index ex)
+  (and-let* ([w (tlref current-worker)]
+             [ (eq? (car w) ex) ])
+    (cdr w)))
+
+;; Find a task to run: first from our own deque (if we're a worker),
+;; then steal from others.  Tasks already claimed by task-result are
+;; skipped.
+(define (find-task ex self)
+  (define deques (~ ex'deques))
+  (define n (vector-length deques))
+  (define (claimed t) (and t (if (task-claim! t) t #f)))
+  (let loop ()
+    (cond [(and self (deque-pop! (vector-ref deques self)))
+           => (^t (or (claimed t) (loop)))]
+          [else
+           (let steal ([k 1])
+             (and (<= k n)
+                  (let1 t (deque-steal! (vector-ref deques
+                                                    (modulo (+ (or self 0) k)
+                                                            n)))
+                    (cond [(not t) (steal (+ k 1))]
+                          [(task-claim! t) t]
+                          [else (steal k)]))))])))
+
+(define (notify ex)
+  ;; NB: Reading sleepers without lock is ok; a worker increments it
+  ;; before it looks at the deques for the last time before sleep.
+  (when (> (~ ex'sleepers) 0)
+    (mutex-lock! (~ ex'lock))
+    (inc! (~ ex'wakeups))
+    (condition-variable-signal! (~ ex'cv))
+    (mutex-unlock! (~ ex'lock))))
+
+(define (worker ex index)
+  (tlset! current-worker (cons ex index))
+  (let loop ()
+    (cond [(find-task ex index) => (^t (task-run! t) (loop))]
+          [(~ ex'shut-down)]
+          [else
+           (mutex-lock! (~ ex'lock))
+           (inc! (~ ex'sleepers))
+           (let1 w (~ ex'wakeups)
+             (mutex-unlock! (~ ex'lock))
+             (let1 t (find-task ex index)
+               (mutex-lock! (~ ex'lock))
+               (when (and (not t)
+                          (= w (~ ex'wakeups))
+                          (not (~ ex'shut-down)))
+                 ;; The timeout is just for safety.
+                 (mutex-unlock! (~ ex'lock) (~ ex'cv) 1)
+                 (mutex-lock! (~ ex'lock)))
+               (dec! (~ ex'sleepers))
+               (mutex-unlock! (~ ex'lock))
+               (when t (task-run! t))
+               (loop)))])))
+
+;; API
+(define (executor-submit! ex thunk)
+  (assume-type ex <executor>)
+  (when (~ ex'shut-down)
+    (error "executor has been shut down:" ex))
+  (let ([t (make-task thunk)]
+        [deques (~ ex'deques)])
+    (deque-push! (vector-ref deques
+                             (or (worker-index ex)
+                                 (rlet1 i (~ ex'next)
+                                   (set! (~ ex'next)
+                                         (modulo (+ i 1)
+                                                 (vector-length deques))))))
+                 t)
+    (notify ex)
+    t))
+
+;; API
+;; Workers finish the tasks already submitted, then exit.
+(define (executor-shutdown! ex)
+  (assume-type ex <executor>)
+  (mutex-lock! (~ ex'lock))
+  (set! (~ ex'shut-down) #t)
+  (condition-variable-broadcast! (~ ex'cv))
+  (mutex-unlock! (~ ex'lock))
+  (unless (worker-index ex)
+    (for-each thread-join! (~ ex'threads)))
+  (undefined))
+
+;; API
+(define (task-result t :optional (timeout #f) (timeout-val #f))
+  (assume-type t task)
+  (let1 abstime (absolute-time timeout)
+    (define (help ex self)
+      ;; Run other tasks while T is running.  If there's nothing to do,
+      ;; wait on T briefly and look for tasks again, for the task we're
+      ;; waiting for may spawn more tasks.
+      (let loop ()
+        (cond [(task-finished? t) #t]
+              [(and abstime (time>=? (current-time) abstime)) #f]
+              [(find-task ex self) => (^t1 (task-run! t1) (loop))]
+              [(task-wait t (min-time abstime 0.001))]
+              [else (loop)])))
+    (if (cond [(task-finished? t) #t]
+              [(task-claim! t) (task-run! t) #t]
+              [(tlref current-worker) => (^w (help (car w) (cdr w)))]
+              [else (task-wait t abstime)])
+      (receive (state result) (task-outcome t)
+        (if (eq? state 'done)
+          (apply values result)
+          (raise result)))
+      timeout-val)))
+
+;; Returns the earlier one of ABSTIME (may be #f) and SECS from now.
+(define (min-time abstime secs)
+  (let1 t (absolute-time secs)
+    (if (and abstime (time<? abstime t)) abstime t)))
+
+;;
+;; Parallel for
+;;
+
+;; API
+;; Calls PROC with each integer in [START, END) in parallel.  The range
+;; is split recursively, and each half is run as a task, until the
+;; number of indexes in a range becomes less than GRAIN.
+(define (parallel-for start end proc :key (grain #f)
+                                         (executor (default-executor)))
+  (define g (or grain
+                (max 1 (quotient (- end start)
+                                 (* 8 (executor-num-workers executor))))))
+  (define (run s e)
+    (if (<= (- e s) g)
+      (do ([i s (+ i 1)]) [(>= i e)] (proc i))
+      (let* ([m (+ s (quotient (- e s) 2))]
+             [t (executor-submit! executor (cut run m e))])
+        (run s m)
+        (task-result t))))
+  (when (< start end) (run start end))
+  (undefined))
@@ -31,8 +31,12 @@
 ;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 ;;;
 
-;; This is a provisional implementation; we'll use implicit thread pool
-;; to avoid thread creation overhead eventually.
+;; A future is run as a task of an executor (control.executor); by
+;; default, the shared executor returned by (default-executor).  So creating
+;; many futures doesn't create many threads.  If the executor is #f,
+;; a dedicated thread is created for the future---that is preferable if
+;; the computation may block for long, e.g. waiting for network I/O,
+;; for it would occupy a worker thread of the executor.
 
 ;; Guile and Racket uses 'touch' to retrive the result of a future, but
 ;; that name seems too generic.  We adopt 'future-get'.
@@ -40,41 +44,72 @@
 ;; If a future already finished computation, 'future-get' returns immediately
 ;; with the result value.  Otherwise, it blocks until the result is available,
 ;; unless timeout is specified.  Subsequent 'future-get' returns the same
-;; result.
+;; result.  If the computation hasn't been started, 'future-get' runs it
+;; in the calling thread.  If 'future-get' is called in a worker of the
+;; executor, the worker runs other tasks while waiting.
+;;
+;; The computation sees the parameterization and the current ports of
+;; the thread that created the future, as if it were run in a thread
+;; created there.
 ;;
 ;; If the concurrent computation raises an exception, it is caught, and
-;; re-raised when first 'future-get'.  It is undefined if future-get is
-;; called again on such a future---it depends on the behavior of thread-join!,
-;; but the behavior of calling thread-join! again on exceptionally terminated
-;; thread isn't defined either.  Currently, the second call of future-get
-;; won't raise an exception and returns #<undef>, but do not count on
-;; the behavior.
+;; re-raised when 'future-get' is called.  It is undefined if future-get is
+;; called again on such a future---currently it raises the same exception
+;; again, but do not count on the behavior.
 
 (define-module control.future
   (use gauche.threads)
+  (use control.executor)
   (export <future> future? future make-future future-done? future-get))
 (select-module control.future)
 
 (define-class <future> ()
   ;; all slots must be private
-  ((%thread    :init-keyword :thread)))
+  ((%thread    :init-keyword :thread :init-value #f)
+   (%task      :init-keyword :task :init-value #f)))
 
 (define-syntax future
   (syntax-rules ()
-    [(_ expr)
-     (make <future>
-       :thread (thread-start! (make-thread (lambda () (values->list expr)))))]))
+    [(_ expr) (make-future (lambda () expr))]
+    [(_ expr executor) (make-future (lambda () expr) executor)]))
+
+(define (make-future thunk :optional (executor (default-executor)))
+  (if executor
+    (make <future> :task (executor-submit! executor (inherit-dynamic-env thunk)))
+    (make <future>
+      :thread (thread-start! (make-thread (lambda () (values->list (thunk))))))))
 
-(define (make-future thunk)
-  (future (thunk)))
+;; A worker thread of the executor has its own dynamic environment.
+;; We capture the creator's one and reinstate it around THUNK, which
+;; a thread created by make-thread would inherit.  The current ports may
+;; have been changed by their setters instead of parameterize, so we
+;; rebind them explicitly.
+(define (inherit-dynamic-env thunk)
+  (let ([pz  (current-parameterization)]
+        [in  (current-input-port)]
+        [out (current-output-port)]
+        [err (current-error-port)])
+    (^[] (call-with-parameterization pz
+           (^[] (parameterize ([current-input-port in]
+                               [current-output-port out]
+                               [current-error-port err])
+                  (thunk)))))))
 
 (define (future? obj) (is-a? obj <future>))
 
 (define (future-done? future)
   (assume-type future <future>)
-  (eq? (thread-state (~ future'%thread)) 'terminated))
+  (if-let1 task (~ future'%task)
+    (task-done? task)
+    (eq? (thread-state (~ future'%thread)) 'terminated)))
 
 (define (future-get future :optional (timeout #f) (timeout-val #f))
   (assume-type future <future>)
-  (guard (e [(<uncaught-exception> e) (raise (~ e'reason))])
-    (apply values (thread-join! (~ future'%thread) timeout timeout-val))))
+  (if-let1 task (~ future'%task)
+    (task-result task timeout timeout-val)
+    (guard (e [(<uncaught-exception> e) (raise (~ e'reason))])
+      (let* ([unique (list #f)]
+             [r (thread-join! (~ future'%thread) timeout unique)])
+        (if (eq? r unique)
+          timeout-val
+          (apply values r))))))
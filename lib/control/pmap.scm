@@ -41,8 +41,10 @@
   (use srfi.19)
   (use control.thread-pool)
   (use control.job)
+  (use control.executor)
   (export pmap pfind pany
           sequential-mapper
+          make-executor-mapper
           make-static-mapper
           make-pool-mapper
           make-fully-concurrent-mapper))
@@ -54,6 +56,13 @@
 ;;   sequential-mapper - A sigleton mapper that runs in a single (current) thread.
 ;;      If the running system is single-core, this is the default mapper.
 ;;
+;;   executor-mapper - Split the collection into chunks and run them as
+;;      tasks of a work-stealing executor (control.executor).  Idle workers
+;;      steal chunks from busy ones, so it adapts to uneven load.  Calling
+;;      pmap within a task is fine; the waiting worker runs other tasks.
+;;      If the running system has more than one cores, this is the
+;;      default mapper.
+;;
 ;;   pool-mapper - Use thread pool.  This is ideal when each task requies
 ;;      some processing time, so that the overhead of thread pool is
 ;;      negligible.
@@ -121,6 +130,45 @@
         (receive (s? r) (proc (next))
           (if s? r (loop)))))))
 
+;;
+;; executor-mapper
+;;
+
+(define-class <executor-mapper> (<mapper>)
+  ((executor :init-keyword :executor :init-value #f))) ; #f - default-executor
+
+(define (make-executor-mapper :optional (executor #f))
+  (make <executor-mapper> :executor executor))
+
+(define (%mapper-executor mapper)
+  (or (~ mapper'executor) (default-executor)))
+
+;; We make chunks a few times more than the workers, so that the workers
+;; that finish early can steal the rest.
+(define (%executor-chunks coll ex)
+  (%split-collection coll (* 4 (executor-num-workers ex))))
+
+(define-method run-map ((mapper <executor-mapper>) proc coll)
+  (let1 ex (%mapper-executor mapper)
+    ($ append-map task-result
+       $ map (^c (executor-submit! ex (cut map proc c)))
+       $ %executor-chunks coll ex)))
+
+(define-method run-select ((mapper <executor-mapper>) proc coll)
+  (define found (atom #f #f))
+  (define (search elts)
+    (let loop ([elts elts])
+      (unless (or (null? elts) (atom-ref found))
+        (receive (s? r) (proc (car elts))
+          (if s?
+            (atomic-update! found (^[f v] (if f (values f v) (values #t r))))
+            (loop (cdr elts)))))))
+  (let1 ex (%mapper-executor mapper)
+    ($ for-each task-result
+       $ map (^c (executor-submit! ex (cut search c)))
+       $ %executor-chunks coll ex)
+    (atom-ref found 1)))
+
 ;;
 ;; static-mapper
 ;;
@@ -298,7 +346,7 @@
   (make-parameter
    (if (= 1 (sys-available-processors))
      (sequential-mapper)
-     (make-static-mapper))))
+     (make-executor-mapper))))
 
 ;;;
 ;;; High-level API
@@ -0,0 +1,295 @@
+;;;
+;;; data.rope - Ropes
+;;;
+;;;   Copyright (c) 2024  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; A rope is an immutable text represented as a height-balanced binary
+;; tree whose leaves are short immutable strings.  Concatenation,
+;; taking a substring and indexed access are O(log n) where n is
+;; the number of characters, so it is suitable to build or edit a large
+;; text piece by piece.  Use rope->string to get a flat string, or
+;; write-rope to emit the content without flattening it.
+;;
+;; Tree = String | Node Tree Tree Length Height
+;;
+;; The tree satisfies AVL condition: heights of the children of a node
+;; differ at most by one.  A leaf (string) has height 0.  Adjacent short
+;; leaves are merged when they're concatenated, so appending a small
+;; string to a rope repeatedly doesn't make the tree grow by each append.
+
+(define-module data.rope
+  (use gauche.record)
+  (use gauche.sequence)
+  (export <rope>
+          rope?
+          rope
+          string->rope
+          rope->string
+          rope-empty?
+          rope-length
+          rope-ref
+          rope-append
+          rope-concatenate
+          subrope
+          rope-replace
+          write-rope
+          rope-null)
+  )
+(select-module data.rope)
+
+(define-class <rope-meta> (<record-meta>) ())
+(define-record-type (<rope> #f :mixins (<sequence>)
+                            :metaclass <rope-meta>)
+  %make-rope rope?
+  (tree rope-tree))
+
+(define-record-type %node %make-node %node?
+  (left   %node-left)
+  (right  %node-right)
+  (length %node-length)
+  (height %node-height))
+
+;; Max number of characters in a leaf we create by merging.
+(define-constant *leaf-size* 512)
+
+;;;
+;;; Tree operations
+;;;
+
+(define-inline (tlen t)
+  (if (string? t) (string-length t) (%node-length t)))
+(define-inline (theight t)
+  (if (string? t) 0 (%node-height t)))
+
+(define rope-null (%make-rope ""))
+
+(define (R tree)
+  (if (eqv? (tlen tree) 0) rope-null (%make-rope tree)))
+
+(define (mk l r)
+  (%make-node l r (+ (tlen l) (tlen r)) (+ 1 (max (theight l) (theight r)))))
+
+;; Creates a node of L and R, whose heights may differ by two at most.
+(define (bal l r)
+  (let ([hl (theight l)] [hr (theight r)])
+    (cond [(> hl (+ hr 1))
+           (let ([ll (%node-left l)] [lr (%node-right l)])
+             (if (>= (theight ll) (theight lr))
+               (mk ll (mk lr r))
+               (mk (mk ll (%node-left lr)) (mk (%node-right lr) r))))]
+          [(> hr (+ hl 1))
+           (let ([rl (%node-left r)] [rr (%node-right r)])
+             (if (>= (theight rr) (theight rl))
+               (mk (mk l rl) rr)
+               (mk (mk l (%node-left rl)) (mk (%node-right rl) rr))))]
+          [else (mk l r)])))
+
+;; Concatenates two trees.  O(|height(l) - height(r)|).
+(define (join l r)
+  (cond [(eqv? (tlen l) 0) r]
+        [(eqv? (tlen r) 0) l]
+        [(and (string? l) (string? r)
+              (<= (+ (string-length l) (string-length r)) *leaf-size*))
+         (string-copy-immutable (string-append l r))]
+        [else
+         (let ([hl (theight l)] [hr (theight r)])
+           (cond [(> hl (+ hr 1))
+                  (bal (%node-left l) (join (%node-right l) r))]
+                 [(> hr (+ hl 1))
+                  (bal (join l (%node-left r)) (%node-right r))]
+                 [else (mk l r)]))]))
+
+;; Splits a tree into the first K characters and the rest.
+(define (split t k)
+  (cond [(<= k 0) (values "" t)]
+        [(>= k (tlen t)) (values t "")]
+        [(string? t)
+         (values (string-copy-immutable t 0 k)
+                 (string-copy-immutable t k))]
+        [else
+         (let* ([l (%node-left t)]
+                [n (tlen l)])
+           (cond [(< k n) (receive (a b) (split l k)
+                            (values a (join b (%node-right t))))]
+                 [(= k n) (values l (%node-right t))]
+                 [else (receive (a b) (split (%node-right t) (- k n))
+                         (values (join l a) b))]))]))
+
+(define (tref t k)
+  (if (string? t)
+    (string-ref t k)
+    (let1 n (tlen (%node-left t))
+      (if (< k n)
+        (tref (%node-left t) k)
+        (tref (%node-right t) (- k n))))))
+
+;; Calls PROC on each leaf from left to right.
+(define (for-each-leaf proc t)
+  (if (string? t)
+    (unless (equal? t "") (proc t))
+    (begin (for-each-leaf proc (%node-left t))
+           (for-each-leaf proc (%node-right t)))))
+
+;; A long string is chopped into leaves and made into a balanced tree.
+;; We use cursors to avoid scanning from the beginning for each leaf.
+(define (string->tree s)
+  (if (<= (string-length s) *leaf-size*)
+    (string-copy-immutable s)
+    (let* ([end (string-cursor-end s)]
+           [leaves (let loop ([cur (string-cursor-start s)]
+                              [rest (string-length s)]
+                              [r '()])
+                     (if (<= rest *leaf-size*)
+                       (list->vector
+                        (reverse! (cons (string-copy-immutable s cur end) r)))
+                       (let1 next (string-cursor-forward s cur *leaf-size*)
+                         (loop next (- rest *leaf-size*)
+                               (cons (string-copy-immutable s cur next)
+                                     r)))))])
+      (let build ([lo 0] [hi (vector-length leaves)])
+        (if (= (+ lo 1) hi)
+          (vector-ref leaves lo)
+          (let1 mid (ash (+ lo hi) -1)
+            (mk (build lo mid) (build mid hi))))))))
+
+(define (->tree obj)
+  (cond [(string? obj) (string->tree obj)]
+        [(rope? obj) (rope-tree obj)]
+        [else (error "string or rope required, but got:" obj)]))
+
+;;;
+;;; API
+;;;
+
+(define (string->rope s)
+  (assume-type s <string>)
+  (R (string->tree s)))
+
+(define (rope->string r)
+  (assume-type r <rope>)
+  (let1 t (rope-tree r)
+    (if (string? t)
+      t
+      (call-with-output-string (cut write-rope r <>)))))
+
+(define (write-rope r :optional (port (current-output-port)))
+  (assume-type r <rope>)
+  (for-each-leaf (cut write-string <> port) (rope-tree r)))
+
+(define (rope-empty? r)
+  (assume-type r <rope>)
+  (eqv? (tlen (rope-tree r)) 0))
+
+(define (rope-length r)
+  (assume-type r <rope>)
+  (tlen (rope-tree r)))
+
+(define (rope-ref r k :optional fallback)
+  (assume-type r <rope>)
+  (let1 t (rope-tree r)
+    (cond [(and (exact-integer? k) (<= 0 k) (< k (tlen t))) (tref t k)]
+          [(undefined? fallback) (error "index out of range:" k)]
+          [else fallback])))
+
+;; Each argument can be a string or a rope.
+(define (rope-concatenate objs)
+  (R (fold (^[obj t] (join t (->tree obj))) "" objs)))
+
+(define (rope-append . objs) (rope-concatenate objs))
+(define (rope . objs) (rope-concatenate objs))
+
+(define (check-range r start end)
+  (let1 len (rope-length r)
+    (unless (and (exact-integer? start) (exact-integer? end)
+                 (<= 0 start end len))
+      (errorf "start/end out of range: ~s/~s (length ~s)" start end len))))
+
+(define (subrope r start :optional (end (rope-length r)))
+  (check-range r start end)
+  (receive (_ b) (split (rope-tree r) start)
+    (receive (c _) (split b (- end start))
+      (R c))))
+
+;; Returns a rope where characters between START and END of R are
+;; replaced with REPLACEMENT, which can be a string or a rope.
+(define (rope-replace r start end replacement)
+  (check-range r start end)
+  (receive (a b) (split (rope-tree r) start)
+    (receive (_ c) (split b (- end start))
+      (R (join (join a (->tree replacement)) c)))))
+
+;;;
+;;; Other protocols
+;;;
+
+(define-method write-object ((r <rope>) port)
+  (format port "#<rope ~s>" (rope-length r)))
+
+(define-method x->string ((r <rope>)) (rope->string r))
+
+(define-method object-equal? ((a <rope>) (b <rope>))
+  (and (= (rope-length a) (rope-length b))
+       (string=? (rope->string a) (rope->string b))))
+
+(define-method call-with-iterator ((r <rope>) proc)
+  ;; We keep the current leaf and its cursor, and the stack of subtrees
+  ;; yet to visit.
+  (define leaf "")
+  (define cur (string-cursor-start leaf))
+  (define stack (list (rope-tree r)))
+  (define (fill!)
+    (when (and (string-cursor=? cur (string-cursor-end leaf))
+               (pair? stack))
+      (let1 t (pop! stack)
+        (if (string? t)
+          (begin (set! leaf t) (set! cur (string-cursor-start t)))
+          (begin (push! stack (%node-right t))
+                 (push! stack (%node-left t))))
+        (fill!))))
+  (define (end?) (fill!) (string-cursor=? cur (string-cursor-end leaf)))
+  (define (next)
+    (fill!)
+    (begin0 (string-ref leaf cur)
+      (set! cur (string-cursor-next leaf cur))))
+  (proc end? next))
+
+(define-method call-with-builder ((rc <rope-meta>) proc :allow-other-keys)
+  (let1 out (open-output-string)
+    (proc (cut write-char <> out)
+          (^[] (string->rope (get-output-string out))))))
+
+(define-method size-of ((r <rope>)) (rope-length r))
+
+(define-method referencer ((r <rope>))
+  (^[o i] (rope-ref o i)))
+
+(define-method subseq ((r <rope>) s e) (subrope r s e))
+(define-method subseq ((r <rope>) s) (subrope r s))
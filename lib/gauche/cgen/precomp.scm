@@ -157,6 +157,15 @@
 ;;      enough from the host environment.  You can't load a different version
 ;;      of the same library the host is using just for the precompiled file.
 ;;      This option is mainly for 'include's in the source.
+;;
+;; whole-program : If true, small exported procedures are compiled as if
+;;      they're defined with define-inline, so that the modules using them
+;;      can inline them.  The inlined code is fixed when the user module is
+;;      compiled, so the user modules have to be recompiled whenever
+;;      the procedures are changed.  Same as gosh's -fwhole-program option.
+;;      (Regardless of this option, the generated initializer warns if
+;;      a procedure inlined from another module has been changed; see
+;;      add-inline-fingerprint-check.)
 
 (define (cgen-precompile src . keys)
   (with-tmodule-recording
@@ -177,7 +186,8 @@
                                     (single-sci-file #f)
                                     (load-paths '())
                                     (target-parameters '())
-                                    (extra-optimization #f))
+                                    (extra-optimization #f)
+                                    (whole-program #f))
   (define (precomp-1 main src)
     (let* ([out.c (cgen-scm-path->c-file (strip-prefix src prefix))]
            [initname (cgen-c-file->initfn out.c)])
@@ -191,6 +201,7 @@
                         :strip-prefix prefix
                         :macros-to-keep macros-to-keep
                         :extra-optimization extra-optimization
+                        :whole-program whole-program
                         :ext-initializer (and (equal? src main)
                                               ext-initializer)
                         :target-parameters target-parameters
@@ -242,7 +253,8 @@
                                (load-paths '())
                                (macros-to-keep '())
                                ((:target-parameters tparams) '())
-                               (extra-optimization #f))
+                               (extra-optimization #f)
+                               (whole-program #f))
   (define (do-it)
     (parameterize ([omitted-code '()]
                    [omit-debug-source-info no-source]
@@ -253,12 +265,22 @@
           ;; NB: *load-path* isn't a parameter (yet), so we hack it.
           ;; This shouldn't be the way; do not copy it.
           (define load-path-save *load-path*)
+          (define flags-save (vm-compiler-flag))
           (unwind-protect
               (begin
                 (set! *load-path* (fold cons *load-path* (reverse load-paths)))
+                (when whole-program
+                  (vm-compiler-flag-set! SCM_COMPILE_WHOLE_PROGRAM))
+                (%start-recording-inline-fingerprints!)
                 (emit-toplevel-executor
-                 (reverse (generator-fold compile-toplevel-form '() read))))
-            (set! *load-path* load-path-save))))
+                 (reverse
+                  (add-inline-fingerprint-check
+                   src (generator-fold compile-toplevel-form '() read)))))
+            (begin
+              (%finish-recording-inline-fingerprints!)
+              (set! *load-path* load-path-save)
+              (vm-compiler-flag-clear! SCM_COMPILE_WHOLE_PROGRAM)
+              (vm-compiler-flag-set! flags-save)))))
       (finalize sub-initializers)
       (setup-debug-info)
       (show-debug-info-stat (cgen-current-unit))
@@ -388,12 +410,28 @@
 (define %procedure-inliner
   (with-module gauche.internal %procedure-inliner))
 (define vm-code->list (with-module gauche.internal vm-code->list))
+(define vm-compiler-flag (with-module gauche.internal vm-compiler-flag))
+(define vm-compiler-flag-set!
+  (with-module gauche.internal vm-compiler-flag-set!))
+(define vm-compiler-flag-clear!
+  (with-module gauche.internal vm-compiler-flag-clear!))
 (define vm-eval-situation
   (with-module gauche.internal vm-eval-situation))
 (define global-eq?? (with-module gauche.internal global-eq??))
 (define make-identifier (with-module gauche.internal make-identifier))
 
+;; The following may not exist in the host gosh we're bootstrapping with.
+(define (internal-proc-or name default)
+  (global-variable-ref (find-module 'gauche.internal) name default))
+(define vm-compiler-flag-whole-program?
+  (internal-proc-or 'vm-compiler-flag-whole-program? (^[] #f)))
+(define %start-recording-inline-fingerprints!
+  (internal-proc-or '%start-recording-inline-fingerprints! (^[] #f)))
+(define %finish-recording-inline-fingerprints!
+  (internal-proc-or '%finish-recording-inline-fingerprints! (^[] '())))
+
 (define-constant SCM_VM_COMPILING 2) ;; must match with vm.h
+(define-constant SCM_COMPILE_WHOLE_PROGRAM (ash 1 15)) ;; ditto
 
 ;;================================================================
 ;; Utilities
@@ -604,7 +642,14 @@
             (format "  (void)Scm_ExportSymbols(Scm_CurrentModule(), ~a);"
                     (cgen-cexpr exp-specs)))))
        seed]
-      [((? =export-all?)) (write-ext-module form) (compile-module-exports #t)]
+      [((? =export-all?))
+       ;; The compiler needs to know exported names in the whole-program
+       ;; mode.  See pass1/auto-inlinable?.
+       (when (vm-compiler-flag-whole-program?)
+         (eval-in-current-tmodule form))
+       (write-ext-module form)
+       (compile-module-exports #t)
+       seed]
       [((? =export-if-defined?) . _) (write-ext-module form) seed]
       [((? =provide?) arg) (write-ext-module form) seed]
       [((? =extend?) . _)
@@ -674,6 +719,20 @@
 ;; given list of toplevel compiled codes, generate code in init
 ;; that calls them.  This is assumed to be the last procedure before
 ;; calling cgen-emit.
+;; If the source inlined procedures from other modules, add a toplevel
+;; code to check at load time that they haven't been changed since.
+;; See "Inline fingerprints" in src/compile.scm.
+(define (add-inline-fingerprint-check src seed)
+  (match (%finish-recording-inline-fingerprints!)
+    [() seed]
+    [entries
+     (cons (cgen-literal
+            (compile `(%check-inline-fingerprints ,(sys-basename src)
+                                                  ',entries)
+                     (find-module 'gauche.internal)
+                     :target-params (target-parameters)))
+           seed)]))
+
 (define (emit-toplevel-executor topcodes)
   (cgen-body "static ScmCompiledCode *toplevels[] = {")
   (dolist [t topcodes]
@@ -0,0 +1,128 @@
+;;;
+;;; gauche.vm.gc-stat - GC statistics utilities
+;;;
+;;;   Copyright (c) 2024  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; This module provides utilities on top of gc-stat, mainly to monitor
+;; GC behavior of a long-running process.
+
+(define-module gauche.vm.gc-stat
+  (use gauche.threads)
+  (export gc-stat-ref gc-stat-diff
+          <gc-stat-emitter> gc-stat-emitter-start gc-stat-emitter-stop
+          write-gc-stat)
+  )
+(select-module gauche.vm.gc-stat)
+
+;; Keys of the cumulative counters.  gc-stat-diff takes difference
+;; of these; other values are taken from the newer stat as is.
+(define *counter-keys*
+  '(:total-bytes :gc-count :pause-count :total-pause-time
+    :total-mark-time :total-reclaim-time :finalizers-run))
+
+;; API
+(define (gc-stat-ref stat key :optional (default #f))
+  (if-let1 p (assq key stat)
+    (cadr p)
+    default))
+
+;; API
+;; Returns the stat of the interval between two gc-stat results.
+(define (gc-stat-diff old new)
+  (define npauses (- (gc-stat-ref new :pause-count 0)
+                     (gc-stat-ref old :pause-count 0)))
+  (map (^[entry]
+         (let ([key (car entry)]
+               [val (cadr entry)])
+           (cond [(memq key *counter-keys*)
+                  (list key (- val (gc-stat-ref old key 0)))]
+                 [(eq? key :recent-pause-times)
+                  (list key (take* val npauses))]
+                 [else entry])))
+       new))
+
+;; API
+;; Default writer of the emitter.  Writes one S-expression per line:
+;;   (gc-stat :timestamp <seconds> <key> <value> ...)
+(define (write-gc-stat stat port)
+  (write `(gc-stat :timestamp ,(time->seconds (current-time))
+                   ,@(concatenate stat))
+         port)
+  (newline port)
+  (flush port))
+
+;; API
+;; Periodic emitter.  A dedicated thread wakes up every INTERVAL seconds
+;; and writes the stat to PORT.  If DIFF is true (default), the written
+;; stat is the difference from the previous one, so that the counters
+;; show the activity in the interval.
+(define-class <gc-stat-emitter> ()
+  ((port     :init-keyword :port)
+   (interval :init-keyword :interval)
+   (diff     :init-keyword :diff)
+   (writer   :init-keyword :writer)
+   (mutex    :init-form (make-mutex))
+   (cv       :init-form (make-condition-variable))
+   (stop?    :init-value #f)
+   (thread   :init-value #f)))
+
+(define (gc-stat-emitter-start port :key (interval 10)
+                                         (diff #t)
+                                         (writer write-gc-stat))
+  (assume (and (real? interval) (positive? interval))
+          "Interval must be a positive real number, but got:" interval)
+  (rlet1 e (make <gc-stat-emitter>
+             :port port :interval interval :diff diff :writer writer)
+    (set! (~ e'thread)
+          (thread-start! (make-thread (cut emitter-loop e) 'gc-stat-emitter)))))
+
+(define (gc-stat-emitter-stop emitter)
+  (with-locking-mutex (~ emitter'mutex)
+    (^[]
+      (set! (~ emitter'stop?) #t)
+      (condition-variable-broadcast! (~ emitter'cv))))
+  (thread-join! (~ emitter'thread))
+  (undefined))
+
+(define (emitter-loop e)
+  (define m (~ e'mutex))
+  (let loop ([prev (gc-stat)])
+    (mutex-lock! m)
+    (if (~ e'stop?)
+      (mutex-unlock! m)
+      (begin
+        ;; Returns when timed out or signaled by gc-stat-emitter-stop.
+        (mutex-unlock! m (~ e'cv) (~ e'interval))
+        (unless (~ e'stop?)
+          (let1 cur (gc-stat)
+            ((~ e'writer) (if (~ e'diff) (gc-stat-diff prev cur) cur)
+                          (~ e'port))
+            (loop cur)))))))
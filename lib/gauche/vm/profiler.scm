@@ -36,7 +36,8 @@
   (use util.match)
   (extend gauche.internal)
   (export profiler-show profiler-get-result
-          profiler-show-load-stats with-profiler)
+          profiler-show-load-stats with-profiler
+          vm-insn-count-get-result vm-insn-count-show vm-insn-count-dump)
   )
 (select-module gauche.vm.profiler)
 
@@ -129,6 +130,42 @@
     (profiler-reset)
     (apply values vals)))
 
+;;
+;; VM instruction counter
+;;
+
+;; Returns two values, ((<insn> . <count>) ...) and
+;; (((<insn> . <insn>) . <count>) ...), in descending order of counts.
+(define (vm-insn-count-get-result)
+  (match-let1 (insns . pairs) (vm-insn-count-raw-result)
+    (values (sort-by insns cdr >) (sort-by pairs cdr >))))
+
+(define (vm-insn-count-show :key (max-rows 30))
+  (define (rows lis) (if (integer? max-rows) (take* lis max-rows) lis))
+  (define (show title lis)
+    (let1 total (fold (^[e s] (+ (cdr e) s)) 0 lis)
+      (print title)
+      (print "---------------------------------------+--------------+-------")
+      (dolist [e (rows lis)]
+        (format #t "~38a ~14d ~5,1f%\n"
+                (match (car e)
+                  [(a . b) #"~a ~b"]
+                  [a a])
+                (cdr e)
+                (if (zero? total) 0 (* 100.0 (/ (cdr e) total)))))))
+  (receive (insns pairs) (vm-insn-count-get-result)
+    (if (null? insns)
+      (print "No VM instruction counts have been gathered.")
+      (begin (show "Instruction                               count" insns)
+             (newline)
+             (show "Instruction pair                          count" pairs)))))
+
+;; Writes the counts in a format that src/gen-combined-insns reads.
+;; It's the same as the one written at exit when GAUCHE_VM_INSN_COUNT
+;; environment variable is set.
+(define (vm-insn-count-dump :optional (port (current-output-port)))
+  (vm-insn-count-dump-raw port))
+
 ;;;==========================================================
 ;;; Internal routines
 ;;;
@@ -40,7 +40,7 @@
   (use rfc.base64)
   (export <message-digest-algorithm> <message-digest-algorithm-meta>
           digest-update! digest-final! digest
-          digest-to digest-message-to
+          digest-to digest-message digest-message-to
 
           ;; Obsoleted API
           digest-string digest-hexify)
@@ -69,13 +69,11 @@
 (define-method digest ((digester <message-digest-algorithm-meta>))
   #f)
 
-;; User API
-(define-method digest-to ((target <string-meta>)
-                          (digester <message-digest-algorithm-meta>))
-  (digest digester))
-(define-method digest-to ((target <u8vector-meta>)
-                          (digester <message-digest-algorithm-meta>))
-  (string->u8vector (digest digester)))
+;; Converts a raw digest (an incomplete string) to the representation
+;; specified by TARGET.
+(define-method digest-convert ((target <string-meta>) raw) raw)
+(define-method digest-convert ((target <u8vector-meta>) raw)
+  (string->u8vector raw))
 ;; Special targets:
 ;;   base64
 ;;   base64url
@@ -84,8 +82,7 @@
 ;;   base32hex
 ;;   base16
 ;;   hex
-(define-method digest-to ((target <symbol>)
-                          (digester <message-digest-algorithm-meta>))
+(define-method digest-convert ((target <symbol>) raw)
   (define encoder
     (ecase target
       [(base64) base64-encode-message]
@@ -96,16 +93,29 @@
       [(base32hex) base32hex-encode-message]
       [(base16) base16-encode-message]
       [(hex) (cut base16-encode-message <> :lowercase #t)]))
-  (encoder (digest digester)))
+  (encoder raw))
+
+;; User API
+(define-method digest-to (target (digester <message-digest-algorithm-meta>))
+  (digest-convert target (digest digester)))
+
+;; User API
+;;   Returns the digest of the whole MESSAGE as an incomplete string.
+;;   The default method feeds MESSAGE to DIGEST through a port.  An
+;;   algorithm that can digest the bytes directly may specialize it,
+;;   and then it can also accept other types of MESSAGE.
+(define-method digest-message ((digester <message-digest-algorithm-meta>)
+                               message)
+  (etypecase message
+    [<string> (with-input-from-string message (cut digest digester))]
+    [<u8vector> (with-input-from-port (open-input-uvector message)
+                  (cut digest digester))]))
 
 ;; User API
 (define-method digest-message-to (target
                                   (digester <message-digest-algorithm-meta>)
                                   message)
-  (etypecase message
-    [<string> (with-input-from-string message (cut digest-to target digester))]
-    [<u8vector> (with-input-from-port (open-input-uvector message)
-                  (cut digest-to target digester))]))
+  (digest-convert target (digest-message digester message)))
 
 
 ;; OBSOLETED
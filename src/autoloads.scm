@@ -128,7 +128,8 @@
           debug-thread-pre debug-thread-post)
 
 (autoload gauche.vm.profiler
-          profiler-show profiler-show-load-stats with-profiler)
+          profiler-show profiler-show-load-stats with-profiler
+          vm-insn-count-get-result vm-insn-count-show vm-insn-count-dump)
 
 (autoload gauche.vm.debug-info decode-debug-info)
 
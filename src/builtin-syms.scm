@@ -163,6 +163,7 @@
     (warn-legacy               SCM_SYM_WARN_LEGACY)
     (strict-r7                 SCM_SYM_STRICT_R7)
     (reader-lexical-mode       SCM_SYM_READER_LEXICAL_MODE)
+    (memory-region             SCM_SYM_MEMORY_REGION)
     (unused-args               SCM_SYM_UNUSED_ARGS)
     (next-method               SCM_SYM_NEXT_METHOD)
     (source                    SCM_SYM_SOURCE)
@@ -908,6 +908,124 @@ ScmObj Scm_CompiledCodeToList(ScmCompiledCode *cc)
     return h;
 }
 
+/* Inverse of Scm_CompiledCodeToList.  Creates a compiled code from
+   the list INSNS of the same format.  Unlike the builder, no instruction
+   combination or jump optimization is done; the code vector is restored
+   as is.  Used to restore cached code.
+
+   The compiled code objects appear in the operands whose parent is
+   not set get this code as the parent. */
+ScmObj Scm_ListToCompiledCode(ScmObj insns, int reqargs, int optargs,
+                              ScmObj name, int maxstack, ScmObj debugInfo,
+                              ScmObj signatureInfo, ScmObj intForm)
+{
+    ScmSmallInt len = Scm_Length(insns);
+    if (len < 0) Scm_Error("proper list required, but got %S", insns);
+
+    ScmCompiledCode *cc = make_compiled_code();
+    ScmWord *code = SCM_NEW_ATOMIC2(ScmWord *, len * sizeof(ScmWord));
+    ScmObj constants = SCM_NIL;
+    ScmObj cp = insns;
+    ScmObj spec, operand = SCM_FALSE, offset;
+    int numConstants = 0;
+
+#define NEXT_ELT(var)                                           \
+    do {                                                        \
+        if (!SCM_PAIRP(cp)) goto truncated;                     \
+        var = SCM_CAR(cp); cp = SCM_CDR(cp); i++;               \
+    } while (0)
+#define ADD_CONSTANT(obj)                                               \
+    do {                                                                \
+        if (SCM_PTRP(obj)) {                                            \
+            constants = Scm_Cons(obj, constants); numConstants++;       \
+        }                                                               \
+    } while (0)
+#define ADOPT(obj)                                                      \
+    do {                                                                \
+        if (SCM_COMPILED_CODE_P(obj)                                    \
+            && SCM_FALSEP(SCM_COMPILED_CODE(obj)->parent)) {            \
+            SCM_COMPILED_CODE(obj)->parent = SCM_OBJ(cc);               \
+        }                                                               \
+    } while (0)
+
+    for (ScmSmallInt i = 0; i < len;) {
+        ScmSmallInt pos = i;
+        NEXT_ELT(spec);
+        code[pos] = Scm_VMInsnBuild(spec);
+        u_int insn = SCM_VM_INSN_CODE(code[pos]);
+
+        switch (Scm_VMInsnOperandType(insn)) {
+        case SCM_VM_OPERAND_OBJ:
+            NEXT_ELT(operand);
+            code[pos+1] = SCM_WORD(operand);
+            ADD_CONSTANT(operand);
+            break;
+        case SCM_VM_OPERAND_CODE:
+            NEXT_ELT(operand);
+            if (!SCM_COMPILED_CODE_P(operand)) goto badoperand;
+            code[pos+1] = SCM_WORD(operand);
+            ADD_CONSTANT(operand);
+            ADOPT(operand);
+            break;
+        case SCM_VM_OPERAND_CODES: {
+            NEXT_ELT(operand);
+            ScmObj lp;
+            SCM_FOR_EACH(lp, operand) ADOPT(SCM_CAR(lp));
+            code[pos+1] = SCM_WORD(operand);
+            ADD_CONSTANT(operand);
+            break;
+        }
+        case SCM_VM_OPERAND_OBJ_LABEL:
+            NEXT_ELT(operand);
+            code[pos+1] = SCM_WORD(operand);
+            ADD_CONSTANT(operand);
+            pos++;
+            /*FALLTHROUGH*/
+        case SCM_VM_OPERAND_LABEL:
+            NEXT_ELT(offset);
+            if (!SCM_INTP(offset) || SCM_INT_VALUE(offset) < 0
+                || SCM_INT_VALUE(offset) >= len) {
+                Scm_Error("bad label offset in code list: %S", offset);
+            }
+            code[pos+1] = SCM_WORD(code + SCM_INT_VALUE(offset));
+            break;
+        case SCM_VM_OPERAND_OBJ_NATIVE:
+            Scm_Error("can't restore native code operand of %S", spec);
+            break;
+        default:
+            break;
+        }
+    }
+#undef NEXT_ELT
+#undef ADD_CONSTANT
+#undef ADOPT
+
+    cc->code = code;
+    cc->codeSize = (int)len;
+    if (numConstants > 0) {
+        cc->constants = SCM_NEW_ARRAY(ScmObj, numConstants);
+        for (int k=0; k<numConstants; k++, constants=SCM_CDR(constants)) {
+            cc->constants[k] = SCM_CAR(constants);
+        }
+    }
+    cc->constantSize = numConstants;
+    cc->maxstack = maxstack;
+    cc->requiredArgs = reqargs;
+    cc->optionalArgs = optargs;
+    cc->name = name;
+    cc->debugInfo = debugInfo;
+    cc->signatureInfo = signatureInfo;
+    cc->intermediateForm = intForm;
+    return SCM_OBJ(cc);
+
+  truncated:
+    Scm_Error("code list ends prematurely: %S", insns);
+    return SCM_UNDEFINED;       /* dummy */
+  badoperand:
+    Scm_Error("compiled code required as an operand, but got %S", operand);
+    return SCM_UNDEFINED;       /* dummy */
+}
+
 /*===========================================================
  * VM Instruction introspection
  */
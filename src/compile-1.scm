@@ -174,6 +174,7 @@
          ($asm src (if opt? `(,inliner ,nargs) `(,inliner))
                (imap (cut pass1 <> cenv) args)))]
       [(? vector?)                     ;inlinable lambda
+       (record-inline-fingerprint! name inliner cenv)
        (expand-inlined-procedure src
                                  (unpack-iform inliner)
                                  (imap (cut pass1 <> cenv) args))]
@@ -609,10 +610,30 @@
          (unless (vm-compiler-flag-is-set? SCM_COMPILE_LEGACY_DEFINE)
            (%insert-binding module (unwrap-syntax name)
                             (%uninitialized) '(fresh)))
-         ($define oform flags id
-                  (%wrap-as-named-expression oform (pass1 expr cenv) id))))]
+         (let1 iform (pass1 expr cenv)
+           (if (pass1/auto-inlinable? name iform flags module cenv)
+             (begin
+               (pass1/mark-closure-inlinable! iform name cenv)
+               ($define oform '(inlinable) id iform))
+             ($define oform flags id
+                      (%wrap-as-named-expression oform iform id))))))]
     [_ (error "syntax-error:" oform)]))
 
+;; In the whole-program mode (SCM_COMPILE_WHOLE_PROGRAM), we treat a plain
+;; definition of a small exported procedure as if it's defined by
+;; define-inline, so that the modules using it can inline it.
+;; The procedure must not close environment, and we only consider
+;; the definitions in the current module, for the inlinable binding
+;; needs to be inserted to the compile-time environment.
+(define (pass1/auto-inlinable? name iform flags module cenv)
+  (and (vm-compiler-flag-whole-program?)
+       (null? flags)
+       (symbol? name)
+       (eq? module (cenv-module cenv))
+       (has-tag? iform $LAMBDA)
+       (%exported-name? module name)
+       (< (iform-count-size-upto iform SMALL_LAMBDA_SIZE) SMALL_LAMBDA_SIZE)))
+
 (define (%rename-toplevel-identifier! identifier)
   (slot-set! identifier 'name (gensym #"~(identifier->symbol identifier)."))
   identifier)
@@ -799,6 +820,7 @@
 
 (define (pass1/define-macro src name expr cenv)
   (unless (identifier? name) (error "syntax-error:" src))
+  (note-compile-time-effect!)
   ;; TODO: macro autoload
   (let* ([proc (eval expr (cenv-module cenv))]
          [source-info (debug-source-info expr)]
@@ -817,6 +839,7 @@
 
 (define-pass1-syntax (define-syntax form cenv) :null
   (check-toplevel form cenv)
+  (note-compile-time-effect!)
   ;; Temporary: we use the old compiler's syntax-rules implementation
   ;; for the time being.
   (match form
@@ -841,6 +864,7 @@
 
 (define (pass1-define-hybrid-syntax form cenv)
   (check-toplevel form cenv)
+  (note-compile-time-effect!)
   (match form
     [(_ name expr macro-expr)
      (let* ([cenv (cenv-add-name cenv (variable-name name))]
@@ -1736,6 +1760,7 @@
   (check-toplevel form cenv)
   (match form
     [(_ name body ...)
+     (note-compile-time-effect!)
      (let* ([mod (ensure-module name 'define-module #t)]
             [newenv (make-bottom-cenv mod)])
        ($seq (imap (cut pass1 <> newenv) body)))]
@@ -1759,6 +1784,7 @@
      ;;  (begin ... (select-module foo) ...)
      ;; It is yet debatable that how select-module should interact with EVAL.
      (let1 m (ensure-module module 'select-module #f)
+       (note-compile-time-effect!)
        (vm-set-current-module m)
        (cenv-module-set! cenv m)
        ($values0))]
@@ -1770,12 +1796,14 @@
   ($const (cenv-module cenv)))
 
 (define-pass1-syntax (export form cenv) :gauche
+  (note-compile-time-effect!)
   (%export-symbols (cenv-module cenv) (cdr form))
   ($values0))
 
 (define-pass1-syntax (export-all form cenv) :gauche
   (unless (null? (cdr form))
     (error "syntax-error: malformed export-all:" form))
+  (note-compile-time-effect!)
   (%export-all (cenv-module cenv))
   ($values0))
 
@@ -1783,6 +1811,7 @@
   (define (ensure m) (or (find-module m) (error "unknown module" m)))
   (define (symbol-but-not-keyword? x)
     (and (symbol? x) (not (keyword? x))))
+  (note-compile-time-effect!)
   (dolist [f (cdr form)]
     (match f
       [((? symbol-but-not-keyword? a) (? symbol-but-not-keyword? b) . r)
@@ -1855,6 +1884,7 @@
     sym))
 
 (define-pass1-syntax (extend form cenv) :gauche
+  (note-compile-time-effect!)
   (%extend-module (cenv-module cenv)
                   (imap (^[m] (or (find-module m)
                                   (begin
@@ -1866,7 +1896,7 @@
 
 (define-pass1-syntax (require form cenv) :gauche
   (match form
-    [(_ feature) (%require feature) ($values0)]
+    [(_ feature) (note-compile-time-effect!) (%require feature) ($values0)]
     [_ (error "syntax-error: malformed require:" form)]))
 
 ;; Include .............................................
@@ -1896,6 +1926,8 @@
               (loop (read iport) (cons r forms))))
         (pass1/report-include iport #f)
         (close-input-port iport))))
+  ;; The result depends on the content of other files.
+  (note-compile-time-effect!)
   (map do-include args))
 
 ;; If filename is relative, we try to resolve it with the source file.
@@ -1943,6 +1975,7 @@
        (when (and (eqv? situ SCM_VM_COMPILING)
                   (memq :compile-toplevel wlist)
                   (cenv-toplevel? cenv))
+         (note-compile-time-effect!)
          (dolist [e expr] (eval e (cenv-module cenv))))
        (if (or (and (eqv? situ SCM_VM_LOADING)
                     (memq :load-toplevel wlist)
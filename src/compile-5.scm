@@ -796,6 +796,7 @@
          [ccb (ctarget-ccb target)]
          [merge-label (compiled-code-new-label ccb)])
     ($call-renv-set! iform (reverse renv))
+    (pass5/infer-param-types! iform)
     (unless (tail-context? ctx)
       (compiled-code-emit1oi! ccb PRE-CALL nargs merge-label ($*-src iform)))
     (let1 dinit (if (> nargs 0)
@@ -960,6 +961,9 @@
       (pass5/asm-nummul2 info (car args) (cadr args) target renv ctx)]
      [(NUMDIV2)
       (pass5/asm-numdiv2 info (car args) (cadr args) target renv ctx)]
+     [(NUMIADD2 NUMISUB2 NUMIMUL2 NUMIDIV2)
+      (pass5/asm-numiop2 info (car insn) (car args) (cadr args)
+                         target renv ctx)]
      [(LOGAND LOGIOR LOGXOR)
       (pass5/asm-bitwise info (car insn) (car args) (cadr args) target renv ctx)]
      [(VEC-REF)
@@ -1099,7 +1103,9 @@
   (pass5/builtin-twoargs info code 0 x y))
 
 (define (pass5/asm-numadd2 info x y target renv ctx)
-  (or (and ($const? x)
+  (or (and (pass5/flonum-args? x y)
+           (pass5/builtin-twoargs info FLADD2 0 x y))
+      (and ($const? x)
            (integer-fits-insn-arg? ($const-value x))
            (pass5/builtin-onearg info NUMADDI ($const-value x) y))
       (and ($const? y)
@@ -1120,7 +1126,9 @@
       (pass5/builtin-twoargs info NUMADD2 0 x y)))
 
 (define (pass5/asm-numsub2 info x y target renv ctx)
-  (or (and ($const? x)
+  (or (and (pass5/flonum-args? x y)
+           (pass5/builtin-twoargs info FLSUB2 0 x y))
+      (and ($const? x)
            (integer-fits-insn-arg? ($const-value x))
            (pass5/builtin-onearg info NUMSUBI ($const-value x) y))
       (and ($const? y)
@@ -1129,10 +1137,26 @@
       (pass5/builtin-twoargs info NUMSUB2 0 x y)))
 
 (define (pass5/asm-nummul2 info x y target renv ctx)
-  (pass5/builtin-twoargs info NUMMUL2 0 x y))
+  (if (pass5/flonum-args? x y)
+    (pass5/builtin-twoargs info FLMUL2 0 x y)
+    (pass5/builtin-twoargs info NUMMUL2 0 x y)))
 
 (define (pass5/asm-numdiv2 info x y target renv ctx)
-  (pass5/builtin-twoargs info NUMDIV2 0 x y))
+  (if (pass5/flonum-args? x y)
+    (pass5/builtin-twoargs info FLDIV2 0 x y)
+    (pass5/builtin-twoargs info NUMDIV2 0 x y)))
+
+;; +., -., *. and /.  If both args are flonums, they're the same as
+;; the generic ones.
+(define (pass5/asm-numiop2 info code x y target renv ctx)
+  (if (pass5/flonum-args? x y)
+    (pass5/builtin-twoargs info (assv-ref `((,NUMIADD2 . ,FLADD2)
+                                            (,NUMISUB2 . ,FLSUB2)
+                                            (,NUMIMUL2 . ,FLMUL2)
+                                            (,NUMIDIV2 . ,FLDIV2))
+                                          code)
+                           0 x y)
+    (pass5/builtin-twoargs info code 0 x y)))
 
 ;; if one of arg is constant, it's always x.  see builtin-inline-bitwise below.
 (define (pass5/asm-bitwise info insn x y target renv ctx)
@@ -1189,6 +1213,143 @@
                (compiled-code-emit0i! (ctarget-ccb target) SLOT-SET info)
                (imax d0 (+ d1 1) (+ d2 2)))))]))
 
+;;
+;; Numeric type inference
+;;
+;;   We infer whether the value of an expression is always a fixnum,
+;;   a flonum, or a real number, so that arithmetic on flonums can be
+;;   compiled into FLADD2 etc., which skip generic dispatch.  Their
+;;   results are left in the VM's flonum registers as the other
+;;   arithmetic instructions do, so intermediate flonums aren't boxed.
+;;
+;;   The type is one of the symbols fixnum, flonum and real, or #f if
+;;   we don't know.  Note that fixnum arithmetic may overflow, so the
+;;   result of (+ fixnum fixnum) is only known to be real.
+;;
+;;   The sources of type information are constants, the init expressions
+;;   of immutable local variables, and the arguments of embedded local
+;;   calls (that is, loops).  For the last one, pass5/infer-param-types!
+;;   is called before the body of the embedded lambda is compiled; it
+;;   looks at the initial call and all jump calls to the body and sets
+;;   lvar-numtype of the parameters.  Lvar-numtype is #f if it hasn't
+;;   been inferred, and unknown if it has been but we don't know the type.
+
+;; Expressions deeper than this are regarded as unknown.
+(define-constant NUMTYPE_DEPTH_LIMIT 8)
+
+(define (numtype-join a b)
+  (cond [(eq? a b) a]
+        [(and a b) 'real]
+        [else #f]))
+
+(define (pass5/numtype iform)
+  (define (rec iform depth)
+    (and (< depth NUMTYPE_DEPTH_LIMIT)
+         (case/unquote
+          (iform-tag iform)
+          [($CONST) (let1 v ($const-value iform)
+                      (cond [(fixnum? v) 'fixnum]
+                            [(flonum? v) 'flonum]
+                            [(real? v) 'real]
+                            [else #f]))]
+          [($LREF) (let* ([lvar ($lref-lvar iform)]
+                          [t (lvar-numtype lvar)])
+                     (and (lvar-immutable? lvar)
+                          (cond [(not t)
+                                 (and-let1 init (lvar-initval lvar)
+                                   (and (vector? init)
+                                        (rec init (+ depth 1))))]
+                                [(eq? t 'unknown) #f]
+                                [else t])))]
+          [($ASM) (asm-type (car ($asm-insn iform)) ($asm-args iform)
+                            (+ depth 1))]
+          [($IF) (and (not ($it? ($if-then iform)))
+                      (not ($it? ($if-else iform)))
+                      (numtype-join (rec ($if-then iform) (+ depth 1))
+                                    (rec ($if-else iform) (+ depth 1))))]
+          [($LET) (rec ($let-body iform) (+ depth 1))]
+          [($SEQ) (and (pair? ($seq-body iform))
+                       (rec (last ($seq-body iform)) (+ depth 1)))]
+          [($LABEL) (rec ($label-body iform) (+ depth 1))]
+          [else #f])))
+  (define (asm-type code args depth)
+    (define (arg-types)
+      (if (and (pair? args) (pair? (cdr args)) (null? (cddr args)))
+        (values (rec (car args) depth) (rec (cadr args) depth))
+        (values #f #f)))
+    (case/unquote
+     code
+     [(NUMADD2 NUMSUB2)
+      (receive (a b) (arg-types)
+        (and a b (if (or (eq? a 'flonum) (eq? b 'flonum)) 'flonum 'real)))]
+     [(NUMMUL2 NUMDIV2)
+      ;; (* 0 +inf.0) is exact 0, so we need both to be flonums.
+      (receive (a b) (arg-types)
+        (and a b (if (and (eq? a 'flonum) (eq? b 'flonum)) 'flonum 'real)))]
+     [(NUMIADD2 NUMISUB2 NUMIMUL2 NUMIDIV2)
+      (receive (a b) (arg-types)
+        (and a b 'flonum))]
+     [(NEGATE)
+      (let1 a (rec (car args) depth)
+        (and a (if (eq? a 'flonum) 'flonum 'real)))]
+     [else #f]))
+  (rec iform 0))
+
+(define (pass5/flonum-args? x y)
+  (and (eq? (pass5/numtype x) 'flonum)
+       (eq? (pass5/numtype y) 'flonum)))
+
+;; IFORM is an embed $CALL node.  Sets the types of the parameters of the
+;; embedded lambda which hold in all calls to it.  We start from the types
+;; of the arguments of the initial call and widen them until they cover
+;; the arguments of the jump calls.
+(define (pass5/infer-param-types! iform)
+  (let* ([lvars ($lambda-lvars ($call-proc iform))]
+         [jumps (pass5/jump-calls iform)])
+    (define (widen types call)
+      (map numtype-join types (map pass5/numtype ($call-args call))))
+    (let loop ([types (map pass5/numtype ($call-args iform))])
+      (for-each (^[lv t] (lvar-numtype-set! lv (or t 'unknown))) lvars types)
+      (let1 types2 (fold (^[call ts] (widen ts call)) types jumps)
+        (unless (equal? types types2)
+          (loop types2))))))
+
+;; Returns a list of jump $CALL nodes to the embed $CALL node EMBED.
+(define (pass5/jump-calls embed)
+  (define labels '())
+  (define r '())
+  (define (rec* iforms) (ifor-each rec iforms))
+  (define (rec iform)
+    (case/unquote
+     (iform-tag iform)
+     [($DEFINE) (rec ($define-expr iform))]
+     [($LSET)   (rec ($lset-expr iform))]
+     [($GSET)   (rec ($gset-expr iform))]
+     [($IF)     (rec ($if-test iform))
+                (rec ($if-then iform))
+                (rec ($if-else iform))]
+     [($LET)    (rec* ($let-inits iform)) (rec ($let-body iform))]
+     [($RECEIVE) (rec ($receive-expr iform)) (rec ($receive-body iform))]
+     [($LAMBDA) (rec ($lambda-body iform))]
+     [($CLAMBDA) (rec* ($clambda-closures iform))]
+     [($LABEL)  (unless (memq iform labels)
+                  (push! labels iform)
+                  (rec ($label-body iform)))]
+     [($SEQ)    (rec* ($seq-body iform))]
+     [($CALL)   (rec* ($call-args iform))
+                (if (eq? ($call-flag iform) 'jump)
+                  (when (eq? ($call-proc iform) embed) (push! r iform))
+                  (rec ($call-proc iform)))]
+     [($ASM)    (rec* ($asm-args iform))]
+     [($CONS $APPEND $MEMV $EQ? $EQV?) (rec ($*-arg0 iform))
+                                       (rec ($*-arg1 iform))]
+     [($VECTOR $LIST $LIST*) (rec* ($*-args iform))]
+     [($LIST->VECTOR) (rec ($*-arg0 iform))]
+     [($DYNENV) (rec* ($dynenv-kvs iform)) (rec ($dynenv-body iform))]
+     [else #f]))
+  (rec ($lambda-body ($call-proc embed)))
+  r)
+
 ;; Dispatch table.
 (define *pass5-dispatch-table* (generate-dispatch-table pass5))
 
@@ -322,3 +322,115 @@
                                          (list ($gref values.) ($lref r))))))
                     )))))]
       [_ (undefined)])))
+
+;; A literal lambda passed to for-each, map or fold never escapes from
+;; the call, for those procedures don't keep it.  We expand such a call
+;; into a local loop that calls the lambda bound to a local variable:
+;;
+;;   (for-each (lambda (x) body) lis)
+;;    => (let ([proc (lambda (x) body)] [lis0 lis])
+;;         (letrec ([loop (lambda (xs)
+;;                          (cond [(pair? xs) (proc (car xs)) (loop (cdr xs))]
+;;                                [(null? xs) (undefined)]
+;;                                [else (error "..." lis0)]))])
+;;           (loop lis0)))
+;;
+;; The only reference to proc is the call in the loop, so Pass 2 embeds
+;; the lambda body there, and the loop becomes a jump.  No closure is
+;; created, hence the frames of the enclosing procedure stay on the stack
+;; instead of being moved to the heap.
+;;
+;; NEXT is a procedure that takes lvars of proc, the current list, the
+;; accumulators and the loop, and returns IForm of the loop body when the
+;; list is a pair.  END takes the accumulator lvars and returns IForm of
+;; the result.  The initial values of the accumulators, INITS, are
+;; evaluated after PROC and before LIS, as the arguments of the original
+;; call.  IMPROPER takes the lvars of the current list and the original
+;; list, and returns IForm to signal an error when the list is improper.
+(define (expand-list-loop src proc lis inits next end
+                          :optional (improper
+                                     (^[xs lv]
+                                       (list-loop-error
+                                        src "improper list not allowed:" lv))))
+  (let* ([pv (make-lvar 'proc)]
+         [lv (make-lvar 'lis)]
+         [loopv (make-lvar 'loop)]
+         [xs (make-lvar 'xs)]
+         [initvs (imap (^_ (make-lvar 'init)) inits)]
+         [accs (imap (^_ (make-lvar 'acc)) inits)]
+         [lmda ($lambda src 'loop (+ (length accs) 1) 0 (cons xs accs)
+                        ($if src ($asm src `(,PAIRP) (list ($lref xs)))
+                             (next pv xs accs loopv)
+                             ($if src ($asm src `(,NULLP) (list ($lref xs)))
+                                  (end accs)
+                                  (improper xs lv)))
+                        '())])
+    (lvar-initval-set! pv proc)
+    (ifor-each2 lvar-initval-set! initvs inits)
+    (lvar-initval-set! lv lis)
+    (lvar-initval-set! loopv lmda)
+    ($let src 'let `(,pv ,@initvs ,lv) `(,proc ,@inits ,lis)
+          ($let src 'rec (list loopv) (list lmda)
+                ($call src ($lref loopv)
+                       (cons ($lref lv) (imap $lref initvs)))))))
+
+(define (list-loop-error src msg lvar)
+  ($call src ($gref error.) (list ($const msg) ($lref lvar))))
+
+;; Returns #t iff IFORM is a literal lambda that takes exactly NARGS args.
+(define (downward-lambda? iform nargs)
+  (and (has-tag? iform $LAMBDA)
+       (= ($lambda-reqargs iform) nargs)
+       (= ($lambda-optarg iform) 0)))
+
+(define-builtin-inliner for-each
+  (^[src args]
+    (match args
+      [((? (cut downward-lambda? <> 1) proc) lis)
+       (expand-list-loop src proc lis '()
+                         (^[pv xs accs loopv]
+                           ($seq
+                            (list ($call src ($lref pv)
+                                         (list ($asm src `(,CAR)
+                                                     (list ($lref xs)))))
+                                  ($call src ($lref loopv)
+                                         (list ($asm src `(,CDR)
+                                                     (list ($lref xs))))))))
+                         (^[accs] ($const-undef)))]
+      [_ (undefined)])))
+
+(define-builtin-inliner map
+  (^[src args]
+    (match args
+      [((? (cut downward-lambda? <> 1) proc) lis)
+       (expand-list-loop src proc lis (list ($const-nil))
+                         (^[pv xs accs loopv]
+                           ($call src ($lref loopv)
+                                  (list ($asm src `(,CDR) (list ($lref xs)))
+                                        ($asm src `(,CONS)
+                                              (list ($call src ($lref pv)
+                                                           (list ($asm src `(,CAR)
+                                                                       (list ($lref xs)))))
+                                                    ($lref (car accs)))))))
+                         (^[accs] ($asm src `(,REVERSE)
+                                        (list ($lref (car accs))))))]
+      [_ (undefined)])))
+
+(define-builtin-inliner fold
+  (^[src args]
+    (match args
+      [((? (cut downward-lambda? <> 2) proc) knil lis)
+       (expand-list-loop src proc lis (list knil)
+                         (^[pv xs accs loopv]
+                           ($call src ($lref loopv)
+                                  (list ($asm src `(,CDR) (list ($lref xs)))
+                                        ($call src ($lref pv)
+                                               (list ($asm src `(,CAR)
+                                                           (list ($lref xs)))
+                                                     ($lref (car accs)))))))
+                         (^[accs] ($lref (car accs)))
+                         ;; Same as null-list? in liblist.scm
+                         (^[xs lv]
+                           (list-loop-error
+                            src "argument must be a list, but got:" xs)))]
+      [_ (undefined)])))
@@ -210,13 +210,16 @@
 ;;     initval   - initialized value (Maybe IForm)
 ;;     ref-count - in how many places this variable is referenced?
 ;;     set-count - in how many places this variable is set!
+;;     numtype   - transient; numeric type of the parameter of an embedded
+;;                 lambda, inferred in Pass 5.  See pass5/numtype.
 ;;
 
 (define-simple-struct lvar 'lvar make-lvar
   (name
    (initval #f)
    (ref-count 0)
-   (set-count 0)))
+   (set-count 0)
+   (numtype #f)))
 
 (define (make-lvar+ name) ;; procedure version of constructor, for mapping
   (make-lvar name))
@@ -244,6 +247,7 @@
  (.define LVAR_OFFSET_INITVAL   (lvar-initval-offset))
  (.define LVAR_OFFSET_REF_COUNT (lvar-ref-count-offset))
  (.define LVAR_OFFSET_SET_COUNT (lvar-set-count-offset))
+ (.define LVAR_OFFSET_NUMTYPE   (lvar-numtype-offset))
  (.define LVAR_SIZE             (lvar-size))
 
  ;; Specialized routine for (map (lambda (name) (make-lvar name)) objs)
@@ -253,7 +257,8 @@
        (let* ([v (Scm_MakeVector LVAR_SIZE '0)])
          (set! (SCM_VECTOR_ELEMENT v LVAR_OFFSET_TAG) 'lvar
                (SCM_VECTOR_ELEMENT v LVAR_OFFSET_NAME) name
-               (SCM_VECTOR_ELEMENT v LVAR_OFFSET_INITVAL) SCM_FALSE)
+               (SCM_VECTOR_ELEMENT v LVAR_OFFSET_INITVAL) SCM_FALSE
+               (SCM_VECTOR_ELEMENT v LVAR_OFFSET_NUMTYPE) SCM_FALSE)
          (SCM_APPEND1 h t v)))
      (return h)))
 
@@ -1079,6 +1084,90 @@
 
     (unpack-rec (V 0))))
 
+;; Inline fingerprints
+;;   A precompiled library carries the bodies of procedures it inlined
+;;   from other modules.  If such a provider is changed and reinstalled,
+;;   the library keeps running the old bodies.  To notice it, precomp
+;;   has the compiler record a fingerprint of every packed IForm inlined
+;;   from other modules, and emits a call of %check-inline-fingerprints
+;;   at the end of the library's initializer, which warns when the
+;;   provider's current inliner no longer matches.
+;;
+;;   Modules bundled with Gauche are excluded; precompiled code is tied
+;;   to the Gauche version anyway.
+
+(define *inline-fingerprints* #f) ; list of (modname name fp) while recording
+
+(define (%start-recording-inline-fingerprints!)
+  (set! *inline-fingerprints* '()))
+
+;; Stops recording and returns the recorded entries.
+(define (%finish-recording-inline-fingerprints!)
+  (rlet1 r (or *inline-fingerprints* '())
+    (set! *inline-fingerprints* #f)))
+
+;; Called from pass1/expand-inliner.  ID is the identifier of the callee.
+(define (record-inline-fingerprint! id ivec cenv)
+  (and-let* ([ *inline-fingerprints* ]
+             [ (identifier? id) ]
+             [g (id->bound-gloc id)]
+             [mod (gloc-module g)]
+             [ (not (eq? mod (cenv-module cenv))) ]
+             [modname (module-name mod)]
+             [ (not (#/^(?:gauche|scheme|srfi)(?:\.|$)/
+                     (symbol->string modname))) ]
+             [name (gloc-name g)]
+             [ (not (find (^e (and (eq? (car e) modname) (eq? (cadr e) name)))
+                          *inline-fingerprints*)) ])
+    (push! *inline-fingerprints*
+           (list modname name (packed-iform-fingerprint ivec)))))
+
+;; The fingerprint must be the same whether the provider is loaded from
+;; the source or from the precompiled code, so we only look at the
+;; structure.  Identifiers are hashed by their module and name, and
+;; uninterned symbols by a fixed marker since gensym'ed names vary.
+;; Objects portable-hash can't handle are hashed by their class names.
+(define (packed-iform-fingerprint ivec)
+  (define (leaf obj)
+    (cond [(symbol? obj)
+           (portable-hash (if (symbol-interned? obj) obj '%uninterned) 0)]
+          [(or (number? obj) (string? obj) (char? obj) (boolean? obj)
+               (keyword? obj) (null? obj))
+           (portable-hash obj 0)]
+          [else (portable-hash (class-name (class-of obj)) 0)]))
+  ;; PATH holds the ancestors, to cut circular source forms.  We don't
+  ;; mark shared substructures, for sharing of literals differs between
+  ;; the source and the precompiled code.
+  (define (rec obj path)
+    (cond [(memq obj path) 0]
+          [(identifier? obj)
+           (combine-hash-value (leaf (module-name (identifier-module obj)))
+                               (rec (identifier-name obj) path))]
+          [(pair? obj)
+           (let1 path (cons obj path)
+             (combine-hash-value (rec (car obj) path) (rec (cdr obj) path)))]
+          [(vector? obj)
+           (let1 path (cons obj path)
+             (fold (^[e h] (combine-hash-value h (rec e path)))
+                   (vector-length obj) (vector->list obj)))]
+          [else (leaf obj)]))
+  (rec ivec '()))
+
+;; Emitted by precomp.  ENTRIES is what
+;; %finish-recording-inline-fingerprints! returned when SRC was compiled.
+(define (%check-inline-fingerprints src entries)
+  (dolist [e entries]
+    (let ([modname (car e)] [name (cadr e)] [fp (caddr e)])
+      (unless (and-let* ([mod (find-module modname)]
+                         [g (find-binding mod name #t)]
+                         [proc (gloc-ref g #f)]
+                         [ (procedure? proc) ]
+                         [ivec (%procedure-inliner proc)]
+                         [ (vector? ivec) ])
+                (eqv? (packed-iform-fingerprint ivec) fp))
+        (warn "~a: ~s in ~s has been changed since it was inlined.  \
+               Recompile ~a.\n" src name modname src)))))
+
 ;; Counts the size (approx # of nodes) of the iform.
 (define (iform-count-size-upto iform limit)
   (define (rec iform cnt)
@@ -1656,6 +1745,18 @@
 (define (compile-partial program module) #f)
 (define (compile-finish cc) #f)
 
+;; Count of forms that had effects at compile time, such as macro
+;; definitions and module operations.  The compiled code of such a form
+;; can't stand alone, since running it doesn't reproduce the effects.
+;; The code cache (see libeval.scm) checks this counter around compile
+;; to decide whether it can save the compiled code instead of the source.
+;; Concurrent compilation may bump it spuriously, which only makes
+;; the cache more conservative.
+(define *compile-time-effects* 0)
+(define (note-compile-time-effect!)
+  (set! *compile-time-effects* (+ *compile-time-effects* 1)))
+(define (compile-time-effect-count) *compile-time-effects*)
+
 (define (parse-target-params target-params)
   (let-keywords target-params ((env-header-size #f)
                                (cont-frame-size #f)
@@ -2163,6 +2264,8 @@
    (return (SCM_VM_COMPILER_FLAG_IS_SET (Scm_VM) SCM_COMPILE_NO_POST_INLINE_OPT)))
  (define-cproc vm-compiler-flag-no-lifting? () ::<boolean>
    (return (SCM_VM_COMPILER_FLAG_IS_SET (Scm_VM) SCM_COMPILE_NO_LIFTING)))
+ (define-cproc vm-compiler-flag-whole-program? () ::<boolean>
+   (return (SCM_VM_COMPILER_FLAG_IS_SET (Scm_VM) SCM_COMPILE_WHOLE_PROGRAM)))
 
  (define-enum SCM_COMPILE_NOINLINE_GLOBALS)
  (define-enum SCM_COMPILE_NOINLINE_LOCALS)
@@ -2180,6 +2283,7 @@
  (define-enum SCM_COMPILE_LEGACY_DEFINE)
  (define-enum SCM_COMPILE_MUTABLE_LITERALS)
  (define-enum SCM_COMPILE_SRFI_FEATURE_ID)
+ (define-enum SCM_COMPILE_WHOLE_PROGRAM)
 
  ;; Set/get VM's current module info. (temporary)
  (define-cproc vm-current-module () (return (SCM_OBJ (-> (Scm_VM) module))))
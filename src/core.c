@@ -66,6 +66,8 @@ static struct {
 
 extern void Scm__InitModule(void);
 extern void Scm__InitHash(void);
+extern void Scm__InitHashDescriptor(void);
+extern void Scm__InitStringDescriptor(void);
 extern void Scm__InitSymbol(void);
 extern void Scm__InitNumber(void);
 extern void Scm__InitChar(void);
@@ -136,6 +138,7 @@ extern void Scm_Init_libomega(void);
 extern void Scm__FinishModuleInitialization(void);
 
 static void finalizable(void);
+static void GC_CALLBACK gcstat_event(GC_EventType ev);
 static void init_cond_features(void);
 
 #ifdef GAUCHE_USE_PTHREADS
@@ -181,6 +184,7 @@ void Scm_Init(const char *signature)
     GC_set_oom_fn(oom_handler);
     GC_set_finalize_on_demand(TRUE);
     GC_set_finalizer_notifier(finalizable);
+    GC_set_on_collection_event(gcstat_event);
 
     /* Newer bdwgc delays spawning marker threads until the client creates
        first thread.  We can take advantage of parallel markers even with
@@ -189,6 +193,11 @@ void Scm_Init(const char *signature)
 
     (void)SCM_INTERNAL_MUTEX_INIT(cond_features.mutex);
 
+    /* Descriptors for precisely typed objects must be ready before
+       any of those objects are allocated. */
+    CALL_INIT(Scm__InitStringDescriptor);
+    CALL_INIT(Scm__InitHashDescriptor);
+
     /* Initialize components.  The order is important, for some components
        rely on the other components to be initialized. */
     CALL_INIT(Scm__InitThreadLocal);
@@ -317,6 +326,38 @@ void Scm_RegisterDL(void *data_start, void *data_end,
     }
 }
 
+/*
+ * Descriptor for precisely typed allocation (SCM_NEW_TYPED).
+ * SIZE is the size of the object in bytes.  The bytes in the range
+ * [NONPTR_START, NONPTR_END) are known not to contain pointers.
+ * A word partially covered by the range is still treated as a pointer,
+ * so the result is always on the safe side.
+ *
+ * Note on memory overhead: The typed object carries its descriptor in
+ * the last word.  However, since we build GC with ALL_INTERIOR_POINTERS,
+ * an ordinary object is already padded by a byte, so both usually end
+ * up in the same size granule.
+ */
+ScmGCDescriptor Scm_MakeGCDescriptor(size_t size,
+                                     size_t nonptr_start,
+                                     size_t nonptr_end)
+{
+    const size_t wordbits = sizeof(GC_word)*CHAR_BIT;
+    size_t nwords = (size + sizeof(GC_word) - 1)/sizeof(GC_word);
+    size_t npstart = (nonptr_start + sizeof(GC_word) - 1)/sizeof(GC_word);
+    size_t npend = nonptr_end/sizeof(GC_word);
+    size_t bmsize = (nwords + wordbits - 1)/wordbits;
+    GC_word *bm = SCM_NEW_ATOMIC_ARRAY(GC_word, bmsize);
+
+    for (size_t i = 0; i < bmsize; i++) bm[i] = 0;
+    for (size_t i = 0; i < nwords; i++) {
+        if (i < npstart || i >= npend) {
+            bm[i/wordbits] |= ((GC_word)1 << (i%wordbits));
+        }
+    }
+    return GC_make_descriptor(bm, nwords);
+}
+
 /*
  * Useful routine for debugging, to check if an object is inadvertently
  * collected.
@@ -332,6 +373,131 @@ void Scm_GCSentinel(void *obj, const char *name)
 }
 
 
+/*
+ * GC tuning.  A collection is triggered after allocating roughly
+ * (traced heap size)/(free space divisor) bytes, but at least the
+ * minimum bytes.  When most allocated objects die young, as in
+ * request-scoped data of servers, raising these thresholds trades
+ * memory for fewer collections.
+ * bdwgc's setters are unsynchronized, so we take the allocation lock.
+ */
+static void *set_free_space_divisor(void *data)
+{
+    GC_set_free_space_divisor(*(GC_word*)data);
+    return NULL;
+}
+
+static void *set_min_bytes_allocd(void *data)
+{
+    GC_set_min_bytes_allocd(*(size_t*)data);
+    return NULL;
+}
+
+void Scm_GCSetFreeSpaceDivisor(u_long n)
+{
+    GC_word v = n;
+    if (n == 0) Scm_Error("free space divisor must be positive");
+    GC_call_with_alloc_lock(set_free_space_divisor, &v);
+}
+
+void Scm_GCSetMinBytesAllocd(size_t n)
+{
+    if (n == 0) Scm_Error("minimum bytes between collections must be positive");
+    GC_call_with_alloc_lock(set_min_bytes_allocd, &n);
+}
+
+/*=============================================================
+ * GC statistics
+ *
+ *  We hook GC's collection event notifier to measure pause times
+ *  and phases.  The notifier is called with the allocation lock held,
+ *  and often with the world stopped, so the updates are serialized,
+ *  but it must not allocate nor do anything that can raise an error.
+ *
+ *  NB: bdwgc sweeps lazily, while allocating.  The reclaim time only
+ *  counts the eager part done within a collection.
+ */
+
+static struct {
+    ScmGCStat stat;
+    int64_t pauseStart;
+    int64_t markStart;
+    int64_t reclaimStart;
+    int     inPause;
+    int     worldEvents;        /* TRUE if we've seen STOP_WORLD events */
+} gcstat;
+
+static int64_t gcstat_now(void)
+{
+    u_long sec, nsec;
+    Scm_ClockGetTimeMonotonic(&sec, &nsec);
+    return (int64_t)sec * 1000000000 + nsec;
+}
+
+static void gcstat_end_pause(int64_t now)
+{
+    int64_t t = now - gcstat.pauseStart;
+    ScmGCStat *st = &gcstat.stat;
+    st->totalPauseTime += t;
+    st->lastPauseTime = t;
+    if (t > st->maxPauseTime) st->maxPauseTime = t;
+    st->recentPauses[st->numPauses % SCM_GC_PAUSE_HISTORY_SIZE] = t;
+    st->numPauses++;
+    gcstat.inPause = FALSE;
+}
+
+static void GC_CALLBACK gcstat_event(GC_EventType ev)
+{
+    int64_t now = gcstat_now();
+
+    switch (ev) {
+    case GC_EVENT_PRE_STOP_WORLD:
+        gcstat.worldEvents = TRUE;
+        gcstat.pauseStart = now;
+        gcstat.inPause = TRUE;
+        break;
+    case GC_EVENT_POST_START_WORLD:
+        if (gcstat.inPause) gcstat_end_pause(now);
+        break;
+    case GC_EVENT_MARK_START:
+        /* Without threads we don't get STOP_WORLD events; the marking
+           is the pause. */
+        if (!gcstat.inPause) {
+            gcstat.pauseStart = now;
+            gcstat.inPause = TRUE;
+        }
+        gcstat.markStart = now;
+        break;
+    case GC_EVENT_MARK_END:
+        gcstat.stat.totalMarkTime += now - gcstat.markStart;
+        if (!gcstat.worldEvents && gcstat.inPause) gcstat_end_pause(now);
+        break;
+    case GC_EVENT_RECLAIM_START:
+        gcstat.reclaimStart = now;
+        break;
+    case GC_EVENT_RECLAIM_END:
+        gcstat.stat.totalReclaimTime += now - gcstat.reclaimStart;
+        break;
+    case GC_EVENT_END:
+        gcstat.stat.numCollections++;
+        break;
+    default:
+        break;
+    }
+}
+
+static void *gcstat_copy(void *data)
+{
+    *(ScmGCStat*)data = gcstat.stat;
+    return NULL;
+}
+
+void Scm_GetGCStat(ScmGCStat *stat)
+{
+    /* Take the allocation lock to get a consistent snapshot. */
+    GC_call_with_alloc_lock(gcstat_copy, stat);
+}
+
 /*=============================================================
  * Finalization.  Scheme finalizers are added as NO_ORDER.
  */
@@ -359,10 +525,19 @@ void finalizable(void)
     }
 }
 
+static void *gcstat_add_finalizers(void *data)
+{
+    gcstat.stat.finalizersRun += *(int*)data;
+    return NULL;
+}
+
 /* Called from VM loop.  Queue is not empty. */
 ScmObj Scm_VMFinalizerRun(ScmVM *vm)
 {
-    GC_invoke_finalizers();
+    /* Finalizers must run without the allocation lock; we take it
+       only to update the counter, as the other gcstat updates do. */
+    int n = GC_invoke_finalizers();
+    if (n > 0) GC_call_with_alloc_lock(gcstat_add_finalizers, &n);
     vm->finalizerPending = FALSE;
     return SCM_UNDEFINED;
 }
@@ -102,6 +102,7 @@ typedef ssize_t ScmSize;
 #endif
 #endif /* LIBGAUCHE_BODY */
 #include <gc.h>
+#include <gc_typed.h>
 
 #ifndef SCM_DECL_BEGIN
 #ifdef __cplusplus
@@ -535,6 +536,25 @@ typedef struct ScmInstanceRec {
 #define SCM_NEW_ATOMIC_ARRAY(type, nelts)  ((type*)(SCM_MALLOC_ATOMIC(sizeof(type)*(nelts))))
 #define SCM_NEW_ATOMIC2(type, size) ((type)(SCM_MALLOC_ATOMIC(size)))
 
+/* Precisely typed allocators.  A descriptor tells GC which words of
+   the object may hold pointers; other words are never scanned.  It is
+   useful for objects having full-word non-pointer fields, such as
+   bitmaps and hash values, which tend to become false pointers.
+   A descriptor is created by Scm_MakeGCDescriptor, and it must be
+   created before the first allocation that uses it.
+   The object allocated by these can't be passed to GC_realloc. */
+typedef GC_descr ScmGCDescriptor;
+
+#define SCM_MALLOC_TYPED(size, descr)  GC_MALLOC_EXPLICITLY_TYPED(size, descr)
+#define SCM_NEW_TYPED(type, descr) \
+    ((type*)(SCM_MALLOC_TYPED(sizeof(type), descr)))
+#define SCM_NEW_TYPED2(type, size, descr) \
+    ((type)(SCM_MALLOC_TYPED(size, descr)))
+
+SCM_EXTERN ScmGCDescriptor Scm_MakeGCDescriptor(size_t size,
+                                                size_t nonptr_start,
+                                                size_t nonptr_end);
+
 typedef void (*ScmFinalizerProc)(ScmObj z, void *data);
 SCM_EXTERN void Scm_RegisterFinalizer(ScmObj z, ScmFinalizerProc finalizer,
                                       void *data);
@@ -1699,6 +1719,13 @@ SCM_EXTERN void   Scm_ProfilerStart(void);
 SCM_EXTERN int    Scm_ProfilerStop(void);
 SCM_EXTERN void   Scm_ProfilerReset(void);
 
+/* VM instruction frequency counter (vmstat.c) */
+SCM_EXTERN void   Scm_VMInsnCountStart(void);
+SCM_EXTERN int    Scm_VMInsnCountStop(void);
+SCM_EXTERN void   Scm_VMInsnCountReset(void);
+SCM_EXTERN ScmObj Scm_VMInsnCountResult(void);
+SCM_EXTERN void   Scm_VMInsnCountDump(ScmPort *port);
+
 /*---------------------------------------------------
  * UTILITY STUFF
  */
@@ -1737,6 +1764,29 @@ SCM_EXTERN void Scm_PrintStaticRoots(void);
 SCM_EXTERN void Scm_RegisterDL(void *data_start, void *data_end,
                                void *bss_start, void *bss_end);
 SCM_EXTERN void Scm_GCSentinel(void *obj, const char *name);
+SCM_EXTERN void Scm_GCSetFreeSpaceDivisor(u_long n);
+SCM_EXTERN void Scm_GCSetMinBytesAllocd(size_t n);
+
+/* GC statistics gathered by the collection event hook.
+   Times are in nanoseconds.  Counters are cumulative since the
+   program started. */
+#define SCM_GC_PAUSE_HISTORY_SIZE 32
+
+typedef struct ScmGCStatRec {
+    u_long  numCollections;     /* # of completed collections */
+    int64_t totalPauseTime;     /* total time the world is stopped */
+    int64_t maxPauseTime;
+    int64_t lastPauseTime;
+    int64_t totalMarkTime;      /* total time spent in mark phase */
+    int64_t totalReclaimTime;   /* total time spent in eager sweep */
+    u_long  numPauses;          /* # of stop-the-world pauses */
+    int64_t recentPauses[SCM_GC_PAUSE_HISTORY_SIZE];
+                                /* recent pause times, ring buffer indexed
+                                   by numPauses */
+    u_long  finalizersRun;      /* # of finalizers invoked */
+} ScmGCStat;
+
+SCM_EXTERN void Scm_GetGCStat(ScmGCStat *stat);
 
 SCM_EXTERN ScmObj Scm_GetFeatures(void);
 SCM_EXTERN void   Scm_AddFeature(const char *feature, const char *mod);
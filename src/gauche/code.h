@@ -128,6 +128,11 @@ SCM_EXTERN void   Scm_CompiledCodeCopyX(ScmCompiledCode *dest,
                                         const ScmCompiledCode *src);
 SCM_EXTERN void   Scm_CompiledCodeDump(ScmCompiledCode *cc);
 SCM_EXTERN ScmObj Scm_CompiledCodeToList(ScmCompiledCode *cc);
+SCM_EXTERN ScmObj Scm_ListToCompiledCode(ScmObj insns, int reqargs,
+                                         int optargs, ScmObj name,
+                                         int maxstack, ScmObj debugInfo,
+                                         ScmObj signatureInfo,
+                                         ScmObj intForm);
 SCM_EXTERN ScmObj Scm_CompiledCodeFullName(ScmCompiledCode *cc);
 SCM_EXTERN void   Scm_VMExecuteToplevels(ScmCompiledCode *cv[]);
 
@@ -84,6 +84,9 @@ SCM_EXTERN void Scm_HashCoreInitGeneral(ScmHashCore *core,
                                         ScmHashCompareProc *cmpfn,
                                         unsigned int initSize,
                                         void *data);
+SCM_EXTERN ScmObj Scm_MakeFastHashTable(int string_keys,
+                                        unsigned int initSize,
+                                        void *data);
 
 SCM_EXTERN int  Scm_HashCoreTypeToProcs(ScmHashType type,
                                         ScmHashProc **hashfn,
@@ -116,6 +119,8 @@ SCM_EXTERN u_long Scm_EqvHash(ScmObj obj);
 SCM_EXTERN u_long Scm_HashString(ScmString *str, u_long bound);
 SCM_EXTERN u_long Scm_PortableHash(ScmObj obj, u_long salt);
 SCM_EXTERN ScmSmallInt Scm_DefaultHash(ScmObj obj);
+SCM_EXTERN ScmSmallInt Scm_FastHash(ScmObj obj);
+SCM_EXTERN u_long Scm_FastHashBytes(const void *p, size_t len);
 SCM_EXTERN ScmSmallInt Scm_RecursiveHash(ScmObj obj,
                                          ScmSmallInt salt,
                                          u_long flags);
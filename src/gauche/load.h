@@ -114,6 +114,10 @@ SCM_EXTERN int Scm_Require(ScmObj feature, int flags, ScmLoadPacket *p);
 SCM_EXTERN ScmObj Scm_Provide(ScmObj feature);
 SCM_EXTERN int    Scm_ProvidedP(ScmObj feature);
 
+/* internal - for parallel loading */
+SCM_EXTERN void   Scm__SetPrefetchParent(ScmObj parent);
+SCM_EXTERN int    Scm__ProvidingP(ScmObj feature);
+
 /*=================================================================
  * Autoloads
  */
@@ -440,6 +440,7 @@ SCM_EXTERN ScmObj Scm_ReadLineUnsafe(ScmPort *port);
 
 SCM_EXTERN ScmObj Scm_OpenFilePort(const char *path, int flags,
                                    int buffering, int perm);
+SCM_EXTERN ScmObj Scm_OpenMappedInputFile(const char *path, int flags);
 
 SCM_EXTERN ScmObj Scm_Stdin(void);
 SCM_EXTERN ScmObj Scm_Stdout(void);
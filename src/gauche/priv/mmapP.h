@@ -40,6 +40,7 @@ struct ScmMemoryRegionRec {
     size_t size;
     int prot;
     int flags;
+    int viewed;                 /* TRUE once a view uvector is created */
 #if defined(GAUCHE_WINDOWS)
     HANDLE fileMapping;         /* file mapping object handle */
 #endif
@@ -52,6 +53,7 @@ SCM_CLASS_DECL(Scm_MemoryRegionClass);
 
 SCM_EXTERN ScmObj Scm_SysMmap(void *addrhint, int fd, size_t len, off_t off,
                               int prot, int flags);
+SCM_EXTERN int    Scm_MemoryRegionRelease(ScmMemoryRegion *m);
 SCM_EXTERN void   Scm_SysMmapWX(size_t len,
                                 ScmMemoryRegion **writable,
                                 ScmMemoryRegion **executable);
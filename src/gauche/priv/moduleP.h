@@ -41,5 +41,7 @@ SCM_EXTERN ScmModule *Scm__RequireBaseModule(void);
 SCM_EXTERN ScmObj Scm__MakeWrapperModule(ScmModule *origin, ScmObj prefix);
 
 SCM_EXTERN ScmGloc   *Scm__IdentifierToBoundGloc(ScmIdentifier*);
+SCM_EXTERN int        Scm__ExportedInternalNameP(ScmModule *module,
+                                                 ScmSymbol *name);
 
 #endif /*GAUCHE_PRIV_MODULEP_H*/
@@ -34,9 +34,13 @@
 #ifndef GAUCHE_VM_H
 #define GAUCHE_VM_H
 
-/* Size of stack per VM (in words). */
+/* Initial size of stack per VM (in words).  It is also the minimum. */
 #define SCM_VM_STACK_SIZE      10000
 
+/* The stack grows up to this size by default (in words).  See save_stack()
+   in vm.c. */
+#define SCM_VM_STACK_SIZE_MAX  (SCM_VM_STACK_SIZE*64)
+
 /* Maximum # of values allowed for multiple value return */
 #define SCM_VM_MAX_VALUES      20
 
@@ -507,6 +511,9 @@ struct ScmVMRec {
     ScmObj *stack;              /* bottom of allocated stack area */
     ScmObj *stackBase;          /* base of current stack area  */
     ScmObj *stackEnd;           /* end of current stack area */
+    long stackSizeMax;          /* the stack can grow up to this # of words */
+    int stackOverflows;         /* # of recent stack overflows */
+    long stackOverflowTime;     /* when the last overflow occurred (us) */
 #if GAUCHE_SPLIT_STACK
     /* EXPERIMENTAL: Save the continuation when an error occurs, used for
        better error diagnostics.  Reset by the "cross the border" APIs
@@ -583,6 +590,7 @@ struct ScmVMRec {
 };
 
 SCM_EXTERN ScmVM *Scm_NewVM(ScmVM *proto, ScmObj name);
+SCM_EXTERN void   Scm_VMSetStackSize(ScmVM *vm, long size, long maxsize);
 SCM_EXTERN int    Scm_AttachVM(ScmVM *vm);
 SCM_EXTERN void   Scm_DetachVM(ScmVM *vm);
 SCM_EXTERN void   Scm_VMDump(ScmVM *vm);
@@ -719,8 +727,10 @@ enum {
                                            timings (incurs runtime overhead) */
     SCM_CHECK_UNDEFINED_TEST = (1L<<7), /* check if #<undef> appears as
                                            the test value in branch */
-    SCM_SAFE_STRING_CURSORS = (1L<<8)   /* Always use large cursors for
+    SCM_SAFE_STRING_CURSORS = (1L<<8),  /* Always use large cursors for
                                            extra validation. */
+    SCM_PARALLEL_LOAD        = (1L<<9)  /* require loads dependencies
+                                           in parallel threads */
 };
 
 #define SCM_VM_RUNTIME_FLAG_IS_SET(vm, flag) ((vm)->runtimeFlags & (flag))
@@ -763,10 +773,12 @@ enum {
     SCM_COMPILE_MUTABLE_LITERALS = (1L<<12),/* Literal pairs are mutable */
     SCM_COMPILE_SRFI_FEATURE_ID = (1L<<13), /* Allow srfi-N feature id in
                                                cond-expand */
-    SCM_COMPILE_NOINLINE_INLINER = (1L<<14)/* (internal) Do not invoke custom
+    SCM_COMPILE_NOINLINE_INLINER = (1L<<14),/* (internal) Do not invoke custom
                                               inliner and ASM inliners.
                                               hybrid macro is still expanded.
                                               used for macroexpand-all */
+    SCM_COMPILE_WHOLE_PROGRAM = (1L<<15)   /* Make small exported procedures
+                                              inlinable into other modules */
 };
 
 #define SCM_VM_COMPILER_FLAG_IS_SET(vm, flag) ((vm)->compilerFlags & (flag))
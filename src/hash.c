@@ -51,6 +51,12 @@ typedef struct EntryRec {
 
 #define BUCKETS(hc)   ((Entry**)hc->buckets)
 
+/* Entries are allocated precisely typed, since hashval, being
+   well distributed, is a good source of false pointers. */
+static ScmGCDescriptor entry_descr;
+
+#define NEW_ENTRY()   SCM_NEW_TYPED(Entry, entry_descr)
+
 #define DEFAULT_NUM_BUCKETS    4
 #define MAX_AVG_CHAIN_LIMITS   3
 #define EXTEND_BITS            2
@@ -130,6 +136,114 @@ ScmSmallInt Scm_HashSaltSet(ScmSmallInt newval) /* returns old value */
 #define SCM_DWSIPHASH_INTERFACE
 #include "gauche/priv/dws_adapter.h"
 
+/* Siphash is resistant to hash flooding, but it is slower than
+   non-cryptographic hashes for short keys.  For the tables that don't
+   take keys from untrusted sources, we provide a "fast" mode, which
+   uses a variation of wyhash (public domain, by Wang Yi).
+   https://github.com/wangyi-fudan/wyhash
+
+   The secret is chosen per process, so the hash value isn't stable
+   across runs, as the default hash.
+ */
+
+/* Modes of equal_hash_common */
+enum {
+    HASH_DEFAULT,
+    HASH_PORTABLE,
+    HASH_FAST
+};
+
+static uint64_t fast_hash_secret;     /* initialized in Scm__InitHash */
+
+static const uint64_t wy_p[4] = {
+    0xa0761d6478bd642full, 0xe7037ed1a0b428dbull,
+    0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull
+};
+
+/* 64x64->128 multiplication; A gets the lower half, B the upper half. */
+static inline void wy_mum(uint64_t *a, uint64_t *b)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32;
+    uint64_t la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha*hb, rm0 = ha*lb, rm1 = hb*la, rl = la*lb;
+    uint64_t t = rl + (rm0 << 32);
+    uint64_t c = (t < rl);
+    uint64_t lo = t + (rm1 << 32);
+    c += (lo < t);
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t wy_mix(uint64_t a, uint64_t b)
+{
+    wy_mum(&a, &b);
+    return a ^ b;
+}
+
+/* Unaligned native-endian loads.  The result depends on endianness,
+   which is fine, since fast hash values are never persisted. */
+static inline uint64_t wy_r8(const uint8_t *p)
+{
+    uint64_t v; memcpy(&v, p, 8); return v;
+}
+
+static inline uint64_t wy_r4(const uint8_t *p)
+{
+    uint32_t v; memcpy(&v, p, 4); return v;
+}
+
+static inline uint64_t wy_r3(const uint8_t *p, size_t k)
+{
+    return (((uint64_t)p[0]) << 16) | (((uint64_t)p[k>>1]) << 8) | p[k-1];
+}
+
+static uint64_t fast_bytes_hash(const uint8_t *p, size_t len, uint64_t seed)
+{
+    uint64_t a, b;
+    seed ^= wy_mix(seed ^ wy_p[0], wy_p[1]);
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (wy_r4(p) << 32) | wy_r4(p + ((len>>3)<<2));
+            b = (wy_r4(p+len-4) << 32) | wy_r4(p+len-4-((len>>3)<<2));
+        } else if (len > 0) {
+            a = wy_r3(p, len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = wy_mix(wy_r8(p) ^ wy_p[1], wy_r8(p+8) ^ seed);
+                see1 = wy_mix(wy_r8(p+16) ^ wy_p[2], wy_r8(p+24) ^ see1);
+                see2 = wy_mix(wy_r8(p+32) ^ wy_p[3], wy_r8(p+40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wy_mix(wy_r8(p) ^ wy_p[1], wy_r8(p+8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = wy_r8(p+i-16);
+        b = wy_r8(p+i-8);
+    }
+    a ^= wy_p[1];
+    b ^= seed;
+    wy_mum(&a, &b);
+    return wy_mix(a ^ wy_p[0] ^ len, b ^ wy_p[1]);
+}
+
 u_long Scm_EqHash(ScmObj obj)
 {
     u_long hashval;
@@ -218,21 +332,24 @@ u_long Scm_EqvHash(ScmObj obj)
     return hashval&HASHMASK;
 }
 
-static u_long internal_string_hash(ScmString *str, u_long salt, int portable)
+static u_long internal_string_hash(ScmString *str, u_long salt, int mode)
 {
     const ScmStringBody *b = SCM_STRING_BODY(str);
-    if (portable) {
+    if (mode == HASH_PORTABLE) {
         return (u_long)Scm__DwSipPortableHash((uint8_t*)b->start, b->size,
                                               salt, salt);
+    } else if (mode == HASH_FAST) {
+        return (u_long)fast_bytes_hash((const uint8_t*)b->start, b->size,
+                                       fast_hash_secret ^ salt);
     } else {
         return Scm__DwSipDefaultHash((uint8_t*)b->start, b->size,
                                      salt, salt);
     }
 }
 
-static u_long internal_uvector_hash(ScmUVector *u, u_long salt, int portable)
+static u_long internal_uvector_hash(ScmUVector *u, u_long salt, int mode)
 {
-    if (portable) {
+    if (mode == HASH_PORTABLE) {
         ScmUVectorType uvtype = Scm_UVectorType(Scm_ClassOf(SCM_OBJ(u)));
         u_long r, seed;
         size_t s = SCM_UVECTOR_SIZE(u);
@@ -330,6 +447,12 @@ static u_long internal_uvector_hash(ScmUVector *u, u_long salt, int portable)
             Scm_Panic("invalid uvector class.");
         }
         return 0;           /* dummy */
+    } else if (mode == HASH_FAST) {
+        /* We include the type, so that #u8(0 0) and #u16(0) differ. */
+        u_long uvtype = Scm_UVectorType(Scm_ClassOf(SCM_OBJ(u)));
+        return (u_long)fast_bytes_hash((const uint8_t*)SCM_UVECTOR_ELEMENTS(u),
+                                       Scm_UVectorSizeInBytes(u),
+                                       fast_hash_secret ^ salt ^ uvtype);
     } else {
         return Scm__DwSipDefaultHash((uint8_t*)SCM_UVECTOR_ELEMENTS(u),
                                      (uint32_t)Scm_UVectorSizeInBytes(u),
@@ -343,42 +466,42 @@ static u_long internal_uvector_hash(ScmUVector *u, u_long salt, int portable)
    Both default-hash and portable-hash have this property but their
    requirements are slightly different, so here's the common part.
 */
-static u_long equal_hash_common(ScmObj obj, u_long salt, int portable)
+static u_long equal_hash_common(ScmObj obj, u_long salt, int mode)
 {
     if (SCM_NUMBERP(obj)) {
-        return number_hash(obj, salt, portable);
+        return number_hash(obj, salt, mode == HASH_PORTABLE);
     } else if (!SCM_PTRP(obj)) {
         u_long hashval;
         SMALL_INT_HASH(hashval, (u_long)SCM_WORD(obj));
         return hashval&PORTABLE_HASHMASK;
     } else if (SCM_STRINGP(obj)) {
-        return internal_string_hash(SCM_STRING(obj), salt, portable);
+        return internal_string_hash(SCM_STRING(obj), salt, mode);
     } else if (SCM_PAIRP(obj)) {
         u_long h = 0, h2;
         ScmObj cp;
         SCM_FOR_EACH(cp, obj) {
-            h2 = equal_hash_common(SCM_CAR(cp), salt, portable);
+            h2 = equal_hash_common(SCM_CAR(cp), salt, mode);
             h = COMBINE(h, h2);
         }
-        h2 = equal_hash_common(cp, salt, portable);
+        h2 = equal_hash_common(cp, salt, mode);
         return COMBINE(h, h2);
     } else if (SCM_VECTORP(obj)) {
         int siz = SCM_VECTOR_SIZE(obj);
         u_long h = 0, h2;
         for (int i=0; i<siz; i++) {
-            h2 = equal_hash_common(SCM_VECTOR_ELEMENT(obj, i), salt, portable);
+            h2 = equal_hash_common(SCM_VECTOR_ELEMENT(obj, i), salt, mode);
             h = COMBINE(h, h2);
         }
         return h;
     /* uvector hash support */
     } else if (SCM_UVECTORP(obj)) {
-        return internal_uvector_hash(SCM_UVECTOR(obj), salt, portable);
+        return internal_uvector_hash(SCM_UVECTOR(obj), salt, mode);
 #if GAUCHE_KEEP_DISJOINT_KEYWORD_OPTION
     } else if (SCM_KEYWORDP(obj)) {
-        if (portable) {
+        if (mode == HASH_PORTABLE) {
             if (SCM_SYMBOLP(obj)) {
                 /* GAUCHE_KEYWORD_IS_SYMBOL mode */
-                return internal_string_hash(SCM_KEYWORD_NAME(obj), salt, TRUE);
+                return internal_string_hash(SCM_KEYWORD_NAME(obj), salt, HASH_PORTABLE);
             } else {
                 /* GAUCHE_KEYWORD_IS_DISJOINT mode.  SCM_KEYWORD_NAME does
                    not include prefix ':'.  We should append it so that
@@ -391,7 +514,7 @@ static u_long equal_hash_common(ScmObj obj, u_long salt, int portable)
                     prefix = SCM_STRING(Scm_MakeString(":", 1, 1, 0));
                 }
                 ScmObj name = Scm_StringAppend2(prefix, SCM_KEYWORD_NAME(obj));
-                return internal_string_hash(SCM_STRING(name), salt, TRUE);
+                return internal_string_hash(SCM_STRING(name), salt, HASH_PORTABLE);
             }
         } else {
             u_long hashval;
@@ -400,8 +523,8 @@ static u_long equal_hash_common(ScmObj obj, u_long salt, int portable)
         }
 #endif /*GAUCHE_KEEP_DISJOINT_KEYWORD_OPTION*/
     } else if (SCM_SYMBOLP(obj)) {
-        if (portable) {
-            return internal_string_hash(SCM_SYMBOL_NAME(obj), salt, TRUE);
+        if (mode == HASH_PORTABLE) {
+            return internal_string_hash(SCM_SYMBOL_NAME(obj), salt, HASH_PORTABLE);
         } else {
             u_long hashval;
             ADDRESS_HASH(hashval, obj);
@@ -412,7 +535,7 @@ static u_long equal_hash_common(ScmObj obj, u_long salt, int portable)
     ScmClass *k = SCM_CLASS_OF(obj);
     if (k->hash) {
         return (u_long)k->hash(obj, salt,
-                               (portable? SCM_HASH_PORTABLE:0));
+                               (mode == HASH_PORTABLE ? SCM_HASH_PORTABLE : 0));
     }
 
     /* Call specialized object-hash method
@@ -425,10 +548,10 @@ static u_long equal_hash_common(ScmObj obj, u_long salt, int portable)
     SCM_BIND_PROC(portable_hash_proc, "portable-hash", Scm_GaucheModule());
     SCM_BIND_PROC(default_hash_proc, "default-hash", Scm_GaucheModule());
     ScmObj r = Scm_ApplyRec3(call_object_hash_proc, obj,
-                             (portable
+                             (mode == HASH_PORTABLE
                               ? portable_hash_proc
                               : default_hash_proc),
-                             (portable
+                             (mode == HASH_PORTABLE
                               ? Scm_MakeIntegerU(salt)
                               : SCM_FALSE));
     if (SCM_INTP(r)) {
@@ -465,13 +588,30 @@ void Scm__InitCurrentRecursiveHash()
  */
 u_long Scm_PortableHash(ScmObj obj, u_long salt)
 {
-    return equal_hash_common(obj, salt, TRUE) & PORTABLE_HASHMASK;
+    return equal_hash_common(obj, salt, HASH_PORTABLE) & PORTABLE_HASHMASK;
 }
 
 /* 'Default' general hash function. */
 ScmSmallInt Scm_DefaultHash(ScmObj obj)
 {
-    return equal_hash_common(obj, Scm_HashSaltRef(), FALSE) & HASHMASK;
+    return equal_hash_common(obj, Scm_HashSaltRef(), HASH_DEFAULT) & HASHMASK;
+}
+
+/* 'Fast' general hash function.  It satisfies the same property as
+   the default hash, but strings and uniform vectors are hashed with
+   a faster, non-cryptographic hash.  Use it only when keys don't come
+   from untrusted sources. */
+ScmSmallInt Scm_FastHash(ScmObj obj)
+{
+    return equal_hash_common(obj, Scm_HashSaltRef(), HASH_FAST) & HASHMASK;
+}
+
+/* Fast hash of raw bytes. */
+u_long Scm_FastHashBytes(const void *p, size_t len)
+{
+    return (u_long)fast_bytes_hash((const uint8_t*)p, len,
+                                   fast_hash_secret ^ Scm_HashSaltRef())
+        & HASHMASK;
 }
 
 /* This is to be called from ScmClass->hash if it needs to compute
@@ -479,9 +619,9 @@ ScmSmallInt Scm_DefaultHash(ScmObj obj)
 ScmSmallInt Scm_RecursiveHash(ScmObj obj, ScmSmallInt salt, u_long flags)
 {
     if (flags & SCM_HASH_PORTABLE) {
-        return equal_hash_common(obj, salt, TRUE) & PORTABLE_HASHMASK;
+        return equal_hash_common(obj, salt, HASH_PORTABLE) & PORTABLE_HASHMASK;
     } else {
-        return equal_hash_common(obj, salt, FALSE) & HASHMASK;
+        return equal_hash_common(obj, salt, HASH_DEFAULT) & HASHMASK;
     }
 }
 
@@ -508,7 +648,7 @@ ScmSmallInt Scm_Int64Hash(int64_t val,
    of srfi-13; just give 0 as modulo if you don't need it.  */
 u_long Scm_HashString(ScmString *str, u_long modulo)
 {
-    u_long hashval = internal_string_hash(str, Scm_HashSaltRef(), FALSE);
+    u_long hashval = internal_string_hash(str, Scm_HashSaltRef(), HASH_DEFAULT);
     if (modulo == 0) return hashval&HASHMASK;
     else return (hashval % modulo);
 }
@@ -561,7 +701,7 @@ static Entry *insert_entry(ScmHashCore *table,
                            u_long   hashval,
                            int index)
 {
-    Entry *e = SCM_NEW(Entry);
+    Entry *e = NEW_ENTRY();
     Entry **buckets = BUCKETS(table);
     e->key = key;
     e->value = 0;
@@ -734,6 +874,24 @@ static int string_cmp(const ScmHashCore *ht SCM_UNUSED, intptr_t k1, intptr_t k2
                        SCM_STRING_BODY_SIZE(b1)) == 0));
 }
 
+/*
+ * Hash functions for fast-hash tables.  They are used with general_access.
+ */
+static u_long fast_equal_hash(const ScmHashCore *ht SCM_UNUSED, intptr_t key)
+{
+    return Scm_FastHash(SCM_OBJ(key));
+}
+
+static u_long fast_string_hash(const ScmHashCore *ht SCM_UNUSED, intptr_t k)
+{
+    ScmObj key = SCM_OBJ(k);
+    if (!SCM_STRINGP(key)) {
+        Scm_Error("Got non-string key %S to the string hashtable.", key);
+    }
+    const ScmStringBody *b = SCM_STRING_BODY(key);
+    return Scm_FastHashBytes(SCM_STRING_BODY_START(b), SCM_STRING_BODY_SIZE(b));
+}
+
 /*
  * Accessor function for general case
  *    (hashfn and cmpfn are given by user)
@@ -856,7 +1014,7 @@ void Scm_HashCoreCopy(ScmHashCore *dst, const ScmHashCore *src)
         Entry *s = (Entry*)src->buckets[i];
         b[i] = NULL;
         while (s) {
-            Entry *e = SCM_NEW(Entry);
+            Entry *e = NEW_ENTRY();
             e->key = s->key;
             e->value = s->value;
             e->next = NULL;
@@ -973,6 +1131,21 @@ ScmObj Scm_MakeHashTableFull(ScmHashProc hashfn,
     return SCM_OBJ(z);
 }
 
+/* Creates a general hash table that uses fast hash, with string=? or
+   equal? as the equality.  DATA is usually a comparator, as in
+   Scm_MakeHashTableFull. */
+ScmObj Scm_MakeFastHashTable(int string_keys, unsigned int initSize,
+                             void *data)
+{
+    if (string_keys) {
+        return Scm_MakeHashTableFull(fast_string_hash, string_cmp,
+                                     initSize, data);
+    } else {
+        return Scm_MakeHashTableFull(fast_equal_hash, equal_cmp,
+                                     initSize, data);
+    }
+}
+
 ScmObj Scm_HashTableCopy(ScmHashTable *src)
 {
     ScmHashTable *dst = SCM_NEW(ScmHashTable);
@@ -1123,6 +1296,14 @@ static unsigned int round2up(unsigned int val)
  * Initialization
  */
 
+/* Called early in the initialization, before any hash table is created. */
+void Scm__InitHashDescriptor()
+{
+    entry_descr = Scm_MakeGCDescriptor(sizeof(Entry),
+                                       offsetof(Entry, hashval),
+                                       sizeof(Entry));
+}
+
 void Scm__InitHash()
 {
     struct timeval t;
@@ -1132,6 +1313,10 @@ void Scm__InitHash()
     u_long salt = ((u_long)getpid() * ((u_long)t.tv_sec^(u_long)t.tv_usec));
     ADDRESS_HASH(salt, salt);
     salt &= SCM_SMALL_INT_MAX;
+    /* The fast hash secret needs full 64 bits; mix in the stack address
+       as well, so that it isn't easily guessed from pid and time. */
+    fast_hash_secret = wy_mix(((uint64_t)getpid() << 32) ^ (uint64_t)t.tv_usec,
+                              (uint64_t)t.tv_sec ^ (uint64_t)(uintptr_t)&t);
     /*
      * We can't use Scm_BindPrimitiveParameter here, since symbol table
      * is not initialized yet (symbol table uses hashtable!)
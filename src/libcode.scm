@@ -37,7 +37,7 @@
 ;; AOT-compiler, and other module that needs to deal with Gauche VM
 ;; code generation.
 (define-module gauche.vm.code
-  (export vm-dump-code vm-code->list vm-insn-build
+  (export vm-dump-code vm-code->list list->vm-code vm-insn-build
           vm-insn-code->name vm-insn-name->code
 
           make-compiled-code-builder
@@ -68,6 +68,11 @@
    Scm_CompiledCodeDump)
  (define-cproc vm-code->list (code::<compiled-code>)
    Scm_CompiledCodeToList)
+ ;; Inverse of vm-code->list.  Used to restore cached code.
+ (define-cproc list->vm-code (insns reqargs::<uint16> optargs::<uint16>
+                              name maxstack::<int> debug-info
+                              signature-info intform)
+   Scm_ListToCompiledCode)
  (define-cproc vm-insn-build (insn) ::<ulong>
    (return (cast u_long (Scm_VMInsnBuild insn))))
  (define-cproc vm-insn-code->name (opcode::<uint>)
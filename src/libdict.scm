@@ -139,6 +139,7 @@
 (define-cproc portable-hash (obj salt::<fixnum>) ::<ulong>
   :fast-flonum Scm_PortableHash)
 (define-cproc default-hash (obj) ::<fixnum> :fast-flonum Scm_DefaultHash)
+(define-cproc fast-hash (obj) ::<fixnum> :fast-flonum Scm_FastHash)
 (define-cproc combine-hash-value (a::<ulong> b::<ulong>) ::<ulong>
   Scm_CombineHashValue)
 
@@ -209,6 +210,11 @@
                                    init-size
                                    comparator))))
 
+(define-cproc %make-hash-table-fast (comparator::<comparator>
+                                     init-size::<int>
+                                     string-keys::<boolean>)
+  (return (Scm_MakeFastHashTable string-keys init-size comparator)))
+
 ;; Comparator argument can be <comparator> or one of the symbols
 ;; eq?, eqv?, equal? or string=?.
 (define (make-hash-table :optional (comparator 'eq?) (init-size 0))
@@ -237,6 +243,13 @@
        (make-hash-table 'equal? init-size)]
       [(eq? comparator string-comparator)
        (make-hash-table 'string=? init-size)]
+      ;; Comparators using fast-hash with equal? or string=? are handled
+      ;; natively, without calling back Scheme procedures.
+      [(and (eq? (comparator-hash-function comparator) fast-hash)
+            (memq (comparator-equality-predicate comparator)
+                  (list equal? string=?)))
+       => (^p (%make-hash-table-fast comparator init-size
+                                     (eq? (car p) string=?)))]
       [else
        (unless (comparator-hashable? comparator)
          (error "make-hash-table requires a comparator with hash function, \
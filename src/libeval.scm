@@ -97,12 +97,12 @@
                 (if hooked? " (hooked) " "")))
       (if (not (input-port? port))
         (and error-if-not-found (raise port))
-        (begin
-          (load-from-port (if ignore-coding
-                            port
-                            (open-coding-aware-port port))
-                          :environment environment
-                          :paths remaining-paths)
+        (let1 port (if ignore-coding port (open-coding-aware-port port))
+          (if (and (not hooked?) (code-cache-enabled?))
+            (load-with-code-cache port path environment remaining-paths)
+            (load-from-port port
+                            :environment environment
+                            :paths remaining-paths))
           path)))))
 
 
@@ -112,6 +112,16 @@
 (define-in-module gauche (load-from-port port
                                          :key (paths #f)
                                               (environment #f))
+  (%load-from-port port paths environment
+                   (^[read-form]
+                     (do ([s (read-form) (read-form)])
+                         [(eof-object? s)]
+                       (eval s #f)))))
+
+;; Sets up the load context and calls RUNNER, with a thunk to read
+;; the next form from PORT.  RUNNER is responsible to evaluate the forms.
+;; The code cache uses it to run the cached code instead.
+(define (%load-from-port port paths environment runner)
   (unless (input-port? port)
     (error "input port required, but got:" port))
   (unless (or (module? environment) (not environment))
@@ -173,9 +183,7 @@
       (when (eq? (gauche-character-encoding) 'utf-8)
         (when (eqv? (peek-char port) #\ufeff)
           (read-char port)))
-      (do ([s (read+ port) (read+ port)])
-          [(eof-object? s)]
-        (eval s #f)))
+      (runner (^[] (read+ port))))
     (restore-load-context)
     #t))
 
@@ -193,12 +201,12 @@
                  (?: (SCM_FALSEP path) t (Scm_Cons path t))
                  (ref (-> vm stat) loadStat))))))))
 
-(define-cproc %new-read-context-for-load ()
+(define-cproc %new-read-context-for-load (:optional (source-info::<boolean> #t))
   (let* ([ctx::ScmReadContext* (Scm_MakeReadContext NULL)])
     (set! (-> ctx flags)
-          (logior (-> ctx flags)
-                  (logior RCTX_LITERAL_IMMUTABLE
-                          RCTX_SOURCE_INFO)))
+          (logior (-> ctx flags) RCTX_LITERAL_IMMUTABLE))
+    (when source-info
+      (set! (-> ctx flags) (logior (-> ctx flags) RCTX_SOURCE_INFO)))
     (return (SCM_OBJ ctx))))
 
 (define-cproc %load-verbose? () ::<boolean>
@@ -252,6 +260,10 @@
 (define-cproc %require (feature) ::<boolean>
   (return (not (Scm_Require feature SCM_LOAD_PROPAGATE_ERROR NULL))))
 
+;; For parallel loading.  See parallel_prefetch in load.c.
+(define-cproc %set-prefetch-parent! (parent) ::<void> Scm__SetPrefetchParent)
+(define-cproc %providing? (feature) ::<boolean> Scm__ProvidingP)
+
 (define-cproc %add-load-path (path::<const-cstring> :optional afterp)
   (return (Scm_AddLoadPath path (not (SCM_FALSEP afterp)))))
 
@@ -431,6 +443,492 @@
     (%add-load-path-hook! hook)
     (^[] (%delete-load-path-hook! hook))))
 
+;;;
+;;; Code cache
+;;;
+
+(select-module gauche.internal)
+
+;; When the code cache is enabled, `load' saves the compiled code of
+;; the source file into a cache file, and uses it next time the same
+;; source is loaded, instead of reading and compiling it again.
+;; It is enabled by setting the environment variable GAUCHE_CODE_CACHE
+;; to the directory to keep the cache files.
+;;
+;; The cache file is named after the absolute pathname of the source.
+;; It consists of a header, followed by entries for each toplevel form
+;; of the source in order.
+;;
+;;   (gauche-code-cache <format> <gauche-version> <compiler-flags>
+;;                      <module> <mtime> <size> <content-hash>)
+;;   (code . <encoded compiled code>)
+;;   (source . <encoded form>)
+;;
+;; The cache is valid if the header matches except <mtime>.  <module> is
+;; the name of the module in which the source is loaded.  The source is
+;; read and hashed only when its <mtime> or <size> differs from the stored
+;; header; otherwise validating the cache costs one stat.
+;;
+;; A form that has compile-time effects, such as macro definitions and
+;; module operations (see note-compile-time-effect! in compile.scm),
+;; is kept as a source and evaluated again.  So is a form whose compiled
+;; code contains an object we can't write out.
+;;
+;; NB: We don't track the changes of other files.  If the source uses
+;; macros or inlinable procedures from other modules, their expansion
+;; is baked into the cached code.
+;;
+;; Objects in the code are encoded as follows:
+;;
+;;   (q . <datum>)    - A datum that can be written and read back
+;;   (p <e> . <e>)    - A pair
+;;   (a <e> <e> . <e>) - An extended pair with source-info (first <e>)
+;;   (v <e> ...)      - A vector
+;;   (g <n> <name>)   - An uninterned symbol, <n>-th in the file
+;;   (i <module> <e>) - A toplevel identifier
+;;   (u)              - #<undef>
+;;   (e)              - #<eof>
+;;   (c <name> <reqargs> <optargs> <maxstack> <insns> <debug-info>
+;;      <signature-info> <intermediate-form>) - A compiled code
+
+(define-constant .code-cache-format. 1)
+
+;; #f - disabled, string - cache directory, #<undef> - not initialized
+(define *code-cache-directory* (undefined))
+
+(define (code-cache-directory)
+  (when (undefined? *code-cache-directory*)
+    (set! *code-cache-directory*
+          (let1 dir (sys-getenv "GAUCHE_CODE_CACHE")
+            (and dir (not (equal? dir "")) dir))))
+  *code-cache-directory*)
+
+(define (code-cache-directory-set! dir)
+  (set! *code-cache-directory* dir))
+
+(define (code-cache-enabled?)
+  (boolean (or (code-cache-directory) *code-image* *code-image-recorder*)))
+
+;; Returns the cache file name for the source PATH, or #f if the cache
+;; isn't enabled.
+(define (code-cache-file path)
+  (and-let1 dir (code-cache-directory)
+    (let* ([abspath (sys-normalize-pathname path :absolute #t
+                                            :canonicalize #t)]
+           [name (%code-cache-mangle abspath)])
+      (string-append dir "/" name ".cache"))))
+
+;; Encode characters that can't appear in a filename, or has special
+;; meaning, to %XX (ASCII) or %uXXXX; (others).  Overly long names are
+;; truncated and the hash value is appended to keep them distinct.
+(define (%code-cache-mangle abspath)
+  (define (safe? c)
+    (or (char<=? #\a c #\z) (char<=? #\A c #\Z) (char<=? #\0 c #\9)
+        (memv c '(#\. #\- #\_))))
+  (let1 name (call-with-output-string
+               (^[out]
+                 (dolist [c (string->list abspath)]
+                   (let1 n (char->integer c)
+                     (cond [(safe? c) (write-char c out)]
+                           [(< n 16) (format out "%0~x" n)]
+                           [(< n 128) (format out "%~x" n)]
+                           [else (format out "%u~x;" n)])))))
+    (if (> (string-length name) 200)
+      (string-append (string-copy name (- (string-length name) 160))
+                     "-" (number->string (portable-hash abspath 0) 16))
+      name)))
+
+;; Returns the header of the cache, or #f if we can't cache the code.
+;; STORED is the header of an existing cache or image entry, or #f.
+;; Hashing the content requires reading the whole source, so if STORED
+;; agrees with the source on everything else, including the mtime and
+;; the size, we trust its hash and only stat the source.
+(define (%code-cache-header path environment stored)
+  (let* ([mod (or environment (vm-current-module))]
+         [modname (module-name mod)])
+    (and (symbol? modname)
+         (eq? (find-module modname) mod)
+         (let* ([st (sys-stat path)]
+                [size (slot-ref st 'size)]
+                [make-header
+                 (^[hash]
+                   `(gauche-code-cache ,.code-cache-format. ,(gauche-version)
+                                       ,(vm-compiler-flag) ,modname
+                                       ,(slot-ref st 'mtime) ,size ,hash))])
+           (if (and (pair? stored)
+                    (equal? (make-header (last stored)) stored))
+             stored
+             (make-header
+              (portable-hash (call-with-input-file path
+                               (^[in] (read-block size in))
+                               :element-type :binary)
+                             0)))))))
+
+;; The stored entries are valid if their header agrees with the source's
+;; one except the mtime; the source may have been touched or copied
+;; without changes.
+(define (%code-cache-valid? header stored)
+  (define (sans-mtime h) (append (take h 5) (drop h 6)))
+  (and (list? stored)
+       (= (length stored) (length header))
+       (equal? (sans-mtime header) (sans-mtime stored))))
+
+;; Read the cache file and returns (<header> <entry> ...), or #f if
+;; it doesn't exist or is broken.  The header isn't validated here.
+(define (%code-cache-read cache-file)
+  (guard (e [else #f])
+    (and (file-exists? cache-file)
+         (let ([ctx (%new-read-context-for-load #f)]
+               [prev (current-read-context)])
+           (call-with-input-file cache-file
+             (^[in]
+               (current-read-context ctx)
+               (unwind-protect
+                   (let loop ([r '()])
+                     (let1 e (read in)
+                       (if (eof-object? e)
+                         (and (pair? r) (reverse! r))
+                         (loop (cons e r)))))
+                 (current-read-context prev))))))))
+
+(define (%code-cache-write cache-file header entries)
+  (let1 tmp #"~|cache-file|.~(sys-getpid)"
+    (guard (e [else
+               (guard (e2 [else #f]) (sys-unlink tmp))
+               (when (%load-verbose?)
+                 (format (current-error-port)
+                         ";;Couldn't write code cache ~a: ~a\n" cache-file
+                         (if (condition? e) (condition-message e) e)))])
+      (let1 dir (sys-dirname cache-file)
+        (unless (file-exists? dir) (sys-mkdir dir #o755)))
+      (call-with-output-file tmp
+        (^[out]
+          (write header out) (newline out)
+          (dolist [e entries] (write e out) (newline out))))
+      (sys-rename tmp cache-file))))
+
+;; Called from `load'.  PORT is the opened source.
+(define (load-with-code-cache port path environment paths)
+  (define abspath
+    (sys-normalize-pathname path :absolute #t :canonicalize #t))
+  (define cache-file (code-cache-file path))
+  ;; With only an image given, files that aren't in it gain nothing from
+  ;; the cache machinery; we don't even compute the header, which may read
+  ;; the whole file to hash it.
+  (define cacheable?
+    (or cache-file
+        *code-image-recorder*
+        (and *code-image* (hash-table-exists? *code-image* abspath))))
+  ;; What we have for the source, as (<header> <entry> ...), or #f.
+  ;; The cache file isn't read if the image has a valid entry.
+  (define in-image (and cacheable? (%code-image-lookup abspath)))
+  (define in-cache
+    (delay (and cacheable? cache-file (%code-cache-read cache-file))))
+  (define header
+    (and cacheable?
+         (%code-cache-header path environment
+                             (cond [in-image => car]
+                                   [(force in-cache) => car]
+                                   [else #f]))))
+  (define (valid-entries stored)
+    (and stored (%code-cache-valid? header (car stored)) (cdr stored)))
+  (define (record! entries)
+    (when *code-image-recorder*
+      (hash-table-put! *code-image-recorder* abspath (cons header entries))))
+  (define (discard!)
+    (when *code-image* (hash-table-delete! *code-image* abspath))
+    (when cache-file (guard (e [else #f]) (sys-unlink cache-file))))
+  (define entries
+    (and header
+         (or (valid-entries in-image)
+             (and-let1 e (valid-entries (force in-cache))
+               ;; If the source is only touched, renew the cache header
+               ;; so that we don't need to hash the source next time.
+               (unless (equal? header (car (force in-cache)))
+                 (%code-cache-write cache-file header e))
+               e))))
+  (cond
+   [(not header) (load-from-port port :environment environment :paths paths)]
+   [entries
+    (record! entries)
+    (%load-from-port port paths environment
+                     (^_ (%code-cache-run entries discard!)))]
+   [else
+    (let ([gtab (make-hash-table 'eq?)]
+          [new-entries #f])
+      (%load-from-port port paths environment
+                       (^[read-form]
+                         (set! new-entries
+                               (%code-cache-compile-and-run read-form gtab))))
+      (when new-entries
+        (record! new-entries)
+        (when cache-file
+          (%code-cache-write cache-file header new-entries))))]))
+
+;; Compiles and runs each form read by READ-FORM, as load-from-port does,
+;; while recording the cache entries.  Returns the list of the entries,
+;; or #f if we can't write a cache.
+;;
+;; A toplevel variable introduced by a macro gets a fresh uninterned
+;; name when its definition is compiled.  If the definition is kept as
+;; source, it gets yet another name when replayed, so code referring to
+;; the variable can't be cached; we keep such a form as source, too.
+;; DEFINED holds the uninterned names defined by the code entries so far.
+(define (%code-cache-compile-and-run read-form gtab)
+  (define defined (make-hash-table 'eq?))
+  (define (cacheable-code? code)
+    (receive (refs defs) (%code-uninterned-globals code)
+      (and (every (^s (or (hash-table-get defined s #f) (memq s defs))) refs)
+           (begin (dolist [s defs] (hash-table-put! defined s #t))
+                  #t))))
+  (let loop ([entries '()] [ok? #t])
+    (let1 form (read-form)
+      (if (eof-object? form)
+        (and ok? (reverse! entries))
+        (let* ([count (compile-time-effect-count)]
+               [code (compile form #f)]
+               ;; We must encode the code before running it, since
+               ;; GREF insns are rewritten to refer to the GLOC directly
+               ;; once executed.
+               [entry (or (and (= count (compile-time-effect-count))
+                               (cacheable-code? code)
+                               (and-let1 e (%code-cache-encode code gtab #f)
+                                 `(code . ,e)))
+                          (and-let1 e (%code-cache-encode form gtab #f)
+                            `(source . ,e)))])
+          ((make-toplevel-closure code))
+          (if entry
+            (loop (cons entry entries) ok?)
+            (loop entries #f)))))))
+
+;; Returns two lists of the uninterned names of toplevel variables in
+;; the compiled code CC: the ones referred to, and the ones defined.
+(define (%code-uninterned-globals cc)
+  (define refs '())
+  (define defs '())
+  (define visited (make-hash-table 'eq?)) ; literals may be circular
+  (define (visit! x)
+    (and (not (hash-table-get visited x #f))
+         (hash-table-put! visited x #t)
+         #t))
+  (define (uninterned-name x)
+    (and (wrapped-identifier? x)
+         (let1 n (identifier->symbol x)
+           (and (not (symbol-interned? n)) n))))
+  (define (walk x)
+    (cond [(uninterned-name x) => (^n (push! refs n))]
+          [(not (or (pair? x) (vector? x) (is-a? x <compiled-code>))) #f]
+          [(not (visit! x)) #f]
+          [(pair? x) (walk (car x)) (walk (cdr x))]
+          [(vector? x) (vector-for-each walk x)]
+          [else (walk-insns (vm-code->list x))
+                (walk (slot-ref x 'intermediate-form))]))
+  (define (walk-insns insns)
+    (match insns
+      [() #f]
+      [((? pair? insn) (? wrapped-identifier? id) . rest)
+       (when (eq? (car insn) 'DEFINE)
+         (and-let1 n (uninterned-name id) (push! defs n)))
+       (walk id)
+       (walk-insns rest)]
+      [(x . rest) (walk x) (walk-insns rest)]))
+  (walk cc)
+  (values refs defs))
+
+(define (%code-cache-run entries discard!)
+  (define gtab (make-hash-table 'eqv?))
+  (define (decode x)
+    (guard (e [else
+               ;; The cache is broken in the way the header can't detect.
+               ;; Discard it so that the next load will recreate it.
+               (discard!)
+               (raise e)])
+      (%code-cache-decode x gtab)))
+  (dolist [e entries]
+    (match e
+      [('code . x) ((make-toplevel-closure (decode x)))]
+      [('source . x) (eval (decode x) #f)]
+      [_ (error "Invalid code cache entry:" e)])))
+
+;; Returns encoded OBJ, or #f if OBJ can't be encoded.
+;; If ATTRS? is true, we keep source-info of extended pairs.
+(define (%code-cache-encode obj gtab attrs?)
+  (define visiting (make-hash-table 'eq?))
+  (define fail (list 'fail))            ;unique marker
+  (define (q? e) (eq? (car e) 'q))
+  (define (enter! obj)                  ;reject circular structure
+    (when (hash-table-get visiting obj #f) (raise fail))
+    (hash-table-put! visiting obj #t))
+  (define (leave! obj) (hash-table-delete! visiting obj))
+  (define (enc obj)
+    (cond [(is-a? obj <compiled-code>) (enc-code obj)]
+          [(wrapped-identifier? obj) (enc-identifier obj)]
+          [(symbol? obj)
+           (if (symbol-interned? obj)
+             `(q . ,obj)
+             `(g ,(or (hash-table-get gtab obj #f)
+                      (rlet1 n (hash-table-num-entries gtab)
+                        (hash-table-put! gtab obj n)))
+                 ,(symbol->string obj)))]
+          [(pair? obj)
+           (enter! obj)
+           (let ([a (enc (car obj))]
+                 [d (enc (cdr obj))]
+                 [si (and attrs? (pair-attribute-get obj 'source-info #f))])
+             (leave! obj)
+             (cond [si `(a ,(enc si) ,a . ,d)]
+                   [(and (q? a) (q? d)) `(q ,(cdr a) . ,(cdr d))]
+                   [else `(p ,a . ,d)]))]
+          [(vector? obj)
+           (enter! obj)
+           (let1 es (map enc (vector->list obj))
+             (leave! obj)
+             (if (every q? es)
+               `(q . ,(list->vector (map cdr es)))
+               `(v ,@es)))]
+          [(undefined? obj) '(u)]
+          [(eof-object? obj) '(e)]
+          [(or (number? obj) (string? obj) (char? obj) (boolean? obj)
+               (null? obj) (keyword? obj) (regexp? obj) (char-set? obj)
+               (uvector? obj))
+           `(q . ,obj)]
+          [else (raise fail)]))
+  (define (enc-identifier id)
+    (let* ([mod (identifier-module id)]
+           [modname (module-name mod)])
+      (unless (and (null? (identifier-env id))
+                   (symbol? modname)
+                   (eq? (find-module modname) mod))
+        (raise fail))
+      `(i ,modname ,(enc (identifier-name id)))))
+  (define (enc-code cc)
+    (enter! cc)
+    (let1 insns (vm-code->list cc)
+      ;; XINSN refers to the native code we can't write out.
+      (when (any (^x (and (pair? x) (eq? (car x) 'XINSN))) insns)
+        (raise fail))
+      (rlet1 r `(c ,(enc (slot-ref cc 'name))
+                   ,(slot-ref cc 'required-args)
+                   ,(slot-ref cc 'optional-args)
+                   ,(slot-ref cc 'max-stack)
+                   ,(enc insns)
+                   ;; Debug info and signature info are only informative;
+                   ;; we drop them if we can't encode them.
+                   ,(or (%code-cache-encode (slot-ref cc 'debug-info) gtab #t)
+                        '(q))
+                   ,(or (%code-cache-encode (slot-ref cc 'signature-info)
+                                            gtab #t)
+                        '(q . #f))
+                   ,(enc (slot-ref cc 'intermediate-form)))
+        (leave! cc))))
+  (guard (e [(eq? e fail) #f])
+    (enc obj)))
+
+(define (%code-cache-decode x gtab)
+  (define (dec x)
+    (match x
+      [('q . d) d]
+      [('p a . d) (cons (dec a) (dec d))]
+      [('a si a . d) (extended-cons (dec a) (dec d)
+                                    `((source-info . ,(dec si))))]
+      [('v . es) (list->vector (map dec es))]
+      [('g n name)
+       (or (hash-table-get gtab n #f)
+           (rlet1 s (string->uninterned-symbol name)
+             (hash-table-put! gtab n s)))]
+      [('i modname name)
+       (make-identifier (dec name)
+                        (or (find-module modname)
+                            (error "Module not found while restoring \
+                                    code cache:" modname))
+                        '())]
+      [('u) (undefined)]
+      [('e) (eof-object)]
+      [('c name reqargs optargs maxstack insns debug-info sig-info iform)
+       (list->vm-code (dec insns) reqargs optargs (dec name) maxstack
+                      (dec debug-info) (dec sig-info) (dec iform))]
+      [_ (error "Invalid code cache item:" x)]))
+  (dec x))
+
+;; Code image
+;;
+;;   A code image bundles the code caches of the files loaded in a session
+;;   into one file, so that gosh can start with the given set of libraries
+;;   without compiling them (gosh -fdump-image=FILE / -fimage=FILE).
+;;   It is written as follows:
+;;
+;;     (gauche-code-image <format> <gauche-version> (<feature> ...))
+;;     (<absolute-path> <header> <entry> ...)
+;;     ...
+;;
+;;   Each file is validated by the header as the code cache file, so
+;;   a file changed after the image is dumped is compiled as usual.
+;;   The features are required by gosh after loading the image.
+
+(define-constant .code-image-format. 1)
+
+;; Hashtable of absolute-path -> (header entry ...), or #f.
+(define *code-image* #f)
+;; When dumping, we collect the cache entries of loaded files here.
+(define *code-image-recorder* #f)
+
+;; Hashtables aren't thread-safe, so we don't load files in parallel
+;; while we're using a code image.  See %parallel-require-prefetch.
+(define (code-image-active?)
+  (boolean (or *code-image* *code-image-recorder*)))
+
+;; Returns (<header> <entry> ...) recorded for ABSPATH, or #f.
+(define (%code-image-lookup abspath)
+  (and *code-image* (hash-table-get *code-image* abspath #f)))
+
+(define (%code-image-start-recording)
+  (set! *code-image-recorder* (make-hash-table 'equal?)))
+
+;; FEATURES are the features to be required when the image is loaded.
+;; This ends the recording.
+(define (%code-image-dump file features)
+  (unless *code-image-recorder*
+    (error "code image recording isn't started"))
+  (let1 tmp #"~|file|.~(sys-getpid)"
+    (guard (e [else (guard (e2 [else #f]) (sys-unlink tmp)) (raise e)])
+      (call-with-output-file tmp
+        (^[out]
+          (write `(gauche-code-image ,.code-image-format. ,(gauche-version)
+                                     ,features)
+                 out)
+          (newline out)
+          (hash-table-for-each *code-image-recorder*
+                               (^[path e] (write (cons path e) out)
+                                  (newline out)))))
+      (sys-rename tmp file))
+    (set! *code-image-recorder* #f)))
+
+;; Reads the code image FILE.  Returns the features recorded in it,
+;; which the caller should require.
+(define (%code-image-load file)
+  (define ctx (%new-read-context-for-load #f))
+  (define prev (current-read-context))
+  (define tab (make-hash-table 'equal?))
+  (define (read-image in)
+    (match (read in)
+      [('gauche-code-image (? (cut eqv? <> .code-image-format.))
+                           (? (cut equal? <> (gauche-version)))
+                           features)
+       (let loop ()
+         (let1 e (read in)
+           (unless (eof-object? e)
+             (hash-table-put! tab (car e) (cdr e))
+             (loop))))
+       features]
+      [_ (error "Not a code image of this version of Gauche:" file)]))
+  (let1 features (call-with-input-file file
+                   (^[in]
+                     (current-read-context ctx)
+                     (unwind-protect (read-image in)
+                       (current-read-context prev))))
+    (set! *code-image* tab)
+    features))
+
 ;;;
 ;;; Repl
 ;;;
@@ -562,17 +1060,81 @@
 (define-cproc gc () (call <void> GC_gcollect))
 
 ;; API
+;; NB: Times are in seconds.  The first four entries are the traditional
+;; ones; the rest are gathered by the collection event hook (core.c).
+(inline-stub
+ (define-cfn gcstat-sec (ns::int64_t) :static
+   (return (Scm_MakeFlonum (/ (cast double ns) 1.0e9))))
+ )
+
 (define-cproc gc-stat ()
-  (return
-   (list
-    (list ':total-heap-size
-          (Scm_MakeIntegerFromUI (cast u_long (GC_get_heap_size))))
-    (list ':free-bytes
-          (Scm_MakeIntegerFromUI (cast u_long (GC_get_free_bytes))))
-    (list ':bytes-since-gc
-          (Scm_MakeIntegerFromUI (cast u_long (GC_get_bytes_since_gc))))
-    (list ':total-bytes
-          (Scm_MakeIntegerFromUI (cast u_long (GC_get_total_bytes)))))))
+  (let* ([st::ScmGCStat]
+         [ps::(struct GC_prof_stats_s)]
+         [recent SCM_NIL]
+         [n::u_long])
+    (Scm_GetGCStat (& st))
+    (GC_get_prof_stats (& ps) (sizeof ps))
+    ;; recent pauses, newest first
+    (set! n (?: (< (ref st numPauses) SCM_GC_PAUSE_HISTORY_SIZE)
+                (ref st numPauses)
+                SCM_GC_PAUSE_HISTORY_SIZE))
+    (dotimes [i n]
+      (set! recent
+            (Scm_Cons (gcstat-sec
+                       (aref (ref st recentPauses)
+                             (% (+ (- (ref st numPauses) n) i)
+                                SCM_GC_PAUSE_HISTORY_SIZE)))
+                      recent)))
+    (return
+     (list
+      (list ':total-heap-size
+            (Scm_MakeIntegerFromUI (cast u_long (GC_get_heap_size))))
+      (list ':free-bytes
+            (Scm_MakeIntegerFromUI (cast u_long (GC_get_free_bytes))))
+      (list ':bytes-since-gc
+            (Scm_MakeIntegerFromUI (cast u_long (GC_get_bytes_since_gc))))
+      (list ':total-bytes
+            (Scm_MakeIntegerFromUI (cast u_long (GC_get_total_bytes))))
+      (list ':unmapped-bytes
+            (Scm_MakeIntegerFromUI (cast u_long (ref ps unmapped_bytes))))
+      (list ':obtained-from-os-bytes
+            (Scm_MakeIntegerFromUI
+             (cast u_long (ref ps obtained_from_os_bytes))))
+      (list ':bytes-reclaimed-since-gc
+            (Scm_MakeIntegerFromUI
+             (cast u_long (ref ps bytes_reclaimed_since_gc))))
+      (list ':gc-count
+            (Scm_MakeIntegerFromUI (cast u_long (GC_get_gc_no))))
+      (list ':marker-threads
+            (Scm_MakeIntegerFromUI (+ (cast u_long (ref ps markers_m1)) 1)))
+      (list ':pause-count (Scm_MakeIntegerFromUI (ref st numPauses)))
+      (list ':total-pause-time (gcstat-sec (ref st totalPauseTime)))
+      (list ':max-pause-time (gcstat-sec (ref st maxPauseTime)))
+      (list ':last-pause-time (gcstat-sec (ref st lastPauseTime)))
+      (list ':recent-pause-times recent)
+      (list ':total-mark-time (gcstat-sec (ref st totalMarkTime)))
+      (list ':total-reclaim-time (gcstat-sec (ref st totalReclaimTime)))
+      (list ':finalizers-run (Scm_MakeIntegerFromUI (ref st finalizersRun)))
+      (list ':finalizers-pending
+            (SCM_MAKE_BOOL (GC_should_invoke_finalizers)))))))
+
+;; API
+;; GC tuning.  See Scm_GCSetFreeSpaceDivisor in core.c.
+(define-cproc gc-free-space-divisor-set! (n::<ulong>) ::<void>
+  Scm_GCSetFreeSpaceDivisor)
+(define-cproc gc-free-space-divisor () ::<ulong>
+  (setter gc-free-space-divisor-set!)
+  (return (GC_get_free_space_divisor)))
+
+(define-cproc gc-min-bytes-between-gc-set! (n::<size_t>) ::<void>
+  Scm_GCSetMinBytesAllocd)
+(define-cproc gc-min-bytes-between-gc () ::<size_t>
+  (setter gc-min-bytes-between-gc-set!)
+  (return (GC_get_min_bytes_allocd)))
+
+;; Grow the heap in advance.  Returns #f if the heap can't be expanded.
+(define-cproc gc-expand-heap! (nbytes::<size_t>) ::<boolean>
+  (return (GC_expand_hp nbytes)))
 
 (select-module gauche.internal)
 ;; for diagnostics
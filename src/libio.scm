@@ -190,7 +190,8 @@
 (define-cproc %open-input-file (path::<string>
                                 :key (if-does-not-exist :error)
                                 (buffering #f)
-                                (element-type :binary))
+                                (element-type :binary)
+                                (mmap::<boolean> #f))
   (let* ([ignerr::int FALSE]
          [flags::int O_RDONLY])
     (cond [(SCM_FALSEP if-does-not-exist) (set! ignerr TRUE)]
@@ -207,8 +208,10 @@
         (logior= flags O_BINARY)))
     (let* ([bufmode::int (Scm_BufferingMode buffering SCM_PORT_INPUT
                                             SCM_PORT_BUFFER_FULL)]
-           [o (Scm_OpenFilePort (Scm_GetStringConst path)
-                                flags bufmode 0)])
+           [o (?: mmap
+                  (Scm_OpenMappedInputFile (Scm_GetStringConst path) flags)
+                  (Scm_OpenFilePort (Scm_GetStringConst path)
+                                    flags bufmode 0))])
       (when (and (SCM_FALSEP o) (not (%open/allow-noexist? ignerr)))
         (Scm_SysError "couldn't open input file: %S" path))
       (return o))))
@@ -823,50 +826,6 @@
 
 (define-cproc flush-all-ports () ::<void> (Scm_FlushAllPorts FALSE))
 
-;;
-;; Internal recusive writer
-;;
-(select-module gauche.internal)
-
-(define-cproc write-need-recurse? (obj) ::<boolean>
-  (return (not (or (not (SCM_PTRP obj))
-                   (SCM_NUMBERP obj)
-                   (SCM_KEYWORDP obj)
-                   (and (SCM_SYMBOLP obj) (SCM_SYMBOL_INTERNED obj))
-                   (and (SCM_STRINGP obj) (== (SCM_STRING_SIZE obj) 0))
-                   (and (SCM_VECTORP obj) (== (SCM_VECTOR_SIZE obj) 0))))))
-
-(define (write-walk obj port)
-  (if-let1 s (%port-write-state port)
-    (%write-walk-rec obj port (~ s shared-table))))
-
-(define (%write-walk-rec obj port tab)
-  (when (write-need-recurse? obj)
-    (if (hash-table-exists? tab obj)
-      (hash-table-update! tab obj (cut + <> 1))   ; seen more than once
-      (begin
-        (hash-table-put! tab obj 1) ; seen once
-        (cond
-         [(symbol? obj)] ; uninterned symbols
-         [(string? obj)]
-         [(uvector? obj)]
-         [(pair? obj)
-          (%write-walk-rec (car obj) port tab)
-          (%write-walk-rec (cdr obj) port tab)]
-         [(vector? obj)
-          (dotimes [i (vector-length obj)]
-            (%write-walk-rec (vector-ref obj i) port tab))]
-         [(box? obj)
-          (dotimes [i (box-arity obj)]
-            (%write-walk-rec (unbox-value obj i) port tab))]
-         [else ; generic objects.  we go walk pass via write-object
-          (write-object obj port)])
-        ;; If circular-only, we don't count non-circular objects.
-        (unless (%port-writing-shared? port)
-          (when (eqv? (hash-table-get tab obj #f) 1)
-            (hash-table-delete! tab obj)))
-        ))))
-
 (select-module gauche.internal)
 
 ;; SRFI-38
@@ -159,6 +159,10 @@
      ;; such srfis for the legacy code, and it's simpler to use this
      ;; compatibility mode rather than changing those srfis to use
      ;; library clause.
+     ;;
+     ;; The expansion depends on the runtime environment, so we let
+     ;; the code cache know it (see "Code cache" in libeval.scm).
+     ((with-module gauche.internal note-compile-time-effect!))
      (match f
        [(_ ':allow-srfi-feature-id . clauses)
         (set! allow-srfi-feature-id? #t)
@@ -301,6 +301,12 @@
   (return (Scm_FindBinding mod name
                            (?: stay_in_module SCM_BINDING_STAY_IN_MODULE 0))))
 
+;; Returns #t iff the binding of NAME in MOD is exported, either by its
+;; own name, by (export (rename NAME other)), or by (export-all).  Unlike
+;; find-binding, this doesn't care whether the binding has a value.
+(define-cproc %exported-name? (mod::<module> name::<symbol>) ::<boolean>
+  (return (Scm__ExportedInternalNameP mod name)))
+
 ;; This small piece of code encapsulates the common procedure in
 ;; pass1/variable to find whether the variable reference is a constant
 ;; or not.
@@ -327,6 +333,8 @@
 (define-cproc gloc-set! (gloc::<gloc> value) SCM_GLOC_SET)
 (define-cproc gloc-const? (gloc::<gloc>) ::<boolean> Scm_GlocConstP)
 (define-cproc gloc-inlinable? (gloc::<gloc>) ::<boolean> Scm_GlocInlinableP)
+(define-cproc gloc-module (gloc::<gloc>) (return (SCM_OBJ (-> gloc module))))
+(define-cproc gloc-name (gloc::<gloc>) (return (SCM_OBJ (-> gloc name))))
 
 ;;;
 ;;; Identifier and binding
@@ -109,6 +109,13 @@
 (define string-comparator
   (make-comparator/compare string? string=? compare
                            default-hash 'string-comparator))
+;; These use fast-hash instead of default-hash; make-hash-table
+;; recognizes them.
+(define fast-equal-comparator
+  (make-comparator/compare #t equal? #f fast-hash 'fast-equal-comparator))
+(define fast-string-comparator
+  (make-comparator/compare string? string=? compare
+                           fast-hash 'fast-string-comparator))
 (define default-comparator
   (make-comparator/compare #t (with-module gauche.internal default-comparator-equal?)
                            compare default-hash 'default-comparator))
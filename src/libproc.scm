@@ -266,6 +266,22 @@
 ;; See lib/gauche/vm/profiler.scm
 (define-cproc profiler-raw-result () Scm_ProfilerRawResult)
 
+;;;
+;;; VM instruction counter
+;;;
+
+(select-module gauche)
+(define-cproc vm-insn-count-start () ::<void> Scm_VMInsnCountStart)
+(define-cproc vm-insn-count-stop  () ::<boolean> Scm_VMInsnCountStop)
+(define-cproc vm-insn-count-reset () ::<void> Scm_VMInsnCountReset)
+
+(select-module gauche.internal)
+;; Returns (<insn-counts> . <insn-pair-counts>).
+;; See lib/gauche/vm/profiler.scm
+(define-cproc vm-insn-count-raw-result () Scm_VMInsnCountResult)
+(define-cproc vm-insn-count-dump-raw (port::<output-port>) ::<void>
+  Scm_VMInsnCountDump)
+
 ;;;
 ;;; Introspection
 ;;;
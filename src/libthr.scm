@@ -129,9 +129,22 @@
      (slot-ref thread 'specific))
    thread-specific-set!))
 
-(define (make-thread thunk :optional (name #f))
-  (rlet1 t (%make-thread thunk name)
-    ((with-module gauche.internal %vm-custom-error-reporter-set!) t (^e #f))))
+;; NAME is optional, so a keyword in its position starts the keyword
+;; arguments: (make-thread thunk :stack-size n) creates an unnamed thread.
+;; Keyword arguments come in pairs, so a keyword followed by an even number
+;; of arguments is still a name, as in (make-thread thunk :worker).
+(define (make-thread thunk . args)
+  (receive (name opts) (if (and (pair? args)
+                                (or (not (keyword? (car args)))
+                                    (odd? (length args))))
+                         (values (car args) (cdr args))
+                         (values #f args))
+    (let-keywords opts ([stack-size #f] [max-stack-size #f])
+      (rlet1 t (%make-thread thunk name)
+        (when (or stack-size max-stack-size)
+          (%thread-set-stack-size! t (or stack-size 0) (or max-stack-size 0)))
+        ((with-module gauche.internal %vm-custom-error-reporter-set!)
+         t (^e #f))))))
 
 (inline-stub
  (define-cproc thread-state (vm::<thread>)
@@ -145,6 +158,9 @@
            (return SCM_UNDEFINED)]))   ;dummy
 
  (define-cproc %make-thread (thunk::<procedure> name) Scm_MakeThread)
+ (define-cproc %thread-set-stack-size! (vm::<thread> size::<long>
+                                                     maxsize::<long>)
+   ::<void> Scm_VMSetStackSize)
 
  (define-cproc thread-start! (vm::<thread>)
    (return (Scm_ThreadStart vm 0)))
@@ -578,3 +594,121 @@
              (condition-variable-broadcast! (~ barrier'cv))
              (mutex-unlock! (~ barrier'mutex))
              timeout-val]))))
+
+;;===============================================================
+;; Parallel require
+;;
+
+;; Called from Scm_Require when -fparallel-load is given (see the comment
+;; of parallel_prefetch in load.c).  We find the features FEATURE depends
+;; on, and require them in worker threads, leaves first, so that
+;; independent libraries are read and compiled concurrently.  Each feature
+;; is still loaded only once; the require machinery makes a thread wait
+;; if the feature it needs is being loaded by another thread.
+;;
+;; The dependencies we find are just a hint.  We don't expand macros,
+;; so we may miss some (they're loaded on demand as usual), or pick ones
+;; that aren't actually needed.  An error in a worker is ignored; the
+;; failed feature is loaded again by whoever requires it next, who
+;; reports the error.
+(define (%parallel-require-prefetch feature)
+  (unless ((with-module gauche.internal code-image-active?))
+    (let1 features (%require-dependencies feature)
+      (when (pair? features)
+        (%parallel-require features (sys-available-processors))))))
+
+;; Returns a list of the features FEATURE depends on, directly or
+;; indirectly, that haven't been provided and whose source can be found
+;; in the load path.  A feature comes after the ones it depends on.
+;; FEATURE itself isn't included.
+;; Features that are being loaded, such as the outer ones when we're
+;; called from a nested require, are excluded, and so are the ones
+;; depending on them; requiring them in a worker would only fail.
+(define (%require-dependencies feature)
+  (define providing? (with-module gauche.internal %providing?))
+  (define visited (make-hash-table 'equal?))
+  (define r '())
+  ;; Returns #f if F can't be prefetched.
+  (define (visit f)
+    (cond [(hash-table-get visited f #f) => (^v (eq? v 'ok))]
+          [(provided? f) #t]
+          [(and (providing? f) (not (equal? f feature)))
+           (hash-table-put! visited f 'ng) #f]
+          [else
+           (hash-table-put! visited f 'ok)  ; for now, to stop recursion
+           (and-let* ([p ((with-module gauche.internal find-load-file)
+                          f *load-path* *load-suffixes*)])
+             (if (every identity (map visit (%scan-require-forms (car p))))
+               (push! r f)
+               (hash-table-put! visited f 'ng)))
+           (eq? (hash-table-get visited f) 'ok)]))
+  (visit feature)
+  (delete feature (reverse r)))
+
+;; Reads toplevel forms from FILE while they look like module setup,
+;; and returns the features they refer to.
+(define (%scan-require-forms file)
+  (define (module->feature m)
+    (cond [(symbol? m) (module-name->path m)]
+          [(and (list? m) (every symbol? m)) ; R7RS library name
+           (string-join (map symbol->string m) "/")]
+          [else #f]))
+  ;; Gauche's import of a module name (a symbol) doesn't load anything;
+  ;; only R7RS library names are features.
+  (define (import-spec->feature spec)
+    (cond [(not (pair? spec)) #f]
+          [(and (pair? (cdr spec)) (keyword? (cadr spec)))
+           #f]                          ; (module :only ...) etc.
+          [(and (memq (car spec) '(only except prefix rename))
+                (pair? (cdr spec)))
+           (import-spec->feature (cadr spec))]
+          [else (module->feature spec)]))
+  (define (form->features form)
+    (if (not (list? form))
+      '()
+      (case (car form)
+        [(use) (if (pair? (cdr form)) (list (module->feature (cadr form))) '())]
+        [(extend) (map module->feature (cdr form))]
+        [(require) (cdr form)]
+        [(import) (map import-spec->feature (cdr form))]
+        [(define-module define-library)
+         (if (pair? (cdr form)) (append-map form->features (cddr form)) '())]
+        [else '()])))
+  (define setup-forms
+    '(define-module define-library select-module use extend require import
+      export export-all provide))
+  (guard (e [else '()])
+    (call-with-port (open-coding-aware-port
+                     (open-input-file file
+                                      :encoding (gauche-character-encoding)))
+      (^[in]
+        (let loop ([r '()])
+          (let1 form (guard (e [else (eof-object)]) (read in))
+            (if (and (pair? form) (memq (car form) setup-forms))
+              (loop (append (filter string? (form->features form)) r))
+              (reverse r))))))))
+
+;; Requires FEATURES by NTHREADS threads, including the calling one.
+(define (%parallel-require features nthreads)
+  (define queue features)
+  (define lock (make-mutex))
+  (define (next!)
+    (with-locking-mutex lock
+      (^[] (and (pair? queue) (pop! queue)))))
+  (define (work)
+    (if-let1 f (next!)
+      (begin
+        (guard (e [else #f]) ((with-module gauche.internal %require) f))
+        (work))))
+  ;; A worker must not wait for the features this thread is loading.
+  ;; See parallel_prefetch in load.c.
+  (define (worker parent)
+    (^[]
+      (unwind-protect
+          (begin ((with-module gauche.internal %set-prefetch-parent!) parent)
+                 (work))
+        ((with-module gauche.internal %set-prefetch-parent!) #f))))
+  (let1 threads (map (^_ (thread-start! (make-thread (worker (current-thread)))))
+                     (iota (- (min nthreads (length features)) 1)))
+    (work)
+    (for-each thread-join! threads)))
@@ -63,6 +63,10 @@ static struct {
     ScmObj waiting;             /* Alist of threads that is waiting for
                                    a feature to being provided, and the
                                    feature that is waited. */
+    ScmObj prefetch_workers;    /* Alist of worker threads of parallel
+                                   prefetching, and the thread that is
+                                   waiting for them.  See parallel_prefetch.
+                                */
     ScmInternalMutex prov_mutex;
     ScmInternalCond  prov_cv;
 
@@ -879,6 +883,80 @@ int Scm_Require(ScmObj feature, int flags, ScmLoadPacket *packet)
     return do_require(feature, flags, Scm__RequireBaseModule(), packet);
 }
 
+/* [Parallel Loading]
+ *
+ *   If SCM_PARALLEL_LOAD runtime flag is set, we call
+ *   %parallel-require-prefetch (in libthr.scm) before loading a feature.
+ *   It scans the sources to find the features the given feature depends
+ *   on, and requires them in worker threads.  Dependencies between them
+ *   are taken care of by the mechanism above; a thread that requires
+ *   a feature being loaded by another thread just waits for it.
+ *
+ *   The flag is cleared while prefetching, so the requires issued by
+ *   the prefetcher, and by the worker threads that inherit the flags
+ *   of this VM, are processed in the normal way.
+ *
+ *   While the workers run, this VM waits for them in thread-join!,
+ *   not in the waiting list, so the loop detection above can't see it.
+ *   If a worker needs a feature this VM is loading (e.g. an outer
+ *   feature in a require loop), it would wait forever.  So the workers
+ *   register themselves in ldinfo.prefetch_workers, and such a require
+ *   fails as a loop instead.  The worker ignores the error, and the
+ *   feature is loaded again later in the normal way.
+ */
+
+/* Registers the calling thread as a prefetch worker for PARENT,
+   or unregisters it if PARENT is #f. */
+void Scm__SetPrefetchParent(ScmObj parent)
+{
+    ScmObj self = SCM_OBJ(Scm_VM());
+    (void)SCM_INTERNAL_MUTEX_LOCK(ldinfo.prov_mutex);
+    ldinfo.prefetch_workers =
+        Scm_AssocDeleteX(self, ldinfo.prefetch_workers, SCM_CMP_EQ);
+    if (!SCM_FALSEP(parent)) {
+        ldinfo.prefetch_workers =
+            Scm_Acons(self, parent, ldinfo.prefetch_workers);
+    }
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(ldinfo.prov_mutex);
+}
+
+/* Returns TRUE if FEATURE is being loaded by some thread. */
+int Scm__ProvidingP(ScmObj feature)
+{
+    (void)SCM_INTERNAL_MUTEX_LOCK(ldinfo.prov_mutex);
+    int r = !SCM_FALSEP(Scm_Assoc(feature, ldinfo.providing, SCM_CMP_EQUAL));
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(ldinfo.prov_mutex);
+    return r;
+}
+
+/* Returns TRUE if VM can never get a feature that is being loaded by
+   PROVIDER: PROVIDER is VM itself, or VM is a prefetch worker and
+   PROVIDER is waiting for it.  Called with prov_mutex held. */
+static int require_loop_p(ScmVM *vm, ScmObj provider)
+{
+    if (provider == SCM_OBJ(vm)) return TRUE;
+    ScmObj w = Scm_Assq(SCM_OBJ(vm), ldinfo.prefetch_workers);
+    return (SCM_PAIRP(w) && SCM_CDR(w) == provider);
+}
+
+static void parallel_prefetch(ScmVM *vm, ScmObj feature)
+{
+    static ScmObj prefetch_proc = SCM_UNDEFINED;
+    SCM_BIND_PROC(prefetch_proc, "%parallel-require-prefetch",
+                  SCM_FIND_MODULE("gauche.threads", 0));
+
+    SCM_VM_RUNTIME_FLAG_CLEAR(vm, SCM_PARALLEL_LOAD);
+    SCM_UNWIND_PROTECT {
+        Scm_ApplyRec1(prefetch_proc, feature);
+    }
+    SCM_WHEN_ERROR {
+        SCM_VM_RUNTIME_FLAG_SET(vm, SCM_PARALLEL_LOAD);
+        SCM_NEXT_HANDLER;
+    }
+    SCM_END_PROTECT;
+    SCM_VM_RUNTIME_FLAG_SET(vm, SCM_PARALLEL_LOAD);
+}
+
 int do_require(ScmObj feature, int flags, ScmModule *base_mod,
                ScmLoadPacket *packet)
 {
@@ -896,6 +974,11 @@ int do_require(ScmObj feature, int flags, ScmModule *base_mod,
         }
     }
 
+    if (SCM_VM_RUNTIME_FLAG_IS_SET(vm, SCM_PARALLEL_LOAD)
+        && !Scm_ProvidedP(feature)) {
+        parallel_prefetch(vm, feature);
+    }
+
     /* Check provided, providing and waiting list.  See the comment above. */
     (void)SCM_INTERNAL_MUTEX_LOCK(ldinfo.prov_mutex);
     for (;;) {
@@ -907,7 +990,7 @@ int do_require(ScmObj feature, int flags, ScmModule *base_mod,
         /* Checks for dependencies */
         ScmObj p = providing;
         SCM_ASSERT(SCM_PAIRP(p) && SCM_PAIRP(SCM_CDR(p)));
-        if (SCM_CADR(p) == SCM_OBJ(vm)) { loop = TRUE; break; }
+        if (require_loop_p(vm, SCM_CADR(p))) { loop = TRUE; break; }
 
         for (;;) {
             ScmObj q = Scm_Assq(SCM_CDR(p), ldinfo.waiting);
@@ -915,7 +998,7 @@ int do_require(ScmObj feature, int flags, ScmModule *base_mod,
             SCM_ASSERT(SCM_PAIRP(q));
             p = Scm_Assoc(SCM_CDR(q), ldinfo.providing, SCM_CMP_EQUAL);
             SCM_ASSERT(SCM_PAIRP(p) && SCM_PAIRP(SCM_CDR(p)));
-            if (SCM_CADR(p) == SCM_OBJ(vm)) { loop = TRUE; break; }
+            if (require_loop_p(vm, SCM_CADR(p))) { loop = TRUE; break; }
         }
         if (loop) break;
         ldinfo.waiting = Scm_Acons(SCM_OBJ(vm), feature, ldinfo.waiting);
@@ -1240,6 +1323,7 @@ void Scm__InitLoad(void)
     ldinfo.provided = SCM_NIL;
     ldinfo.providing = SCM_NIL;
     ldinfo.waiting = SCM_NIL;
+    ldinfo.prefetch_workers = SCM_NIL;
     ldinfo.dso_suffixes = SCM_LIST2(SCM_MAKE_STR(".la"),
                                     SCM_MAKE_STR("." SHLIB_SO_SUFFIX));
     ldinfo.dso_table = SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_STRING,0));
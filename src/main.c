@@ -64,6 +64,8 @@ int test_mode = FALSE;          /* add . and ../lib implicitly  */
 int profiling_mode = FALSE;     /* profile the script? */
 int stats_mode = FALSE;         /* collect stats (EXPERIMENTAL) */
 int version_mode = FALSE;       /* show version and exit (-V option) */
+const char *image_file = NULL;  /* -fimage=<file> */
+const char *dump_image_file = NULL; /* -fdump-image=<file> */
 
 ScmObj pre_cmds = SCM_NIL;      /* assoc list of commands that needs to be
                                    processed before entering repl.
@@ -134,6 +136,11 @@ void usage(int errorp)
             "      7               R7RS (R7RS-small)\n"
             "  -f<flag> Sets various flags\n"
             "      case-fold       uses case-insensitive reader (as in R5RS)\n"
+            "      dump-image=<file>\n"
+            "                      saves the compiled code of the libraries given by\n"
+            "                      -u options into <file> and exits.  See -fimage.\n"
+            "      image=<file>    loads the libraries saved by -fdump-image from\n"
+            "                      <file>, without compiling them again.\n"
             "      include-verbose reports while including files\n"
             "      load-verbose    reports while loading files\n"
             "      no-inline       doesn't inline procedures & constants (combined\n"
@@ -152,6 +159,8 @@ void usage(int errorp)
             "      no-post-inline-pass\n"
             "                      doesn't run post-inline optimization pass.\n"
             "      no-source-info  doesn't preserve source information for debugging\n"
+            "      parallel-load   loads the libraries a library depends on in\n"
+            "                      parallel threads.\n"
             "      read-edit\n"
             "                      enables input-editing mode, if terminal supports it.\n"
             "      no-read-edit\n"
@@ -166,6 +175,8 @@ void usage(int errorp)
             "                      prints warning when srfi-N is used as a feature id.\n"
             "      no-warn-srfi-feature-id\n"
             "                      doesn't print warning when srfi-N is used as a feature id.\n"
+            "      whole-program   makes small exported procedures inlinable\n"
+            "                      into the modules that use them.\n"
             "Environment variables:\n"
             "  GAUCHE_AVAILABLE_PROCESSORS\n"
             "      Value must be an integer.  If set, it overrides the number of\n"
@@ -173,6 +184,9 @@ void usage(int errorp)
             "      `sys-available-processors'.\n"
             "  GAUCHE_CHECK_UNDEFINED_TEST\n"
             "      Warn if #<undef> is used in the test expression of branch.\n"
+            "  GAUCHE_CODE_CACHE\n"
+            "      Directory to keep the compiled code of loaded Scheme source.\n"
+            "      If set, the source isn't compiled again unless it is changed.\n"
             "  GAUCHE_DYNLOAD_PATH\n"
             "      Directories separated by colon (on Unix) or semilcolon (on Windows)\n"
             "      to search dynamically loadable files.\n"
@@ -325,6 +339,15 @@ void further_options(const char *optarg)
     else if (strcmp(optarg, "no-source-info") == 0) {
         SCM_VM_COMPILER_FLAG_SET(vm, SCM_COMPILE_NOSOURCE);
     }
+    else if (strcmp(optarg, "whole-program") == 0) {
+        SCM_VM_COMPILER_FLAG_SET(vm, SCM_COMPILE_WHOLE_PROGRAM);
+    }
+    else if (strncmp(optarg, "image=", 6) == 0) {
+        image_file = optarg + 6;
+    }
+    else if (strncmp(optarg, "dump-image=", 11) == 0) {
+        dump_image_file = optarg + 11;
+    }
     else if (strcmp(optarg, "load-verbose") == 0) {
         SCM_VM_RUNTIME_FLAG_SET(vm, SCM_LOAD_VERBOSE);
     }
@@ -348,6 +371,9 @@ void further_options(const char *optarg)
     else if (strcmp(optarg, "test") == 0) {
         test_mode = TRUE;
     }
+    else if (strcmp(optarg, "parallel-load") == 0) {
+        SCM_VM_RUNTIME_FLAG_SET(vm, SCM_PARALLEL_LOAD);
+    }
     else if (strcmp(optarg, "safe-string-cursors") == 0) {
         SCM_VM_RUNTIME_FLAG_SET(vm, SCM_SAFE_STRING_CURSORS);
     }
@@ -380,13 +406,15 @@ void further_options(const char *optarg)
     }
     else {
         fprintf(stderr, "unknown -f option: %s\n", optarg);
-        fprintf(stderr, "supported options are: -fcase-fold, -fload-verbose, "
+        fprintf(stderr, "supported options are: -fcase-fold, "
+                "-fdump-image=<file>, -fimage=<file>, -fload-verbose, "
                 "-finclude-verbose, -fno-dissolve-apply -fno-inline, "
                 "-fno-inline-globals, -fno-inline-locals, "
                 "-fno-inline-constants, -fno-inline-setters, -fno-source-info, "
                 "-fno-post-inline-pass, -fno-lambda-lifting-pass, "
-                "-fread-edit, -fno-read-edit, "
+                "-fparallel-load, -fread-edit, -fno-read-edit, "
                 "-fsafe-string-cursors, -fwarn-legacy-syntax, "
+                "-fwhole-program, "
                 "-fwarn-srfi-feature-id, -fno-warn-srfi-feature-id, "
                 "or -ftest\n");
         exit(1);
@@ -556,9 +584,18 @@ void cleanup_main(void *data SCM_UNUSED)
     /* EXPERIMENTAL */
     if (stats_mode) {
         fprintf(stderr, "\n;; Statistics (*: main thread only):\n");
+        ScmGCStat gcs;
+        Scm_GetGCStat(&gcs);
         fprintf(stderr,
                 ";;  GC: %zubytes heap, %zubytes allocated\n",
                 GC_get_heap_size(), GC_get_total_bytes());
+        fprintf(stderr,
+                ";;  GC: %lu collections, %.2fms paused total/%.2fms max,"
+                " %.2fms marking\n",
+                gcs.numCollections,
+                gcs.totalPauseTime/1000000.0,
+                gcs.maxPauseTime/1000000.0,
+                gcs.totalMarkTime/1000000.0);
         fprintf(stderr,
                 ";;  stack overflow*: %ldtimes, %.2fms total/%.2fms avg\n",
                 vm->stat.sovCount,
@@ -597,6 +634,53 @@ void error_exit(ScmObj c)
     Scm_Exit(1);
 }
 
+/* Code image.  The work is done in libeval.scm.
+   Load_image reads the image and returns the list of features to be
+   required. */
+static ScmObj load_image(const char *file)
+{
+    static ScmObj load_image_proc = SCM_UNDEFINED;
+    SCM_BIND_PROC(load_image_proc, "%code-image-load",
+                  Scm_GaucheInternalModule());
+    ScmEvalPacket epak;
+    if (Scm_Apply(load_image_proc, SCM_LIST1(SCM_MAKE_STR_COPYING(file)),
+                  &epak) < 0) {
+        error_exit(epak.exception);
+    }
+    return epak.results[0];
+}
+
+static void start_dump_image(void)
+{
+    static ScmObj start_proc = SCM_UNDEFINED;
+    SCM_BIND_PROC(start_proc, "%code-image-start-recording",
+                  Scm_GaucheInternalModule());
+    Scm_ApplyRec0(start_proc);
+}
+
+/* The features given by -u options are recorded in the image, so that
+   they're loaded when the image is used. */
+static void dump_image(const char *file, ScmObj cmd_args)
+{
+    static ScmObj dump_proc = SCM_UNDEFINED;
+    SCM_BIND_PROC(dump_proc, "%code-image-dump", Scm_GaucheInternalModule());
+    ScmObj h = SCM_NIL, t = SCM_NIL, cp;
+    SCM_FOR_EACH(cp, cmd_args) {
+        ScmObj p = SCM_CAR(cp);
+        if (SCM_CHAR_VALUE(SCM_CAR(p)) != 'u') continue;
+        SCM_APPEND1(h, t,
+                    Scm_StringJoin(Scm_StringSplitByChar(SCM_STRING(SCM_CDR(p)),
+                                                         '.'),
+                                   SCM_STRING(SCM_MAKE_STR("/")),
+                                   SCM_STRING_JOIN_INFIX));
+    }
+    ScmEvalPacket epak;
+    if (Scm_Apply(dump_proc, SCM_LIST2(SCM_MAKE_STR_COPYING(file), h),
+                  &epak) < 0) {
+        error_exit(epak.exception);
+    }
+}
+
 /* Returns FALSE if the process doesn't have a console. */
 #if defined(GAUCHE_WINDOWS)
 static int init_console(void)
@@ -907,10 +991,29 @@ int main(int ac, char **av)
         Scm_InitCommandLine2(1, (const char*[]){""}, SCM_COMMAND_LINE_SCRIPT);
     }
 
+    /* We read the image before processing -u options, so that they can
+       use the code in the image.  The features in the image are
+       required after -I and -A options are processed. */
+    ScmObj image_features = SCM_NIL;
+    if (image_file != NULL) image_features = load_image(image_file);
+    if (dump_image_file != NULL) start_dump_image();
+
     process_command_args(Scm_Reverse(pre_cmds));
 
-    /* Set up instruments. */
     ScmLoadPacket lpak;
+    ScmObj cp;
+    SCM_FOR_EACH(cp, image_features) {
+        if (Scm_Require(SCM_CAR(cp), 0, &lpak) < 0) {
+            error_exit(lpak.exception);
+        }
+    }
+
+    if (dump_image_file != NULL) {
+        dump_image(dump_image_file, Scm_Reverse(pre_cmds));
+        Scm_Exit(0);
+    }
+
+    /* Set up instruments. */
     if (profiling_mode) {
         if (Scm_Require(SCM_MAKE_STR("gauche/vm/profiler"), 0, &lpak) < 0) {
             error_exit(lpak.exception);
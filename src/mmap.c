@@ -46,9 +46,8 @@
 #include <sys/mman.h>
 #endif
 
-static void mem_finalize(ScmObj obj, void *data SCM_UNUSED)
+static void unmap_region(ScmMemoryRegion *m)
 {
-    ScmMemoryRegion *m = SCM_MEMORY_REGION(obj);
     if (m->ptr != NULL) {
 #if !defined(GAUCHE_WINDOWS)
         int r;
@@ -68,6 +67,11 @@ static void mem_finalize(ScmObj obj, void *data SCM_UNUSED)
     }
 }
 
+static void mem_finalize(ScmObj obj, void *data SCM_UNUSED)
+{
+    unmap_region(SCM_MEMORY_REGION(obj));
+}
+
 static ScmObj make_memory_region(void *ptr, size_t size, int prot, int flags
 #if defined(GAUCHE_WINDOWS)
                                  , HANDLE fileMapping
@@ -80,6 +84,7 @@ static ScmObj make_memory_region(void *ptr, size_t size, int prot, int flags
     m->size = size;
     m->prot = prot;
     m->flags = flags;
+    m->viewed = FALSE;
 #if defined(GAUCHE_WINDOWS)
     m->fileMapping = fileMapping;
 #endif
@@ -199,6 +204,18 @@ ScmObj Scm_SysMmap(void *addrhint, int fd, size_t len, off_t off,
 #endif /*GAUCHE_WINDOWS*/
 }
 
+/* Unmaps the region M before it is garbage collected, unless a view
+   uvector has been created on it (the view refers to the mapped memory
+   directly, so the mapping must live as long as the view).
+   Returns TRUE if the region is unmapped. */
+int Scm_MemoryRegionRelease(ScmMemoryRegion *m)
+{
+    if (m->viewed) return FALSE;
+    unmap_region(m);
+    Scm_UnregisterFinalizer(SCM_OBJ(m));
+    return TRUE;
+}
+
 /* Mmap for runtime code generation.  Returns two ScmMemoryRegions
    of the same size, one for write and one for execute.  If the system
    allows a page being both writable and executable, two regions may
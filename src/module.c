@@ -132,6 +132,10 @@ static struct {
     ScmHashTable *table;    /* Maps name -> module. */
     ScmInternalMutex mutex; /* Lock for table.  Only register_module and
                                lookup_module may hold the lock. */
+    ScmWeakHashTable *renamed; /* Module -> set of internal names exported
+                                  under different names.  Built on demand
+                                  by Scm__ExportedInternalNameP, and dropped
+                                  whenever the module's exports change. */
 } modules;
 
 /* Predefined modules - slots will be initialized by Scm__InitModule */
@@ -689,6 +693,7 @@ ScmObj Scm_ExportSymbols(ScmModule *module, ScmObj specs)
                              SCM_DICT_VALUE(e), 0);
         }
     }
+    Scm_WeakHashTableDelete(modules.renamed, SCM_OBJ(module));
     (void)SCM_INTERNAL_MUTEX_UNLOCK(modules.mutex);
 
     /* Now, if this export changes the meaning of exported symbols, we
@@ -733,6 +738,42 @@ ScmObj Scm_ExportAll(ScmModule *module)
     return SCM_OBJ(module);
 }
 
+/* Returns TRUE if the binding of NAME in MODULE is visible from outside,
+   either under its own name or under a renamed one.  Used by the compiler
+   to decide auto-inlining.  Renamed exports are looked up through
+   a reverse table, which is built once per module and kept until
+   the module's exports change. */
+int Scm__ExportedInternalNameP(ScmModule *module, ScmSymbol *name)
+{
+    if (module->exportAll) return SCM_SYMBOL_INTERNED(name);
+
+    ScmObj g = Scm_HashTableRef(module->external, SCM_OBJ(name), SCM_FALSE);
+    if (SCM_GLOCP(g) && SCM_EQ(SCM_GLOC(g)->name, name)) return TRUE;
+
+    (void)SCM_INTERNAL_MUTEX_LOCK(modules.mutex);
+    ScmObj r = Scm_WeakHashTableRef(modules.renamed, SCM_OBJ(module),
+                                    SCM_FALSE);
+    if (SCM_FALSEP(r)) {
+        r = Scm_MakeHashTableSimple(SCM_HASH_EQ, 0);
+        ScmHashIter iter;
+        Scm_HashIterInit(&iter, SCM_HASH_TABLE_CORE(module->external));
+        ScmDictEntry *e;
+        while ((e = Scm_HashIterNext(&iter)) != NULL) {
+            ScmObj v = SCM_DICT_VALUE(e);
+            if (SCM_GLOCP(v)
+                && !SCM_EQ(SCM_OBJ(SCM_GLOC(v)->name), SCM_DICT_KEY(e))
+                && SCM_GLOC(v)->module == module) {
+                Scm_HashTableSet(SCM_HASH_TABLE(r),
+                                 SCM_OBJ(SCM_GLOC(v)->name), SCM_TRUE, 0);
+            }
+        }
+        Scm_WeakHashTableSet(modules.renamed, SCM_OBJ(module), r, 0);
+    }
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(modules.mutex);
+    return !SCM_FALSEP(Scm_HashTableRef(SCM_HASH_TABLE(r), SCM_OBJ(name),
+                                        SCM_FALSE));
+}
+
 /* internal routine form Scm_ModuleExports */
 static void add_parent_module_exports(ScmHashCore *syms,
                                       ScmModule *module,
@@ -850,6 +891,9 @@ void Scm__DestroyModule(ScmModule *m)
     m->depended = SCM_NIL;
     Scm_HashCoreClear(&m->internal->core);
     Scm_HashCoreClear(&m->external->core);
+    (void)SCM_INTERNAL_MUTEX_LOCK(modules.mutex);
+    Scm_WeakHashTableDelete(modules.renamed, SCM_OBJ(m));
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(modules.mutex);
     m->origin = SCM_FALSE;
     m->prefix = SCM_FALSE;
 }
@@ -996,6 +1040,10 @@ void Scm__InitModule(void)
 {
     (void)SCM_INTERNAL_MUTEX_INIT(modules.mutex);
     modules.table = SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_EQ, 64));
+    modules.renamed =
+        SCM_WEAK_HASH_TABLE(Scm_MakeWeakHashTableSimple(SCM_HASH_EQ,
+                                                        SCM_WEAK_KEY,
+                                                        0, SCM_FALSE));
 
     /* standard module chain */
     ScmObj mpl = SCM_NIL;
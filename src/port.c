@@ -35,6 +35,7 @@
 #include "gauche.h"
 #include "gauche/priv/configP.h"
 #include "gauche/priv/portP.h"
+#include "gauche/priv/mmapP.h"
 #include "gauche/priv/builtin-syms.h"
 
 #include <string.h>
@@ -42,6 +43,10 @@
 #include <errno.h>
 #include <ctype.h>
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
 #undef MAX
 #undef MIN
 #define MAX(a, b) ((a)>(b)? (a) : (b))
@@ -179,6 +184,8 @@ SCM_DEFINE_BASE_CLASS(Scm_CodingAwarePortClass,
  *   already GC-ed.  The FINAL flag indicates that.
 
  */
+static void release_mapped_region(ScmPort *port);
+
 static void port_cleanup(ScmPort *port, _Bool final)
 {
     if (SCM_PORT_CLOSED_P(port)) return;
@@ -204,6 +211,9 @@ static void port_cleanup(ScmPort *port, _Bool final)
     case SCM_PORT_PROC:
         if (!final && PORT_VT(port)->Close) PORT_VT(port)->Close(port);
         break;
+    case SCM_PORT_ISTR:
+        if (!final) release_mapped_region(port);
+        break;
     default:
         break;
     }
@@ -1614,6 +1624,102 @@ ScmObj Scm_MakePortWithFd(ScmObj name, int direction,
     return p;
 }
 
+/*===============================================================
+ * Memory-mapped input file
+ */
+
+/* Opens a file PATH for reading, and maps its entire content to the
+   memory.  The returned port reads directly from the mapped region,
+   just like an input string port reads from the string body; no
+   read(2) nor copying to the port buffer is involved.
+
+   The region is kept in the read-only port attribute memory-region,
+   so that it won't be unmapped while the port is alive.  Scheme code
+   can use it to create a view uvector of the content without copying.
+   Closing the port unmaps the region, unless such a view has been
+   created; in that case the mapping is left until the view is gone.
+
+   If PATH isn't a regular file (e.g. a named pipe or a device), or is
+   too big to be mapped, we fall back to an ordinary file port.
+   Like Scm_OpenFilePort, returns #f if the file can't be opened.
+ */
+ScmObj Scm_OpenMappedInputFile(const char *path, int flags)
+{
+    if ((flags & O_ACCMODE) != O_RDONLY) {
+        Scm_Error("mapped file can only be opened for reading: %s", path);
+    }
+#if defined(GAUCHE_WINDOWS)
+    if (!(flags & (O_TEXT|O_BINARY))) {
+        flags |= O_BINARY;
+    }
+#endif /*GAUCHE_WINDOWS*/
+    int fd = open(path, flags);
+    if (fd < 0) return SCM_FALSE;
+
+    struct stat st;
+    int r;
+    SCM_SYSCALL(r, fstat(fd, &st));
+    if (r < 0 || !S_ISREG(st.st_mode)
+        || (uintmax_t)st.st_size > (uintmax_t)SCM_SMALL_INT_MAX) {
+        return Scm_MakePortWithFd(SCM_MAKE_STR_COPYING(path), SCM_PORT_INPUT,
+                                  fd, SCM_PORT_BUFFER_FULL, TRUE);
+    }
+
+    /* mmap(2) doesn't allow zero-length mapping. */
+    volatile ScmObj mem = SCM_FALSE;
+    if (st.st_size > 0) {
+        SCM_UNWIND_PROTECT {
+            mem = Scm_SysMmap(NULL, fd, (size_t)st.st_size, 0,
+                              PROT_READ, MAP_PRIVATE);
+        }
+        SCM_WHEN_ERROR {
+            close(fd);
+            SCM_NEXT_HANDLER;
+        }
+        SCM_END_PROTECT;
+    }
+    /* The mapping remains valid after the file is closed. */
+    close(fd);
+
+    ScmPort *p = make_port(SCM_CLASS_PORT, SCM_MAKE_STR_COPYING(path),
+                           SCM_PORT_INPUT, SCM_PORT_ISTR);
+    if (SCM_MEMORY_REGION_P(mem)) {
+        const char *start = (const char*)SCM_MEMORY_REGION(mem)->ptr;
+        PORT_ISTR(p)->start = start;
+        PORT_ISTR(p)->current = start;
+        PORT_ISTR(p)->end = start + SCM_MEMORY_REGION(mem)->size;
+    } else {
+        PORT_ISTR(p)->start = PORT_ISTR(p)->current = PORT_ISTR(p)->end = "";
+    }
+    /* Read-only attribute.  See "Port Attributes" above. */
+    PORT_ATTRS(p) = Scm_Cons(Scm_Cons(SCM_SYM_MEMORY_REGION,
+                                      Scm_Cons(mem, SCM_FALSE)),
+                             PORT_ATTRS(p));
+    return SCM_OBJ(p);
+}
+
+/* If PORT is an input string port reading from a mapped file, returns
+   the memory region.  Otherwise returns #f. */
+static ScmObj mapped_region(ScmPort *port)
+{
+    ScmObj p = Scm_Assq(SCM_SYM_MEMORY_REGION, PORT_ATTRS(port));
+    if (!SCM_PAIRP(p) || !SCM_PAIRP(SCM_CDR(p))) return SCM_FALSE;
+    ScmObj mem = SCM_CADR(p);
+    return SCM_MEMORY_REGION_P(mem)? mem : SCM_FALSE;
+}
+
+/* Called when an input string port is closed.  If it's a mapped file
+   port, release the mapping now rather than waiting for GC. */
+static void release_mapped_region(ScmPort *port)
+{
+    ScmObj mem = mapped_region(port);
+    if (SCM_MEMORY_REGION_P(mem)
+        && Scm_MemoryRegionRelease(SCM_MEMORY_REGION(mem))) {
+        PORT_ISTR(port)->start = PORT_ISTR(port)->current =
+            PORT_ISTR(port)->end = "";
+    }
+}
+
 /*===============================================================
  * String port
  */
@@ -1681,6 +1787,9 @@ ScmObj Scm_GetRemainingInputString(ScmPort *port, int flags)
         Scm_Error("input string port required, but got %S", port);
     /* NB: we don't need to lock the port, since the string body
        the port is pointing won't be changed. */
+    /* A mapped file is unmapped when the port is closed, so the string
+       must not share the mapped memory. */
+    if (!SCM_FALSEP(mapped_region(port))) flags |= SCM_STRING_COPYING;
     const char *ep = PORT_ISTR(port)->end;
     const char *cp = PORT_ISTR(port)->current;
     /* Things gets complicated if there's an ungotten char or bytes.
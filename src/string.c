@@ -40,6 +40,10 @@
 
 #include <string.h>
 #include <ctype.h>
+#include "gauche/bits_inline.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 void Scm_DStringDump(FILE *out, ScmDString *dstr);
 static ScmObj make_string_cursor(ScmString *src, const char *cursor);
@@ -55,6 +59,16 @@ SCM_DEFINE_BUILTIN_CLASS(Scm_StringClass, string_print, NULL, NULL, NULL,
         }                                                       \
     } while (0)
 
+/* The initial body's flags, length and size never hold pointers. */
+static ScmGCDescriptor string_descr;
+
+void Scm__InitStringDescriptor(void)
+{
+    string_descr = Scm_MakeGCDescriptor(sizeof(ScmString),
+                                        offsetof(ScmString, initialBody.flags),
+                                        offsetof(ScmString, initialBody.start));
+}
+
 /* Internal primitive constructor.   LEN can be negative if the string
    is incomplete. */
 static ScmString *make_str(ScmSmallInt len, ScmSmallInt siz,
@@ -71,7 +85,7 @@ static ScmString *make_str(ScmSmallInt len, ScmSmallInt siz,
         Scm_Error("string length (%ld) exceeds size (%ld)", len, siz);
     }
 
-    ScmString *s = SCM_NEW(ScmString);
+    ScmString *s = SCM_NEW_TYPED(ScmString, string_descr);
     SCM_SET_CLASS(s, SCM_CLASS_STRING);
     s->body = NULL;
     s->initialBody.flags = flags & SCM_STRING_FLAG_MASK;
@@ -122,54 +136,129 @@ char *Scm_StrdupPartial(const char *src, size_t size)
 
 /* We have multiple similar functions, due to performance reasons. */
 
+/* Bulk scanning.
+   In a valid UTF-8 sequence, every octet except 10xxxxxx begins a
+   character.  We examine a vector (with SSE2) or a word at a time,
+   to skip ASCII octets and to count characters. */
+
+#define HIGH_BITS   ((~0UL/0xff)*0x80) /* 0x8080...80 */
+
+/* Returns the number of ASCII octets at the beginning of P. */
+static inline ScmSmallInt ascii_prefix(const char *p, ScmSmallInt size)
+{
+    ScmSmallInt i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        int m = _mm_movemask_epi8(v);
+        if (m) return i + Scm__LowestBitNumber((u_long)m);
+    }
+#endif /*__SSE2__*/
+    for (; i + (ScmSmallInt)sizeof(u_long) <= size; i += sizeof(u_long)) {
+        u_long w;
+        memcpy(&w, p + i, sizeof(u_long));
+        if (w & HIGH_BITS) break;
+    }
+    for (; i < size && (unsigned char)p[i] < 0x80; i++)
+        ;
+    return i;
+}
+
+/* Returns the number of octets of a multibyte character at P, or -1 if
+   it isn't valid.  The criteria are the same as Scm_CharUtf8Getc; we
+   just inline the common cases. */
+static inline int mb_char_size(const unsigned char *p, ScmSmallInt size)
+{
+    unsigned char c = p[0];
+    if (c >= 0xc2 && c < 0xe0) {
+        if (size < 2 || (p[1] & 0xc0) != 0x80) return -1;
+        return 2;
+    }
+    if (c >= 0xe0 && c < 0xf0) {
+        if (size < 3 || (p[1] & 0xc0) != 0x80 || (p[2] & 0xc0) != 0x80) {
+            return -1;
+        }
+        if (c == 0xe0 && p[1] < 0xa0) return -1; /* overlong */
+        return 3;
+    }
+    int n = SCM_CHAR_NFOLLOWS(c);
+    if (n <= 0 || n >= size) return -1;
+    if (Scm_CharUtf8Getc(p) == SCM_CHAR_INVALID) return -1;
+    return n + 1;
+}
+
+/* Calculate length of known size string.  str can contain NUL character.
+   Returns -1 if str isn't a valid multibyte string. */
+static inline ScmSmallInt count_length(const char *str, ScmSmallInt size)
+{
+    ScmSmallInt count = 0;
+    while (size > 0) {
+        ScmSmallInt n = ascii_prefix(str, size);
+        count += n;
+        str += n;
+        size -= n;
+        while (size > 0 && (unsigned char)*str >= 0x80) {
+            int i = mb_char_size((const unsigned char*)str, size);
+            if (i < 0) return -1;
+            count++;
+            str += i;
+            size -= i;
+        }
+    }
+    return count;
+}
+
 /* Calculate both length and size of C-string str.
    If str is incomplete, *plen gets -1. */
 static inline ScmSmallInt count_size_and_length(const char *str,
                                                 ScmSmallInt *psize, /* out */
                                                 ScmSmallInt *plen)  /* out */
 {
-    char c;
-    int incomplete = FALSE;
-    const char *p = str;
-    ScmSmallInt size = 0, len = 0;
-    while ((c = *p++) != 0) {
-        int i = SCM_CHAR_NFOLLOWS(c);
-        len++;
-        size += i+1;
-
-        ScmChar ch;
-        SCM_CHAR_GET(p-1, ch);
-        if (ch == SCM_CHAR_INVALID) incomplete = TRUE;
-        /* Check every octet to avoid skipping over terminating NUL. */
-        while (i-- > 0) {
-            if (!*p++) { incomplete = TRUE; goto eos; }
-        }
-    }
-  eos:
-    if (incomplete) len = -1;
+    ScmSmallInt size = (ScmSmallInt)strlen(str);
+    ScmSmallInt len = count_length(str, size);
     *psize = size;
     *plen = len;
     return len;
 }
 
-/* Calculate length of known size string.  str can contain NUL character. */
-static inline ScmSmallInt count_length(const char *str, ScmSmallInt size)
-{
-    ScmSmallInt count = 0;
-    while (size-- > 0) {
-        unsigned char c = (unsigned char)*str;
-        int i = SCM_CHAR_NFOLLOWS(c);
-        if (i < 0 || i > size) return -1;
-        ScmChar ch;
-        SCM_CHAR_GET(str, ch);
-        if (ch == SCM_CHAR_INVALID) return -1;
-        count++;
-        str += i+1;
-        size -= i;
+/* Returns the pointer to the NCHARS-th character from P, where [P, END)
+   must be a valid multibyte string.  If there are less than NCHARS
+   characters, returns END. */
+static const char *skip_chars(const char *p, const char *end,
+                              ScmSmallInt nchars)
+{
+#if defined(__SSE2__)
+    const __m128i cont_max = _mm_set1_epi8((char)0xbf); /* -65 */
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        int m = _mm_movemask_epi8(_mm_cmpgt_epi8(v, cont_max));
+        ScmSmallInt c = (ScmSmallInt)Scm__CountBitsInWord((u_long)m);
+        if (c > nchars) break;
+        nchars -= c;
+        p += 16;
+    }
+#endif /*__SSE2__*/
+    while (end - p >= (ScmSmallInt)sizeof(u_long)) {
+        u_long w;
+        memcpy(&w, p, sizeof(u_long));
+        /* 10xxxxxx has the high bit set and the next bit clear. */
+        ScmSmallInt c = sizeof(u_long)
+            - (ScmSmallInt)Scm__CountBitsInWord(w & ~(w<<1) & HIGH_BITS);
+        if (c > nchars) break;
+        nchars -= c;
+        p += sizeof(u_long);
+    }
+    for (; p < end; p++) {
+        if (((unsigned char)*p & 0xc0) != 0x80) {
+            if (nchars == 0) return p;
+            nchars--;
+        }
     }
-    return count;
+    return end;
 }
 
+#undef HIGH_BITS
+
 /* Returns length of string, starts from str and end at stop.
    If stop is NULL, str is regarded as C-string (NUL terminated).
    If the string is incomplete, returns -1. */
@@ -538,6 +627,11 @@ static inline const char *forward_pos(const ScmStringBody *body,
         return current + nchars;
     }
 
+    if (body) {
+        return skip_chars(current,
+                          SCM_STRING_BODY_START(body) + SCM_STRING_BODY_SIZE(body),
+                          nchars);
+    }
     while (nchars--) {
         int n = SCM_CHAR_NFOLLOWS(*current);
         current += n + 1;
@@ -31,6 +31,7 @@
  *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#define _GNU_SOURCE  /* for posix_spawn_file_actions_*_np on Linux */
 #define LIBGAUCHE_BODY
 #include "gauche.h"
 #include "gauche/priv/configP.h"
@@ -63,6 +64,11 @@ extern char **environ;
    We need to use _NSGetEnviron(), and this header defines it. */
 #include <crt_externs.h>
 # endif /* HAVE_CRT_EXTERNS_H */
+
+# if defined(HAVE_SPAWN_H) && defined(HAVE_POSIX_SPAWNP)
+#include <spawn.h>
+#define USE_POSIX_SPAWN 1
+# endif /* HAVE_SPAWN_H && HAVE_POSIX_SPAWNP */
 #else   /* GAUCHE_WINDOWS */
 #include <lm.h>
 #include <tlhelp32.h>
@@ -1595,6 +1601,109 @@ char *win_create_command_line(ScmObj args)
 }
 #endif /*GAUCHE_WINDOWS*/
 
+#if defined(USE_POSIX_SPAWN)
+/* posix_spawn path of fork-and-exec
+ *   fork() of a process with a large heap is costly, since the kernel
+ *   has to copy all the page tables; it may even fail if overcommit is
+ *   restricted.  posix_spawn doesn't copy the address space (glibc uses
+ *   clone(CLONE_VM|CLONE_VFORK)), so we use it whenever the requested
+ *   options can be expressed by spawn attributes and file actions.
+ *
+ *   try_spawn returns the child's pid, or -1 if we can't use posix_spawn
+ *   or it failed.  In the latter case the caller falls back to fork(), so
+ *   that errors such as a nonexistent program are reported in the same
+ *   way as before (the child exits with a message).
+ */
+
+/* Express what Scm_SysSwapFds does as file actions.  We can't dup() in
+   the child to resolve conflicts, so we first move all the source fds
+   above any fd appearing in the map, then dup2 them to the destinations,
+   and close the rest. */
+#if defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP)
+static int spawn_add_fdmap(posix_spawn_file_actions_t *actions, int *fds)
+{
+    int nfds = fds[0];
+    int *tofd   = fds + 1;
+    int *fromfd = fds + 1 + nfds;
+    int base = 0, r;
+
+    for (int i=0; i<nfds; i++) {
+        if (tofd[i] >= base)   base = tofd[i] + 1;
+        if (fromfd[i] >= base) base = fromfd[i] + 1;
+    }
+    for (int i=0; i<nfds; i++) {
+        r = posix_spawn_file_actions_adddup2(actions, fromfd[i], base+i);
+        if (r != 0) return r;
+    }
+    for (int fd=0; fd<base; fd++) {
+        int j;
+        for (j=0; j<nfds; j++) if (fd == tofd[j]) break;
+        if (j < nfds) continue;
+        if (fcntl(fd, F_GETFD) < 0) continue; /* not open */
+        r = posix_spawn_file_actions_addclose(actions, fd);
+        if (r != 0) return r;
+    }
+    for (int i=0; i<nfds; i++) {
+        r = posix_spawn_file_actions_adddup2(actions, base+i, tofd[i]);
+        if (r != 0) return r;
+    }
+    return posix_spawn_file_actions_addclosefrom_np(actions, base);
+}
+#endif /*HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP*/
+
+static pid_t try_spawn(const char *program, char **argv, int *fds,
+                       ScmSysSigset *mask, const char *cdir, int detachp)
+{
+    /* Detaching requires double fork. */
+    if (detachp) return -1;
+#if !defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP)
+    if (cdir != NULL) return -1;
+#endif
+#if !defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP)
+    if (fds != NULL) return -1;
+#endif
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    short attrflags = 0;
+    pid_t pid = -1;
+    int r = 0;
+
+    if (posix_spawn_file_actions_init(&actions) != 0) return -1;
+    if (posix_spawnattr_init(&attr) != 0) {
+        posix_spawn_file_actions_destroy(&actions);
+        return -1;
+    }
+
+#if defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP)
+    if (cdir != NULL) r = posix_spawn_file_actions_addchdir_np(&actions, cdir);
+#endif
+#if defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP)
+    if (r == 0 && fds != NULL) r = spawn_add_fdmap(&actions, fds);
+#endif
+    if (r == 0 && mask != NULL) {
+        /* Like Scm_ResetSignalHandlers in the fork path, make sure our
+           handlers won't run in the child once the mask is changed. */
+        sigset_t dfl = Scm_GetMasterSigmask();
+        r = posix_spawnattr_setsigdefault(&attr, &dfl);
+        if (r == 0) r = posix_spawnattr_setsigmask(&attr, &mask->set);
+        attrflags |= POSIX_SPAWN_SETSIGDEF|POSIX_SPAWN_SETSIGMASK;
+    }
+    if (r == 0) r = posix_spawnattr_setflags(&attr, attrflags);
+    if (r == 0) {
+#if defined(HAVE_CRT_EXTERNS_H)
+        char **envp = *_NSGetEnviron();
+#else
+        char **envp = environ;
+#endif
+        r = posix_spawnp(&pid, program, &actions, &attr, argv, envp);
+    }
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return (r == 0)? pid : -1;
+}
+#endif /*USE_POSIX_SPAWN*/
+
 /* Scm_SysExec
  *   execvp(), with optionally setting stdios correctly.
  *
@@ -1610,7 +1719,8 @@ char *win_create_command_line(ScmObj args)
  *   descriptors.  It is more reliable way to fork&exec in multi-threaded
  *   program.  In such a case, this function returns Scheme integer to
  *   show the children's pid.   If fork arg is FALSE, this procedure
- *   of course never returns.
+ *   of course never returns.  When available, we use posix_spawn instead
+ *   of fork (see try_spawn above).
  *
  *   On Windows port, this returns a process handle obejct instead of
  *   pid of the child process in fork mode.  We need to keep handle, or
@@ -1647,6 +1757,10 @@ ScmObj Scm_SysExec(ScmString *file, ScmObj args, ScmObj iomap,
 
     /* When requested, call fork() here. */
     if (forkp) {
+#if defined(USE_POSIX_SPAWN)
+        pid = try_spawn(program, argv, fds, mask, cdir, detachp);
+        if (pid > 0) return Scm_MakeInteger(pid);
+#endif
         SCM_SYSCALL(pid, fork());
         if (pid < 0) Scm_SysError("fork failed");
     }
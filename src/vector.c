@@ -849,6 +849,7 @@ ScmObj Scm_MakeViewUVector(ScmMemoryRegion *mem, ScmClass *klass,
                            ScmSmallInt len, ScmSmallInt offset,
                            int immutable)
 {
+    if (mem->ptr == NULL) Scm_Error("memory region is already unmapped");
     if (offset < 0) Scm_Error("offset must not be negative: %ld", offset);
     int esize = Scm_UVectorElementSize(klass);
     if (esize < 0) Scm_Error("uvector class required, but got: %S", klass);
@@ -858,6 +859,7 @@ ScmObj Scm_MakeViewUVector(ScmMemoryRegion *mem, ScmClass *klass,
     if (len < 0) len = (mem->size - offset)/esize;
 
     if (!(mem->prot & PROT_WRITE)) immutable = TRUE;
+    mem->viewed = TRUE;
     return Scm_MakeUVectorFull(klass, len, mem->ptr + offset, immutable,
                                (void*)mem);
 }
@@ -241,3 +241,7 @@
 (XLSET . 237)
 (EXTEND-DENV . 238)
 (TAIL-EXTEND-DENV . 239)
+(FLADD2 . 240)
+(FLSUB2 . 241)
+(FLMUL2 . 242)
+(FLDIV2 . 243)
@@ -47,6 +47,8 @@
 #include "gauche/prof.h"
 #include "gauche/precomp.h"
 
+#include <fcntl.h>
+
 /* Experimental code to use custom mark procedure for stack gc.
    Currently it doens't show any improvement, so we disable it
    by default. */
@@ -191,6 +193,7 @@ static ScmVM *theVM;
 #endif /* !GAUCHE_USE_PTHREADS */
 
 static void save_stack(ScmVM *vm);
+static void replace_stack(ScmVM *vm, long size);
 
 static ScmObj find_dynamic_env(ScmVM *vm, ScmObj key, ScmObj fallback);
 static void push_dynamic_env(ScmVM *vm, ScmObj key, ScmObj val);
@@ -214,10 +217,20 @@ static ScmObj get_denv(ScmVM *vm);
 static void   call_error_reporter(ScmObj e);
 static ScmObj call_abort_handler(ScmObj, ScmObj);
 
-/*#define COUNT_INSN_FREQUENCY*/
-#ifdef COUNT_INSN_FREQUENCY
 #include "vmstat.c"
-#endif /*COUNT_INSN_FREQUENCY*/
+
+/* Allocates a stack of SIZE words for VM. */
+static ScmObj *alloc_stack(ScmVM *vm SCM_UNUSED, long size)
+{
+#ifdef USE_CUSTOM_STACK_MARKER
+    ScmObj *s = (ScmObj*)GC_generic_malloc((size+1)*sizeof(ScmObj),
+                                           vm_stack_kind);
+    *s++ = SCM_OBJ(vm);
+    return s;
+#else  /*!USE_CUSTOM_STACK_MARKER*/
+    return SCM_NEW_ARRAY(ScmObj, size);
+#endif /*!USE_CUSTOM_STACK_MARKER*/
+}
 
 /*
  * Constructor
@@ -271,16 +284,13 @@ ScmVM *Scm_NewVM(ScmVM *proto, ScmObj name)
     v->finalizerPending = 0;
     v->stopRequest = 0;
 
-#ifdef USE_CUSTOM_STACK_MARKER
-    v->stack = (ScmObj*)GC_generic_malloc((SCM_VM_STACK_SIZE+1)*sizeof(ScmObj),
-                                          vm_stack_kind);
-    *v->stack++ = SCM_OBJ(v);
-#else  /*!USE_CUSTOM_STACK_MARKER*/
-    v->stack = SCM_NEW_ARRAY(ScmObj, SCM_VM_STACK_SIZE);
-#endif /*!USE_CUSTOM_STACK_MARKER*/
+    v->stack = alloc_stack(v, SCM_VM_STACK_SIZE);
     v->sp = v->stack;
     v->stackBase = v->stack;
     v->stackEnd = v->stack + SCM_VM_STACK_SIZE;
+    v->stackSizeMax = proto? proto->stackSizeMax : SCM_VM_STACK_SIZE_MAX;
+    v->stackOverflows = 0;
+    v->stackOverflowTime = 0;
 #if GAUCHE_FFX
     v->fpstack = SCM_NEW_ATOMIC_ARRAY(ScmFlonum, SCM_VM_STACK_SIZE);
     v->fpstackEnd = v->fpstack + SCM_VM_STACK_SIZE;
@@ -350,6 +360,33 @@ ScmVM *Scm_NewVM(ScmVM *proto, ScmObj name)
     return v;
 }
 
+/*
+ * Stack size configuration.
+ *   SIZE is the initial stack size, and MAXSIZE is the limit the stack can
+ *   grow, both in words.  Zero means the default.  SIZE smaller than
+ *   SCM_VM_STACK_SIZE is rounded up, since the compiler assumes a certain
+ *   amount of stack space.  It can only be called before the VM starts
+ *   running.
+ */
+void Scm_VMSetStackSize(ScmVM *vm, long size, long maxsize)
+{
+    if (vm->state != SCM_VM_NEW) {
+        Scm_Error("can't change the stack size of a running thread: %S", vm);
+    }
+    if (size < 0 || maxsize < 0) {
+        Scm_Error("stack size must be a nonnegative integer, but got %ld",
+                  size < 0 ? size : maxsize);
+    }
+    if (size < SCM_VM_STACK_SIZE) size = SCM_VM_STACK_SIZE;
+    if (maxsize == 0) maxsize = SCM_VM_STACK_SIZE_MAX;
+    if (maxsize < size) maxsize = size;
+
+    vm->stackSizeMax = maxsize;
+    if (size != vm->stackEnd - vm->stack) {
+        replace_stack(vm, size);
+    }
+}
+
 /*
  * Taking a snapshot of VM.
  *   Copying VM is mainly to preserve a snapshot of VM for analysis.
@@ -385,17 +422,15 @@ ScmVM *Scm_VMTakeSnapshot(ScmVM *master)
     v->finalizerPending = master->finalizerPending;
     v->stopRequest = master->stopRequest;
 
-#ifdef USE_CUSTOM_STACK_MARKER
-    v->stack = (ScmObj*)GC_generic_malloc((SCM_VM_STACK_SIZE+1)*sizeof(ScmObj),
-                                          vm_stack_kind);
-    *v->stack++ = SCM_OBJ(v);
-#else  /*!USE_CUSTOM_STACK_MARKER*/
-    v->stack = SCM_NEW_ARRAY(ScmObj, SCM_VM_STACK_SIZE);
-#endif /*!USE_CUSTOM_STACK_MARKER*/
+    long stack_size = master->stackEnd - master->stack;
+    v->stack = alloc_stack(v, stack_size);
     v->sp = v->stack;
     v->stackBase = v->stack;
-    v->stackEnd = v->stack + SCM_VM_STACK_SIZE;
-    memcpy(v->stack, master->stack, SCM_VM_STACK_SIZE*sizeof(ScmObj));
+    v->stackEnd = v->stack + stack_size;
+    v->stackSizeMax = master->stackSizeMax;
+    v->stackOverflows = 0;
+    v->stackOverflowTime = 0;
+    memcpy(v->stack, master->stack, stack_size*sizeof(ScmObj));
 
 #if GAUCHE_FFX
     v->fpstack = SCM_NEW_ATOMIC_ARRAY(ScmFlonum, SCM_VM_STACK_SIZE);
@@ -614,11 +649,7 @@ static void vm_unregister(ScmVM *vm)
 #define FETCH_OPERAND(var)      ((var) = SCM_OBJ(*PC))
 #define FETCH_OPERAND_PUSH      (*SP++ = SCM_OBJ(*PC))
 
-#ifndef COUNT_INSN_FREQUENCY
 #define FETCH_INSN(var)         ((var) = *PC++)
-#else
-#define FETCH_INSN(var)         ((var) = fetch_insn_counting(vm, var))
-#endif
 
 /* For sanity check in debugging mode */
 #ifdef PARANOIA
@@ -683,8 +714,8 @@ static void vm_unregister(ScmVM *vm)
 #define IN_FULL_STACK_P(ptr)                            \
     ((ptr) >= vm->stack && (ptr) < vm->stackEnd)
 #else  /*!GAUCHE_SPLIT_STACK*/
-#define IN_STACK_P(ptr)                                         \
-    ((unsigned long)((ptr) - vm->stack) < SCM_VM_STACK_SIZE)
+#define IN_STACK_P(ptr)                                                 \
+    ((unsigned long)((ptr) - vm->stack) < (unsigned long)(vm->stackEnd - vm->stack))
 #define IN_FULL_STACK_P(ptr) IN_STACK_P(ptr)
 #endif /*!GAUCHE_SPLIT_STACK*/
 
@@ -946,25 +977,30 @@ static void vm_unregister(ScmVM *vm)
    the combination is very frequent - but for the less frequent
    instructions, NEXT_PUSHCHECK proved effective without introducing
    new fused vm insns.
+
+   DTAB is either dispatch_table or counting_table; the latter is used
+   while VM insn counting is on (see vmstat.c).  We don't fuse PUSH
+   then, so that it is counted.
 */
 #ifdef __GNUC__
-#define SWITCH(val) goto *dispatch_table[val];
+#define SWITCH(val) goto *dtab[val];
 #define CASE(insn)  SCM_CPP_CAT(LABEL_, insn) :
 #define DEFAULT     LABEL_DEFAULT :
 #define DISPATCH    /*empty*/
 #define NEXT                                            \
     do {                                                \
         FETCH_INSN(code);                               \
-        goto *dispatch_table[SCM_VM_INSN_CODE(code)];   \
+        goto *dtab[SCM_VM_INSN_CODE(code)];             \
     } while (0)
 #define NEXT_PUSHCHECK                                  \
     do {                                                \
         FETCH_INSN(code);                               \
-        if (code == SCM_VM_PUSH) {                      \
+        if (code == SCM_VM_PUSH                         \
+            && dtab == dispatch_table) {                \
             PUSH_ARG(VAL0);                             \
             FETCH_INSN(code);                           \
         }                                               \
-        goto *dispatch_table[SCM_VM_INSN_CODE(code)];   \
+        goto *dtab[SCM_VM_INSN_CODE(code)];             \
     } while (0)
 #else /* !__GNUC__ */
 #define SWITCH(val)    switch (val)
@@ -1083,7 +1119,10 @@ static void run_loop()
 #include "vminsn.c"
 #undef DEFINSN
     };
+    static void *counting_table[256];
+    void **dtab;
 #endif /* __GNUC__ */
+    ScmWord *prev_insn = NULL;  /* for insn pair counting */
 
     /* Records the offset of each instruction handler from run_loop entry
        address.  They can be retrieved by gauche.internal#%vm-get-insn-offsets.
@@ -1095,13 +1134,23 @@ static void run_loop()
             vminsn_offsets[i] =
                 (unsigned long)((char*)dispatch_table[i] - (char*)run_loop);
         }
+#ifdef __GNUC__
+        for (int i=0; i<256; i++) counting_table[i] = &&count_insn;
+#endif /* __GNUC__ */
+        insn_count_init();
     }
+#ifdef __GNUC__
+    dtab = insn_count.enabled ? counting_table : dispatch_table;
+#endif /* __GNUC__ */
 
     for (;;) {
         DISPATCH;
         /*VM_DUMP("");*/
         if (vm->attentionRequest) goto process_queue;
         FETCH_INSN(code);
+#ifndef __GNUC__
+        if (insn_count.enabled) vm_count_insn(&prev_insn, PC-1, code);
+#endif /* !__GNUC__ */
         SWITCH(SCM_VM_INSN_CODE(code)) {
 #define VMLOOP
 #include "vminsn.c"
@@ -1117,7 +1166,16 @@ static void run_loop()
         PUSH_CONT(PC);
         process_queued_requests(vm);
         POP_CONT();
+#ifdef __GNUC__
+        dtab = insn_count.enabled ? counting_table : dispatch_table;
         NEXT;
+      count_insn:
+        /* We come here instead of the insn handler while counting. */
+        if (insn_count.enabled) vm_count_insn(&prev_insn, PC-1, code);
+        goto *dispatch_table[SCM_VM_INSN_CODE(code)];
+#else  /* !__GNUC__ */
+        NEXT;
+#endif /* !__GNUC__ */
     }
 }
 /* End of run_loop */
@@ -1299,6 +1357,44 @@ static void save_cont(ScmVM *vm)
     vm->stackBase = vm->stack;
 }
 
+/* Stack growth policy.
+   When the stack overflows, save_stack moves all the frames to the heap.
+   If a deep recursion keeps overflowing the stack, the frames are
+   saved and restored over and over.  So if we see STACK_GROW_THRESHOLD
+   overflows in a row, each within STACK_GROW_WINDOW microseconds from
+   the previous one, we double the stack (up to vm->stackSizeMax) when
+   the stack is empty right after saving the frames.  The stack never
+   shrinks; an occasional overflow doesn't make it grow.
+ */
+#define STACK_GROW_THRESHOLD  3
+#define STACK_GROW_WINDOW     10000
+
+static int stack_should_grow(ScmVM *vm)
+{
+    if (vm->stackEnd - vm->stack >= vm->stackSizeMax) return FALSE;
+    long now = Scm_CurrentMicroseconds();
+    if (now - vm->stackOverflowTime < STACK_GROW_WINDOW) {
+        vm->stackOverflows++;
+    } else {
+        vm->stackOverflows = 1;
+    }
+    vm->stackOverflowTime = now;
+    return (vm->stackOverflows >= STACK_GROW_THRESHOLD);
+}
+
+/* Replace the stack with a new one of SIZE words.  This must be called
+   right after save_cont, when the only thing on the stack is the
+   argument frame between argp and sp. */
+static void replace_stack(ScmVM *vm, long size)
+{
+    ScmObj *s = alloc_stack(vm, size);
+    long nargs = vm->sp - vm->argp;
+    memcpy(s, vm->argp, nargs * sizeof(ScmObj));
+    vm->stack = vm->stackBase = vm->argp = s;
+    vm->sp = s + nargs;
+    vm->stackEnd = s + size;
+}
+
 static void save_stack(ScmVM *vm)
 {
 #if HAVE_GETTIMEOFDAY
@@ -1311,12 +1407,19 @@ static void save_stack(ScmVM *vm)
 #endif
 
     save_cont(vm);
-    memmove(vm->stackBase, vm->argp,
-            (vm->sp - (ScmObj*)vm->argp) * sizeof(ScmObj*));
-    vm->sp -= (ScmObj*)vm->argp - vm->stackBase;
-    vm->argp = vm->stackBase;
-    /* Clear the stack.  This removes bogus pointers and accelerates GC */
-    for (ScmObj *p = vm->sp; p < vm->stackEnd; p++) *p = NULL;
+    if (stack_should_grow(vm)) {
+        long size = (vm->stackEnd - vm->stack) * 2;
+        if (size > vm->stackSizeMax) size = vm->stackSizeMax;
+        replace_stack(vm, size);
+        vm->stackOverflows = 0;
+    } else {
+        memmove(vm->stackBase, vm->argp,
+                (vm->sp - (ScmObj*)vm->argp) * sizeof(ScmObj*));
+        vm->sp -= (ScmObj*)vm->argp - vm->stackBase;
+        vm->argp = vm->stackBase;
+        /* Clear the stack.  This removes bogus pointers and accelerates GC */
+        for (ScmObj *p = vm->sp; p < vm->stackEnd; p++) *p = NULL;
+    }
 
 #if HAVE_GETTIMEOFDAY
     if (stats) {
@@ -4264,9 +4367,10 @@ struct GC_ms_entry *vm_stack_mark(GC_word *addr,
     struct GC_ms_entry *e = mark_sp;
     ScmObj *vmsb = ((ScmObj*)addr)+1;
     ScmVM *vm = (ScmVM*)*addr;
+    if (vmsb != vm->stack) return e; /* stack has been replaced */
     int limit = vm->sp - vm->stackBase + 5;
     void *spb = (void *)vm->stackBase;
-    void *sbe = (void *)(vm->stackBase + SCM_VM_STACK_SIZE);
+    void *sbe = (void *)vm->stackEnd;
     void *hb = GC_least_plausible_heap_addr;
     void *he = GC_greatest_plausible_heap_addr;
 
@@ -4350,9 +4454,12 @@ void Scm__InitVM(void)
     theVM = rootVM;
 #endif  /* no threads */
 
-#ifdef COUNT_INSN_FREQUENCY
-    Scm_AddCleanupHandler(dump_insn_frequency, NULL);
-#endif /*COUNT_INSN_FREQUENCY*/
+    const char *insn_count_file = Scm_GetEnv("GAUCHE_VM_INSN_COUNT");
+    if (insn_count_file != NULL && *insn_count_file != '\0') {
+        insn_count.enabled = TRUE;
+        Scm_AddCleanupHandler(insn_count_dump_at_exit,
+                              (void*)insn_count_file);
+    }
 
 #ifdef COUNT_FLUSH_FPSTACK
     Scm_AddCleanupHandler(print_flush_fpstack_count, NULL);
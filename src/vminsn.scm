@@ -1311,6 +1311,33 @@
       ($result:f (/ (Scm_GetDouble arg) (Scm_GetDouble VAL0)))
       ($result (Scm_VMDivInexact arg VAL0)))))
 
+;; Flonum arithmetic.  The compiler emits these for +, -, *, / and
+;; their inexact variants when it infers both args are flonums (see
+;; pass5/numtype).  We still check the types, just in case.
+(define-insn FLADD2      0 none #f
+  ($w/argp arg
+    (if (and (SCM_FLONUMP arg) (SCM_FLONUMP VAL0))
+      ($result:f (+ (SCM_FLONUM_VALUE arg) (SCM_FLONUM_VALUE VAL0)))
+      ($result (Scm_Add arg VAL0)))))
+
+(define-insn FLSUB2      0 none #f
+  ($w/argp arg
+    (if (and (SCM_FLONUMP arg) (SCM_FLONUMP VAL0))
+      ($result:f (- (SCM_FLONUM_VALUE arg) (SCM_FLONUM_VALUE VAL0)))
+      ($result (Scm_Sub arg VAL0)))))
+
+(define-insn FLMUL2      0 none #f
+  ($w/argp arg
+    (if (and (SCM_FLONUMP arg) (SCM_FLONUMP VAL0))
+      ($result:f (* (SCM_FLONUM_VALUE arg) (SCM_FLONUM_VALUE VAL0)))
+      ($result (Scm_Mul arg VAL0)))))
+
+(define-insn FLDIV2      0 none #f
+  ($w/argp arg
+    (if (and (SCM_FLONUMP arg) (SCM_FLONUMP VAL0))
+      ($result:f (/ (SCM_FLONUM_VALUE arg) (SCM_FLONUM_VALUE VAL0)))
+      ($result (Scm_Div arg VAL0)))))
+
 (define-insn NUMADDI     1 none #f      ; +, if one of op is small int
   (let* ([imm::long (SCM_VM_INSN_ARG code)])
     ($w/argr arg
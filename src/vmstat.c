@@ -33,88 +33,148 @@
 
 /* This file is included from vm.c */
 
-#ifdef COUNT_INSN_FREQUENCY
-/* for statistics */
-static u_long insn1_freq[SCM_VM_NUM_INSNS];
-static u_long insn2_freq[SCM_VM_NUM_INSNS][SCM_VM_NUM_INSNS];
+/*
+ * VM instruction frequency counter
+ *
+ *   While counting is on, run_loop dispatches through counting_table,
+ *   every entry of which jumps to a stub that calls vm_count_insn and
+ *   then jumps to the real handler.  So the normal dispatch path pays
+ *   nothing while counting is off.
+ *
+ *   We count each instruction, and each pair of instructions where
+ *   the second one immediately follows the first one in the code vector
+ *   and executed right after it.  Those are the candidates of combined
+ *   instructions.  See src/gen-combined-insns.
+ *
+ *   The counters are shared by all threads and updated without locking,
+ *   so the numbers may be slightly off when more than one thread is
+ *   running.  They're meant to be used as statistics.
+ */
 
-#define LREF_FREQ_COUNT_MAX 10
-static u_long lref_freq[LREF_FREQ_COUNT_MAX][LREF_FREQ_COUNT_MAX];
-static u_long lset_freq[LREF_FREQ_COUNT_MAX][LREF_FREQ_COUNT_MAX];
+static struct {
+    volatile int enabled;
+    u_char nwords[SCM_VM_NUM_INSNS]; /* # of words taken by each insn */
+    u_long insn1[SCM_VM_NUM_INSNS];
+    u_long insn2[SCM_VM_NUM_INSNS][SCM_VM_NUM_INSNS];
+} insn_count;
 
-static ScmWord fetch_insn_counting(ScmVM *vm, ScmWord code)
+static void insn_count_init(void)
 {
-    if (vm->base && vm->pc != vm->base->code) {
-        insn2_freq[SCM_VM_INSN_CODE(code)][SCM_VM_INSN_CODE(*vm->pc)]++;
-    }
-    code = *vm->pc++;
-    insn1_freq[SCM_VM_INSN_CODE(code)]++;
-    switch (SCM_VM_INSN_CODE(code)) {
-    case SCM_VM_LREF0: lref_freq[0][0]++; break;
-    case SCM_VM_LREF1: lref_freq[0][1]++; break;
-    case SCM_VM_LREF2: lref_freq[0][2]++; break;
-    case SCM_VM_LREF3: lref_freq[0][3]++; break;
-    case SCM_VM_LREF4: lref_freq[0][4]++; break;
-    case SCM_VM_LREF10: lref_freq[1][0]++; break;
-    case SCM_VM_LREF11: lref_freq[1][1]++; break;
-    case SCM_VM_LREF12: lref_freq[1][2]++; break;
-    case SCM_VM_LREF13: lref_freq[1][3]++; break;
-    case SCM_VM_LREF14: lref_freq[1][4]++; break;
-    case SCM_VM_LREF:
-    {
-        int dep = SCM_VM_INSN_ARG0(code);
-        int off = SCM_VM_INSN_ARG1(code);
-        if (dep >= LREF_FREQ_COUNT_MAX) dep=LREF_FREQ_COUNT_MAX-1;
-        if (off >= LREF_FREQ_COUNT_MAX) off=LREF_FREQ_COUNT_MAX-1;
-        lref_freq[dep][off]++;
-        break;
+    for (int i=0; i<SCM_VM_NUM_INSNS; i++) {
+        switch (Scm_VMInsnOperandType(i)) {
+        case SCM_VM_OPERAND_NONE: insn_count.nwords[i] = 1; break;
+        case SCM_VM_OPERAND_OBJ_LABEL:
+        case SCM_VM_OPERAND_OBJ_NATIVE: insn_count.nwords[i] = 3; break;
+        default: insn_count.nwords[i] = 2; break;
+        }
     }
-    case SCM_VM_LSET0: lset_freq[0][0]++; break;
-    case SCM_VM_LSET1: lset_freq[0][1]++; break;
-    case SCM_VM_LSET2: lset_freq[0][2]++; break;
-    case SCM_VM_LSET3: lset_freq[0][3]++; break;
-    case SCM_VM_LSET4: lset_freq[0][4]++; break;
-    case SCM_VM_LSET:
-    {
-        int dep = SCM_VM_INSN_ARG0(code);
-        int off = SCM_VM_INSN_ARG1(code);
-        if (dep >= LREF_FREQ_COUNT_MAX) dep=LREF_FREQ_COUNT_MAX-1;
-        if (off >= LREF_FREQ_COUNT_MAX) off=LREF_FREQ_COUNT_MAX-1;
-        lset_freq[dep][off]++;
-        break;
+}
+
+/* PC points to the insn CODE being executed.  *PREV keeps the location
+   of the previously executed insn in this run_loop. */
+static inline void vm_count_insn(ScmWord **prev, ScmWord *pc, ScmWord code)
+{
+    u_int c = SCM_VM_INSN_CODE(code);
+    insn_count.insn1[c]++;
+    if (*prev != NULL) {
+        u_int p = SCM_VM_INSN_CODE(**prev);
+        if (pc == *prev + insn_count.nwords[p]) insn_count.insn2[p][c]++;
     }
+    *prev = pc;
+}
+
+/* Let every VM reload the dispatch table. */
+static void insn_count_notify(void)
+{
+    rootVM->attentionRequest = TRUE;
+    SCM_INTERNAL_MUTEX_LOCK(vm_table_mutex);
+    ScmHashIter iter;
+    Scm_HashIterInit(&iter, &vm_table);
+    ScmDictEntry *e;
+    while ((e = Scm_HashIterNext(&iter)) != NULL) {
+        ((ScmVM*)e->key)->attentionRequest = TRUE;
     }
-    return code;
+    SCM_INTERNAL_MUTEX_UNLOCK(vm_table_mutex);
+}
+
+void Scm_VMInsnCountStart(void)
+{
+    insn_count.enabled = TRUE;
+    insn_count_notify();
+}
+
+/* Returns TRUE if counting was on. */
+int Scm_VMInsnCountStop(void)
+{
+    int r = insn_count.enabled;
+    insn_count.enabled = FALSE;
+    insn_count_notify();
+    return r;
+}
+
+void Scm_VMInsnCountReset(void)
+{
+    memset(insn_count.insn1, 0, sizeof(insn_count.insn1));
+    memset(insn_count.insn2, 0, sizeof(insn_count.insn2));
 }
 
-static void dump_insn_frequency(void *data)
+static ScmObj insn_sym(int code)
 {
-    Scm_Printf(SCM_CUROUT, "(:instruction-frequencies (");
+    return SCM_INTERN(Scm_VMInsnName(code));
+}
+
+/* Returns (((<insn> . <count>) ...) . (((<insn> . <insn>) . <count>) ...)),
+   with nonzero counts only. */
+ScmObj Scm_VMInsnCountResult(void)
+{
+    ScmObj h1 = SCM_NIL, t1 = SCM_NIL, h2 = SCM_NIL, t2 = SCM_NIL;
     for (int i=0; i<SCM_VM_NUM_INSNS; i++) {
-        Scm_Printf(SCM_CUROUT, "(%s %d", Scm_VMInsnName(i), insn1_freq[i]);
+        if (insn_count.insn1[i] == 0) continue;
+        SCM_APPEND1(h1, t1,
+                    Scm_Cons(insn_sym(i),
+                             Scm_MakeIntegerU(insn_count.insn1[i])));
         for (int j=0; j<SCM_VM_NUM_INSNS; j++) {
-            Scm_Printf(SCM_CUROUT, " %d", insn2_freq[i][j]);
+            if (insn_count.insn2[i][j] == 0) continue;
+            SCM_APPEND1(h2, t2,
+                        Scm_Cons(Scm_Cons(insn_sym(i), insn_sym(j)),
+                                 Scm_MakeIntegerU(insn_count.insn2[i][j])));
         }
-        Scm_Printf(SCM_CUROUT, ")\n");
     }
-    Scm_Printf(SCM_CUROUT, ")\n :lref-frequencies (");
-    for (int i=0; i<LREF_FREQ_COUNT_MAX; i++) {
-        Scm_Printf(SCM_CUROUT, "(");
-        for (int j=0; j<LREF_FREQ_COUNT_MAX; j++) {
-            Scm_Printf(SCM_CUROUT, "%d ", lref_freq[i][j]);
-        }
-        Scm_Printf(SCM_CUROUT, ")\n");
+    return Scm_Cons(h1, h2);
+}
+
+/* Writes the result in the format src/gen-combined-insns reads. */
+void Scm_VMInsnCountDump(ScmPort *port)
+{
+    Scm_Printf(port, "(:insn-frequencies\n (");
+    for (int i=0; i<SCM_VM_NUM_INSNS; i++) {
+        if (insn_count.insn1[i] == 0) continue;
+        Scm_Printf(port, "(%s . %lu)\n  ",
+                   Scm_VMInsnName(i), insn_count.insn1[i]);
     }
-    Scm_Printf(SCM_CUROUT, ")\n :lset-frequencies (");
-    for (int i=0; i<LREF_FREQ_COUNT_MAX; i++) {
-        Scm_Printf(SCM_CUROUT, "(");
-        for (int j=0; j<LREF_FREQ_COUNT_MAX; j++) {
-            Scm_Printf(SCM_CUROUT, "%d ", lset_freq[i][j]);
+    Scm_Printf(port, ")\n :insn-pair-frequencies\n (");
+    for (int i=0; i<SCM_VM_NUM_INSNS; i++) {
+        for (int j=0; j<SCM_VM_NUM_INSNS; j++) {
+            if (insn_count.insn2[i][j] == 0) continue;
+            Scm_Printf(port, "((%s . %s) . %lu)\n  ",
+                       Scm_VMInsnName(i), Scm_VMInsnName(j),
+                       insn_count.insn2[i][j]);
         }
-        Scm_Printf(SCM_CUROUT, ")\n");
     }
-    Scm_Printf(SCM_CUROUT, ")\n");
-    Scm_Printf(SCM_CUROUT, ")\n");
+    Scm_Printf(port, "))\n");
 }
 
-#endif /*COUNT_INSN_FREQUENCY*/
+/* If GAUCHE_VM_INSN_COUNT is set, we count from the start and dump
+   the result to the named file at exit. */
+static void insn_count_dump_at_exit(void *data)
+{
+    ScmObj out = Scm_OpenFilePort((const char*)data,
+                                  O_WRONLY|O_CREAT|O_TRUNC, SCM_PORT_BUFFER_FULL,
+                                  0666);
+    if (SCM_FALSEP(out)) {
+        Scm_Warn("couldn't open %s to write VM insn counts", (const char*)data);
+        return;
+    }
+    Scm_VMInsnCountDump(SCM_PORT(out));
+    Scm_ClosePort(SCM_PORT(out));
+}
@@ -530,10 +530,8 @@ ScmObj Scm__WritePrimitive(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
    NB: R7RS write-shared doesn't require datum labels on strings,
    but srfi-38 does.  We follow srfi-38.
 
-   NB: The walk pass is now written in Scheme (libio.scm: write-walk),
-   but the emit pass is in C (write_rec).  Using naive recursion in write_rec
-   can bust the C stack when deep structure is passed, even if it is
-   not circular.
+   NB: Using naive recursion in write_walk and write_rec can bust
+   the C stack when deep structure is passed, even if it is not circular.
    Thus we avoided recursion by managing traversal stack by our own
    ('stack' local variable).    It made the code ugly.  Oh well.
 
@@ -556,16 +554,205 @@ ScmObj Scm__WritePrimitive(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
  */
 
 /* pass 1 */
-/* Implemented in Scheme */
+
+/* Returns TRUE if OBJ can be shared and we need to keep track of it. */
+static inline int walk_need_recurse(ScmObj obj)
+{
+    return !(!SCM_PTRP(obj)
+             || SCM_NUMBERP(obj)
+             || SCM_KEYWORDP(obj)
+             || (SCM_SYMBOLP(obj) && SCM_SYMBOL_INTERNED(obj))
+             || (SCM_STRINGP(obj) && SCM_STRING_SIZE(obj) == 0)
+             || (SCM_VECTORP(obj) && SCM_VECTOR_SIZE(obj) == 0));
+}
+
+/* Objects we don't look into. */
+static inline int walk_leaf_p(ScmObj obj)
+{
+    return (SCM_SYMBOLP(obj) || SCM_STRINGP(obj) || SCM_UVECTORP(obj));
+}
+
+/* Returns the number of elements of a pair, vector, or (mv-)box to
+   be traversed, or -1 if OBJ isn't one of them.  Shared boxes are
+   handled as generic objects; their printer walks the values. */
+static inline ScmSize walk_arity(ScmObj obj)
+{
+    if (SCM_PAIRP(obj))   return 2;
+    if (SCM_VECTORP(obj)) return SCM_VECTOR_SIZE(obj);
+    if (SCM_BOXP(obj))    return 1;
+    if (SCM_MVBOXP(obj))  return SCM_MVBOX_SIZE(obj);
+    return -1;
+}
+
+static inline ScmObj walk_element(ScmObj obj, ScmSize i)
+{
+    if (SCM_PAIRP(obj))   return (i == 0)? SCM_CAR(obj) : SCM_CDR(obj);
+    if (SCM_VECTORP(obj)) return SCM_VECTOR_ELEMENT(obj, i);
+    if (SCM_BOXP(obj))    return SCM_BOX_VALUE(obj);
+    return SCM_MVBOX_VALUES(obj)[i];
+}
+
+typedef struct walk_frame_rec {
+    ScmObj obj;
+    ScmSize index;              /* next element to visit */
+    ScmObj slow;                /* fast path only; see below */
+} walk_frame;
+
+/* Fast path for circular-only mode.
+   In that mode, the walk pass leaves in the table only the objects that
+   are revisited while we're still traversing inside of them, that is,
+   the ones on cycles.  If the data is a tree (or a small DAG) without
+   generic objects, we can prove it has no cycles without recording
+   anything: we follow cdr chains with a tortoise-and-hare check, and
+   limit the depth of car/vector nesting and the total number of visits.
+   Returns TRUE if OBJ is proven acyclic, FALSE if we gave up.  The
+   latter doesn't mean OBJ is circular.  */
+#define WALK_FAST_DEPTH   256
+#define WALK_FAST_BUDGET  0x400000
+
+static int walk_acyclic_p(ScmObj obj)
+{
+    walk_frame stack[WALK_FAST_DEPTH];
+    int sp = 0;
+    long budget = WALK_FAST_BUDGET;
+
+    for (;;) {
+        if (walk_need_recurse(obj) && !walk_leaf_p(obj)) {
+            if (--budget < 0) return FALSE;
+            if (SCM_PAIRP(obj)) {
+                if (sp == WALK_FAST_DEPTH) return FALSE;
+                stack[sp].obj = stack[sp].slow = obj;
+                stack[sp].index = 0;
+                sp++;
+                obj = SCM_CAR(obj);
+                continue;
+            }
+            ScmSize n = walk_arity(obj);
+            if (n < 0) return FALSE; /* generic object */
+            if (sp == WALK_FAST_DEPTH) return FALSE;
+            stack[sp].obj = obj;
+            stack[sp].index = 0;
+            stack[sp].slow = SCM_FALSE;
+            sp++;
+        }
+        /* Find the next object to visit. */
+        for (;;) {
+            if (sp == 0) return TRUE;
+            walk_frame *f = &stack[sp-1];
+            if (SCM_PAIRP(f->obj)) {
+                /* F->OBJ is the current pair of the list and F->SLOW
+                   follows it at the half speed. */
+                ScmObj next = SCM_CDR(f->obj);
+                if (SCM_PAIRP(next)) {
+                    if (--budget < 0) return FALSE;
+                    if ((++f->index) % 2 == 0) f->slow = SCM_CDR(f->slow);
+                    if (next == f->slow) return FALSE; /* cdr-circular */
+                    f->obj = next;
+                    obj = SCM_CAR(next);
+                    break;
+                }
+                sp--;
+                obj = next;
+                break;
+            }
+            ScmSize n = walk_arity(f->obj);
+            if (f->index < n) {
+                obj = walk_element(f->obj, f->index++);
+                break;
+            }
+            sp--;
+        }
+    }
+}
+
+/* The general walker.  We count the number of times each object is
+   visited in the hash table TAB.  In circular-only mode, the entry is
+   removed after its elements are traversed unless it has been revisited
+   in the meantime.  The traversal stack is managed explicitly so that
+   deep structures don't bust the C stack; it can't be avoided when
+   we go through write-object for generic objects, though. */
+#define WALK_STACK_INIT   64
+
+static void walk_rec(ScmObj obj, ScmPort *port, ScmHashCore *tab)
+{
+    walk_frame init_stack[WALK_STACK_INIT];
+    walk_frame *stack = init_stack;
+    ScmSize sp = 0, stack_size = WALK_STACK_INIT;
+    int shared = (port->flags & SCM_PORT_WRITESS);
+
+    for (;;) {
+        if (!shared && walk_leaf_p(obj)) {
+            /* A leaf can't be on a cycle.  We'd record and remove it
+               immediately, so we skip it altogether. */
+            obj = SCM_UNBOUND;
+        } else if (walk_need_recurse(obj)) {
+            ScmDictEntry *e = Scm_HashCoreSearch(tab, (intptr_t)obj,
+                                                 SCM_DICT_CREATE);
+            if (e->value) {
+                /* seen more than once */
+                (void)SCM_DICT_SET_VALUE(e,
+                             SCM_MAKE_INT(SCM_INT_VALUE(SCM_DICT_VALUE(e))+1));
+                obj = SCM_UNBOUND;
+            } else {
+                (void)SCM_DICT_SET_VALUE(e, SCM_MAKE_INT(1));
+                if (walk_leaf_p(obj)) {
+                    /* nothing to traverse */
+                } else if (walk_arity(obj) >= 0) {
+                    if (sp == stack_size) {
+                        walk_frame *new_stack =
+                            SCM_NEW_ARRAY(walk_frame, stack_size*2);
+                        memcpy(new_stack, stack, sizeof(walk_frame)*sp);
+                        stack = new_stack;
+                        stack_size *= 2;
+                    }
+                    stack[sp].obj = obj;
+                    stack[sp].index = 0;
+                    sp++;
+                    obj = SCM_UNBOUND;
+                } else {
+                    /* generic objects.  we go walk pass via write-object */
+                    write_object(obj, port, NULL);
+                }
+            }
+        } else {
+            obj = SCM_UNBOUND;
+        }
+
+        /* Here, OBJ is the object whose elements are all traversed,
+           or SCM_UNBOUND.  Finish it and find the next object to visit. */
+        for (;;) {
+            if (!shared && !SCM_UNBOUNDP(obj)) {
+                ScmDictEntry *e = Scm_HashCoreSearch(tab, (intptr_t)obj,
+                                                     SCM_DICT_GET);
+                if (e && SCM_EQ(SCM_DICT_VALUE(e), SCM_MAKE_INT(1))) {
+                    Scm_HashCoreSearch(tab, (intptr_t)obj, SCM_DICT_DELETE);
+                }
+            }
+            if (sp == 0) return;
+            walk_frame *f = &stack[sp-1];
+            ScmSize n = walk_arity(f->obj);
+            if (f->index < n) {
+                obj = walk_element(f->obj, f->index++);
+                /* In write/ss mode we don't need to finish the list,
+                   so we follow the cdr without keeping the frame. */
+                if (shared && f->index == n && SCM_PAIRP(f->obj)) sp--;
+                break;
+            }
+            obj = f->obj;
+            sp--;
+        }
+    }
+}
+
 static void write_walk(ScmObj obj, ScmPort *port)
 {
-    static ScmObj proc = SCM_UNDEFINED;
     ScmWriteState *s = Scm_PortWriteState(port);
     SCM_ASSERT(s);
     ScmHashTable *ht = s->sharedTable;
     SCM_ASSERT(ht != NULL);
-    SCM_BIND_PROC(proc, "%write-walk-rec", Scm_GaucheInternalModule());
-    Scm_ApplyRec3(proc, obj, SCM_OBJ(port), SCM_OBJ(ht));
+
+    if (!(port->flags & SCM_PORT_WRITESS) && walk_acyclic_p(obj)) return;
+    walk_rec(obj, port, SCM_HASH_TABLE_CORE(ht));
 }
 
 /* pass 2 */
@@ -223,6 +223,56 @@
   (define seq (coroutine->cseq coro))
   (test* "cseq (coroutine)" '(0 1 2 3 4 5 6 7 8 9) seq))
 
+;;--------------------------------------------------------------------
+;; control.executor
+;;
+
+(test-section "control.executor")
+(use control.executor)
+(test-module 'control.executor)
+
+(let1 ex (make-executor 4)
+  (test* "submit" '(3 4)
+         (values->list (task-result (executor-submit! ex (^[] (values 3 4))))))
+  (test* "error" (test-error <error> "oops")
+         (task-result (executor-submit! ex (^[] (error "oops")))))
+  ;; fork-join; each task waits for subtasks
+  (let ()
+    (define (pfib n)
+      (if (< n 10)
+        (let loop ([n n]) (if (< n 2) n (+ (loop (- n 1)) (loop (- n 2)))))
+        (let1 t (executor-submit! ex (^[] (pfib (- n 1))))
+          (+ (pfib (- n 2)) (task-result t)))))
+    (test* "fork-join" 6765 (pfib 20)))
+  (test* "many tasks" (* 5000 4999)
+         (let1 ts (map (^i (executor-submit! ex (^[] (* i 2)))) (iota 5000))
+           (fold + 0 (map task-result ts))))
+  (test* "parallel-for" (* 1000 999 1/2)
+         (let1 a (atom 0)
+           (parallel-for 0 1000 (^i (atomic-update! a (cut + <> i)))
+                         :executor ex)
+           (atom-ref a)))
+  (test* "parallel-for (nested)" 10000
+         (let1 a (atom 0)
+           (parallel-for 0 100
+                         (^i (parallel-for 0 100
+                                           (^j (atomic-update! a (cut + <> 1)))
+                                           :executor ex :grain 7))
+                         :executor ex :grain 1)
+           (atom-ref a)))
+  (test* "timeout" 'timeout
+         (let* ([m (make-mutex)]
+                [_ (mutex-lock! m)]
+                [t (executor-submit! ex (^[] (mutex-lock! m)
+                                             (mutex-unlock! m)))])
+           (sys-nanosleep #e1e8)          ;let a worker start the task
+           (begin0 (task-result t 0.1 'timeout)
+             (mutex-unlock! m)
+             (task-result t))))
+  (executor-shutdown! ex)
+  (test* "shut down" (test-error)
+         (executor-submit! ex (^[] #t))))
+
 ;;--------------------------------------------------------------------
 ;; control.future
 ;;
@@ -242,6 +292,31 @@
          (future? f))
   (test* "future error handling (propagated)" (test-error <error> "oops")
          (future-get f)))
+(test* "many futures" (* 1000 999 1/2)
+       (fold + 0 (map future-get (map (^i (future i)) (iota 1000)))))
+(let ([p (make-parameter 'outer)]
+      [out (open-output-string)])
+  (test* "future inherits dynamic environment" '(inner "hello")
+         (let1 f (parameterize ([p 'inner])
+                   (with-output-to-port out
+                     (^[] (future (begin (display "hello") (p))))))
+           ;; make sure it's run by a worker, not by future-get
+           (let loop ([n 0])
+             (unless (or (future-done? f) (> n 1000))
+               (sys-nanosleep #e1e6)
+               (loop (+ n 1))))
+           (list (future-get f) (get-output-string out)))))
+(test* "future in dedicated thread" 'ok
+       (future-get (future 'ok #f)))
+(test* "future timeout" '(timeout timeout)
+       (let* ([m (make-mutex)]
+              [_ (mutex-lock! m)]
+              [f1 (future (begin (mutex-lock! m) (mutex-unlock! m)))]
+              [f2 (future (begin (mutex-lock! m) (mutex-unlock! m)) #f)])
+         (sys-nanosleep #e1e8)
+         (begin0 (list (future-get f1 0.1 'timeout)
+                       (future-get f2 0.1 'timeout))
+           (mutex-unlock! m))))
 
 ;;--------------------------------------------------------------------
 ;; control.pmap
@@ -253,6 +328,18 @@
 (test* "pmap (default)"
        (map (cut * <> 2) (iota 100))
        (pmap (cut * <> 2) (iota 100)))
+(test* "pmap (executor)"
+       (map (cut * <> 2) (iota 100))
+       (pmap (cut * <> 2) (iota 100) :mapper (make-executor-mapper)))
+(test* "pmap (executor, nested)"
+       (map (^i (map (cut * i <>) (iota 10))) (iota 10))
+       (pmap (^i (pmap (cut * i <>) (iota 10))) (iota 10)
+             :mapper (make-executor-mapper)))
+(test* "pfind (executor)"
+       (find (cut = <> 77) (iota 100))
+       (pfind (cut = <> 77) (iota 100) :mapper (make-executor-mapper)))
+(test* "pany (executor)" #f
+       (pany (cut = <> 100) (iota 100) :mapper (make-executor-mapper)))
 (test* "pmap (thread-pool)"
        (map (cut * <> 2) (iota 100))
        (pmap (cut * <> 2) (iota 100) :mapper (make-pool-mapper)))
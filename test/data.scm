@@ -528,6 +528,64 @@
                   (list v k)))
   )
 
+;;;========================================================================
+;; rope
+(test-section "data.rope")
+(use data.rope)
+(use gauche.sequence)
+(test-module 'data.rope)
+
+(test* "rope basic" '(#t 0 "")
+       (list (rope-empty? (rope)) (rope-length (rope)) (rope->string (rope))))
+(test* "rope basic" '(#f 6 "abcdef")
+       (let1 r (rope "ab" (string->rope "cd") "ef")
+         (list (rope-empty? r) (rope-length r) (rope->string r))))
+(test* "rope-ref" '(#\a #\い #\z)
+       (let1 r (rope "a" "あいう" "z")
+         (map (cut rope-ref r <>) '(0 2 4))))
+(test* "rope-ref out of range" (test-error) (rope-ref (rope "abc") 3))
+(test* "rope-ref fallback" 'none (rope-ref (rope "abc") 3 'none))
+(test* "rope type check" (test-error) (rope "abc" 'def))
+
+;; Build a large rope incrementally, and compare it with the flat version.
+(let* ([pieces (map (^i (format "~d:あ~a;" i (make-string (modulo i 7) #\x)))
+                    (iota 3000))]
+       [str (string-join pieces "")]
+       [r (fold (^[p r] (rope-append r p)) (rope) pieces)]
+       [len (string-length str)])
+  (test* "rope append" str (rope->string r))
+  (test* "rope length" len (rope-length r))
+  (test* "rope-ref" #t
+         (every (^k (eqv? (string-ref str k) (rope-ref r k)))
+                (iota 200 0 (quotient len 200))))
+  (test* "subrope" #t
+         (every (^[s e] (equal? (substring str s e)
+                                (rope->string (subrope r s e))))
+                (iota 20 0 997) (iota 20 1234 1501)))
+  (test* "subrope" (substring str 12345 len)
+         (rope->string (subrope r 12345)))
+  (test* "subrope out of range" (test-error) (subrope r 10 (+ len 1)))
+  (test* "rope-replace" (string-append (substring str 0 100) "XYZ"
+                                       (substring str 20000 len))
+         (rope->string (rope-replace r 100 20000 "XYZ")))
+  (test* "rope-replace with rope" (string-append str str)
+         (rope->string (rope-replace r 0 0 r)))
+  (test* "string->rope" #t
+         (equal? (string->rope str) r))
+  (test* "write-rope" str
+         (with-output-to-string (cut write-rope r)))
+  (test* "rope sequence" (substring str 500 600)
+         (list->string (coerce-to <list> (subseq r 500 600))))
+  )
+
+(test* "rope sequence" '(#\c #\b #\a)
+       (fold cons '() (rope "a" "" "b" (rope "c"))))
+(test* "rope size-of" 3 (size-of (rope "a" "bc")))
+(test* "rope ref" #\b (ref (rope "a" "bc") 1))
+(test* "rope builder" "abc"
+       (rope->string (coerce-to <rope> '(#\a #\b #\c))))
+(test* "rope x->string" "abc" (x->string (rope "a" "bc")))
+
 ;;;========================================================================
 ;; skew-list
 (test-section "data.skew-list")
@@ -75,4 +75,47 @@
   (test-debug-info `(12345 123456789 123456789012345 ,@xs #0=(1234567) . #0#)
                    "big data"))
 
+(test-section "VM instruction counting")
+
+(define (insn-count-loop n)
+  (let loop ([i 0] [r '()])
+    (if (< i n) (loop (+ i 1) (cons i r)) (length r))))
+
+(test* "counting" '(#t #t #t)
+       (begin
+         (vm-insn-count-reset)
+         (vm-insn-count-start)
+         (insn-count-loop 1000)
+         (vm-insn-count-stop)
+         (receive (insns pairs) (vm-insn-count-get-result)
+           (list (>= (fold (^[e s] (+ (cdr e) s)) 0 insns) 1000)
+                 (every (^e (and (symbol? (caar e)) (symbol? (cdar e))))
+                        pairs)
+                 (pair? pairs)))))
+
+(test* "stopped" #t
+       (receive (insns _) (vm-insn-count-get-result)
+         (insn-count-loop 1000)
+         (receive (insns2 _) (vm-insn-count-get-result)
+           (equal? insns insns2))))
+
+(test* "dump" '(:insn-frequencies :insn-pair-frequencies)
+       (let1 dump (read-from-string
+                   (with-output-to-string vm-insn-count-dump))
+         (list (car dump) (caddr dump))))
+
+(test* "show" '(#t #t)
+       (receive (insns pairs) (vm-insn-count-get-result)
+         (let ([out (with-output-to-string
+                      (cut vm-insn-count-show :max-rows #f))]
+               [p (find (^e (not (eq? (caar e) (cdar e)))) pairs)])
+           (list (boolean (#/Instruction pair/ out))
+                 (or (not p)
+                     (boolean
+                      (string-scan out #"~(caar p) ~(cdar p) ")))))))
+
+(test* "reset" '()
+       (begin (vm-insn-count-reset)
+              (values-ref (vm-insn-count-get-result) 0)))
+
 (test-end)
@@ -454,6 +454,45 @@
          (map cdr x)
          (map (^p (hash-table-comparator (make-hash-table (car p)))) x)))
 
+;;------------------------------------------------------------------
+(test-section "fast-hash tables")
+
+(test* "fast-hash consistency" #t
+       (and (= (fast-hash "abc") (fast-hash (string-copy "abc")))
+            (= (fast-hash '#u8(1 2 3)) (fast-hash (u8vector 1 2 3)))
+            (= (fast-hash '("a" #(b #u16(1 2)) 3))
+               (fast-hash (list "a" (vector 'b (u16vector 1 2)) 3)))))
+(test* "fast-hash uvector type" #f
+       (= (fast-hash '#u8(0 0)) (fast-hash '#u16(0))))
+
+(let ([keys (map (^i (format "key~a~a" i (make-string (modulo i 70) #\x)))
+                 (iota 500))])
+  (define (run cmpr)
+    (let1 h (make-hash-table cmpr)
+      (for-each (^[k i] (hash-table-put! h (string-copy k) i)) keys (iota 500))
+      (list (hash-table-num-entries h)
+            (every (^[k i] (eqv? (hash-table-get h k #f) i)) keys (iota 500))
+            (hash-table-get h "nokey" #f)
+            (eq? (hash-table-comparator h) cmpr))))
+  (test* "fast-string-comparator" '(500 #t #f #t)
+         (run fast-string-comparator))
+  (test* "fast-equal-comparator" '(500 #t #f #t)
+         (run fast-equal-comparator))
+  (test* "fast-string-comparator non-string key" (test-error)
+         (hash-table-get (make-hash-table fast-string-comparator) 'a #f))
+  (test* "user comparator with fast-hash" '(500 #t #f #t)
+         (run (make-comparator string? string=? #f fast-hash))))
+
+(let1 h (make-hash-table fast-equal-comparator)
+  (hash-table-put! h '#u8(1 2 3) 'a)
+  (hash-table-put! h '#f64(1.0 2.0) 'b)
+  (hash-table-put! h '(1 "x" #u32(5)) 'c)
+  (test* "fast-equal-comparator uvector keys" '(a b c #f)
+         (list (hash-table-get h (u8vector 1 2 3) #f)
+               (hash-table-get h (f64vector 1.0 2.0) #f)
+               (hash-table-get h (list 1 "x" (u32vector 5)) #f)
+               (hash-table-get h (s8vector 1 2 3) #f))))
+
 ;;------------------------------------------------------------------
 (test-section "hash-table-copy & rehash")
 
@@ -103,6 +103,61 @@
              :if-exists #f)
            (call-with-input-file "tmp2.o" read)))
 
+(call-with-output-file "tmp2.o"
+  (^p (display "(abc \"\u3042\u3044\u3046\")\nline2\n" p)))
+
+(test* "open-input-file :mmap #t"
+       (list '(abc "\u3042\u3044\u3046") "" "line2" (eof-object))
+       (call-with-input-file "tmp2.o"
+         (^p (let* ([a (read p)]
+                    [b (read-line p)]
+                    [c (read-line p)])
+               (list a b c (read-line p))))
+         :mmap #t))
+
+(test* "open-input-file :mmap #t (seek)" '(6 #\u3042 "line2")
+       (call-with-input-file "tmp2.o"
+         (^p (let1 pos (begin (port-seek p 6) (port-tell p))
+               (list pos (read-char p)
+                     (begin (port-seek p -6 SEEK_END) (read-line p)))))
+         :mmap #t))
+
+(test* "open-input-file :mmap #t (memory-region)" '("abc" #t)
+       (call-with-input-file "tmp2.o"
+         (^p (let* ([m (port-attribute-ref p 'memory-region)]
+                    [v (make-view-uvector m <u8vector> 3 1)])
+               (list (u8vector->string v)
+                     (guard (e [else #t]) (u8vector-set! v 0 0) #f))))
+         :mmap #t))
+
+(test* "open-input-file :mmap #t (unmapped on close)" (test-error)
+       (let* ([p (open-input-file "tmp2.o" :mmap #t)]
+              [m (port-attribute-ref p 'memory-region)])
+         (close-port p)
+         (make-view-uvector m <u8vector> 3 1)))
+
+(test* "open-input-file :mmap #t (view survives close)" "abc"
+       (let* ([p (open-input-file "tmp2.o" :mmap #t)]
+              [v (make-view-uvector (port-attribute-ref p 'memory-region)
+                                    <u8vector> 3 1)])
+         (close-port p)
+         (u8vector->string v)))
+
+(test* "open-input-file :mmap #t (remaining string survives close)" "line2\n"
+       (let* ([p (open-input-file "tmp2.o" :mmap #t)]
+              [s (begin (read-line p)
+                        (get-remaining-input-string p))])
+         (close-port p)
+         (gc)
+         (string-copy s)))
+
+(call-with-output-file "tmp2.o" (^p #f))
+
+(test* "open-input-file :mmap #t (empty file)" (list (eof-object) #f)
+       (call-with-input-file "tmp2.o"
+         (^p (list (read-char p) (port-attribute-ref p 'memory-region)))
+         :mmap #t))
+
 ;;-------------------------------------------------------------------
 (test-section "port-attributes")
 
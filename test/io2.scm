@@ -230,6 +230,34 @@
            (loop (+ cnt 1) (list ls))
            (string-length (write-to-string ls)))))
 
+(test* "deep list doesn't bust C stack (write/ss)" 2000002
+       (let loop ([cnt 0] [ls '()])
+         (if (< cnt 1000000)
+           (loop (+ cnt 1) (list ls))
+           (string-length (write-to-string ls write/ss)))))
+
+(test* "long list with cdr cycle"
+       (string-append "(" (string-join (map number->string (iota 99998)) " ")
+                      " . #0=(99998 99999 . #0#))")
+       (let1 x (iota 100000)
+         (set-cdr! (last-pair x) (list-tail x 99998))
+         (write-to-string x)))
+
+(test* "deep nesting with car cycle"
+       (string-append "#0=" (make-string 1001 #\() "#0#"
+                      (make-string 1001 #\)))
+       (let* ([c (list #f)]
+              [top (let loop ([n 0] [x c])
+                     (if (= n 1000) x (loop (+ n 1) (list x))))])
+         (set-car! c top)
+         (write-to-string top)))
+
+(test* "shared leaves aren't labeled by write" "(\"a\" \"a\" . #0=(1 . #0#))"
+       (let* ([s "a"]
+              [x (list 1)])
+         (set-cdr! x x)
+         (write-to-string (list* s s x))))
+
 ;;---------------------------------------------------------------
 (test-section "format/ss")
 
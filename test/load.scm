@@ -399,6 +399,116 @@
 
 (rmrf "test.o")
 
+;;----------------------------------------------------------------
+(test-section "code cache")
+
+(sys-mkdir "test.o" #o777)
+
+(define (write-cc-source . extra)
+  (with-output-to-file "test.o/cc.scm"
+    (^[]
+      (for-each (^x (write x) (newline))
+                `((define-module code-cache.test
+                    (export cc-fact cc-count cc-data cc-hidden cc-ticks))
+                  (select-module code-cache.test)
+                  (define-syntax twice
+                    (syntax-rules () [(_ x) (* 2 x)]))
+                  (define-syntax define-hidden
+                    (syntax-rules ()
+                      [(_ getter) (begin (define hidden 42)
+                                         (define (getter) hidden))]))
+                  (define cc-count 0)
+                  (set! cc-count (+ cc-count 1))
+                  (define (cc-fact n)
+                    (if (= n 0) 1 (twice (* n (cc-fact (- n 1))))))
+                  (define cc-data '(#(1 "a" #\b) 2.5 . c))
+                  (define-hidden cc-hidden)
+                  ;; The hidden variable is defined in one form and
+                  ;; used in another, through a macro.
+                  (define-syntax define-counter
+                    (syntax-rules ()
+                      [(_ name)
+                       (begin (define count 0)
+                              (define-syntax name
+                                (syntax-rules ()
+                                  [(_) (begin (set! count (+ count 1))
+                                              count)])))]))
+                  (define-counter cc-tick)
+                  (define (cc-ticks) (cc-tick) (cc-tick))
+                  ,@extra)))))
+
+;; Returns the cache file content, or #f if not exists
+(define (load-with-cache path)
+  (let1 saved ((with-module gauche.internal code-cache-directory))
+    ((with-module gauche.internal code-cache-directory-set!) "test.o/cache")
+    (unwind-protect
+        (begin
+          (load path)
+          (let1 cache ((with-module gauche.internal code-cache-file) path)
+            (and (file-exists? cache)
+                 (call-with-input-file cache port->sexp-list))))
+      ((with-module gauche.internal code-cache-directory-set!) saved))))
+
+(define (cc-ref name)
+  (global-variable-ref (find-module 'code-cache.test) name))
+
+(define (cc-results)
+  (list ((cc-ref 'cc-fact) 3) (cc-ref 'cc-count) (cc-ref 'cc-data)
+        ((cc-ref 'cc-hidden)) ((cc-ref 'cc-ticks))))
+
+(define (cc-entry-types cache) (map car (cdr cache)))
+
+(write-cc-source)
+
+(let1 cache #f
+  (test* "code cache (create)" '(48 1 (#(1 "a" #\b) 2.5 . c) 42 2)
+         (begin (set! cache (load-with-cache "./test.o/cc.scm"))
+                (cc-results)))
+  (test* "code cache entries"
+         '(source source source source code code code code code
+           source source source)
+         (and cache (cc-entry-types cache)))
+  (test* "code cache (reuse)" '(48 1 (#(1 "a" #\b) 2.5 . c) 42 2 #t)
+         (let1 cache2 (load-with-cache "./test.o/cc.scm")
+           `(,@(cc-results) ,(equal? cache cache2))))
+  )
+
+(write-cc-source '(set! cc-count (+ cc-count 1)))
+
+(test* "code cache (invalidate)" '(48 2 (#(1 "a" #\b) 2.5 . c) 42 2)
+       (begin (load-with-cache "./test.o/cc.scm")
+              (cc-results)))
+
+;; Touching the source keeps the cache, but renews the recorded mtime.
+(test* "code cache (touched)" '(#t 1000000)
+       (let1 before (load-with-cache "./test.o/cc.scm")
+         (sys-utime "test.o/cc.scm" 1000000 1000000)
+         (let1 after (load-with-cache "./test.o/cc.scm")
+           (list (equal? (cdr before) (cdr after))
+                 (list-ref (car after) 5)))))
+
+(test* "code image" '(("test.o/cc") 12 (48 2 (#(1 "a" #\b) 2.5 . c) 42 2))
+       (let ([abspath (sys-normalize-pathname "test.o/cc.scm"
+                                              :absolute #t :canonicalize #t)]
+             [image-entries
+              (^[abspath]
+                (cdr (hash-table-get (with-module gauche.internal *code-image*)
+                                     abspath)))])
+         ((with-module gauche.internal %code-image-start-recording))
+         (load "./test.o/cc.scm")
+         ((with-module gauche.internal %code-image-dump)
+          "test.o/cc.image" '("test.o/cc"))
+         (unwind-protect
+             (let1 features ((with-module gauche.internal %code-image-load)
+                             "test.o/cc.image")
+               (load "./test.o/cc.scm")
+               (list features
+                     (length (image-entries abspath))
+                     (cc-results)))
+           (eval '(set! *code-image* #f) (find-module 'gauche.internal)))))
+
+(rmrf "test.o")
+
 ;; Load-path hook -----------------------------------
 
 (test-section "load-path hook")
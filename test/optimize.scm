@@ -244,6 +244,75 @@
                        [_ #f]))
             (proc->insn/split case-lambda-pass2-inline-3)))
 
+;; Whole-program mode.  Small exported procedures become inlinable.
+(with-module gauche.internal
+  (vm-compiler-flag-set! SCM_COMPILE_WHOLE_PROGRAM))
+(define-module opt.whole-program
+  (export wp-add3 wp-list wp-adder wp-hidden-caller (rename wp-sub1 wp-dec))
+  (define (wp-add3 x) (+ x 3))
+  (define (wp-list x) (list x x x x x x x x x x x x x x x x))
+  (define wp-adder (let ([n 5]) (^[x] (+ x n))))
+  (define (wp-hidden x) (+ x 1))
+  (define (wp-hidden-caller x) (wp-hidden x))
+  (define (wp-sub1 x) (- x 1)))
+(define-module opt.whole-program-all
+  (export-all)
+  (define (wp-mul3 x) (* x 3)))
+(with-module gauche.internal
+  (vm-compiler-flag-clear! SCM_COMPILE_WHOLE_PROGRAM))
+(import opt.whole-program)
+(import opt.whole-program-all)
+
+(define (wp-add3-caller x) (wp-add3 x))
+(test* "whole-program inlining" '(() 7)
+       (list (filter-insn wp-add3-caller 'GREF-TAIL-CALL)
+             (wp-add3-caller 4)))
+(define (wp-list-caller x) (wp-list x))
+(test* "whole-program inlining (too big)" 1
+       (length (filter-insn wp-list-caller 'GREF-TAIL-CALL)))
+(define (wp-dec-caller x) (wp-dec x))
+(test* "whole-program inlining (renamed export)" '(() 3)
+       (list (filter-insn wp-dec-caller 'GREF-TAIL-CALL)
+             (wp-dec-caller 4)))
+(define (wp-mul3-caller x) (wp-mul3 x))
+(test* "whole-program inlining (export-all)" '(() 12)
+       (list (filter-insn wp-mul3-caller 'GREF-TAIL-CALL)
+             (wp-mul3-caller 4)))
+(define (wp-adder-caller x) (wp-adder x))
+(test* "whole-program inlining (closure)" '(1 9)
+       (list (length (filter-insn wp-adder-caller 'GREF-TAIL-CALL))
+             (wp-adder-caller 4)))
+(test* "whole-program inlining (not exported)" 1
+       (length (filter-insn (with-module opt.whole-program wp-hidden-caller)
+                            'GREF-TAIL-CALL)))
+
+;; Fingerprints of inlined procedures, used by precompiled code to detect
+;; changes of the providers.
+(let ()
+  (define fingerprints
+    (with-module gauche.internal
+      (^[expr]
+        (%start-recording-inline-fingerprints!)
+        (compile expr (find-module 'user))
+        (%finish-recording-inline-fingerprints!))))
+  (define (check entries)
+    (call-with-output-string
+      (^p (with-error-to-port p
+            (^[] ((with-module gauche.internal %check-inline-fingerprints)
+                  "foo.scm" entries))))))
+  (let1 entries (fingerprints '(^x (wp-add3 (wp-dec x))))
+    (test* "inline fingerprints (recorded)"
+           '((opt.whole-program wp-add3) (opt.whole-program wp-sub1))
+           (sort (map (^e (list (car e) (cadr e))) entries)
+                 (^[a b] (string<? (x->string (cadr a))
+                                   (x->string (cadr b))))))
+    (test* "inline fingerprints (unchanged)" ""
+           (check entries))
+    (test* "inline fingerprints (changed)" #t
+           (and (#/wp-add3 in opt.whole-program has been changed/
+                 (check (map (^e (list (car e) (cadr e) (+ (caddr e) 1)))
+                             entries)))
+                #t))))
 
 (test-section "lambda lifting")
 
@@ -402,4 +471,86 @@
        '(((CONST-RET) number))
        (proc->insn/split (^[] (static-gf 123))))
 
+(test-section "downward closures")
+
+;; A literal lambda passed to for-each, map or fold is expanded into
+;; a local loop, so no closure is created.
+(define (sum-scaled xs k)
+  (let1 s 0
+    (for-each (^x (set! s (+ s (* x k)))) xs)
+    s))
+(define (scale-all xs k) (map (^x (* x k)) xs))
+(define (count-larger xs k) (fold (^[x n] (if (> x k) (+ n 1) n)) 0 xs))
+
+(test* "for-each with literal lambda" '() (filter-insn sum-scaled 'CLOSURE))
+(test* "for-each with literal lambda" 12 (sum-scaled '(1 2 3) 2))
+(test* "map with literal lambda" '() (filter-insn scale-all 'CLOSURE))
+(test* "map with literal lambda" '(3 6 9) (scale-all '(1 2 3) 3))
+(test* "map with literal lambda" '() (scale-all '() 3))
+(test* "fold with literal lambda" '() (filter-insn count-larger 'CLOSURE))
+(test* "fold with literal lambda" 2 (count-larger '(5 1 7 3) 3))
+(test* "improper list" (test-error) (scale-all '(1 2 . 3) 3))
+(test* "improper list" (test-error) (sum-scaled '(1 . 2) 1))
+(test* "improper list (fold)"
+       (test-error <error> "argument must be a list, but got: 3")
+       (count-larger '(1 2 . 3) 0))
+(test* "fold evaluates knil before the list" '(knil lis)
+       (let1 r '()
+         (fold (^[x acc] acc)
+               (begin (push! r 'knil) 0)
+               (begin (push! r 'lis) '(1)))
+         (reverse r)))
+
+;; Variable arity lambda or multiple lists aren't expanded, but should
+;; work as usual.
+(test* "map with rest args" '((1 4) (2 5))
+       ((^[xs ys] (map (^ args args) xs ys)) '(1 2) '(4 5)))
+(test* "fold with optional arg" 6
+       ((^[xs] (fold (^[x acc :optional (z 0)] (+ x acc z)) 0 xs)) '(1 2 3)))
+
+(test-section "numeric type inference")
+
+(define (flonum-sum n)
+  (let loop ([i 0] [s 0.0])
+    (if (< i n)
+      (loop (+ i 1) (+ s 1.5))
+      s)))
+
+(test* "flonum loop variable" '(((FLADD2)))
+       (filter-insn flonum-sum 'FLADD2))
+(test* "flonum loop variable" 15.0 (flonum-sum 10))
+
+(define (real-sum n)
+  (let loop ([i 0] [s 0])
+    (if (< i n)
+      (loop (+ i 1) (+ s 1.5))
+      s)))
+
+(test* "real loop variable" '() (filter-insn real-sum 'FLADD2))
+(test* "real loop variable" 0 (real-sum 0))
+(test* "real loop variable" 15.0 (real-sum 10))
+
+(define (inexact-sum n)
+  (let loop ([i 0] [s 0.0])
+    (if (< i n)
+      (loop (+ i 1) (+. s (*. 0.5 i)))
+      s)))
+
+(test* "inexact ops" '((((FLADD2))) ())
+       (list (filter-insn inexact-sum 'FLADD2)
+             (filter-insn inexact-sum 'FLMUL2)))
+(test* "inexact ops" 3.0 (inexact-sum 4))
+
+(define (flonum-decay n)
+  (let loop ([i 0] [s 1.0])
+    (if (< i n)
+      (let1 d (* s 0.5)
+        (loop (+ i 1) (- s d)))
+      s)))
+
+(test* "let-bound flonums" '(((FLMUL2)) ((FLSUB2)))
+       (append (filter-insn flonum-decay 'FLMUL2)
+               (filter-insn flonum-decay 'FLSUB2)))
+(test* "let-bound flonums" 0.125 (flonum-decay 3))
+
 (test-end)
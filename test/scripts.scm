@@ -794,10 +794,36 @@
             (map thread-join! thrs))))
   )
 
+(define (precomp-test-5)
+  (test* "running precomp 5" #t
+         (do-precomp! '("whole-program.scm") '("-e" "--whole-program")))
+  (test* "compile 5" #t (do-compile! "whole-program" '("whole-program.c")))
+
+  ;; Each entry is (<result> <calls-global?>)
+  (test* "whole-program inlining" '((6 #f) (1 #t) (3 #t))
+         (dynload-and-eval
+          "whole-program"
+          (let ([m (make-module #f)]
+                [calls-global?
+                 (^[proc]
+                   (boolean
+                    (any (^i (and (pair? i) (eq? (car i) 'GREF-TAIL-CALL)))
+                         ((with-module gauche.internal vm-code->list)
+                          (closure-code proc)))))])
+            (eval '(import whole-program) m)
+            (map (^[expr arg]
+                   (let1 proc (eval expr m)
+                     (list (apply proc arg) (calls-global? proc))))
+                 '((^x (wp-triple x))
+                   (^[] (wp-counter))
+                   (with-module whole-program wp-hidden-caller))
+                 '((2) () (2)))))))
+
 (wrap-with-test-directory precomp-test-1 '("test.o"))
 (wrap-with-test-directory precomp-test-2 '("test.o"))
 (wrap-with-test-directory precomp-test-3 '("test.o"))
 (wrap-with-test-directory precomp-test-4 '("test.o"))
+(wrap-with-test-directory precomp-test-5 '("test.o"))
 
 ;;=======================================================================
 (test-section "build-standalone")
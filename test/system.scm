@@ -670,6 +670,23 @@
                  (sys-waitpid pid)
                  #t)))))
 
+  ;; iomap that swaps fds, with directory.  This exercises the fd
+  ;; shuffling done without fork (posix_spawn path) where available.
+  (test* "fork, exec, iomap and directory" '("err" "out" "/")
+         (receive (in1 out1) (sys-pipe)
+           (receive (in2 out2) (sys-pipe)
+             (let1 pid (sys-fork-and-exec
+                        "/bin/sh"
+                        '("/bin/sh" "-c" "echo out; echo err 1>&2; pwd")
+                        :iomap `((1 . ,out2) (2 . ,out1))
+                        :directory "/")
+               (close-port out1)
+               (close-port out2)
+               (sys-waitpid pid)
+               (begin0 (list (read-line in1) (read-line in2) (read-line in2))
+                 (close-port in1)
+                 (close-port in2))))))
+
   ;; Testing fork&exec and detached process
   ;; NB: these tests assume we're running the testing gosh in the
   ;; current directory.
@@ -1018,4 +1035,41 @@
   ]
  [else]) ; gauche.os.windows
 
+;;-------------------------------------------------------------------
+(test-section "gc statistics")
+
+(use gauche.vm.gc-stat)
+(test-module 'gauche.vm.gc-stat)
+
+(test* "gc-stat counters" #t
+       (let* ([s0 (gc-stat)]
+              [_  (gc)]
+              [s1 (gc-stat)]
+              [d  (gc-stat-diff s0 s1)])
+         (and (>= (gc-stat-ref d :gc-count) 1)
+              (>= (gc-stat-ref d :pause-count) 1)
+              (>= (gc-stat-ref d :total-pause-time) 0)
+              (>= (gc-stat-ref s1 :max-pause-time)
+                  (gc-stat-ref s1 :last-pause-time))
+              (every real? (gc-stat-ref s1 :recent-pause-times)))))
+
+(test* "gc-free-space-divisor" '(2 #t)
+       (let1 d (gc-free-space-divisor)
+         (set! (gc-free-space-divisor) 2)
+         (begin0 (list (gc-free-space-divisor)
+                       (positive? (gc-min-bytes-between-gc)))
+           (set! (gc-free-space-divisor) d))))
+
+(test* "gc-stat emitter" '(gc-stat :timestamp)
+       (let* ([out (open-output-string)]
+              [e (gc-stat-emitter-start out :interval 0.01)])
+         (let loop ([n 0])
+           (gc)
+           (when (and (< n 100)
+                      (string-null? (get-output-string out)))
+             (sys-nanosleep #e1e7)
+             (loop (+ n 1))))
+         (gc-stat-emitter-stop e)
+         (take (read (open-input-string (get-output-string out))) 2)))
+
 (test-end)
@@ -0,0 +1,18 @@
+;;
+;; precompiled with --whole-program.  Small exported procedures
+;; can be inlined into the modules that use them.
+;;
+
+(define-module whole-program
+  (export wp-triple wp-counter wp-hidden-caller))
+(select-module whole-program)
+
+(define (wp-triple x) (* x 3))
+
+;; closes a variable; not inlinable
+(define wp-counter
+  (let ([n 0]) (^[] (set! n (+ n 1)) n)))
+
+;; not exported; not inlinable
+(define (wp-hidden x) (+ x 1))
+(define (wp-hidden-caller x) (wp-hidden x))
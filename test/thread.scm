@@ -105,6 +105,28 @@
          (thread-terminate! t1)
          (thread-state t1)))
 
+;; Deep non-tail recursion overflows the initial stack many times,
+;; which makes the stack grow.
+(define (deep-sum n) (if (zero? n) 0 (+ n (deep-sum (- n 1)))))
+
+(test* "thread with stack-size" (deep-sum 100000)
+       (thread-join!
+        (thread-start!
+         (make-thread (^[] (deep-sum 100000)) 'deep :stack-size 200000))))
+(test* "thread with max-stack-size" (deep-sum 100000)
+       (thread-join!
+        (thread-start!
+         (make-thread (^[] (deep-sum 100000)) #f :max-stack-size 20000))))
+(test* "unnamed thread with stack-size" `(,(deep-sum 100000) #f)
+       (let1 t (make-thread (^[] (deep-sum 100000)) :stack-size 200000)
+         (list (thread-join! (thread-start! t)) (thread-name t))))
+(test* "keyword as a thread name" '(:worker :worker)
+       (list (thread-name (make-thread (^[] #f) :worker))
+             (thread-name (make-thread (^[] #f) :worker :stack-size 20000))))
+(test* "stack-size of running thread" (test-error)
+       ((with-module gauche.threads %thread-set-stack-size!)
+        (current-thread) 20000 0))
+
 ;;---------------------------------------------------------------------
 (test-section "thread and error")
 
@@ -860,6 +882,42 @@
                         (make-mtqueue :max-length 0)
                         100 3)
 
+(test-producer-consumer "(mpmc queue)"
+                        (make-mpmc-queue 4)
+                        100 3)
+
+(let ()
+  (define (test-mpmc-batch nproducers nconsumers nitems)
+    (define q (make-mpmc-queue 16))
+    (define data (iota (* nproducers nitems)))
+    (test* #"mpmc batch transfer (~|nproducers|x~|nconsumers|)"
+           data
+           (let* ([ps (map (^k (thread-start!
+                                (make-thread
+                                 (^[] (enqueue-batch/wait!
+                                       q (iota nitems (* k nitems)))))))
+                           (iota nproducers))]
+                  [cs (map (^_ (thread-start!
+                                (make-thread
+                                 (^[] (let loop ([r '()])
+                                        ;; -1 is the end marker.  If we
+                                        ;; get more than one, put back
+                                        ;; the extras for other consumers.
+                                        (let* ([xs (dequeue-batch/wait! q 5)]
+                                               [n (count (cut eqv? -1 <>) xs)])
+                                          (if (zero? n)
+                                            (loop (append xs r))
+                                            (begin
+                                              (enqueue-batch/wait!
+                                               q (make-list (- n 1) -1))
+                                              (append (delete -1 xs) r)))))))))
+                           (iota nconsumers))])
+             (for-each thread-join! ps)
+             (dotimes [i nconsumers] (enqueue/wait! q -1))
+             (sort (append-map thread-join! cs)))))
+  (test-mpmc-batch 1 1 1000)
+  (test-mpmc-batch 4 4 1000))
+
 (test* "dequeue/wait! timeout" "timed out!"
        (dequeue/wait! (make-mtqueue) 0.01 "timed out!"))
 (test* "enqueue/wait! timeout" "timed out!"
@@ -935,6 +993,11 @@
          (let1 q (make-mtqueue)
            (enqueue/wait! q 'a #f #f #t)
            (~ q'closed)))
+  (test* "closed mpmc-queue rejects enqueue/wait"
+         (test-error <error> #/queue is closed/)
+         (let1 q (make-mpmc-queue 4)
+           (dequeue/wait! q 0 #f #t)
+           (enqueue/wait! q 'a)))
   )
 
 ;;---------------------------------------------------------------------
@@ -1011,4 +1074,76 @@
   ;;((with-module gauche.internal memo-table-dump) string-hash-tab)
   )
 
+;;---------------------------------------------------------------------
+(test-section "parallel require")
+
+(use file.util)
+
+;; a requires b and c, both of which require d.
+(let ()
+  (define (mkfile name deps expr)
+    (with-output-to-file #"test.thr/~|name|.scm"
+      (^[]
+        (let1 mod (string->symbol #"thr-~name")
+          (write `(define-module ,mod (export ,mod)))
+          (write `(select-module ,mod))
+          (dolist [d deps]
+            (write `(require ,#"test.thr/~d"))
+            (write `(import ,(string->symbol #"thr-~d"))))
+          (write `(define ,mod ,expr))))))
+  (remove-directory* "test.thr")
+  (make-directory* "test.thr")
+  (mkfile "a" '("b" "c") '(+ thr-b thr-c))
+  (mkfile "b" '("d") '(+ thr-d 1))
+  (mkfile "c" '("d") '(+ thr-d 2))
+  (mkfile "d" '() 10))
+
+(test* "require dependencies" '("test.thr/d" "test.thr/b" "test.thr/c")
+       ((with-module gauche.threads %require-dependencies) "test.thr/a"))
+
+(test* "parallel require" '(#t #t #t #f)
+       (begin
+         ((with-module gauche.threads %parallel-require-prefetch) "test.thr/a")
+         (map provided? '("test.thr/b" "test.thr/c" "test.thr/d"
+                          "test.thr/a"))))
+
+(test* "parallel require (root)" 23
+       (begin
+         (eval '(require "test.thr/a") (interaction-environment))
+         (global-variable-ref (find-module 'thr-a) 'thr-a)))
+
+;; A module name given to import isn't a feature.
+(with-output-to-file "test.thr/e.scm"
+  (^[] (write '(define-module thr-e
+                 (import thr-d)
+                 (import (only (test.thr d) thr-d))))))
+
+(test* "require dependencies (import)" '("test.thr/d")
+       ((with-module gauche.threads %scan-require-forms) "test.thr/e.scm"))
+
+;; f and g require each other.  While loading f, we prefetch g, which
+;; needs f.  It must end up with a loop error, not a deadlock.
+(with-output-to-file "test.thr/f.scm"
+  (^[] (for-each write
+                 '((define-module thr-f)
+                   (select-module thr-f)
+                   (define deps
+                     ((with-module gauche.threads %require-dependencies)
+                      "test.thr/g"))
+                   ((with-module gauche.threads %parallel-require)
+                    '("test.thr/g" "test.thr/g" "test.thr/g") 3)
+                   (require "test.thr/g")))))
+(with-output-to-file "test.thr/g.scm"
+  (^[] (for-each write
+                 '((define-module thr-g)
+                   (select-module thr-g)
+                   (require "test.thr/f")))))
+
+(test* "parallel require (loop)" (test-error)
+       (eval '(require "test.thr/f") (interaction-environment)))
+(test* "parallel require (loop) dependencies" '()
+       (global-variable-ref (find-module 'thr-f) 'deps))
+
+(remove-directory* "test.thr")
+
 (test-end)
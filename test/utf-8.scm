@@ -254,6 +254,27 @@
 (test "string-incomplete->complete (escape)" "あ__い_91う_80え"
       (lambda () (string-incomplete->complete #*"あ_い\x91う\x80え" :escape #\_)))
 
+(let ([pad (make-string 37 #\a)])
+  ;; Invalid sequences after a long ASCII run, at various alignments.
+  (define (t expect bytes)
+    (dotimes [k 17]
+      (let1 s (string-append (string-complete->incomplete (substring pad 0 (+ k 20)))
+                             bytes)
+        (test* #"validity ~(write-to-string bytes) after ~(+ k 20) ASCII chars"
+               (and expect (+ k 20 expect))
+               (and-let1 c (string-incomplete->complete s #f)
+                 (string-length c))))))
+  (t 1 #*"\xc3\xa9")
+  (t 1 #*"\xf0\x9f\x98\x80")
+  (t 3 #*"\xe3\x81\x82b\xed\xa0\x80")
+  (t #f #*"\xc0\x80")
+  (t #f #*"\xe0\x80\x80")
+  (t 1 #*"\xe0\xa0\x80")
+  (t #f #*"\xf0\x80\x80\x80")
+  (t #f #*"\xe3\x81")
+  (t #f #*"\xe3\x81b")
+  (t #f #*"\x80"))
+
 (test "string=?" #t (lambda () (string=? #*"あいう" #*"あいう")))
 
 (test "string-byte-ref" #x81 (lambda () (string-byte-ref #*"あいう" 1)))